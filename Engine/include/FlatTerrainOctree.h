@@ -0,0 +1,99 @@
+#pragma once
+#include "CommonTypedefs.h"
+#include "Core.h"
+#include <glm.hpp>
+#include <vector>
+#include "ITerrainOctreeNode.h"
+#include "TerrainDefs.h"
+
+/// <summary>
+/// A copy of an octree's structure laid out for walking it. Nodes are 32 bit indices and each field is its own array,
+/// so a traversal touches 18 bytes a node instead of the whole node with its mesh. A node's children are next to each
+/// other, in child order, starting at its FirstChild - only the ones in its ChildMask are there.
+///
+/// Everything else about a node, its mesh and voxel data, stays with the tree node it was built from, see GetTreeNode.
+/// Rebuild it when the tree's structure changes, SparseTerrainVoxelOctree::GetStructureGeneration says when.
+/// </summary>
+class APP_API FlatTerrainOctree
+{
+public:
+	static const u32 INVALID_NODE = 0xffffffff;
+
+	// the nodes are in breadth first order so the root is 0
+	void Build(ITerrainOctreeNode* root);
+
+	void Clear();
+
+	u32 GetNumNodes() const { return (u32)ChildMask.size(); }
+
+	u32 GetRoot() const { return ChildMask.empty() ? INVALID_NODE : 0; }
+
+	u8 GetChildMask(u32 node) const { return ChildMask[node]; }
+
+	// the children in the mask follow this one
+	u32 GetFirstChild(u32 node) const { return FirstChild[node]; }
+
+	// INVALID_NODE if the child doesn't exist
+	u32 GetChild(u32 node, u8 child) const
+	{
+		u8 mask = ChildMask[node];
+		if (!(mask & (1 << child)))
+		{
+			return INVALID_NODE;
+		}
+		// skip the children before it that exist
+		return FirstChild[node] + CountBits(mask & ((1 << child) - 1));
+	}
+
+	u32 GetMipLevel(u32 node) const { return MipLevel[node]; }
+
+	u32 GetSizeInVoxels(u32 node) const { return BASE_CELL_SIZE << MipLevel[node]; }
+
+	glm::ivec3 GetBottomLeftCorner(u32 node) const { return { BottomLeftX[node], BottomLeftY[node], BottomLeftZ[node] }; }
+
+	// the node in the tree this was built from
+	ITerrainOctreeNode* GetTreeNode(u32 node) const { return TreeNodes[node]; }
+
+	// the deepest node containing the point, INVALID_NODE if it's outside the octree
+	u32 FindNodeContainingPoint(const glm::ivec3& point) const;
+
+	size_t GetTraversalBytes() const;
+
+private:
+	static inline u32 CountBits(u32 bits)
+	{
+		bits = bits - ((bits >> 1) & 0x55);
+		bits = (bits & 0x33) + ((bits >> 2) & 0x33);
+		return (bits + (bits >> 4)) & 0x0f;
+	}
+
+	std::vector<u32> FirstChild;
+
+	std::vector<u8> ChildMask;
+
+	std::vector<u8> MipLevel;
+
+	std::vector<i32> BottomLeftX;
+
+	std::vector<i32> BottomLeftY;
+
+	std::vector<i32> BottomLeftZ;
+
+	// side table, not read while walking
+	std::vector<ITerrainOctreeNode*> TreeNodes;
+};
+
+// for walking a FlatTerrainOctree with the templated TerrainLODSelectionAndCullingAlgorithm::GetChunksToRender
+struct FlatTerrainOctreeLODTraits
+{
+	typedef u32 Node;
+	FlatTerrainOctreeLODTraits(const FlatTerrainOctree& octree) : Octree(octree) {}
+	bool IsValid(Node node) const { return node != FlatTerrainOctree::INVALID_NODE; }
+	Node GetChild(Node node, u8 child) const { return Octree.GetChild(node, child); }
+	glm::ivec3 GetBottomLeftCorner(Node node) const { return Octree.GetBottomLeftCorner(node); }
+	u32 GetSizeInVoxels(Node node) const { return Octree.GetSizeInVoxels(node); }
+	bool HasChildren(Node node) const { return Octree.GetChildMask(node) != 0; }
+	bool NeedsRegenerating(Node node) const { return Octree.GetTreeNode(node)->NeedsRegenerating(); }
+	ITerrainOctreeNode* GetTreeNode(Node node) const { return Octree.GetTreeNode(node); }
+	const FlatTerrainOctree& Octree;
+};
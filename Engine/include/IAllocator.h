@@ -4,6 +4,7 @@
 class APP_API IAllocator
 {
 public:
+	virtual ~IAllocator() {}
 	virtual void* Malloc(size_t numBytes) = 0;
 	virtual void Free(void* ptr) = 0;
 	virtual void* Realloc(void* ptr, size_t newSize) = 0;
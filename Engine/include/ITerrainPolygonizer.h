@@ -4,6 +4,7 @@
 #include <glm.hpp>
 #include "CommonTypedefs.h"
 #include "Core.h"
+#include "OctreeTypes.h"
 
 struct ITerrainOctreeNode;
 struct Triangle;
@@ -24,6 +25,24 @@ struct APP_API TerrainVertex
 	TerrainNormal Normal;
 };
 
+// fractional bits of a TerrainVertexCompact position, in steps of the chunk - the chunk is 16 steps across so this is as many as fit in a u16
+#define TERRAIN_COMPACT_POSITION_FRACTION_BITS 11
+
+// a third the size of a TerrainVertex. Position is relative to the chunk's bottom left corner in steps of
+// GetSizeInVoxels() / BASE_CELL_SIZE, with TERRAIN_COMPACT_POSITION_FRACTION_BITS of fraction, and Normal is
+// octahedral encoded - the renderer decodes both in its vertex shader
+struct APP_API TerrainVertexCompact
+{
+	u16 Position[3];
+	i8 Normal[2];
+};
+
+static_assert(sizeof(TerrainVertexCompact) == 8);
+
+// fractional bits of a TerrainVertexFixedPoint position
+#define TERRAIN_FIXED_FRACTION_SIZE_BITS 8
+#define TERRAIN_FIXED_FRACTION_MAX 0xff
+
 struct APP_API TerrainVertexFixedPoint
 {
 	TerrainPositionFixed Position;
@@ -40,8 +59,12 @@ struct APP_API TerrainTransitionMeshGeometry
 
 struct APP_API PolygonizeWorkerThreadData
 {
-	TerrainVertex* Vertices;
-	u32* Indices;
+	TerrainVertex* Vertices; // if VertexFormat is Full
+	TerrainVertexCompact* CompactVertices; // if VertexFormat is Compact
+	TerrainVertexFormat VertexFormat;
+	u32* Indices; // if IndexType is U32
+	u16* ShortIndices; // if IndexType is U16
+	TerrainIndexType IndexType;
 	Triangle* Tris;
 	u32 VerticesSize;
 	u32 IndicesSize;
@@ -3,6 +3,7 @@
 #include "CommonTypedefs.h"
 #include "Core.h"
 #include "OctreeTypes.h"
+#include <functional>
 struct ITerrainOctreeNode;
 
 class APP_API IVoxelDataSource
@@ -12,7 +13,19 @@ public:
 	// TODO: sort out
 	virtual i8 GetVoxelAt(const glm::ivec3& valueAt) = 0;
 	virtual void GetVoxelsForNode(ITerrainOctreeNode* node, i8* outVoxels) = 0;
+	// the biggest region containing location that can be read directly, for VoxelAccessor to cache.
+	// the pointers in it are valid until the source is next written to. Left empty if there's nothing there that can be
+	// read directly, GetVoxelAt says what's there instead
+	virtual void GetVoxelRegionContainingPoint(const glm::ivec3& location, VoxelRegion& outRegion) = 0;
 	virtual TerrainOctreeIndex SetVoxelAt(const glm::ivec3& location, i8 value) = 0;
+	// write a whole BASE_CELL_SIZE^3 leaf in one go. brickBottomLeft must be a multiple of BASE_CELL_SIZE,
+	// voxels are laid out x, then y, then z, the same as a leaf nodes voxel data. Values are clamped to the
+	// sources clamp range. Returns the index of the leaf written to.
+	virtual TerrainOctreeIndex FillBrick(const glm::ivec3& brickBottomLeft, const i8* voxels) = 0;
+	virtual TerrainOctreeIndex FillBrick(const glm::ivec3& brickBottomLeft, const std::function<i8(const glm::ivec3&)>& generator) = 0;
+	// read a whole BASE_CELL_SIZE^3 leaf in one go, the counterpart of FillBrick.
+	// returns false if the source couldn't get at what's stored there, outVoxels is only a stand in for it
+	virtual bool ReadBrick(const glm::ivec3& brickBottomLeft, i8* outVoxels) = 0;
 	virtual void Clear() = 0;
 	virtual void ResizeAndClear(const size_t newSize) = 0;
 	virtual size_t GetSize() const = 0;
@@ -20,4 +33,8 @@ public:
 	virtual void AllocateNodeVoxelData(ITerrainOctreeNode* node) = 0;
 	virtual ITerrainOctreeNode* GetParentNode() = 0;
 	virtual void CreateChildrenForFirstNMipLevels(ITerrainOctreeNode* node, int n, int onLevel=0) = 0;
+	// drop bricks that are all one value and any subtree that is entirely one value, storing just the value instead,
+	// and compress what's left if the source supports it.
+	// Nodes that are dropped lose their meshes so this should be done before the terrain is first rendered
+	virtual void CollapseUniformSubtrees() = 0;
 };
\ No newline at end of file
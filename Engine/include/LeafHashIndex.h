@@ -0,0 +1,81 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include "CommonTypedefs.h"
+#include "Core.h"
+
+class IAllocator;
+struct ITerrainOctreeNode;
+
+/// <summary>
+/// An open addressing hash map from the Morton code of a leaf's coordinates (its bottom left corner / BASE_CELL_SIZE)
+/// to the leaf, so that a point lookup is one probe instead of a walk down the octree.
+///
+/// Find doesn't take a lock and can run alongside Insert on other threads. Inserts are serialised by a mutex.
+/// When the table grows the old one can't be freed straight away as a reader may still be probing it,
+/// so retired tables are kept until Clear.
+///
+/// Remove and Clear must not be called while anything else is using the index.
+/// </summary>
+class APP_API LeafHashIndex
+{
+public:
+	LeafHashIndex(IAllocator* allocator, u32 initialCapacityLog2 = 12);
+	~LeafHashIndex();
+
+	ITerrainOctreeNode* Find(u64 mortonCode) const;
+
+	void Insert(u64 mortonCode, ITerrainOctreeNode* leaf);
+
+	void Remove(u64 mortonCode);
+
+	void Clear();
+
+	size_t GetNumLeaves() const { return NumLeaves; }
+
+	// for visiting every leaf - walk slots [0, GetNumSlots()), empty ones give nullptr.
+	// the slots move when the table grows or a leaf is removed, so only use these while nothing is inserting or removing
+	u64 GetNumSlots() const { return 1ull << CurrentTable.load(std::memory_order_acquire)->CapacityLog2; }
+
+	ITerrainOctreeNode* GetLeafInSlot(u64 slot) const { return CurrentTable.load(std::memory_order_acquire)->Entries[slot].Value.load(std::memory_order_relaxed); }
+
+private:
+	struct Entry
+	{
+		std::atomic<u64> Key;
+		std::atomic<ITerrainOctreeNode*> Value;
+	};
+
+	struct Table
+	{
+		u32 CapacityLog2;
+		Entry* Entries;
+	};
+
+	Table* AllocateTable(u32 capacityLog2);
+
+	void FreeTable(Table* table);
+
+	void Grow();
+
+	static inline u64 GetSlot(u64 mortonCode, u32 capacityLog2)
+	{
+		// fibonacci hashing - morton codes of nearby leaves only differ in their low bits
+		return (mortonCode * 0x9E3779B97F4A7C15ull) >> (64 - capacityLog2);
+	}
+
+private:
+	IAllocator* Allocator;
+
+	std::atomic<Table*> CurrentTable;
+
+	// tables replaced by Grow that readers might still be looking at
+	std::vector<Table*> RetiredTables;
+
+	u32 InitialCapacityLog2;
+
+	size_t NumLeaves = 0;
+
+	std::mutex InsertMutex;
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include "CommonTypedefs.h"
+#include "Core.h"
+#include <cstdint>
+
+/// <summary>
+/// A whole file mapped read only into memory. Pages are read in by the OS the first time they're touched,
+/// so opening a file is about as quick however big it is.
+/// Writing to the mapping faults, anything that needs to change what it reads has to copy it out first.
+/// </summary>
+class APP_API MemoryMappedFile
+{
+public:
+	MemoryMappedFile();
+	~MemoryMappedFile();
+	MemoryMappedFile(MemoryMappedFile&& other) noexcept;
+	MemoryMappedFile& operator=(MemoryMappedFile&& other) noexcept;
+	MemoryMappedFile(const MemoryMappedFile&) = delete;
+	MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+	// returns false if the file can't be opened or is empty
+	bool Open(const char* path);
+
+	void Close();
+
+	bool IsOpen() const { return Data != nullptr; }
+
+	const u8* GetData() const { return Data; }
+
+	size_t GetSize() const { return Size; }
+
+	// is ptr somewhere in the mapping
+	bool Contains(const void* ptr) const
+	{
+		return (uintptr_t)ptr - (uintptr_t)Data < Size;
+	}
+
+private:
+	const u8* Data = nullptr;
+
+	size_t Size = 0;
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include "CommonTypedefs.h"
+#include "OctreeTypes.h"
 
 #include <glm.hpp>
 
@@ -17,4 +18,57 @@ public:
 	static u32 GetSizeInVoxels(u32 mipLevel);
 
 	static bool IsPointInCube(const glm::ivec3& point, const glm::ivec3& cubeBottomLeft, u32 cubeSizeVoxels);
+
+	// the bottom left corner of the leaf a TerrainOctreeIndex leads to in an octree rootSizeInVoxels across,
+	// found without the nodes on the way needing to exist
+	static glm::ivec3 GetBottomLeftCornerFromIndex(TerrainOctreeIndex index, u32 rootSizeInVoxels);
+
+	// the TerrainOctreeIndex of the leaf containing point in an octree rootSizeInVoxels across with its bottom left at the origin
+	static TerrainOctreeIndex GetIndexOfLeafContainingPoint(const glm::ivec3& point, u32 rootSizeInVoxels);
+
+	// which of a node's children contains point, the same numbering as TerrainOctreeIndex nibbles - x is bit 0, y bit 1, z bit 2
+	static inline u8 GetChildIndexContainingPoint(const glm::ivec3& point, const glm::ivec3& nodeBottomLeft, u32 nodeSizeInVoxels)
+	{
+		i32 childDims = nodeSizeInVoxels / 2;
+		return (u8)((point.x - nodeBottomLeft.x >= childDims)
+			| ((point.y - nodeBottomLeft.y >= childDims) << 1)
+			| ((point.z - nodeBottomLeft.z >= childDims) << 2));
+	}
+
+	// interleave the bits of three coordinates of up to 21 bits each, x lowest, so that cells close in space get close codes
+	static inline u64 GetMortonCode(u32 x, u32 y, u32 z)
+	{
+		return SpreadBitsForMortonCode(x) | (SpreadBitsForMortonCode(y) << 1) | (SpreadBitsForMortonCode(z) << 2);
+	}
+
+	// the coordinates a morton code was made from
+	static inline glm::uvec3 GetCellFromMortonCode(u64 code)
+	{
+		return { CompactBitsFromMortonCode(code), CompactBitsFromMortonCode(code >> 1), CompactBitsFromMortonCode(code >> 2) };
+	}
+
+private:
+	// put two zero bits between each of the low 21 bits of v
+	static inline u64 SpreadBitsForMortonCode(u32 v)
+	{
+		u64 x = v & 0x1fffff;
+		x = (x | x << 32) & 0x1f00000000ffff;
+		x = (x | x << 16) & 0x1f0000ff0000ff;
+		x = (x | x << 8) & 0x100f00f00f00f00f;
+		x = (x | x << 4) & 0x10c30c30c30c30c3;
+		x = (x | x << 2) & 0x1249249249249249;
+		return x;
+	}
+
+	// the reverse of SpreadBitsForMortonCode, every third bit of x starting from the lowest
+	static inline u32 CompactBitsFromMortonCode(u64 x)
+	{
+		x &= 0x1249249249249249;
+		x = (x ^ (x >> 2)) & 0x10c30c30c30c30c3;
+		x = (x ^ (x >> 4)) & 0x100f00f00f00f00f;
+		x = (x ^ (x >> 8)) & 0x1f0000ff0000ff;
+		x = (x ^ (x >> 16)) & 0x1f00000000ffff;
+		x = (x ^ (x >> 32)) & 0x1fffff;
+		return (u32)x;
+	}
 };
@@ -1,12 +1,19 @@
 #pragma once
 #include <unordered_set>
 #include "OctreeTypes.h"
+#include <glm.hpp>
 
 
 class IVoxelDataSource;
+namespace rdx { class thread_pool; }
 
 namespace OctreeSerialisation
 {
-	void SaveNewlyGeneratedToFile(const std::unordered_set<TerrainOctreeIndex>& setNodex, IVoxelDataSource* voxelDataSource, const char* path);
-	void LoadFromFile(IVoxelDataSource* voxelDataSource, const char* path);
+	// saved as a VoxelRegionFile. given a thread pool the bricks are read and compressed on it a subtree at a time
+	void SaveNewlyGeneratedToFile(const std::unordered_set<TerrainOctreeIndex>& setNodex, IVoxelDataSource* voxelDataSource, const char* path, rdx::thread_pool* threadPool = nullptr);
+	// reads region files, and files saved before there were region files.
+	// given a thread pool, region files are decompressed and loaded on it a subtree at a time
+	void LoadFromFile(IVoxelDataSource* voxelDataSource, const char* path, rdx::thread_pool* threadPool = nullptr);
+	// only the bricks that overlap [min, max], without reading the rest of the file
+	void LoadRegionFromFile(IVoxelDataSource* voxelDataSource, const char* path, const glm::ivec3& min, const glm::ivec3& max);
 }
\ No newline at end of file
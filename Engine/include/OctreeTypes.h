@@ -1,6 +1,7 @@
 #pragma once
 #include "CommonTypedefs.h"
 #include "Core.h"
+#include <glm.hpp>
 
 // a stack of visited children to get to a node - each nibble is an index into children
 // to be used for serialization.
@@ -12,6 +13,18 @@ enum class TerrainChunkMeshBuffer
 	EBO = 1
 };
 
+enum class TerrainVertexFormat : u8
+{
+	Full = 0,	// TerrainVertex
+	Compact = 1	// TerrainVertexCompact
+};
+
+enum class TerrainIndexType : u8
+{
+	U32 = 0,
+	U16 = 1	// when the chunk has few enough vertices
+};
+
 struct APP_API TerrainChunkTransitionMesh
 {
 	u32 VAO;
@@ -24,9 +37,21 @@ struct APP_API TerrainChunkMesh
 	u32 VAO;
 	u32 Buffers[2];
 	u32 IndiciesToDraw;
+	TerrainVertexFormat VertexFormat;
+	TerrainIndexType IndexType;
 	TerrainChunkTransitionMesh TransitionMeshes[6];
-	bool bNeedsRegenerating;
 	inline u32 GetVBO() const { return Buffers[(u32)TerrainChunkMeshBuffer::VBO]; }
 	inline u32 GetEBO() const { return Buffers[(u32)TerrainChunkMeshBuffer::EBO]; }
 
-};
\ No newline at end of file
+};
+
+// a cube of voxels that all read the same way - a leaf's brick or a part of the octree that is one value.
+// see IVoxelDataSource::GetVoxelRegionContainingPoint and VoxelAccessor
+struct APP_API VoxelRegion
+{
+	glm::ivec3 BottomLeft = { 0,0,0 };
+	u32 SizeInVoxels = 0; // 0 if there's no region to cache, the point is outside the source
+	const i8* Voxels = nullptr; // a leaf's raw BASE_CELL_SIZE^3 voxel data
+	const u8* CompressedVoxels = nullptr; // a leaf's VoxelBrickCompression voxel data
+	i8 UniformValue = 0; // the value of every voxel in the region if it has neither
+};
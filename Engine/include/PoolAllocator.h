@@ -0,0 +1,79 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include "CommonTypedefs.h"
+#include "Core.h"
+#include "IAllocator.h"
+
+// the most pools that can have thread local caches at once, any more than this fall back to the shared free list
+#define POOL_ALLOCATOR_MAX_CACHED_POOLS 64
+
+/// <summary>
+/// Allocates blocks of a single fixed size carved out of large slabs requested from a backing allocator.
+/// Freed blocks go on to a free list - each thread keeps a small cache of free blocks so that allocating
+/// and freeing doesn't take the lock, the shared free list is only touched to move blocks in batches.
+/// 
+/// ReleaseAll hands every slab back to the backing allocator at once, without touching the blocks
+/// allocated from them. It must not be called while other threads are allocating from the pool.
+/// </summary>
+class APP_API PoolAllocator : public IAllocator
+{
+public:
+	PoolAllocator(IAllocator* backingAllocator, size_t blockSize, size_t blocksPerSlab);
+	~PoolAllocator();
+
+	// Inherited via IAllocator
+	virtual void* Malloc(size_t numBytes) override;
+
+	virtual void Free(void* ptr) override;
+
+	// blocks are a fixed size, so this only succeeds if the block is already big enough
+	virtual void* Realloc(void* ptr, size_t newSize) override;
+
+	void ReleaseAll();
+
+	size_t GetBlockSize() const { return BlockSize; }
+
+	size_t GetNumSlabs() const { return Slabs.size(); }
+
+	size_t GetSlabSizeBytes() const { return BlockSize * BlocksPerSlab; }
+
+private:
+	struct FreeBlock
+	{
+		FreeBlock* Next;
+	};
+
+	// move up to maxBlocks from the shared free list (allocating a new slab if needed) into a list returned in outHead
+	u32 TakeBlocks(u32 maxBlocks, FreeBlock*& outHead);
+
+	void ReturnBlocks(FreeBlock* head, FreeBlock* tail);
+
+	void AllocateSlab();
+
+private:
+	IAllocator* BackingAllocator;
+
+	size_t BlockSize;
+
+	size_t BlocksPerSlab;
+
+	std::vector<u8*> Slabs;
+
+	FreeBlock* FreeListHead = nullptr;
+
+	// the next block to be handed out from the newest slab, blocks are only threaded onto the free list once they've been freed
+	u8* SlabCursor = nullptr;
+
+	u8* SlabEnd = nullptr;
+
+	std::mutex Mtx;
+
+	// index into the thread local caches, or -1 if this pool couldn't get one
+	i32 CacheIndex;
+
+	// changes each time the pool is released - a thread cache from an older epoch
+	// refers to slabs that no longer exist and is thrown away
+	std::atomic<u64> Epoch;
+};
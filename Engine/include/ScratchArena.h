@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+#include "CommonTypedefs.h"
+#include "Core.h"
+#include "IAllocator.h"
+
+/// <summary>
+/// Memory for one job at a time, handed out by bumping a pointer through a block that's kept between jobs.
+/// Free does nothing - Reset frees everything at once, ready for the next job.
+///
+/// If a job needs more than the block holds more blocks are taken from the heap, and the next Reset swaps them
+/// all for one block big enough for that job, so after the first few jobs nothing is allocated at all.
+/// Not thread safe, each thread should have its own.
+/// </summary>
+class APP_API ScratchArena : public IAllocator
+{
+public:
+	ScratchArena(size_t initialSizeBytes = 0);
+	~ScratchArena();
+
+	ScratchArena(const ScratchArena&) = delete;
+	ScratchArena& operator=(const ScratchArena&) = delete;
+
+	// Inherited via IAllocator
+	virtual void* Malloc(size_t numBytes) override;
+
+	// memory is only given back by Reset
+	virtual void Free(void* ptr) override {}
+
+	// grows or shrinks the most recent allocation in place, anything else is copied to a new allocation
+	virtual void* Realloc(void* ptr, size_t newSize) override;
+
+	// everything allocated since the last Reset is invalid after this
+	void Reset();
+
+	// of the block kept between jobs
+	size_t GetSizeBytes() const { return BlockSizeBytes; }
+
+	// the most allocated between two Resets
+	size_t GetHighWaterMarkBytes() const { return HighWaterMarkBytes; }
+
+private:
+	u8* Block = nullptr;
+
+	size_t BlockSizeBytes = 0;
+
+	size_t BlockTop = 0;
+
+	// where the most recent allocation starts, for Realloc
+	size_t LastAllocation = 0;
+
+	struct OverflowBlock
+	{
+		void* Ptr;
+		size_t SizeBytes;
+	};
+
+	// taken when a job didn't fit in Block, freed at Reset. their sizes are counted in OverflowBytes
+	std::vector<OverflowBlock> OverflowBlocks;
+
+	size_t OverflowBytes = 0;
+
+	size_t HighWaterMarkBytes = 0;
+};
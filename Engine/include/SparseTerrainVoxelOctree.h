@@ -5,11 +5,22 @@
 #include "ITerrainOctreeNode.h"
 #include "OctreeTypes.h"
 #include "Core.h"
+#include "PoolAllocator.h"
+#include "VoxelBrickCompression.h"
+#include "VoxelBrickDownsample.h"
+#include "SpinLock.h"
+#include "LeafHashIndex.h"
+#include "FlatTerrainOctree.h"
+#include "TerrainOctreeStatistics.h"
+#include "VoxelBrickPager.h"
+#include "MemoryMappedFile.h"
 #include <glm.hpp>
 #include <vector>
 #include "SparseTerrainVoxelOctree.h"
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <future>
 using namespace glm;
 
 class IAllocator;
@@ -17,34 +28,87 @@ class Camera;
 class ITerrainPolygonizer;
 class ITerrainGraphicsAPIAdaptor;
 class ITerrainVoxelPopulator;
+class SparseTerrainVoxelOctreeSnapshot;
+struct PolygonizeWorkerThreadData;
+namespace rdx { class thread_pool; }
 
 class APP_API SparseTerrainVoxelOctree : public IVoxelDataSource
 {
+	friend class SparseTerrainVoxelOctreeSnapshot;
 public:
 
-	struct SparseTerrainOctreeNode : public ITerrainOctreeNode
+	/// <summary>
+	/// What a leaf held before it was written to while a snapshot was pinned, for the snapshots to keep reading.
+	/// It covers the snapshot versions [From, Until), the versions before From are in Previous.
+	/// Immutable once it's in a leaf's History, and owns its bricks
+	/// </summary>
+	struct LeafVersion
+	{
+		u32 From;
+		u32 Until;
+		const i8* VoxelData;
+		const u8* CompressedVoxelData;
+		i8 UniformValue;
+		LeafVersion* Previous;
+		u32 RetiredAfter; // once unlinked, the newest snapshot version that might still be looking at it
+	};
+
+	// final so that traversals templated on it (see TerrainLODNodeTraits) call its functions directly
+	struct SparseTerrainOctreeNode final : public ITerrainOctreeNode
 	{
 		SparseTerrainOctreeNode(u32 mipLevel, const ivec3& bottomLeftCorner, u32 sizeInVoxels);
 		SparseTerrainOctreeNode(u32 mipLevel, const ivec3& bottomLeftCorner);
-		SparseTerrainOctreeNode* Children[8] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+		// written with a compare and swap so threads can create children at the same time, see CreateChild
+		std::atomic<SparseTerrainOctreeNode*> Children[8] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+		SparseTerrainOctreeNode* Parent = nullptr;
 		u32 MipLevel;
 		ivec3 BottomLeftCorner;
 		TerrainChunkMesh Mesh;
 		u32 SizeInVoxels;
-		i8* VoxelData = nullptr; // only set when MipLevel = 0
-		//std::mutex Mutex;
-		virtual ITerrainOctreeNode* GetChild(u8 child)const override { return static_cast<ITerrainOctreeNode*>(Children[child]); }
+		// atomic so that snapshots can read a leaf while it's being written to, see LeafVersion
+		std::atomic<i8*> VoxelData = { nullptr }; // only set when MipLevel = 0, and only if the leaf isn't all one value
+		std::atomic<u8*> CompressedVoxelData = { nullptr }; // VoxelBrickCompression form of the leaf, only ever set when VoxelData isn't
+		i8* MipVoxelData = nullptr; // only on nodes above MipLevel 0 with children, this node at its own resolution - see UpdateMips
+		std::atomic<i8> UniformValue = { 0 }; // the value of every voxel in this node not covered by VoxelData or a child
+		std::atomic<LeafVersion*> History = { nullptr }; // newest first, only on leaves written to while a snapshot was pinned
+		u32 PreservedVersion = 0; // the write version History was last added to in, guarded by BrickLock
+		std::atomic<bool> bInLeavesWithHistory = { false };
+		SparseTerrainOctreeNode* NextWithHistory = nullptr;
+		std::atomic<bool> bHasUncompressedBricks = { false }; // set on a leaf with raw VoxelData and on all of its ancestors
+		std::atomic<u32> EditGeneration = { 1 }; // bumped by every edit to a voxel the polygonizer reads for this node, see MarkNodesReadingRegion
+		u32 MeshedGeneration = 0; // EditGeneration when the node was last handed to the polygonizer
+		std::atomic<bool> bMipStale = { true }; // set on every ancestor of a leaf that's been written to since MipVoxelData was built
+		SpinLock BrickLock; // held by writers while they change a leaf's VoxelData, CompressedVoxelData, UniformValue or History
+		std::atomic<bool> bPagedOut = { false }; // the leaf's brick is only in the page file, see MakeLeafResident
+		std::atomic<bool> bReferenced = { false }; // read or written since the clock last passed it, see EnforceBrickBudget
+		std::atomic<u32> PagedSlot = { VoxelBrickPager::INVALID_SLOT }; // page file slot holding a copy of the brick that's still up to date
+		std::atomic<u32> DirtyCheckpoint = { 0 }; // CheckpointGeneration when the leaf was last added to DirtyBricks, see MarkLeafDirty
+		virtual ITerrainOctreeNode* GetChild(u8 child)const override { return Children[child].load(std::memory_order_acquire); }
 		virtual const ivec3& GetBottomLeftCorner()const override { return BottomLeftCorner; }
 		virtual u32 GetSizeInVoxels() const override { return SizeInVoxels; }
 		virtual u32 GetMipLevel() const override { return MipLevel; }
 		virtual const TerrainChunkMesh& GetTerrainChunkMesh() const override;
 		virtual void SetTerrainChunkMesh(const TerrainChunkMesh& mesh) override;
-		virtual bool NeedsRegenerating() const override { return Mesh.bNeedsRegenerating; }
+		virtual bool NeedsRegenerating() const override { return EditGeneration.load(std::memory_order_acquire) != MeshedGeneration; }
 		virtual TerrainChunkMesh& GetTerrainChunkMeshMutable() override { return Mesh; }
 		virtual i8* GetVoxelData() override { return VoxelData; };
 		virtual void SetVoxelData(i8* newData) { VoxelData = newData; }
 	};
 
+	// the version reads of the live octree are made at, newer than every snapshot
+	static const u32 LIVE_VERSION = 0xffffffff;
+
+	struct LeafState
+	{
+		const i8* VoxelData;
+		const u8* CompressedVoxelData;
+		i8 UniformValue;
+	};
+
+	// what a leaf held as of a snapshot version, or what it holds now if version is LIVE_VERSION.
+	// a paged out leaf reads as having no bricks, call MakeLeafResidentForRead first
+	static void GetLeafState(const SparseTerrainOctreeNode* leaf, u32 version, LeafState& outState);
+
 public:
 
 	SparseTerrainVoxelOctree(IAllocator* allocator, ITerrainPolygonizer* polygonizer, ITerrainGraphicsAPIAdaptor* graphicsAPIAdaptor, u32 sizeVoxels, i8 clampValueHigh, i8 clampValueLow);
@@ -63,9 +127,20 @@ public:
 	virtual void GetVoxelsForNode(ITerrainOctreeNode* node, i8* outVoxels) override;
 	
 	virtual i8 GetVoxelAt(const glm::ivec3& location) override;
+
+	virtual void GetVoxelRegionContainingPoint(const glm::ivec3& location, VoxelRegion& outRegion) override;
 	
+	// SetVoxelAt and FillBrick can be called from any number of threads at once. Nothing else may read the octree
+	// while they are, except through a SparseTerrainVoxelOctreeSnapshot.
+	// they return 0xffffffffffffffff, writing nothing, if the leaf's brick is paged out and can't be read back
 	virtual TerrainOctreeIndex SetVoxelAt(const glm::ivec3& location, i8 value) override;
 
+	virtual TerrainOctreeIndex FillBrick(const glm::ivec3& brickBottomLeft, const i8* voxels) override;
+
+	virtual TerrainOctreeIndex FillBrick(const glm::ivec3& brickBottomLeft, const std::function<i8(const glm::ivec3&)>& generator) override;
+
+	virtual bool ReadBrick(const glm::ivec3& brickBottomLeft, i8* outVoxels) override;
+
 	virtual void Clear() override;
 
 	virtual void ResizeAndClear(const size_t newSize) override;
@@ -78,47 +153,345 @@ public:
 
 	virtual void CreateChildrenForFirstNMipLevels(ITerrainOctreeNode* node, int n, int onLevel) override;
 
+	virtual void CollapseUniformSubtrees() override;
+
 	//IVoxelDataSource end
 
+	// compress bricks written since the last time this was called, if bCompressBricks is set.
+	// must not be called while anything else is reading from or writing to the octree, and does nothing while a snapshot is pinned
+	void CompressBricks();
+
+	// rebuild MipVoxelData of every node below which something has been written since the last time this was called.
+	// must not be called while anything else is reading from or writing to the octree, and does nothing while a snapshot is pinned
+	void UpdateMips();
+
+	// old leaf versions kept alive for pinned snapshots
+	u32 GetNumLeafVersions() const { return NumLeafVersions.load(std::memory_order_relaxed); }
+
+	// bytes held by the brick pools, raw and compressed
+	size_t GetResidentVoxelDataBytes() const;
+
+	// count what's in the octree, walking its subtrees on threadPool's workers, or on this thread if it's null.
+	// must not be called while anything is writing to the octree, or from one of threadPool's workers
+	void GetStatistics(TerrainOctreeStatistics& outStatistics, rdx::thread_pool* threadPool = nullptr) const;
+
+	// keep at most budgetBytes of leaf bricks in memory, evicting the rest to a file at backingFilePath.
+	// must not be called while anything else is using the octree. returns false if the file can't be opened
+	bool EnablePaging(const char* backingFilePath, size_t budgetBytes);
+
+	// bring every paged out brick back into memory and close the page file.
+	// must not be called while anything else is using the octree
+	void DisablePaging();
+
+	bool IsPagingEnabled() const { return Pager.IsOpen(); }
+
+	// evict bricks that haven't been used recently until the resident ones fit in BrickBudgetBytes, using the clock algorithm.
+	// must not be called while anything else is reading from or writing to the octree, and does nothing while a snapshot is pinned
+	void EnforceBrickBudget();
+
+	// fault a leaf's brick back in from the page file if it's been evicted. can be called from any thread.
+	// returns false if the brick couldn't be read, the leaf is left paged out and reads as its uniform value
+	bool MakeLeafResident(SparseTerrainOctreeNode* leaf)
+	{
+		if (!leaf->bReferenced.load(std::memory_order_relaxed))
+		{
+			leaf->bReferenced.store(true, std::memory_order_relaxed);
+		}
+		if (leaf->bPagedOut.load(std::memory_order_acquire))
+		{
+			return FaultInLeaf(leaf);
+		}
+		return true;
+	}
+
+	// MakeLeafResident for readers, trying the page file again if it can't be read the first time. If it still can't,
+	// the nodes that read the leaf are marked edited so they're meshed again once it can be, and false is returned -
+	// ReadUnresidentLeaf gives what the leaf reads as in the meantime
+	bool MakeLeafResidentForRead(SparseTerrainOctreeNode* leaf);
+
+	// what a leaf that couldn't be faulted in reads as until it can be - its parent's mip, built before the leaf was
+	// evicted, or the default value if the parent hasn't got one. never the leaf's UniformValue, that's stale once paged out
+	void ReadUnresidentLeaf(const SparseTerrainOctreeNode* leaf, i8* outVoxels) const;
+
+	// reads that gave up on faulting a leaf in, see MakeLeafResidentForRead
+	u64 GetNumFailedBrickReads() const { return NumFailedBrickReads.load(std::memory_order_relaxed); }
+
+	// fault in the bricks of every leaf overlapping [min, max] on one of threadPool's workers, or on this thread if it's null,
+	// so that reads of the region later on don't wait for the file. can run alongside readers and writers but not EnforceBrickBudget
+	std::future<void> PrefetchRegionAsync(const glm::ivec3& min, const glm::ivec3& max, rdx::thread_pool* threadPool);
+
+	// bytes of leaf bricks in memory, raw and compressed, including those kept for snapshots. mips aren't counted
+	size_t GetResidentBrickBytes() const { return ResidentBrickBytes.load(std::memory_order_relaxed); }
+
+	u64 GetNumBrickFaults() const { return NumBrickFaults.load(std::memory_order_relaxed); }
+
+	u64 GetNumBrickEvictions() const { return NumBrickEvictions; }
+
+	// write the octree to a file LoadMappedWorld can map straight back in.
+	// must not be called while anything is writing to the octree. returns false if the file can't be written or a paged out brick can't be read back
+	bool SaveMappedWorld(const char* path);
+
+	// replace what's in the octree with a world saved by SaveMappedWorld. Leaves point at their bricks in the mapped file
+	// rather than having them read in, so loading only takes as long as building the nodes and the OS reads bricks in as
+	// they're first touched. A mapped brick is copied out the first time it's written to, the file itself never changes.
+	// must not be called while anything else is using the octree. returns false, leaving the octree empty, if the file isn't a world
+	bool LoadMappedWorld(const char* path);
+
+	// bottom left corners of the bricks written to since the last call, for saving only what's changed since the last
+	// checkpoint - see VoxelEditJournal. Loading a world writes all of its bricks, so take them once it's loaded to start
+	// from there. can be called while the octree is being written to, a brick being written at the time may be in this
+	// list, the next one or both
+	std::vector<glm::ivec3> TakeDirtyBricks();
+
+	size_t GetNumDirtyBricks();
+
+	// changes whenever a node is added or removed
+	u32 GetStructureGeneration() const { return StructureGeneration.load(std::memory_order_acquire); }
+
+	// the tree's structure as a FlatTerrainOctree, rebuilt here if it's changed since the last call.
+	// must not be called while anything is writing to the octree
+	const FlatTerrainOctree& GetFlatOctree();
+
 	// return a list of TerrainOctreeNodes to render.
 	// these will be frustum culled and LOD'd correctly 
-	// from the cam data provided
+	// from the cam data provided.
+	// nodes that need regenerating are polygonized from a snapshot by jobs that outlive the call, their meshes are uploaded
+	// by whichever later call finds them finished. SetVoxelAt and FillBrick can be called between calls while they run.
+	// the mips are updated and bricks compressed and evicted only once a batch of jobs has finished and released its
+	// snapshot, before the next one starts. must not be called while anything else is reading from or writing to the octree
 	void GetChunksToRender(
 		const Camera& camera,
 		float aspect, float fovY, float zNear, float zFar,
 		std::vector<ITerrainOctreeNode*>& outNodesToRender);
 
+	// wait for the polygonize jobs GetChunksToRender started, upload their meshes and release their snapshot.
+	// Clear, ResizeAndClear, LoadMappedWorld and the destructor call this first
+	void FinishMeshing();
+
+	// polygonize jobs started by GetChunksToRender that haven't been uploaded yet
+	size_t GetNumMeshingJobs() const { return MeshingFutures.size(); }
+
+public:
+	// keep leaves compressed where it saves memory, see VoxelBrickCompression.
+	// Compressed leaves are decompressed when they're written to and compressed again by CompressBricks
+	bool bCompressBricks = false;
+
+	// GetVoxelsForNode reads nodes above MipLevel 0 from their MipVoxelData, which averages the voxels
+	// below instead of picking every stepSize'th one. Kept up to date by GetChunksToRender
+	bool bUsePrefilteredMips = false;
+
+	// GetChunksToRender walks a FlatTerrainOctree instead of the nodes themselves
+	bool bUseFlatTraversal = true;
+
+	// bytes of leaf bricks EnforceBrickBudget keeps in memory once paging is enabled.
+	// GetChunksToRender enforces it before each batch of polygonize jobs, faults can take it over in between
+	size_t BrickBudgetBytes = 0;
+
 private:
 
+	i8 GetVoxelAt_Internal(const glm::ivec3& location, u32 version);
+
+	void GetVoxelsForNode_Internal(ITerrainOctreeNode* node, u32 version, i8* outVoxels);
+
+	void GetVoxelRegionContainingPoint_Internal(const glm::ivec3& location, u32 version, VoxelRegion& outRegion);
+
+	bool ReadBrick_Internal(const glm::ivec3& brickBottomLeft, u32 version, i8* outVoxels);
+
+	// must not be called while anything is writing to the octree. returns the snapshot's version
+	u32 PinSnapshot();
+
+	// can be called while the octree is being written to
+	void ReleaseSnapshot(u32 version);
+
+	// called by writers holding the leaf's BrickLock before they change it. if a snapshot might still need what the
+	// leaf holds it's moved into a LeafVersion, and the leaf carries on with copies of its bricks
+	// bKeepBricks false is for a writer about to replace everything in the leaf, the leaf is left with no bricks at all
+	void PreserveLeafForSnapshots(SparseTerrainOctreeNode* leaf, bool bKeepBricks = true);
+
+	// free the leaf versions no pinned snapshot can see any more. called with SnapshotMutex held
+	void ReclaimLeafVersions();
+
+	void FreeLeafVersion(LeafVersion* version);
+
+	void PushLeafWithHistory(SparseTerrainOctreeNode* leaf);
+
 	void PopulateSingleMipLevel(SparseTerrainOctreeNode* node);
 
+	void CompressBricksInSubtree(SparseTerrainOctreeNode* node);
+
+	// upload the meshes of the polygonize jobs that have finished, waiting for the rest if bWait is set.
+	// releases the snapshot they read once none are left
+	void UploadFinishedMeshes(bool bWait);
+
+	void UpdateMipsInSubtree(SparseTerrainOctreeNode* node);
+
+	void FreeMipBrick(SparseTerrainOctreeNode* node);
+
+	// store voxels in the leaf compressed, or as its uniform value if they're all the same.
+	// voxels may be the leaf's own VoxelData. returns false, leaving the leaf alone, if there are too many distinct values
+	bool TryCompressLeafBrick(SparseTerrainOctreeNode* leaf, const i8* voxels);
+
+	PoolAllocator& GetCompressedBrickPool(const u8* compressed);
+
+	// give a leaf raw VoxelData holding what it currently reads as, decompressing it if it's compressed
+	i8* MakeLeafBrickRaw(SparseTerrainOctreeNode* leaf);
+
+	void FreeLeafBricks(SparseTerrainOctreeNode* leaf);
+
+	i8* AllocateRawBrick();
+
+	u8* AllocateCompressedBrick(size_t sizeBytes);
+
+	void FreeRawBrick(const i8* voxels);
+
+	void FreeCompressedBrick(const u8* compressed);
+
+	// read a leaf's brick back from the page file and give it to the leaf, unless another thread already has.
+	// returns false if the file couldn't be read, the slot is kept so the brick isn't lost
+	bool FaultInLeaf(SparseTerrainOctreeNode* leaf);
+
+	// write the leaf's bricks to the page file, if there isn't an up to date copy there already, and free them
+	bool EvictLeaf(SparseTerrainOctreeNode* leaf);
+
+	// called when a leaf's contents change, the copy in the page file is out of date
+	void DiscardPagedCopy(SparseTerrainOctreeNode* leaf);
+
+	// add a leaf that's just been written to DirtyBricks, unless it's already there since the last checkpoint.
+	// can be called from any thread
+	void MarkLeafDirty(SparseTerrainOctreeNode* leaf);
+
+	// bricks in the mapped world file aren't the pools' to free and can't be written to
+	bool IsMappedBrick(const void* brick) const { return MappedWorld.Contains(brick); }
+
+	struct MappedWorldNode;
+
+	// append node and its subtree to outNodes depth first, with the brick each one's entry refers to in outBricks.
+	// returns false if a leaf's brick couldn't be faulted in, so the world can't be saved as it is
+	bool CollectMappedWorldNodes(SparseTerrainOctreeNode* node, std::vector<MappedWorldNode>& outNodes, std::vector<const void*>& outBricks);
+
+	// create node's subtree from the entries in the mapped world starting at cursor. returns false if they don't make a valid tree
+	bool BuildMappedSubtree(SparseTerrainOctreeNode* node, const MappedWorldNode* nodes, u64 numNodes, u64& cursor);
+
+	static void ReadLeafBrick(const LeafState& leaf, i8* outVoxels);
+
 	TerrainOctreeIndex SetVoxelAt_Internal(const glm::ivec3& location, i8 value);
 
+	/// <summary>
+	/// walk down to the leaf containing location, creating any missing nodes on the way.
+	/// the nodes passed through are written to outAncestors, which must have room for ParentNode.MipLevel entries.
+	/// safe to call from several threads at once
+	/// </summary>
+	SparseTerrainOctreeNode* FindOrCreateLeafContainingPoint(const glm::ivec3& location, TerrainOctreeIndex& outIndex, SparseTerrainOctreeNode** outAncestors);
+
 	/// <param name="allocateNewIfNull">if the point is in a branch that does not exist do we allocate it or return the default value</param>
 	SparseTerrainOctreeNode* FindChildContainingPoint(SparseTerrainOctreeNode* parent, const glm::ivec3& point, u8& outChildIndex, bool allocateNewIfNull = true);
 
 	void DeleteAllChildren(SparseTerrainOctreeNode* node);
 
+	/// <summary>
+	/// bump the EditGeneration of every node whose polygonizer input includes a voxel in [editMin, editMax] -
+	/// at each mip level the node the edit is in and any neighbours whose gutters reach it, and only at levels whose
+	/// lattice the edit touches. the region must lie within leaf, ancestors are as from FindOrCreateLeafContainingPoint
+	/// </summary>
+	void MarkNodesReadingRegion(const glm::ivec3& editMin, const glm::ivec3& editMax, SparseTerrainOctreeNode* leaf, SparseTerrainOctreeNode** ancestors);
+
+	// the node at mipLevel with this bottom left corner, or nullptr if it doesn't exist
+	SparseTerrainOctreeNode* FindExistingNode(const glm::ivec3& bottomLeft, u32 mipLevel);
+
+	// returns the child at childIndex, which may have been created by another thread in the meantime
+	SparseTerrainOctreeNode* CreateChild(SparseTerrainOctreeNode* parent, u8 childIndex);
+
+	static bool IsBrickUniform(const i8* voxels);
+
+	// returns true if the node is left with neither children nor a brick, ie it's entirely its UniformValue
+	bool CollapseUniformSubtree(SparseTerrainOctreeNode* node);
+
 	glm::ivec3 GetLocationWithinMipZeroCellFromWorldLocation(SparseTerrainOctreeNode* mipZeroCell, const glm::ivec3& globalLocation);
 
 private:
 
 	IAllocator* Allocator;
 
+	// every node below the root comes from here
+	PoolAllocator NodePool;
+
+	// every leaf's BASE_CELL_SIZE^3 voxel data comes from here
+	PoolAllocator BrickPool;
+
+	// compressed bricks, one pool for each VoxelBrickCompression size class
+	PoolAllocator CompressedBrickPools[VOXEL_BRICK_NUM_SIZE_CLASSES];
+
+	// every leaf by the morton code of its coordinates, so finding the leaf a point is in doesn't need to walk the tree.
+	// a point with no leaf is in a subtree collapsed into its uniform value, finding that still takes the walk
+	LeafHashIndex LeafIndex;
+
+	// every LeafVersion comes from here
+	PoolAllocator LeafVersionPool;
+
 	SparseTerrainOctreeNode ParentNode;
 
+	// writes are made in this version, snapshots get the versions before it
+	std::atomic<u32> WriteVersion = { 1 };
+
+	// guards PinnedVersions and RetiredLeafVersions
+	std::mutex SnapshotMutex;
+
+	std::vector<u32> PinnedVersions;
+
+	std::atomic<u32> NumPinnedSnapshots = { 0 };
+
+	// leaves with a History, pushed by writers and taken apart by ReclaimLeafVersions
+	std::atomic<SparseTerrainOctreeNode*> LeavesWithHistory = { nullptr };
+
+	// unlinked from their leaf but maybe still being read by a snapshot
+	std::vector<LeafVersion*> RetiredLeafVersions;
+
+	std::atomic<u32> NumLeafVersions = { 0 };
+
+	std::atomic<u32> StructureGeneration = { 1 };
+
+	// what the polygonize jobs of the batch GetChunksToRender last started read, null once they've all been uploaded
+	SparseTerrainVoxelOctreeSnapshot* MeshingSnapshot = nullptr;
+
+	std::vector<std::future<PolygonizeWorkerThreadData*>> MeshingFutures;
+
+	FlatTerrainOctree FlatOctree;
+
+	VoxelBrickPager Pager;
+
+	// the file loaded by LoadMappedWorld, unmapped when the octree is cleared
+	MemoryMappedFile MappedWorld;
+
+	// bumped by TakeDirtyBricks, a leaf is in DirtyBricks if its DirtyCheckpoint matches
+	std::atomic<u32> CheckpointGeneration = { 1 };
+
+	// guards DirtyBricks
+	std::mutex DirtyBricksMutex;
+
+	// bottom left corners of the leaves written to since the last checkpoint, cleared along with the octree
+	std::vector<glm::ivec3> DirtyBricks;
+
+	// slot in LeafIndex the clock hand of EnforceBrickBudget is on
+	u64 ClockHand = 0;
+
+	std::atomic<size_t> ResidentBrickBytes = { 0 };
+
+	std::atomic<u64> NumBrickFaults = { 0 };
+
+	std::atomic<u64> NumFailedBrickReads = { 0 };
+
+	u64 NumBrickEvictions = 0;
+
+	// StructureGeneration when FlatOctree was built
+	u32 FlatOctreeGeneration = 0;
+
 	i8 VoxelClampValueHigh;
 
 	i8 VoxelClampValueLow;
 
 	i8 VoxelDefaultValue;
 
-	// this has a bounded upper size so we can allocate it once on construction
-	SparseTerrainOctreeNode** ParentNodeStack;
-
 	ITerrainPolygonizer* Polygonizer;
 
 	ITerrainGraphicsAPIAdaptor* GraphicsAPIAdaptor;
-
-	std::mutex SetVoxelMutex;
 };
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+#include "IVoxelDataSource.h"
+#include "CommonTypedefs.h"
+#include "Core.h"
+
+class SparseTerrainVoxelOctree;
+
+/// <summary>
+/// A read only view of a SparseTerrainVoxelOctree as it was when the snapshot was made. The octree can be
+/// written to from other threads while snapshots are being read, leaves written to keep their old contents
+/// around for as long as a snapshot that might read them exists.
+///
+/// Snapshots must be made while nothing is writing to the octree, and released before it's cleared or destroyed.
+/// Reading one is thread safe. The octree's structure isn't versioned so collapsing uniform subtrees, compressing
+/// bricks, rebuilding mips and paging bricks out all wait until no snapshots are left.
+/// </summary>
+class APP_API SparseTerrainVoxelOctreeSnapshot : public IVoxelDataSource
+{
+public:
+	SparseTerrainVoxelOctreeSnapshot(SparseTerrainVoxelOctree* octree);
+	~SparseTerrainVoxelOctreeSnapshot();
+	SparseTerrainVoxelOctreeSnapshot(const SparseTerrainVoxelOctreeSnapshot&) = delete;
+	SparseTerrainVoxelOctreeSnapshot& operator=(const SparseTerrainVoxelOctreeSnapshot&) = delete;
+
+	u32 GetVersion() const { return Version; }
+
+	// IVoxelDataSource
+	virtual i8 GetVoxelAt(const glm::ivec3& location) override;
+	virtual void GetVoxelsForNode(ITerrainOctreeNode* node, i8* outVoxels) override;
+	virtual void GetVoxelRegionContainingPoint(const glm::ivec3& location, VoxelRegion& outRegion) override;
+	virtual bool ReadBrick(const glm::ivec3& brickBottomLeft, i8* outVoxels) override;
+	virtual size_t GetSize() const override;
+	// never creates nodes, a snapshot can't change the octree
+	virtual ITerrainOctreeNode* FindNodeFromIndex(TerrainOctreeIndex index, bool createIfDoesntExist = false) override;
+	virtual ITerrainOctreeNode* GetParentNode() override;
+
+	// the rest write to the octree - they assert and do nothing
+	virtual TerrainOctreeIndex SetVoxelAt(const glm::ivec3& location, i8 value) override;
+	virtual TerrainOctreeIndex FillBrick(const glm::ivec3& brickBottomLeft, const i8* voxels) override;
+	virtual TerrainOctreeIndex FillBrick(const glm::ivec3& brickBottomLeft, const std::function<i8(const glm::ivec3&)>& generator) override;
+	virtual void Clear() override;
+	virtual void ResizeAndClear(const size_t newSize) override;
+	virtual void AllocateNodeVoxelData(ITerrainOctreeNode* node) override;
+	virtual void CreateChildrenForFirstNMipLevels(ITerrainOctreeNode* node, int n, int onLevel = 0) override;
+	virtual void CollapseUniformSubtrees() override;
+	// IVoxelDataSource end
+
+private:
+	SparseTerrainVoxelOctree* Octree;
+
+	u32 Version;
+};
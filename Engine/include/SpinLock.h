@@ -0,0 +1,27 @@
+#pragma once
+#include <atomic>
+#include <thread>
+
+/// <summary>
+/// A lock small enough to put in every octree node, for guarding work that only takes a handful of instructions.
+/// Meets the BasicLockable requirements so it can be used with std::lock_guard.
+/// </summary>
+class SpinLock
+{
+public:
+	inline void lock()
+	{
+		while (Flag.test_and_set(std::memory_order_acquire))
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	inline void unlock()
+	{
+		Flag.clear(std::memory_order_release);
+	}
+
+private:
+	std::atomic_flag Flag = ATOMIC_FLAG_INIT;
+};
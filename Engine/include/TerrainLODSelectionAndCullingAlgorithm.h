@@ -2,14 +2,56 @@
 #include <glm.hpp>
 #include <vector>
 #include <functional>
+#include "CommonTypedefs.h"
+#include "CameraFunctionLibrary.h"
+#include "ITerrainOctreeNode.h"
 
 struct Frustum;
-struct ITerrainOctreeNode;
+class FlatTerrainOctree;
 
+/// <summary>
+/// How the templated GetChunksToRender sees the nodes of an octree. This one works for any ITerrainOctreeNode type,
+/// for a final one the compiler can call the node's functions directly instead of through the vtable.
+/// An octree that isn't made of ITerrainOctreeNodes gives its own, see FlatTerrainOctreeLODTraits
+/// </summary>
+template<typename TNode>
+struct TerrainLODNodeTraits
+{
+	typedef TNode* Node;
+	bool IsValid(Node node) const { return node != nullptr; }
+	Node GetChild(Node node, u8 child) const { return static_cast<TNode*>(node->GetChild(child)); }
+	glm::ivec3 GetBottomLeftCorner(Node node) const { return node->GetBottomLeftCorner(); }
+	u32 GetSizeInVoxels(Node node) const { return node->GetSizeInVoxels(); }
+	bool HasChildren(Node node) const
+	{
+		for (u8 i = 0; i < 8; i++)
+		{
+			if (node->GetChild(i))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+	bool NeedsRegenerating(Node node) const { return node->NeedsRegenerating(); }
+	ITerrainOctreeNode* GetTreeNode(Node node) const { return node; }
+};
 
 class TerrainLODSelectionAndCullingAlgorithm
 {
 public:
+	// the traversal every other GetChunksToRender is made from. TTraits is like TerrainLODNodeTraits and callback is
+	// called with each node pushed to outNodesToRender that needs regenerating
+	template<typename TTraits, typename TCallback>
+	static void GetChunksToRender(
+		const TTraits& traits,
+		const Frustum& frustum,
+		std::vector<ITerrainOctreeNode*>& outNodesToRender,
+		typename TTraits::Node onNode,
+		const glm::mat4& viewProjectionMatrix,
+		TCallback& needsRegeneratingCallback);
+
+	// for anything made of ITerrainOctreeNodes, mocks included
 	static void GetChunksToRender(
 		const Frustum& frustum,
 		std::vector<ITerrainOctreeNode*>& outNodesToRender,
@@ -17,10 +59,76 @@ public:
 		const glm::mat4& viewProjectionMatrix,
 		std::function<void(ITerrainOctreeNode*)> needsRegeneratingCallback = std::function<void(ITerrainOctreeNode*)>{});
 
+	// the same selection made walking a FlatTerrainOctree, outputs the tree nodes it was built from
+	static void GetChunksToRender(
+		const Frustum& frustum,
+		std::vector<ITerrainOctreeNode*>& outNodesToRender,
+		const FlatTerrainOctree& octree,
+		u32 onNode,
+		const glm::mat4& viewProjectionMatrix,
+		const std::function<void(ITerrainOctreeNode*)>& needsRegeneratingCallback = std::function<void(ITerrainOctreeNode*)>{});
+
 	// estimate how much space a block will take up in the view port
 	static float ViewportAreaHeuristic(ITerrainOctreeNode* block, const glm::mat4& viewProjectionMatrix);
 
+	static float ViewportAreaHeuristic(const glm::ivec3& bottomLeft, u32 sizeInVoxels, const glm::mat4& viewProjectionMatrix);
+
+	static bool HasChildren(ITerrainOctreeNode* node);
+
 	// if the viewport area heuristic for a block is < this value then
 	// the block will be rendered and it's subtree skipped.
 	static float MinimumViewportAreaThreshold;
-};
\ No newline at end of file
+};
+
+template<typename TTraits, typename TCallback>
+void TerrainLODSelectionAndCullingAlgorithm::GetChunksToRender(const TTraits& traits, const Frustum& frustum, std::vector<ITerrainOctreeNode*>& outNodesToRender, typename TTraits::Node onNode, const glm::mat4& viewProjectionMatrix, TCallback& needsRegeneratingCallback)
+{
+	/*
+	https://transvoxel.org/Lengyel-VoxelTerrain.pdf?fbclid=IwAR0xXDW0I_amFS0Tfp-YtyE9oB_va_SDVP4zdpb6D4Z8Lmb1Gvf-6212_EI
+	The octree is traversed when the terrain is rendered, and any block not
+	intersecting the view frustum is culled along with its entire subtree. When a block is visited in the
+	octree and determined to be visible to the camera, its projected size in the viewport is calculated.
+	If the size falls below a threshold value, then that block is rendered, and its subtree is skipped.
+
+	Jims note: presumably it also renders chunks when they are in the viewport and the lowest mip level
+	has been reached without the size threshold being satisfied, because if you're looking at the floor in a blck
+	then you want that floor to be rendered in the highest detail
+	*/
+	for (u8 i = 0; i < 8; i++)
+	{
+		typename TTraits::Node child = traits.GetChild(onNode, i);
+		if (traits.IsValid(child))
+		{
+			glm::ivec3 bottomLeft = traits.GetBottomLeftCorner(child);
+			u32 sizeInVoxels = traits.GetSizeInVoxels(child);
+			glm::vec3 sphereCenter =
+			{
+				bottomLeft.x + (float)sizeInVoxels / 2.0f,
+				bottomLeft.y + (float)sizeInVoxels / 2.0f,
+				bottomLeft.z + (float)sizeInVoxels / 2.0f
+			};
+			float sphereRadius = abs(glm::length(sphereCenter - glm::vec3(bottomLeft))); // maybe abs not needed - todo - find out
+			if (CameraFunctionLibrary::IsSphereInFrustum(sphereCenter, sphereRadius, frustum))
+			{
+				// here we need to determine the blocks projected size in the viewport and if it is 
+				// below a threshold or, I think the lowst mip level, then add it to the output list 
+				float val = ViewportAreaHeuristic(bottomLeft, sizeInVoxels, viewProjectionMatrix);
+				// a node without children is either a leaf or a subtree that's been collapsed because it's all one value,
+				// either way there's nothing finer to draw
+				if ((val < MinimumViewportAreaThreshold && val > 0.0f) || !traits.HasChildren(child))
+				{
+					ITerrainOctreeNode* treeNode = traits.GetTreeNode(child);
+					outNodesToRender.push_back(treeNode);
+					if (traits.NeedsRegenerating(child))
+					{
+						needsRegeneratingCallback(treeNode);
+					}
+				}
+				else
+				{
+					GetChunksToRender(traits, frustum, outNodesToRender, child, viewProjectionMatrix, needsRegeneratingCallback);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "CommonTypedefs.h"
+#include "Core.h"
+#include <string>
+
+// enough for a TerrainOctreeIndex's worth of levels and the leaves
+#define TERRAIN_STATISTICS_MAX_MIP_LEVELS 17
+
+/// <summary>
+/// What an octree is made of and how much memory it's using, see SparseTerrainVoxelOctree::GetStatistics.
+/// The counts are of what's in the tree, the pool bytes are what the allocators are holding on to - free blocks included
+/// </summary>
+struct APP_API TerrainOctreeStatistics
+{
+	u32 NumMipLevels = 0;
+	u64 NodesPerMipLevel[TERRAIN_STATISTICS_MAX_MIP_LEVELS] = {};
+	u64 NodeBytes = 0;
+
+	// leaves with no brick, all one value
+	u64 NumUniformLeaves = 0;
+	u64 NumRawBricks = 0;
+	u64 NumCompressedBricks = 0;
+	// evicted to the page file, see SparseTerrainVoxelOctree::EnablePaging
+	u64 NumPagedOutBricks = 0;
+	// raw or compressed bricks with voxels on both sides of zero, the ones with a surface going through them
+	u64 NumSurfaceBricks = 0;
+	u64 RawBrickBytes = 0;
+	u64 CompressedBrickBytes = 0;
+	// interior nodes with no children left, collapsed into their uniform value
+	u64 NumCollapsedNodes = 0;
+	u64 NumMipBricks = 0;
+	u64 MipBrickBytes = 0;
+	u64 NumLeafVersions = 0;
+
+	// meshes with a VAO, and their index counts
+	u64 NumMeshes = 0;
+	u64 NumTransitionMeshes = 0;
+	u64 NumMeshIndices = 0;
+
+	u64 NodePoolBytes = 0;
+	u64 BrickPoolBytes = 0;
+	u64 CompressedBrickPoolBytes = 0;
+	u64 LeafVersionPoolBytes = 0;
+	u64 PageFileBytes = 0;
+	// the file a world loaded with SparseTerrainVoxelOctree::LoadMappedWorld reads its bricks from
+	u64 MappedWorldBytes = 0;
+
+	// how many voxels in the whole volume have each value, indexed by value + 128
+	u64 VoxelValueCounts[256] = {};
+
+	// add the counts from a part of the same octree
+	void Add(const TerrainOctreeStatistics& other);
+
+	u64 GetTotalPoolBytes() const { return NodePoolBytes + BrickPoolBytes + CompressedBrickPoolBytes + LeafVersionPoolBytes; }
+
+	std::string ToJson() const;
+};
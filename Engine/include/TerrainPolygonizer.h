@@ -8,8 +8,9 @@
 
 struct ITerrainOctreeNode;
 class IAllocator;
+class VoxelAccessor;
 
-class TerrainPolygonizer : public ITerrainPolygonizer
+class APP_API TerrainPolygonizer : public ITerrainPolygonizer
 {
 public:
 	TerrainPolygonizer(IAllocator* allocator, std::shared_ptr<rdx::thread_pool> threadPool);
@@ -22,6 +23,10 @@ public:
 	PolygonizeWorkerThreadData* PolygonizeCellSyncMMC(ITerrainOctreeNode* cellToPolygonize, IVoxelDataSource* source);
 public:
 	bool bExactFit = false;
+	// output TerrainVertexCompact rather than TerrainVertex, MMC only
+	bool bCompactVertices = false;
+	// MMC only - false visits every cell rather than only those the surface goes through, which makes the same mesh
+	bool bSkipEmptyCells = true;
 private:
 	struct GridCell
 	{
@@ -35,8 +40,8 @@ private:
 		u16 Edge[9];
 	};
 private:
-	TerrainVertex VertexInterp( glm::vec3 p1, glm::vec3 p2,float valp1,float valp2, glm::ivec3& coords1, glm::ivec3& coords2, i8* voxels, ITerrainOctreeNode* cellToPolygonize, IVoxelDataSource* source);
-	int Polygonise(GridCell &Grid, int &NewVertexCount, TerrainVertex *Vertices, int& newIndicesCount, char* indices, i8* voxels, ITerrainOctreeNode* node, IVoxelDataSource* source);
+	TerrainVertex VertexInterp( glm::vec3 p1, glm::vec3 p2,float valp1,float valp2, glm::ivec3& coords1, glm::ivec3& coords2, i8* voxels, ITerrainOctreeNode* cellToPolygonize, VoxelAccessor& accessor);
+	int Polygonise(GridCell &Grid, int &NewVertexCount, TerrainVertex *Vertices, int& newIndicesCount, char* indices, i8* voxels, ITerrainOctreeNode* node, VoxelAccessor& accessor);
 private:
 	std::shared_ptr<rdx::thread_pool> ThreadPool;
 	IAllocator* Allocator;
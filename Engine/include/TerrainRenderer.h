@@ -73,6 +73,9 @@ private:
 
 	Shader TerrainShader;
 
+	// for chunks polygonized into TerrainVertexCompact
+	Shader CompactTerrainShader;
+
 	LastRenderedMap LastRendered;
 
 	GPUMemoryFreeingStrategy FreeingStrategy;
@@ -0,0 +1,25 @@
+#pragma once
+#include <glm.hpp>
+#include "CommonTypedefs.h"
+#include "Core.h"
+#include "ITerrainPolygonizer.h"
+
+/// <summary>
+/// Converts the polygonizer's fixed point vertices to TerrainVertexCompact and back.
+///
+/// Positions are rounded to the nearest 1 / (1 << TERRAIN_COMPACT_POSITION_FRACTION_BITS) of a step, where a step is
+/// the chunk's GetSizeInVoxels() / BASE_CELL_SIZE. The decode functions do the same as the compact vertex shader
+/// in TerrainRenderer, they're here so the encoding can be tested.
+/// </summary>
+namespace TerrainVertexCompression
+{
+	APP_API TerrainVertexCompact Encode(const TerrainVertexFixedPoint& fixed, const glm::ivec3& chunkBottomLeft, u32 stepSize);
+
+	APP_API glm::vec3 DecodePosition(const TerrainVertexCompact& compact, const glm::ivec3& chunkBottomLeft, u32 stepSize);
+
+	// octahedral encoded, normal doesn't need to be normalized
+	APP_API void EncodeNormal(const glm::vec3& normal, i8* outEncoded);
+
+	// normalized
+	APP_API glm::vec3 DecodeNormal(const i8* encoded);
+}
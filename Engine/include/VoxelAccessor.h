@@ -0,0 +1,71 @@
+#pragma once
+#include "CommonTypedefs.h"
+#include "Core.h"
+#include "OctreeTypes.h"
+#include "TerrainDefs.h"
+#include "VoxelBrickCompression.h"
+#include <glm.hpp>
+
+class IVoxelDataSource;
+
+// how many regions an accessor remembers - reads straddling a brick boundary alternate between two,
+// and a cell's corners can touch up to eight
+#define VOXEL_ACCESSOR_CACHED_REGIONS 4
+
+/// <summary>
+/// Reads voxels from an IVoxelDataSource, remembering the last few regions (leaf bricks, or whole subtrees
+/// that are one value) it read from. A read that lands in one of them is a bounds check and an array load
+/// rather than a lookup in the source.
+///
+/// Not thread safe - make one per thread, they're cheap. The cached regions point straight into the source's
+/// voxel data so an accessor must be Reset (or thrown away) once the source has been written to.
+/// </summary>
+class APP_API VoxelAccessor
+{
+public:
+	VoxelAccessor(IVoxelDataSource* source);
+
+	inline i8 GetVoxelAt(const glm::ivec3& location)
+	{
+		for (u32 i = 0; i < VOXEL_ACCESSOR_CACHED_REGIONS; i++)
+		{
+			const VoxelRegion& region = Regions[i];
+			// unsigned compares so one test per axis covers both sides
+			if ((u32)(location.x - region.BottomLeft.x) < region.SizeInVoxels
+				&& (u32)(location.y - region.BottomLeft.y) < region.SizeInVoxels
+				&& (u32)(location.z - region.BottomLeft.z) < region.SizeInVoxels)
+			{
+				return ReadRegion(region, location);
+			}
+		}
+		return GetVoxelAt_Miss(location);
+	}
+
+	// forget every cached region
+	void Reset();
+
+	u64 GetNumMisses() const { return NumMisses; }
+
+private:
+	static inline i8 ReadRegion(const VoxelRegion& region, const glm::ivec3& location)
+	{
+		if (!region.Voxels && !region.CompressedVoxels)
+		{
+			return region.UniformValue;
+		}
+		glm::ivec3 local = location - region.BottomLeft;
+		u32 index = local.x + BASE_CELL_SIZE * local.y + BASE_CELL_SIZE * BASE_CELL_SIZE * local.z;
+		return region.Voxels ? region.Voxels[index] : VoxelBrickCompression::GetVoxel(region.CompressedVoxels, index);
+	}
+
+	i8 GetVoxelAt_Miss(const glm::ivec3& location);
+
+private:
+	IVoxelDataSource* Source;
+
+	VoxelRegion Regions[VOXEL_ACCESSOR_CACHED_REGIONS];
+
+	u32 NextRegionToReplace = 0;
+
+	u64 NumMisses = 0;
+};
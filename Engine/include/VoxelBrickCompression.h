@@ -0,0 +1,77 @@
+#pragma once
+#include "CommonTypedefs.h"
+#include "Core.h"
+#include "TerrainDefs.h"
+
+// most distinct values a brick can have and still be palette compressed, any more and an index is as big as the value
+#define VOXEL_BRICK_MAX_PALETTE_SIZE 16
+
+// compressed bricks are allocated from pools of these sizes, see GetSizeClassBytes
+#define VOXEL_BRICK_NUM_SIZE_CLASSES 6
+
+/// <summary>
+/// Compression for BASE_CELL_SIZE^3 voxel bricks. Surface bricks tend to be mostly the clamp values
+/// with a band of others where the surface passes through. When the band holds only a few distinct values
+/// each voxel is stored as a 1, 2 or 4 bit index into a palette of the values the brick actually contains.
+/// When it doesn't (the density is continuous so a steep surface gives a different value in every voxel it crosses)
+/// each row along x is stored as runs of equal values instead, which still pays off where the band is thin.
+///
+/// A compressed brick is a CompressedBrickHeader followed by either
+///		- the palette indices packed least significant bit first
+///		- a u16 per row giving the index of its first run, then the runs as (value, length) byte pairs
+/// </summary>
+namespace VoxelBrickCompression
+{
+	struct APP_API CompressedBrickHeader
+	{
+		u8 BitsPerVoxel;	// 1, 2 or 4 for a palette, 0 for runs
+		u8 PaletteSize;
+		u16 SizeBytes;		// including this header
+		i8 Palette[VOXEL_BRICK_MAX_PALETTE_SIZE];
+	};
+
+	// build the palette for a brick and work out how many bits each index needs.
+	// returns 0 if the brick has too many distinct values to palette compress
+	APP_API u32 BuildPalette(const i8* brick, CompressedBrickHeader& outHeader);
+
+	// pick the smallest form for a brick and fill in the header for it.
+	// returns the compressed size in bytes, or 0 if the brick is better left raw
+	APP_API size_t PlanCompression(const i8* brick, CompressedBrickHeader& outHeader);
+
+	// out must have room for header.SizeBytes bytes
+	APP_API void Compress(const i8* brick, const CompressedBrickHeader& header, u8* out);
+
+	APP_API void Decompress(const u8* compressed, i8* outBrick);
+
+	// size classes cover each palette width exactly, and the run length form in the gaps between them
+	APP_API size_t GetSizeClassBytes(u32 sizeClass);
+
+	// smallest size class that will hold sizeBytes
+	APP_API u32 GetSizeClass(size_t sizeBytes);
+
+	inline const CompressedBrickHeader* GetHeader(const u8* compressed)
+	{
+		return reinterpret_cast<const CompressedBrickHeader*>(compressed);
+	}
+
+	inline i8 GetVoxel(const u8* compressed, u32 voxelIndex)
+	{
+		const CompressedBrickHeader* header = GetHeader(compressed);
+		if (header->BitsPerVoxel)
+		{
+			const u8* packed = compressed + sizeof(CompressedBrickHeader);
+			u32 bitIndex = voxelIndex * header->BitsPerVoxel;
+			u32 paletteIndex = (packed[bitIndex >> 3] >> (bitIndex & 7)) & ((1u << header->BitsPerVoxel) - 1);
+			return header->Palette[paletteIndex];
+		}
+		const u16* rowStarts = reinterpret_cast<const u16*>(compressed + sizeof(CompressedBrickHeader));
+		const u8* run = reinterpret_cast<const u8*>(rowStarts + BASE_CELL_SIZE * BASE_CELL_SIZE) + 2 * rowStarts[voxelIndex / BASE_CELL_SIZE];
+		u32 x = voxelIndex % BASE_CELL_SIZE;
+		while (x >= run[1])
+		{
+			x -= run[1];
+			run += 2;
+		}
+		return (i8)run[0];
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "CommonTypedefs.h"
+#include "Core.h"
+#include "TerrainDefs.h"
+
+/// <summary>
+/// Builds the BASE_CELL_SIZE^3 mip brick of an interior octree node from its children's bricks.
+/// Each child covers one octant of its parent's brick at half resolution, every voxel of the octant
+/// being the average of a 2x2x2 block of the child's voxels, rounded to nearest.
+///
+/// Octant i covers x from (i & 1) * BASE_CELL_SIZE / 2, y from ((i >> 1) & 1) * BASE_CELL_SIZE / 2 and
+/// z from ((i >> 2) & 1) * BASE_CELL_SIZE / 2, the same order as a node's children.
+/// </summary>
+namespace VoxelBrickDownsample
+{
+	// uses SSE2 where it's available, otherwise the same as DownsampleIntoOctant_Scalar
+	APP_API void DownsampleIntoOctant(const i8* childBrick, u8 octant, i8* outBrick);
+
+	APP_API void DownsampleIntoOctant_Scalar(const i8* childBrick, u8 octant, i8* outBrick);
+
+	// for a child that's all one value, or missing
+	APP_API void FillOctant(i8 value, u8 octant, i8* outBrick);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "CommonTypedefs.h"
+#include "Core.h"
+#include "TerrainDefs.h"
+
+/// <summary>
+/// A small LZ77 codec for BASE_CELL_SIZE^3 voxel bricks, for bricks on disk where VoxelBrickCompression's forms don't fit.
+/// Those can't take advantage of a brick repeating itself, a gently sloping surface gives rows and layers that are the
+/// same as ones a little way back, or the same shifted along by a voxel.
+///
+/// The compressed form is a sequence of
+///		- a token byte, the number of literals in the high nibble and the match length - 4 in the low.
+///		  a nibble of 15 is followed by bytes added on to it, up to and including the first that isn't 255
+///		- the literals
+///		- a u16 offset back into the brick to copy the match from, and the extra match length bytes.
+///		  the last sequence stops after its literals
+/// </summary>
+namespace VoxelBrickLZ
+{
+	// returns the compressed size, or 0 if it would be more than maxSizeBytes
+	APP_API size_t Compress(const i8* brick, u8* out, size_t maxSizeBytes);
+
+	// returns false if compressed isn't a whole brick's worth of valid sequences
+	APP_API bool Decompress(const u8* compressed, size_t sizeBytes, i8* outBrick);
+}
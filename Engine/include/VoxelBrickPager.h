@@ -0,0 +1,63 @@
+#pragma once
+#include "CommonTypedefs.h"
+#include "Core.h"
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+/// <summary>
+/// Backing file for bricks evicted from memory by SparseTerrainVoxelOctree::EnforceBrickBudget.
+/// The file is a run of fixed size slots, one brick each, raw or VoxelBrickCompression compressed.
+/// Freed slots are reused by later writes, the file never shrinks while it's open.
+///
+/// Reads and writes can come from any thread, they're serialised by a mutex - faults are expected to be rare
+/// enough that this isn't worth avoiding.
+/// </summary>
+class APP_API VoxelBrickPager
+{
+public:
+	static const u32 INVALID_SLOT = 0xffffffff;
+
+	VoxelBrickPager();
+	~VoxelBrickPager();
+	VoxelBrickPager(const VoxelBrickPager&) = delete;
+	VoxelBrickPager& operator=(const VoxelBrickPager&) = delete;
+
+	// create the backing file, replacing anything already at path. returns false if it can't be opened
+	bool Open(const char* path);
+
+	void Close();
+
+	bool IsOpen() const { return File.is_open(); }
+
+	// store a brick of up to a slot's worth of bytes, returns its slot or INVALID_SLOT if the write failed
+	u32 WriteSlot(const void* data, u32 sizeBytes, bool bCompressed);
+
+	// read a slot back into outData, which must have room for a slot. returns the number of bytes read, 0 on failure
+	u32 ReadSlot(u32 slot, void* outData, bool& outCompressed) const;
+
+	void FreeSlot(u32 slot);
+
+	// forget every slot, for when the octree is cleared
+	void FreeAllSlots();
+
+	u32 GetNumSlotsInUse() const;
+
+	u64 GetFileSizeBytes() const;
+
+private:
+	struct Slot
+	{
+		u32 SizeBytes; // 0 when the slot is free
+		bool bCompressed;
+	};
+
+private:
+	mutable std::fstream File;
+
+	mutable std::mutex Mtx;
+
+	std::vector<Slot> Slots;
+
+	std::vector<u32> FreeSlots;
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include "CommonTypedefs.h"
+#include "Core.h"
+#include "TerrainDefs.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/// <summary>
+/// The marching cubes case of every cell of a block gathered by IVoxelDataSource::GetVoxelsForNode, and which cells
+/// the surface goes through, worked out from the sign bits of a lattice row at a time before the polygonizer visits any cell.
+///
+/// Cell (i, j, k) has its bottom left corner at lattice point (i, j, k), and its case has bit c set if corner c is
+/// negative - corners in the order (i,j,k), (i+1,j,k), (i,j+1,k), (i+1,j+1,k), then the same four at k + 1.
+/// </summary>
+namespace VoxelCellCases
+{
+	struct CellCases
+	{
+		// bit i of row j + BASE_CELL_SIZE * k is set if cell (i, j, k) isn't case 0 or 255, so has some surface in it
+		u16 OccupiedCells[BASE_CELL_SIZE * BASE_CELL_SIZE];
+
+		// case of cell (i, j, k) at i + BASE_CELL_SIZE * j + BASE_DECK_SIZE * k
+		u8 Cases[BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE];
+	};
+
+	// uses SSE2 where it's available, otherwise the same as Build_Scalar.
+	// field is a TOTAL_CELL_VOLUME_SIZE block with its gutters. returns how many cells have some surface in them
+	APP_API u32 Build(const i8* field, CellCases& outCases);
+
+	APP_API u32 Build_Scalar(const i8* field, CellCases& outCases);
+
+	// index of the lowest set bit, bits must not be 0
+	inline u32 LowestSetBit(u32 bits)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, bits);
+		return (u32)index;
+#else
+		return (u32)__builtin_ctz(bits);
+#endif
+	}
+
+	inline bool IsDeckOccupied(const CellCases& cases, u32 k)
+	{
+		const u16* rows = cases.OccupiedCells + BASE_CELL_SIZE * k;
+		u16 any = 0;
+		for (u32 j = 0; j < BASE_CELL_SIZE; j++)
+		{
+			any |= rows[j];
+		}
+		return any != 0;
+	}
+}
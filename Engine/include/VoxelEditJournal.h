@@ -0,0 +1,88 @@
+#pragma once
+#include "CommonTypedefs.h"
+#include "Core.h"
+#include "VoxelRegionFile.h"
+#include <glm.hpp>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class IVoxelDataSource;
+
+/// <summary>
+/// The bricks edited since a VoxelRegionFile was saved, appended to a file a checkpoint at a time so that saving
+/// only costs as much as what's changed - see SparseTerrainVoxelOctree::TakeDirtyBricks. Loading is the region file
+/// then Replay, and CompactInto folds the journal into the region file to stop it growing forever.
+///
+/// The file is a journal header, then each checkpoint's header, directory and bricks, encoded the same as a region file's.
+/// A checkpoint that was only partly written when the game stopped is cut off when the journal is next opened.
+/// Can be used from several threads at once
+/// </summary>
+class APP_API VoxelEditJournal
+{
+public:
+	// open the journal at path, starting an empty one if there isn't one. returns false if it can't be opened
+	// or is a journal for a different sized volume
+	bool Open(const char* path, u32 sizeVoxels);
+
+	void Close();
+
+	bool IsOpen() const;
+
+	u32 GetNumCheckpoints() const;
+
+	u64 GetSizeBytes() const;
+
+	// read the bricks with these bottom left corners from source and add them to the end of the journal in one go.
+	// must not be called while anything is writing to source. returns false if the checkpoint couldn't be written,
+	// or source couldn't read one of the bricks - nothing is added then
+	bool AppendCheckpoint(IVoxelDataSource* source, const std::vector<glm::ivec3>& brickBottomLefts);
+
+	// FillBrick every brick in the journal into destination, oldest checkpoint first. returns how many were filled
+	u32 Replay(IVoxelDataSource* destination);
+
+	// rewrite the region file at regionFilePath with the bricks in the journal in place of its own and empty the journal,
+	// apart from checkpoints appended while this was running. If there's no region file there one is made from the
+	// journal alone. The region file is written to a temporary file and moved over the old one, so it's never left half
+	// written. returns false if it can't be done, in which case loading the region file and replaying the journal still
+	// gets every brick back
+	bool CompactInto(const char* regionFilePath);
+
+	// CompactInto on another thread, appending and replaying can carry on while it runs.
+	// the journal must outlive the future
+	std::future<bool> CompactIntoAsync(const char* regionFilePath);
+
+private:
+	struct CheckpointInfo
+	{
+		u64 Offset; // of the checkpoint's header
+		u64 SizeBytes; // of its directory and bricks
+		u32 NumBricks;
+	};
+
+	// read checkpoints, which are one after another in the journal at path, into outData.
+	// each one's header is at outData + its Offset - checkpoints.front().Offset
+	static bool ReadCheckpoints(const std::string& path, const std::vector<CheckpointInfo>& checkpoints, std::vector<u8>& outData);
+
+	// replace the journal with one without its first numDropped checkpoints. called with Mutex held
+	bool DropCheckpoints(size_t numDropped);
+
+	// guards everything but CompactionMutex
+	mutable std::mutex Mutex;
+
+	// one compaction at a time
+	std::mutex CompactionMutex;
+
+	std::string Path;
+
+	// appends go through this, reads open their own stream
+	std::ofstream File;
+
+	std::vector<CheckpointInfo> Checkpoints;
+
+	u64 SizeBytes = 0;
+
+	u32 SizeVoxels = 0;
+};
@@ -0,0 +1,126 @@
+#pragma once
+#include "CommonTypedefs.h"
+#include "Core.h"
+#include <glm.hpp>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+class IVoxelDataSource;
+namespace rdx { class thread_pool; }
+
+/// <summary>
+/// Bricks of a voxel volume saved to disk, each in whichever BrickCodec is smallest for it, with a directory of them
+/// sorted by the morton code of the brick's position. Opening the file only reads the directory, so a single brick or
+/// a region can be loaded without reading the rest, and the bricks of a region are mostly next to each other in the file.
+///
+/// The file is a RegionFileHeader, then the brick data in directory order, each starting on a multiple of
+/// REGION_FILE_BRICK_ALIGNMENT, then the directory. In morton order the bricks of each subtree of the octree are
+/// next to each other, so Write and LoadAll can hand a thread pool a subtree at a time.
+/// Not safe to read from on more than one thread at a time, apart from LoadAll's own threads
+/// </summary>
+class APP_API VoxelRegionFile
+{
+public:
+	enum class BrickCodec : u8
+	{
+		Uniform,	// every voxel is UniformValue, there's no data
+		Raw,
+		Compressed,	// VoxelBrickCompression
+		LZ			// VoxelBrickLZ
+	};
+
+	struct DirectoryEntry
+	{
+		u64 MortonCode; // of the brick's bottom left corner / BASE_CELL_SIZE
+		u64 Offset;
+		u32 SizeBytes;
+		BrickCodec Codec;
+		i8 UniformValue;
+		u16 Padding;
+	};
+
+	// read the bricks with these bottom left corners from source and write them to path. returns false if the file can't be written,
+	// or if source can't read one of the bricks.
+	// given a thread pool, subtrees are read and encoded on its workers and written in order as they're done -
+	// the file is the same either way. must not be called from one of threadPool's workers
+	static bool Write(const char* path, IVoxelDataSource* source, const std::vector<glm::ivec3>& brickBottomLefts, rdx::thread_pool* threadPool = nullptr);
+
+	// write bricks that are already encoded, in directory's order, which must be sorted by MortonCode with no repeats.
+	// readBrick(i, out) writes the SizeBytes of directory[i]'s brick to out and returns false if it can't, which stops
+	// the write. directory's Offsets are set to where the bricks are put. returns false if the file can't be written
+	static bool WriteEncoded(const char* path, u32 sizeVoxels, std::vector<DirectoryEntry>& directory, const std::function<bool(size_t, u8*)>& readBrick);
+
+	// read the header and directory. returns false if the file can't be read or isn't a region file
+	bool Open(const char* path);
+
+	void Close();
+
+	bool IsOpen() const { return File.is_open(); }
+
+	// of the volume the bricks were saved from
+	u32 GetSizeVoxels() const { return SizeVoxels; }
+
+	const std::vector<DirectoryEntry>& GetDirectory() const { return Directory; }
+
+	// nullptr if the file doesn't have the brick
+	const DirectoryEntry* FindBrick(const glm::ivec3& brickBottomLeft) const;
+
+	// returns false if the file doesn't have the brick or it can't be read
+	bool ReadBrick(const glm::ivec3& brickBottomLeft, i8* outVoxels);
+
+	// the brick as it's stored in the file, SizeBytes of it, to be copied somewhere else without decoding it
+	bool ReadEncodedBrick(const DirectoryEntry& entry, u8* out);
+
+	// FillBrick every brick in the file that overlaps [min, max] into destination. returns how many were filled
+	u32 LoadRegion(IVoxelDataSource* destination, const glm::ivec3& min, const glm::ivec3& max);
+
+	// FillBrick every brick in the file into destination, reading each subtree's bricks in one go. returns how many were filled.
+	// given a thread pool, subtrees are read, decoded and filled on its workers, each reading the file through its own stream.
+	// must not be called from one of threadPool's workers
+	u32 LoadAll(IVoxelDataSource* destination, rdx::thread_pool* threadPool = nullptr);
+
+	static glm::ivec3 GetBrickBottomLeft(const DirectoryEntry& entry);
+
+	// pick the smallest codec for a brick and fill in the entry for it, out must have room for a raw brick.
+	// returns the size of what's written to out
+	static u32 EncodeBrick(const i8* voxels, DirectoryEntry& outEntry, u8* out);
+
+	// data is SizeBytes of the entry's brick. returns false if it doesn't decode to a whole brick
+	static bool DecodeBrick(const DirectoryEntry& entry, const u8* data, i8* outVoxels);
+
+private:
+	bool ReadEntry(const DirectoryEntry& entry, i8* outVoxels);
+
+	// the header, with no DirectoryOffset until FinishWriting fills it in
+	static bool BeginWriting(std::ofstream& ofs, const char* path, u32 sizeVoxels, u32 numBricks);
+
+	// write the directory after the bricks, which end at directoryOffset, and fill in the header
+	static bool FinishWriting(std::ofstream& ofs, const char* path, u32 sizeVoxels, const std::vector<DirectoryEntry>& directory, u64 directoryOffset);
+
+	// how many levels below the root to split a volume into subtrees so that there's at least minSubtrees of them,
+	// 0 if it's too small to split
+	static u32 GetPartitionDepth(u32 sizeVoxels, size_t minSubtrees);
+
+	// [first, last) ranges of directory, one per subtree depth levels below the root that has any bricks
+	static std::vector<std::pair<size_t, size_t>> PartitionBySubtree(const std::vector<DirectoryEntry>& directory, u32 sizeVoxels, u32 depth);
+
+	// read and encode the bricks of entries, setting their Offsets relative to the start of outData.
+	// returns false if any of them couldn't be read from source
+	static bool EncodePartition(IVoxelDataSource* source, DirectoryEntry* entries, size_t numEntries, std::vector<u8>& outData);
+
+	// FillBrick the directory's [first, last) bricks, reading them from file in one go
+	u32 LoadPartition(std::istream& file, IVoxelDataSource* destination, size_t first, size_t last) const;
+
+	std::string Path;
+
+	std::ifstream File;
+
+	std::vector<DirectoryEntry> Directory;
+
+	// where the brick data ends and the directory starts
+	u64 DirectoryOffset = 0;
+
+	u32 SizeVoxels = 0;
+};
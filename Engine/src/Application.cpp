@@ -4,6 +4,7 @@
 #include "Gizmos.h"
 
 #include <iostream>
+#include <fstream>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
@@ -17,6 +18,7 @@
 #include "TerrainLight.h"
 #include "TestProceduralTerrainVoxelPopulator.h"
 #include "ThreadPool.h"
+#include "VoxelEditJournal.h"
 #include <memory>
 
 #include "tinyxml2.h"
@@ -187,6 +189,8 @@ TerrainMaterial material;
 
 TerrainLight light;
 bool bRefreshChunks = true;
+bool bPageBricks = false;
+int BrickBudgetMB = 256;
 
 
 void Application::DrawGrid()
@@ -238,6 +242,14 @@ void Application::Run()
 	SparseTerrainVoxelOctree sparse(&allocator, &polygonizer, &renderer, 2048, 126, -127, &pop);
 	sOctree = &sparse;
 
+	// the populator has just saved the world as generated to level.vox, edits since then are checkpointed to the journal.
+	// an old journal was for the old level.vox
+	sparse.TakeDirtyBricks();
+	std::remove("level.voxj");
+	VoxelEditJournal journal;
+	journal.Open("level.voxj", (u32)sparse.GetSize());
+	std::future<bool> compaction;
+
 	ImGuiIO& io = ImGui::GetIO();
 	std::vector<ITerrainOctreeNode*> outNodes;
 	glm::mat4 identity(1.0f);
@@ -300,6 +312,55 @@ void Application::Run()
 				ImGui::Checkbox("DebugVoxels", &bDebugVoxels);
 				ImGui::Checkbox("Refresh chunks", &bRefreshChunks);
 				ImGui::Checkbox("Exact fit", &polygonizer.bExactFit);
+				ImGui::Checkbox("Compact vertices", &polygonizer.bCompactVertices);
+				ImGui::Checkbox("Compress bricks", &sparse.bCompressBricks);
+				ImGui::Checkbox("Prefiltered mips", &sparse.bUsePrefilteredMips);
+				ImGui::Checkbox("Flat traversal", &sparse.bUseFlatTraversal);
+				if (ImGui::Button("Save statistics"))
+				{
+					TerrainOctreeStatistics statistics;
+					sparse.GetStatistics(statistics, threadPool.get());
+					std::ofstream("TerrainStatistics.json") << statistics.ToJson();
+					std::cout << "terrain pools hold " << statistics.GetTotalPoolBytes() << " bytes, written to TerrainStatistics.json\n";
+				}
+				if (ImGui::Button("Save world"))
+				{
+					sparse.SaveMappedWorld("TerrainWorld.vxw");
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Load world"))
+				{
+					// the nodes drawn last frame are about to be freed
+					outNodes.clear();
+					sparse.LoadMappedWorld("TerrainWorld.vxw");
+				}
+				if (ImGui::Button("Checkpoint edits"))
+				{
+					journal.AppendCheckpoint(&sparse, sparse.TakeDirtyBricks());
+				}
+				ImGui::SameLine();
+				bool bCompacting = compaction.valid() && compaction.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+				if (ImGui::Button(bCompacting ? "Compacting..." : "Compact journal") && !bCompacting)
+				{
+					compaction = journal.CompactIntoAsync("level.vox");
+				}
+				if (ImGui::Checkbox("Page bricks to disk", &bPageBricks))
+				{
+					if (bPageBricks)
+					{
+						bPageBricks = sparse.EnablePaging("TerrainBricks.page", (size_t)BrickBudgetMB * 1024 * 1024);
+					}
+					else
+					{
+						sparse.DisablePaging();
+					}
+				}
+				if (ImGui::SliderInt("Brick budget MB", &BrickBudgetMB, 1, 4096))
+				{
+					sparse.BrickBudgetBytes = (size_t)BrickBudgetMB * 1024 * 1024;
+				}
+				ImGui::Text("resident bricks %zu KB, %llu faults, %llu evictions", sparse.GetResidentBrickBytes() / 1024,
+					(unsigned long long)sparse.GetNumBrickFaults(), (unsigned long long)sparse.GetNumBrickEvictions());
 				if (bDebugVoxels)
 				{
 					DrawBoxAroundSelectedVoxel();
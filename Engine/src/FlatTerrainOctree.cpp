@@ -0,0 +1,76 @@
+#include "FlatTerrainOctree.h"
+#include "ITerrainOctreeNode.h"
+
+void FlatTerrainOctree::Build(ITerrainOctreeNode* root)
+{
+	Clear();
+	// breadth first, so each node's children are appended together
+	TreeNodes.push_back(root);
+	for (u32 onNode = 0; onNode < TreeNodes.size(); onNode++)
+	{
+		ITerrainOctreeNode* node = TreeNodes[onNode];
+		const glm::ivec3& bottomLeft = node->GetBottomLeftCorner();
+		BottomLeftX.push_back(bottomLeft.x);
+		BottomLeftY.push_back(bottomLeft.y);
+		BottomLeftZ.push_back(bottomLeft.z);
+		MipLevel.push_back((u8)node->GetMipLevel());
+		FirstChild.push_back((u32)TreeNodes.size());
+		u8 mask = 0;
+		if (node->GetMipLevel() != 0)
+		{
+			for (u8 i = 0; i < 8; i++)
+			{
+				if (ITerrainOctreeNode* child = node->GetChild(i))
+				{
+					mask |= 1 << i;
+					TreeNodes.push_back(child);
+				}
+			}
+		}
+		ChildMask.push_back(mask);
+	}
+}
+
+void FlatTerrainOctree::Clear()
+{
+	FirstChild.clear();
+	ChildMask.clear();
+	MipLevel.clear();
+	BottomLeftX.clear();
+	BottomLeftY.clear();
+	BottomLeftZ.clear();
+	TreeNodes.clear();
+}
+
+u32 FlatTerrainOctree::FindNodeContainingPoint(const glm::ivec3& point) const
+{
+	u32 onNode = GetRoot();
+	if (onNode == INVALID_NODE)
+	{
+		return INVALID_NODE;
+	}
+	glm::ivec3 relative = point - GetBottomLeftCorner(onNode);
+	u32 size = GetSizeInVoxels(onNode);
+	if ((u32)relative.x >= size || (u32)relative.y >= size || (u32)relative.z >= size)
+	{
+		return INVALID_NODE;
+	}
+	while (ChildMask[onNode])
+	{
+		u32 halfSize = GetSizeInVoxels(onNode) / 2;
+		glm::ivec3 local = point - GetBottomLeftCorner(onNode);
+		u8 childIndex = (u8)(((u32)local.x >= halfSize) | (((u32)local.y >= halfSize) << 1) | (((u32)local.z >= halfSize) << 2));
+		u32 child = GetChild(onNode, childIndex);
+		if (child == INVALID_NODE)
+		{
+			break;
+		}
+		onNode = child;
+	}
+	return onNode;
+}
+
+size_t FlatTerrainOctree::GetTraversalBytes() const
+{
+	return GetNumNodes() * (sizeof(u32) + sizeof(u8) * 2 + sizeof(i32) * 3);
+}
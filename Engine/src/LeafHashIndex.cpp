@@ -0,0 +1,179 @@
+#include "LeafHashIndex.h"
+#include "IAllocator.h"
+#include <cassert>
+#include <new>
+
+// no valid morton code has its top bit set, they're at most 63 bits
+#define EMPTY_KEY 0xffffffffffffffffull
+
+LeafHashIndex::LeafHashIndex(IAllocator* allocator, u32 initialCapacityLog2)
+	:Allocator(allocator),
+	CurrentTable(nullptr),
+	InitialCapacityLog2(initialCapacityLog2)
+{
+	CurrentTable = AllocateTable(InitialCapacityLog2);
+}
+
+LeafHashIndex::~LeafHashIndex()
+{
+	Clear();
+	FreeTable(CurrentTable.load());
+}
+
+ITerrainOctreeNode* LeafHashIndex::Find(u64 mortonCode) const
+{
+	const Table* table = CurrentTable.load(std::memory_order_acquire);
+	u64 mask = (1ull << table->CapacityLog2) - 1;
+	for (u64 slot = GetSlot(mortonCode, table->CapacityLog2);; slot = (slot + 1) & mask)
+	{
+		const Entry& entry = table->Entries[slot];
+		u64 key = entry.Key.load(std::memory_order_acquire);
+		if (key == mortonCode)
+		{
+			return entry.Value.load(std::memory_order_relaxed);
+		}
+		if (key == EMPTY_KEY)
+		{
+			return nullptr;
+		}
+	}
+}
+
+void LeafHashIndex::Insert(u64 mortonCode, ITerrainOctreeNode* leaf)
+{
+	assert(mortonCode != EMPTY_KEY);
+	std::lock_guard<std::mutex> lock(InsertMutex);
+	Table* table = CurrentTable.load(std::memory_order_relaxed);
+	// keep it at most half full so probes stay short
+	if ((NumLeaves + 1) * 2 > (1ull << table->CapacityLog2))
+	{
+		Grow();
+		table = CurrentTable.load(std::memory_order_relaxed);
+	}
+	u64 mask = (1ull << table->CapacityLog2) - 1;
+	for (u64 slot = GetSlot(mortonCode, table->CapacityLog2);; slot = (slot + 1) & mask)
+	{
+		Entry& entry = table->Entries[slot];
+		u64 key = entry.Key.load(std::memory_order_relaxed);
+		if (key == mortonCode)
+		{
+			entry.Value.store(leaf, std::memory_order_relaxed);
+			return;
+		}
+		if (key == EMPTY_KEY)
+		{
+			// value first so a reader that sees the key sees the value
+			entry.Value.store(leaf, std::memory_order_relaxed);
+			entry.Key.store(mortonCode, std::memory_order_release);
+			NumLeaves++;
+			return;
+		}
+	}
+}
+
+void LeafHashIndex::Remove(u64 mortonCode)
+{
+	std::lock_guard<std::mutex> lock(InsertMutex);
+	Table* table = CurrentTable.load(std::memory_order_relaxed);
+	u64 mask = (1ull << table->CapacityLog2) - 1;
+	u64 slot = GetSlot(mortonCode, table->CapacityLog2);
+	while (table->Entries[slot].Key.load(std::memory_order_relaxed) != mortonCode)
+	{
+		if (table->Entries[slot].Key.load(std::memory_order_relaxed) == EMPTY_KEY)
+		{
+			return;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	// backward shift deletion - pull later entries of the probe sequence into the gap so no tombstones are needed
+	u64 gap = slot;
+	for (u64 next = (gap + 1) & mask;; next = (next + 1) & mask)
+	{
+		u64 key = table->Entries[next].Key.load(std::memory_order_relaxed);
+		if (key == EMPTY_KEY)
+		{
+			break;
+		}
+		u64 home = GetSlot(key, table->CapacityLog2);
+		// can the entry at next move back to gap without ending up before its home slot
+		if (((next - home) & mask) >= ((next - gap) & mask))
+		{
+			table->Entries[gap].Key.store(key, std::memory_order_relaxed);
+			table->Entries[gap].Value.store(table->Entries[next].Value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			gap = next;
+		}
+	}
+	table->Entries[gap].Key.store(EMPTY_KEY, std::memory_order_relaxed);
+	table->Entries[gap].Value.store(nullptr, std::memory_order_relaxed);
+	NumLeaves--;
+}
+
+void LeafHashIndex::Clear()
+{
+	std::lock_guard<std::mutex> lock(InsertMutex);
+	for (Table* table : RetiredTables)
+	{
+		FreeTable(table);
+	}
+	RetiredTables.clear();
+	Table* table = CurrentTable.load(std::memory_order_relaxed);
+	if (table->CapacityLog2 != InitialCapacityLog2)
+	{
+		FreeTable(table);
+		CurrentTable = AllocateTable(InitialCapacityLog2);
+	}
+	else
+	{
+		for (u64 i = 0; i < (1ull << table->CapacityLog2); i++)
+		{
+			table->Entries[i].Key.store(EMPTY_KEY, std::memory_order_relaxed);
+			table->Entries[i].Value.store(nullptr, std::memory_order_relaxed);
+		}
+	}
+	NumLeaves = 0;
+}
+
+LeafHashIndex::Table* LeafHashIndex::AllocateTable(u32 capacityLog2)
+{
+	Table* table = IAllocator::New<Table>(Allocator);
+	table->CapacityLog2 = capacityLog2;
+	table->Entries = IAllocator::NewArray<Entry>(Allocator, 1ull << capacityLog2);
+	for (u64 i = 0; i < (1ull << capacityLog2); i++)
+	{
+		new(&table->Entries[i].Key) std::atomic<u64>(EMPTY_KEY);
+		new(&table->Entries[i].Value) std::atomic<ITerrainOctreeNode*>(nullptr);
+	}
+	return table;
+}
+
+void LeafHashIndex::FreeTable(Table* table)
+{
+	Allocator->Free(table->Entries);
+	Allocator->Free(table);
+}
+
+void LeafHashIndex::Grow()
+{
+	// called with InsertMutex held
+	Table* oldTable = CurrentTable.load(std::memory_order_relaxed);
+	Table* newTable = AllocateTable(oldTable->CapacityLog2 + 1);
+	u64 mask = (1ull << newTable->CapacityLog2) - 1;
+	for (u64 i = 0; i < (1ull << oldTable->CapacityLog2); i++)
+	{
+		u64 key = oldTable->Entries[i].Key.load(std::memory_order_relaxed);
+		if (key == EMPTY_KEY)
+		{
+			continue;
+		}
+		u64 slot = GetSlot(key, newTable->CapacityLog2);
+		while (newTable->Entries[slot].Key.load(std::memory_order_relaxed) != EMPTY_KEY)
+		{
+			slot = (slot + 1) & mask;
+		}
+		newTable->Entries[slot].Key.store(key, std::memory_order_relaxed);
+		newTable->Entries[slot].Value.store(oldTable->Entries[i].Value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+	CurrentTable.store(newTable, std::memory_order_release);
+	RetiredTables.push_back(oldTable);
+}
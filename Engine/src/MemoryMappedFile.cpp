@@ -0,0 +1,131 @@
+#include "MemoryMappedFile.h"
+#include <iostream>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MemoryMappedFile::MemoryMappedFile()
+{
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+	Close();
+}
+
+MemoryMappedFile::MemoryMappedFile(MemoryMappedFile&& other) noexcept
+	:Data(other.Data),
+	Size(other.Size)
+{
+	other.Data = nullptr;
+	other.Size = 0;
+}
+
+MemoryMappedFile& MemoryMappedFile::operator=(MemoryMappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		std::swap(Data, other.Data);
+		std::swap(Size, other.Size);
+	}
+	return *this;
+}
+
+#ifdef _WIN32
+
+bool MemoryMappedFile::Open(const char* path)
+{
+	Close();
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "Cannot open file " << path << "\n";
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	// the view keeps the mapping and the file open, the handles aren't needed once it's made
+	CloseHandle(file);
+	if (!mapping)
+	{
+		std::cout << "Cannot map file " << path << "\n";
+		return false;
+	}
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!view)
+	{
+		std::cout << "Cannot map file " << path << "\n";
+		return false;
+	}
+	Data = (const u8*)view;
+	Size = (size_t)size.QuadPart;
+	return true;
+}
+
+void MemoryMappedFile::Close()
+{
+	if (Data)
+	{
+		UnmapViewOfFile(Data);
+		Data = nullptr;
+		Size = 0;
+	}
+}
+
+#else
+
+bool MemoryMappedFile::Open(const char* path)
+{
+	Close();
+	int file = open(path, O_RDONLY);
+	if (file < 0)
+	{
+		std::cout << "Cannot open file " << path << "\n";
+		return false;
+	}
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0)
+	{
+		close(file);
+		return false;
+	}
+	void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, file, 0);
+	// the mapping keeps the file open
+	close(file);
+	if (view == MAP_FAILED)
+	{
+		std::cout << "Cannot map file " << path << "\n";
+		return false;
+	}
+	Data = (const u8*)view;
+	Size = (size_t)info.st_size;
+	return true;
+}
+
+void MemoryMappedFile::Close()
+{
+	if (Data)
+	{
+		munmap(const_cast<u8*>(Data), Size);
+		Data = nullptr;
+		Size = 0;
+	}
+}
+
+#endif
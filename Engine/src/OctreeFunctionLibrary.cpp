@@ -46,3 +46,31 @@ u32 OctreeFunctionLibrary::GetMipLevel(i32 cellVoxelsWidth)
 	}
 	return mipLevel;
 }
+
+glm::ivec3 OctreeFunctionLibrary::GetBottomLeftCornerFromIndex(TerrainOctreeIndex index, u32 rootSizeInVoxels)
+{
+	u32 rootMipLevel = GetMipLevel(rootSizeInVoxels);
+	glm::ivec3 bottomLeft = { 0,0,0 };
+	for (u32 i = 0; i < rootMipLevel; i++)
+	{
+		u32 childIndex = (index >> (4 * i)) & 0x0f;
+		i32 childDims = rootSizeInVoxels >> (i + 1);
+		bottomLeft.x += (childIndex & 1) * childDims;
+		bottomLeft.y += ((childIndex >> 1) & 1) * childDims;
+		bottomLeft.z += ((childIndex >> 2) & 1) * childDims;
+	}
+	return bottomLeft;
+}
+
+TerrainOctreeIndex OctreeFunctionLibrary::GetIndexOfLeafContainingPoint(const glm::ivec3& point, u32 rootSizeInVoxels)
+{
+	TerrainOctreeIndex index = 0;
+	u32 i = 0;
+	for (u32 childDims = rootSizeInVoxels / 2; childDims >= BASE_CELL_SIZE; childDims /= 2, i++)
+	{
+		// the nodes are all aligned to their size so the bit for the child's size picks the half the point is in
+		TerrainOctreeIndex childIndex = ((point.x & childDims) != 0) | (((point.y & childDims) != 0) << 1) | (((point.z & childDims) != 0) << 2);
+		index |= childIndex << (4 * i);
+	}
+	return index;
+}
@@ -3,80 +3,95 @@
 #include "IVoxelDataSource.h"
 #include "CommonTypedefs.h"
 #include "TerrainDefs.h"
+#include "OctreeFunctionLibrary.h"
+#include "VoxelRegionFile.h"
 #include <cassert>
 #include <iostream>
 #include <fstream>
 
 namespace OctreeSerialisation
 {
-#define CURRENT_FILE_FORMAT_VERSION 0
+// files from before VoxelRegionFile, a header and then an index and raw brick for each leaf
+#define LEGACY_FILE_FORMAT_VERSION 0
 	struct VoxelFileHeader
 	{
 		u32 Version;
 		u32 NumNodes;
 	};
 
-	void WriteHeader(std::ofstream& ofs, const std::unordered_set<TerrainOctreeIndex>& setNodes, IVoxelDataSource* voxelDataSource)
+	void SaveNewlyGeneratedToFile(const std::unordered_set<TerrainOctreeIndex>& setNodes, IVoxelDataSource* voxelDataSource, const char* path, rdx::thread_pool* threadPool)
 	{
-		VoxelFileHeader header;
-		header.Version = CURRENT_FILE_FORMAT_VERSION;
-		header.NumNodes = setNodes.size();
-		ofs.write((char*)&header, sizeof(VoxelFileHeader));
-	}
-
-#pragma optimize("", off)
-
-	void WriteNode(std::ofstream& ofs, TerrainOctreeIndex index, ITerrainOctreeNode* node)
-	{
-		ofs.write((char*)&index, sizeof(TerrainOctreeIndex));
-		ofs.write((const char*)node->GetVoxelData(), BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE);
-	}
-
-	void SaveNewlyGeneratedToFile(const std::unordered_set<TerrainOctreeIndex>& setNodes, IVoxelDataSource* voxelDataSource, const char* path)
-	{
-		std::ofstream ofs(path, std::ios::out | std::ofstream::binary);
-		if(!ofs)
-		{
-			std::cout << "Cannot open file.\n";
-			return;
-		}
-		WriteHeader(ofs, setNodes, voxelDataSource);
+		// the leaf might not have raw voxel data of its own - it could be compressed, all one value,
+		// or collapsed into an ancestor - so VoxelRegionFile reads it back through the data source
+		std::vector<glm::ivec3> bricks;
+		bricks.reserve(setNodes.size());
 		for (TerrainOctreeIndex index : setNodes)
 		{
-			ITerrainOctreeNode* node = voxelDataSource->FindNodeFromIndex(index);
-			assert(node->GetMipLevel() == 0);
-			assert(node->GetVoxelData());
-			WriteNode(ofs, index, node);
+			bricks.push_back(OctreeFunctionLibrary::GetBottomLeftCornerFromIndex(index, voxelDataSource->GetSize()));
 		}
+		VoxelRegionFile::Write(path, voxelDataSource, bricks, threadPool);
 	}
-#pragma optimize("", on)
 
 	void ReadHeader(std::ifstream& ifs, VoxelFileHeader& header)
 	{
 		ifs.read((char*)&header, sizeof(VoxelFileHeader));
 	}
 
-	void LoadFromFile(IVoxelDataSource* voxelDataSource, const char* path)
+	static void LoadFromLegacyFile(IVoxelDataSource* voxelDataSource, const char* path)
 	{
 		std::ifstream ifs(path, std::ios::in | std::ofstream::binary);
 		VoxelFileHeader header;
 		ReadHeader(ifs, header);
-		if (header.Version != CURRENT_FILE_FORMAT_VERSION)
-		{
-			std::cout << "Trying to read a voxel file with an incorrect version\n";
-		}
 
-		std::vector<i8> debug(BASE_CELL_SIZE*BASE_CELL_SIZE*BASE_CELL_SIZE);
-		for (int i = 0; i < header.NumNodes; i++)
+		std::vector<i8> brick(BASE_CELL_SIZE*BASE_CELL_SIZE*BASE_CELL_SIZE);
+		for (u32 i = 0; i < header.NumNodes; i++)
 		{
 			TerrainOctreeIndex index;
 			ifs.read((char*)&index, sizeof(TerrainOctreeIndex));
- 			ITerrainOctreeNode* node = voxelDataSource->FindNodeFromIndex(index, true);
-			assert(node);
-			assert(node->GetMipLevel() == 0);
-			voxelDataSource->AllocateNodeVoxelData(node);
-			ifs.read((char*)debug.data(), BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE);
-			memcpy(node->GetVoxelData(), debug.data(), BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE);
+			if (!ifs.read((char*)brick.data(), BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE))
+			{
+				std::cout << "Voxel file " << path << " is truncated\n";
+				break;
+			}
+			voxelDataSource->FillBrick(OctreeFunctionLibrary::GetBottomLeftCornerFromIndex(index, voxelDataSource->GetSize()), brick.data());
+		}
+	}
+
+	void LoadFromFile(IVoxelDataSource* voxelDataSource, const char* path, rdx::thread_pool* threadPool)
+	{
+		u32 version = 0xffffffff;
+		{
+			std::ifstream ifs(path, std::ios::in | std::ofstream::binary);
+			ifs.read((char*)&version, sizeof(u32));
+		}
+		if (version == LEGACY_FILE_FORMAT_VERSION)
+		{
+			LoadFromLegacyFile(voxelDataSource, path);
+		}
+		else
+		{
+			VoxelRegionFile file;
+			if (!file.Open(path))
+			{
+				return;
+			}
+			if (file.GetSizeVoxels() != voxelDataSource->GetSize())
+			{
+				std::cout << "Trying to read a voxel file saved from a different sized volume\n";
+				return;
+			}
+			file.LoadAll(voxelDataSource, threadPool);
+		}
+		voxelDataSource->CollapseUniformSubtrees();
+	}
+
+	void LoadRegionFromFile(IVoxelDataSource* voxelDataSource, const char* path, const glm::ivec3& min, const glm::ivec3& max)
+	{
+		VoxelRegionFile file;
+		if (!file.Open(path))
+		{
+			return;
 		}
+		file.LoadRegion(voxelDataSource, min, max);
 	}
 }
\ No newline at end of file
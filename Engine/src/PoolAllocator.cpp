@@ -0,0 +1,206 @@
+#include "PoolAllocator.h"
+#include <cassert>
+#include <algorithm>
+#include <cstddef>
+
+// how many free blocks a thread holds on to before handing half of them back,
+// and how many are taken from the shared list at a time when a thread runs out
+#define THREAD_CACHE_MAX_BLOCKS 64
+#define THREAD_CACHE_REFILL_BLOCKS 32
+
+namespace
+{
+	struct PoolThreadCache
+	{
+		u64 Epoch = 0;
+		void* Head = nullptr;
+		u32 Count = 0;
+	};
+
+	// epoch of each pool holding a cache index, 0 if the index is free
+	std::atomic<u64> sCacheIndexEpochs[POOL_ALLOCATOR_MAX_CACHED_POOLS];
+
+	std::atomic<u64> sNextEpoch = 1;
+
+	thread_local PoolThreadCache tCaches[POOL_ALLOCATOR_MAX_CACHED_POOLS];
+
+	i32 ClaimCacheIndex(u64 epoch)
+	{
+		for (i32 i = 0; i < POOL_ALLOCATOR_MAX_CACHED_POOLS; i++)
+		{
+			u64 expected = 0;
+			if (sCacheIndexEpochs[i].compare_exchange_strong(expected, epoch))
+			{
+				return i;
+			}
+		}
+		return -1;
+	}
+}
+
+PoolAllocator::PoolAllocator(IAllocator* backingAllocator, size_t blockSize, size_t blocksPerSlab)
+	:BackingAllocator(backingAllocator),
+	BlockSize(std::max(blockSize, sizeof(FreeBlock))),
+	BlocksPerSlab(blocksPerSlab),
+	Epoch(sNextEpoch++)
+{
+	// keep every block aligned for anything that might be stored in it
+	BlockSize = (BlockSize + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+	CacheIndex = ClaimCacheIndex(Epoch);
+}
+
+PoolAllocator::~PoolAllocator()
+{
+	ReleaseAll();
+	if (CacheIndex >= 0)
+	{
+		sCacheIndexEpochs[CacheIndex] = 0;
+	}
+}
+
+void* PoolAllocator::Malloc(size_t numBytes)
+{
+	assert(numBytes <= BlockSize);
+	if (CacheIndex < 0)
+	{
+		FreeBlock* block = nullptr;
+		TakeBlocks(1, block);
+		return block;
+	}
+
+	PoolThreadCache& cache = tCaches[CacheIndex];
+	u64 epoch = Epoch.load(std::memory_order_relaxed);
+	if (cache.Epoch != epoch)
+	{
+		// the pool has been released (or this index belongs to a new pool) since this thread last used it
+		cache.Epoch = epoch;
+		cache.Head = nullptr;
+		cache.Count = 0;
+	}
+	if (!cache.Head)
+	{
+		FreeBlock* head = nullptr;
+		cache.Count = TakeBlocks(THREAD_CACHE_REFILL_BLOCKS, head);
+		cache.Head = head;
+	}
+	FreeBlock* block = static_cast<FreeBlock*>(cache.Head);
+	cache.Head = block->Next;
+	--cache.Count;
+	return block;
+}
+
+void PoolAllocator::Free(void* ptr)
+{
+	if (!ptr)
+	{
+		return;
+	}
+	FreeBlock* block = static_cast<FreeBlock*>(ptr);
+	if (CacheIndex < 0)
+	{
+		block->Next = nullptr;
+		ReturnBlocks(block, block);
+		return;
+	}
+
+	PoolThreadCache& cache = tCaches[CacheIndex];
+	u64 epoch = Epoch.load(std::memory_order_relaxed);
+	if (cache.Epoch != epoch)
+	{
+		cache.Epoch = epoch;
+		cache.Head = nullptr;
+		cache.Count = 0;
+	}
+	block->Next = static_cast<FreeBlock*>(cache.Head);
+	cache.Head = block;
+	if (++cache.Count > THREAD_CACHE_MAX_BLOCKS)
+	{
+		// give half back so blocks freed on one thread can be reused by the others
+		FreeBlock* head = static_cast<FreeBlock*>(cache.Head);
+		FreeBlock* tail = head;
+		for (u32 i = 1; i < THREAD_CACHE_MAX_BLOCKS / 2; i++)
+		{
+			tail = tail->Next;
+		}
+		cache.Head = tail->Next;
+		cache.Count -= THREAD_CACHE_MAX_BLOCKS / 2;
+		tail->Next = nullptr;
+		ReturnBlocks(head, tail);
+	}
+}
+
+void* PoolAllocator::Realloc(void* ptr, size_t newSize)
+{
+	if (newSize > BlockSize)
+	{
+		return nullptr;
+	}
+	return ptr ? ptr : Malloc(newSize);
+}
+
+void PoolAllocator::ReleaseAll()
+{
+	std::lock_guard<std::mutex> lock(Mtx);
+	for (u8* slab : Slabs)
+	{
+		BackingAllocator->Free(slab);
+	}
+	Slabs.clear();
+	FreeListHead = nullptr;
+	SlabCursor = nullptr;
+	SlabEnd = nullptr;
+	u64 newEpoch = sNextEpoch++;
+	Epoch = newEpoch;
+	if (CacheIndex >= 0)
+	{
+		sCacheIndexEpochs[CacheIndex] = newEpoch;
+	}
+}
+
+u32 PoolAllocator::TakeBlocks(u32 maxBlocks, FreeBlock*& outHead)
+{
+	std::lock_guard<std::mutex> lock(Mtx);
+	u32 count = 0;
+	FreeBlock* head = nullptr;
+	while (count < maxBlocks && FreeListHead)
+	{
+		FreeBlock* block = FreeListHead;
+		FreeListHead = block->Next;
+		block->Next = head;
+		head = block;
+		++count;
+	}
+	if (!count)
+	{
+		if (SlabCursor == SlabEnd)
+		{
+			AllocateSlab();
+		}
+		while (count < maxBlocks && SlabCursor != SlabEnd)
+		{
+			FreeBlock* block = reinterpret_cast<FreeBlock*>(SlabCursor);
+			SlabCursor += BlockSize;
+			block->Next = head;
+			head = block;
+			++count;
+		}
+	}
+	outHead = head;
+	return count;
+}
+
+void PoolAllocator::ReturnBlocks(FreeBlock* head, FreeBlock* tail)
+{
+	std::lock_guard<std::mutex> lock(Mtx);
+	tail->Next = FreeListHead;
+	FreeListHead = head;
+}
+
+void PoolAllocator::AllocateSlab()
+{
+	u8* slab = IAllocator::NewArray<u8>(BackingAllocator, BlockSize * BlocksPerSlab);
+	assert(slab);
+	Slabs.push_back(slab);
+	SlabCursor = slab;
+	SlabEnd = slab + BlockSize * BlocksPerSlab;
+}
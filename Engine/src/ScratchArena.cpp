@@ -0,0 +1,107 @@
+#include "ScratchArena.h"
+#include <cstddef>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+
+#define SCRATCH_ARENA_ALIGNMENT alignof(std::max_align_t)
+
+// no allocation starts here, so Realloc can't grow in place
+#define SCRATCH_ARENA_NO_LAST_ALLOCATION ((size_t)-1)
+
+ScratchArena::ScratchArena(size_t initialSizeBytes)
+	:LastAllocation(SCRATCH_ARENA_NO_LAST_ALLOCATION)
+{
+	if (initialSizeBytes > 0)
+	{
+		Block = (u8*)malloc(initialSizeBytes);
+		BlockSizeBytes = Block ? initialSizeBytes : 0;
+	}
+}
+
+ScratchArena::~ScratchArena()
+{
+	Reset();
+	free(Block);
+}
+
+void* ScratchArena::Malloc(size_t numBytes)
+{
+	size_t start = (BlockTop + SCRATCH_ARENA_ALIGNMENT - 1) & ~(SCRATCH_ARENA_ALIGNMENT - 1);
+	if (Block && start + numBytes <= BlockSizeBytes)
+	{
+		LastAllocation = start;
+		BlockTop = start + numBytes;
+		return Block + start;
+	}
+
+	// doesn't fit, Reset will make the block big enough for next time
+	void* overflow = malloc(numBytes);
+	if (overflow)
+	{
+		OverflowBlocks.push_back({ overflow, numBytes });
+		OverflowBytes += numBytes + SCRATCH_ARENA_ALIGNMENT;
+	}
+	LastAllocation = SCRATCH_ARENA_NO_LAST_ALLOCATION;
+	return overflow;
+}
+
+void* ScratchArena::Realloc(void* ptr, size_t newSize)
+{
+	if (!ptr)
+	{
+		return Malloc(newSize);
+	}
+	bool bIsLastAllocation = LastAllocation != SCRATCH_ARENA_NO_LAST_ALLOCATION && ptr == Block + LastAllocation;
+	if (bIsLastAllocation && LastAllocation + newSize <= BlockSizeBytes)
+	{
+		BlockTop = LastAllocation + newSize;
+		return ptr;
+	}
+
+	// sizes of allocations in Block aren't kept, but none of them can go past BlockTop
+	size_t oldSize = 0;
+	u8* bytes = (u8*)ptr;
+	if (Block && bytes >= Block && bytes < Block + BlockTop)
+	{
+		oldSize = BlockTop - (bytes - Block);
+	}
+	else
+	{
+		auto overflow = std::find_if(OverflowBlocks.begin(), OverflowBlocks.end(), [ptr](const OverflowBlock& block) { return block.Ptr == ptr; });
+		assert(overflow != OverflowBlocks.end());
+		oldSize = overflow != OverflowBlocks.end() ? overflow->SizeBytes : 0;
+	}
+
+	void* moved = Malloc(newSize);
+	if (moved)
+	{
+		memcpy(moved, ptr, std::min(oldSize, newSize));
+	}
+	return moved;
+}
+
+void ScratchArena::Reset()
+{
+	size_t usedBytes = BlockTop + OverflowBytes;
+	HighWaterMarkBytes = std::max(HighWaterMarkBytes, usedBytes);
+
+	if (!OverflowBlocks.empty())
+	{
+		for (const OverflowBlock& overflow : OverflowBlocks)
+		{
+			free(overflow.Ptr);
+		}
+		OverflowBlocks.clear();
+		OverflowBytes = 0;
+
+		// one block that would have held the whole job
+		free(Block);
+		Block = (u8*)malloc(usedBytes);
+		BlockSizeBytes = Block ? usedBytes : 0;
+	}
+
+	BlockTop = 0;
+	LastAllocation = SCRATCH_ARENA_NO_LAST_ALLOCATION;
+}
@@ -10,35 +10,88 @@
 #include "ITerrainPolygonizer.h"
 #include "ITerrainGraphicsAPIAdaptor.h"
 #include "ITerrainVoxelPopulator.h"
+#include "VoxelBrickCompression.h"
+#include "SparseTerrainVoxelOctreeSnapshot.h"
+#include "ThreadPool.h"
 #include <future>
 #include <new>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
 
 // mute these tests before running as they regularly print the bell character '\a' 
 
+#define NODES_PER_POOL_SLAB 256
+#define BRICKS_PER_POOL_SLAB 64
+#define BRICK_SIZE_BYTES (BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE)
+#define COMPRESSED_BRICKS_PER_POOL_SLAB 128
+#define LEAF_VERSIONS_PER_POOL_SLAB 256
+#define MAX_OCTREE_DEPTH 16 // a TerrainOctreeIndex has a nibble for each level
+#define BRICK_FAULT_READ_ATTEMPTS 3 // before a reader gives up on the page file, see MakeLeafResidentForRead
+
+// key of the leaf containing a point in LeafIndex
+static inline u64 GetLeafMortonCode(const glm::ivec3& location)
+{
+	return OctreeFunctionLibrary::GetMortonCode((u32)location.x / BASE_CELL_SIZE, (u32)location.y / BASE_CELL_SIZE, (u32)location.z / BASE_CELL_SIZE);
+}
+
+static inline void MarkEdited(SparseTerrainVoxelOctree::SparseTerrainOctreeNode* node)
+{
+	node->EditGeneration.fetch_add(1, std::memory_order_release);
+}
+
+// is there a multiple of step in [min, max], min is never negative
+static inline bool RangeContainsMultipleOf(i32 min, i32 max, i32 step)
+{
+	return ((min + step - 1) / step) * step <= max;
+}
+
+// flags on nodes near the root are set by every writing thread - only writing when the flag
+// isn't already set keeps them from fighting over the cache line
+static inline void SetFlag(std::atomic<bool>& flag)
+{
+	if (!flag.load(std::memory_order_relaxed))
+	{
+		flag.store(true, std::memory_order_release);
+	}
+}
+
 SparseTerrainVoxelOctree::SparseTerrainVoxelOctree(IAllocator* allocator, ITerrainPolygonizer* polygonizer, ITerrainGraphicsAPIAdaptor* graphicsAPIAdaptor, u32 sizeVoxels, i8 clampValueHigh, i8 clampValueLow)
 	:Allocator(allocator),
+	NodePool(allocator, sizeof(SparseTerrainOctreeNode), NODES_PER_POOL_SLAB),
+	BrickPool(allocator, BRICK_SIZE_BYTES, BRICKS_PER_POOL_SLAB),
+	CompressedBrickPools{
+		{ allocator, VoxelBrickCompression::GetSizeClassBytes(0), COMPRESSED_BRICKS_PER_POOL_SLAB },
+		{ allocator, VoxelBrickCompression::GetSizeClassBytes(1), COMPRESSED_BRICKS_PER_POOL_SLAB },
+		{ allocator, VoxelBrickCompression::GetSizeClassBytes(2), COMPRESSED_BRICKS_PER_POOL_SLAB },
+		{ allocator, VoxelBrickCompression::GetSizeClassBytes(3), COMPRESSED_BRICKS_PER_POOL_SLAB },
+		{ allocator, VoxelBrickCompression::GetSizeClassBytes(4), COMPRESSED_BRICKS_PER_POOL_SLAB },
+		{ allocator, VoxelBrickCompression::GetSizeClassBytes(5), COMPRESSED_BRICKS_PER_POOL_SLAB } },
+	LeafIndex(allocator),
+	LeafVersionPool(allocator, sizeof(LeafVersion), LEAF_VERSIONS_PER_POOL_SLAB),
 	Polygonizer(polygonizer),
 	GraphicsAPIAdaptor(graphicsAPIAdaptor),
 	ParentNode(OctreeFunctionLibrary::GetMipLevel(sizeVoxels), { 0,0,0 }, sizeVoxels),
-	ParentNodeStack(IAllocator::NewArray<SparseTerrainOctreeNode*>(Allocator, ParentNode.MipLevel + 1)),
 	VoxelClampValueHigh(clampValueHigh),
 	VoxelClampValueLow(clampValueLow),
 	VoxelDefaultValue(clampValueHigh)
 {
-
-
+	assert(ParentNode.MipLevel <= MAX_OCTREE_DEPTH);
+	ParentNode.UniformValue = VoxelDefaultValue;
 }
 
 SparseTerrainVoxelOctree::SparseTerrainVoxelOctree(IAllocator* allocator, ITerrainPolygonizer* polygonizer, ITerrainGraphicsAPIAdaptor* graphicsAPIAdaptor, u32 sizeVoxels, i8 clampValueHigh, i8 clampValueLow, ITerrainVoxelPopulator* populator)
 	:SparseTerrainVoxelOctree(allocator,polygonizer,graphicsAPIAdaptor,sizeVoxels,clampValueHigh,clampValueLow)
 {
 	populator->PopulateTerrain(this);
+	CollapseUniformSubtrees();
 }
 
 SparseTerrainVoxelOctree::~SparseTerrainVoxelOctree()
 {
+	FinishMeshing();
+	assert(NumPinnedSnapshots.load() == 0);
 	DeleteAllChildren(&ParentNode);
-	Allocator->Free(ParentNodeStack);
 }
 
 TerrainOctreeIndex SparseTerrainVoxelOctree::SetVoxelAt_Internal(const glm::ivec3& location, i8 value)
@@ -49,80 +102,347 @@ TerrainOctreeIndex SparseTerrainVoxelOctree::SetVoxelAt_Internal(const glm::ivec
 		return 0xffffffffffffffff;
 	}
 
-	SparseTerrainOctreeNode* onNode = &ParentNode;
-	size_t ParentNodeStackPtr = 0;
+	// a stack per call, writers on other threads are walking the tree at the same time
+	SparseTerrainOctreeNode* ancestors[MAX_OCTREE_DEPTH];
 	TerrainOctreeIndex outIndex = 0;
+	SparseTerrainOctreeNode* onNode = FindOrCreateLeafContainingPoint(location, outIndex, ancestors);
 
-	u32 shiftCounter = 0;
+	glm::ivec3 voxelDataLocation = GetLocationWithinMipZeroCellFromWorldLocation(onNode, location);
+
+	size_t voxelDataIndex = voxelDataLocation.x + BASE_CELL_SIZE * voxelDataLocation.y + BASE_CELL_SIZE * BASE_CELL_SIZE * voxelDataLocation.z;
+	// before taking the lock, faulting in takes it too
+	if (!MakeLeafResident(onNode))
+	{
+		// writing would throw away the brick still in the page file
+		return 0xffffffffffffffff;
+	}
+	{
+		std::lock_guard<SpinLock> lock(onNode->BrickLock);
+		LeafState state;
+		GetLeafState(onNode, LIVE_VERSION, state);
+		i8 currentValue = state.VoxelData ? state.VoxelData[voxelDataIndex] :
+			state.CompressedVoxelData ? VoxelBrickCompression::GetVoxel(state.CompressedVoxelData, voxelDataIndex) : state.UniformValue;
+		if (currentValue == value)
+		{
+			// nothing would change so don't give the leaf a raw brick
+			return outIndex;
+		}
+		PreserveLeafForSnapshots(onNode);
+		DiscardPagedCopy(onNode);
+		i8* voxels = MakeLeafBrickRaw(onNode);
+		// a new raw brick, or a copy of one in the mapped world
+		if (voxels != state.VoxelData)
+		{
+			for (u32 i = 0; i < ParentNode.MipLevel; i++)
+			{
+				SetFlag(ancestors[i]->bHasUncompressedBricks);
+			}
+		}
+		voxels[voxelDataIndex] = value;
+	}
+
+	for (u32 i = 0; i < ParentNode.MipLevel; i++)
+	{
+		SetFlag(ancestors[i]->bMipStale);
+	}
+	MarkNodesReadingRegion(location, location, onNode, ancestors);
+	MarkLeafDirty(onNode);
+
+	return outIndex;
+}
 
+SparseTerrainVoxelOctree::SparseTerrainOctreeNode* SparseTerrainVoxelOctree::FindOrCreateLeafContainingPoint(const glm::ivec3& location, TerrainOctreeIndex& outIndex, SparseTerrainOctreeNode** outAncestors)
+{
+	if (SparseTerrainOctreeNode* leaf = static_cast<SparseTerrainOctreeNode*>(LeafIndex.Find(GetLeafMortonCode(location))))
+	{
+		// the leaf already exists so there's nothing to create, just fill in the ancestors from its parents
+		SparseTerrainOctreeNode** ancestor = outAncestors + ParentNode.MipLevel;
+		for (SparseTerrainOctreeNode* parent = leaf->Parent; parent; parent = parent->Parent)
+		{
+			*(--ancestor) = parent;
+		}
+		assert(ancestor == outAncestors);
+		outIndex = OctreeFunctionLibrary::GetIndexOfLeafContainingPoint(location, ParentNode.SizeInVoxels);
+		return leaf;
+	}
+
+	SparseTerrainOctreeNode* onNode = &ParentNode;
+	u32 shiftCounter = 0;
+	outIndex = 0;
 	while (onNode->MipLevel != 0)
 	{
-		onNode->GetTerrainChunkMeshMutable().bNeedsRegenerating = true;
-		ParentNodeStack[ParentNodeStackPtr++] = onNode;
+		*(outAncestors++) = onNode;
 		u8 childIndex = 0xff;
 		onNode = FindChildContainingPoint(onNode, location, childIndex);
 		assert(onNode);
+		outIndex |= (TerrainOctreeIndex)childIndex << (4 * (shiftCounter++));
+	}
+	return onNode;
+}
+
+TerrainOctreeIndex SparseTerrainVoxelOctree::FillBrick(const glm::ivec3& brickBottomLeft, const i8* voxels)
+{
+	static const size_t voxelDataAllocationSize = BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE;
+	assert(brickBottomLeft.x % BASE_CELL_SIZE == 0);
+	assert(brickBottomLeft.y % BASE_CELL_SIZE == 0);
+	assert(brickBottomLeft.z % BASE_CELL_SIZE == 0);
+	if (!OctreeFunctionLibrary::IsPointInCube(brickBottomLeft, ParentNode.BottomLeftCorner, ParentNode.SizeInVoxels))
+	{
+		return 0xffffffffffffffff;
+	}
+
+	// a stack per call as this gets called from many populator threads at once
+	SparseTerrainOctreeNode* ancestors[MAX_OCTREE_DEPTH];
+	TerrainOctreeIndex outIndex = 0;
+	SparseTerrainOctreeNode* leaf = FindOrCreateLeafContainingPoint(brickBottomLeft, outIndex, ancestors);
 
-		outIndex |= (TerrainOctreeIndex)(childIndex << (4 * (shiftCounter++)));
-		
+	i8 clamped[voxelDataAllocationSize];
+	for (size_t i = 0; i < voxelDataAllocationSize; i++)
+	{
+		clamped[i] = std::clamp(voxels[i], VoxelClampValueLow, VoxelClampValueHigh);
 	}
 
-	if (!onNode->VoxelData)
+	bool bChanged = false;
+	if (!MakeLeafResident(leaf))
 	{
-		static const size_t voxelDataAllocationSize = BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE;
-		onNode->VoxelData = IAllocator::NewArray<i8>(Allocator, voxelDataAllocationSize);
-		
-		memset(onNode->VoxelData, VoxelDefaultValue, voxelDataAllocationSize);
-		for (i32 i = 0; i < 8; i++)
+		// writing would throw away the brick still in the page file
+		return 0xffffffffffffffff;
+	}
+	{
+		std::lock_guard<SpinLock> lock(leaf->BrickLock);
+		// a leaf that's just been created reads as its uniform value
+		i8 previous[voxelDataAllocationSize];
+		LeafState state;
+		GetLeafState(leaf, LIVE_VERSION, state);
+		ReadLeafBrick(state, previous);
+		bChanged = memcmp(previous, clamped, voxelDataAllocationSize) != 0;
+		if (!bChanged)
 		{
-			onNode->Children[i] = nullptr;
+			// leave the bricks alone, a snapshot might be reading them
+			return outIndex;
+		}
+		// the leaf's bricks go to the snapshots rather than being copied, they're about to be replaced anyway
+		PreserveLeafForSnapshots(leaf, false);
+		DiscardPagedCopy(leaf);
+		if (IsBrickUniform(clamped))
+		{
+			// no need for a brick, the leaf just stores the value
+			FreeLeafBricks(leaf);
+			leaf->UniformValue = clamped[0];
+		}
+		else if (!bCompressBricks || !TryCompressLeafBrick(leaf, clamped))
+		{
+			MakeLeafBrickRaw(leaf);
+			memcpy(leaf->VoxelData.load(), clamped, voxelDataAllocationSize);
+			for (u32 i = 0; i < ParentNode.MipLevel; i++)
+			{
+				SetFlag(ancestors[i]->bHasUncompressedBricks);
+			}
 		}
 	}
-	glm::ivec3 voxelDataLocation = GetLocationWithinMipZeroCellFromWorldLocation(onNode, location);
 
-	size_t voxelDataIndex = voxelDataLocation.x + BASE_CELL_SIZE * voxelDataLocation.y + BASE_CELL_SIZE * BASE_CELL_SIZE * voxelDataLocation.z;
-	if (onNode->VoxelData[voxelDataIndex] != value)
+	for (u32 i = 0; i < ParentNode.MipLevel; i++)
+	{
+		SetFlag(ancestors[i]->bMipStale);
+	}
+	MarkNodesReadingRegion(brickBottomLeft, brickBottomLeft + glm::ivec3(BASE_CELL_SIZE - 1), leaf, ancestors);
+	MarkLeafDirty(leaf);
+	return outIndex;
+}
+
+TerrainOctreeIndex SparseTerrainVoxelOctree::FillBrick(const glm::ivec3& brickBottomLeft, const std::function<i8(const glm::ivec3&)>& generator)
+{
+	i8 voxels[BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE];
+	i8* writePtr = voxels;
+	for (i32 z = brickBottomLeft.z; z < brickBottomLeft.z + BASE_CELL_SIZE; z++)
+	{
+		for (i32 y = brickBottomLeft.y; y < brickBottomLeft.y + BASE_CELL_SIZE; y++)
+		{
+			for (i32 x = brickBottomLeft.x; x < brickBottomLeft.x + BASE_CELL_SIZE; x++)
+			{
+				*(writePtr++) = generator(glm::ivec3{ x,y,z });
+			}
+		}
+	}
+	return FillBrick(brickBottomLeft, voxels);
+}
+
+// the world space coordinates sampled along each axis by GetVoxelsForNode.
+// negative coordinates are clamped to 0 the same as GetVoxelAt, so each axis is sorted but may repeat
+struct VoxelGatherLattice
+{
+	i32 Samples[3][TOTAL_CELL_SIZE];
+};
+
+// find the range [outBegin, outEnd) of samples on an axis that lie within [min, min + size)
+static void FindSamplesInRange(const i32* samples, i32 min, i32 size, i32& outBegin, i32& outEnd)
+{
+	outBegin = (i32)(std::lower_bound(samples, samples + TOTAL_CELL_SIZE, min) - samples);
+	outEnd = (i32)(std::lower_bound(samples + outBegin, samples + TOTAL_CELL_SIZE, min + size) - samples);
+}
+
+static bool FindSamplesInCube(const VoxelGatherLattice& lattice, const glm::ivec3& bottomLeft, i32 size, i32* outBegin, i32* outEnd)
+{
+	for (i32 axis = 0; axis < 3; axis++)
 	{
-		onNode->VoxelData[voxelDataIndex] = value;
+		FindSamplesInRange(lattice.Samples[axis], bottomLeft[axis], size, outBegin[axis], outEnd[axis]);
+		if (outBegin[axis] == outEnd[axis])
+		{
+			return false;
+		}
+	}
+	return true;
+}
 
-		for (i32 i = 0; i < ParentNodeStackPtr; i++)
+static void FillSamples(const i32* begin, const i32* end, i8 value, i8* outVoxels)
+{
+	for (i32 z = begin[2]; z < end[2]; z++)
+	{
+		for (i32 y = begin[1]; y < end[1]; y++)
 		{
-			ParentNodeStack[i]->Mesh.bNeedsRegenerating = true;
+			memset(outVoxels + TOTAL_DECK_SIZE * z + TOTAL_CELL_SIZE * y + begin[0], value, end[0] - begin[0]);
 		}
+	}
+}
+
+// walk down the tree visiting only the nodes that contain samples, copying from each leaf in one pass.
+// nodes at mipLevelToRead are read from their MipVoxelData instead, where they have it.
+// regions without a brick or a child are filled with the uniform value of the node they fall in
+static void GatherVoxelRegion(SparseTerrainVoxelOctree* octree, SparseTerrainVoxelOctree::SparseTerrainOctreeNode* node, const VoxelGatherLattice& lattice, u32 mipLevelToRead, u32 version, i8* outVoxels)
+{
+	i32 begin[3], end[3];
+	if (!FindSamplesInCube(lattice, node->BottomLeftCorner, node->SizeInVoxels, begin, end))
+	{
+		return;
+	}
 
-		onNode->Mesh.bNeedsRegenerating = true;
+	const i8* mipBrick = (node->MipLevel != 0 && node->MipLevel == mipLevelToRead) ? node->MipVoxelData : nullptr;
+	if (node->MipLevel != 0 && !mipBrick)
+	{
+		i32 childDims = node->SizeInVoxels / 2;
+		for (i32 i = 0; i < 8; i++)
+		{
+			if (SparseTerrainVoxelOctree::SparseTerrainOctreeNode* child = node->Children[i].load(std::memory_order_acquire))
+			{
+				GatherVoxelRegion(octree, child, lattice, mipLevelToRead, version, outVoxels);
+			}
+			else
+			{
+				glm::ivec3 childBL = node->BottomLeftCorner + glm::ivec3{ i & 1, (i >> 1) & 1, (i >> 2) & 1 } * childDims;
+				if (FindSamplesInCube(lattice, childBL, childDims, begin, end))
+				{
+					FillSamples(begin, end, node->UniformValue, outVoxels);
+				}
+			}
+		}
+		return;
 	}
 
+	SparseTerrainVoxelOctree::LeafState leaf = { nullptr, nullptr, 0 };
+	i8 decompressed[BRICK_SIZE_BYTES];
+	if (!mipBrick && !octree->MakeLeafResidentForRead(node))
+	{
+		octree->ReadUnresidentLeaf(node, decompressed);
+		leaf.VoxelData = decompressed;
+	}
+	else if (!mipBrick)
+	{
+		SparseTerrainVoxelOctree::GetLeafState(node, version, leaf);
+		if (!leaf.VoxelData && !leaf.CompressedVoxelData)
+		{
+			FillSamples(begin, end, leaf.UniformValue, outVoxels);
+			return;
+		}
+	}
+	// a mip brick has a voxel every 1 << MipLevel, the samples taken from it all land on one
+	u32 shift = mipBrick ? node->MipLevel : 0;
+	const i32* samplesX = lattice.Samples[0];
+	i32 runLength = end[0] - begin[0];
+	// with a step of one voxel of the brick the samples along x are consecutive voxels in it, unless
+	// clamping at the octree's negative edge has repeated a coordinate
+	bool bContiguousX = ((samplesX[end[0] - 1] - samplesX[begin[0]]) >> shift) == runLength - 1;
 
-	return outIndex;
+	const i8* brick = mipBrick ? mipBrick : leaf.VoxelData;
+	if (!brick)
+	{
+		if (!bContiguousX)
+		{
+			// coarse mips only take a handful of samples from each leaf, cheaper to pick them out one by one
+			for (i32 z = begin[2]; z < end[2]; z++)
+			{
+				i32 brickZ = lattice.Samples[2][z] - node->BottomLeftCorner.z;
+				for (i32 y = begin[1]; y < end[1]; y++)
+				{
+					i32 brickY = lattice.Samples[1][y] - node->BottomLeftCorner.y;
+					i8* outRow = outVoxels + TOTAL_DECK_SIZE * z + TOTAL_CELL_SIZE * y;
+					u32 rowStart = BASE_CELL_SIZE * brickY + BASE_CELL_SIZE * BASE_CELL_SIZE * brickZ;
+					for (i32 x = begin[0]; x < end[0]; x++)
+					{
+						outRow[x] = VoxelBrickCompression::GetVoxel(leaf.CompressedVoxelData, rowStart + samplesX[x] - node->BottomLeftCorner.x);
+					}
+				}
+			}
+			return;
+		}
+		VoxelBrickCompression::Decompress(leaf.CompressedVoxelData, decompressed);
+		brick = decompressed;
+	}
+	for (i32 z = begin[2]; z < end[2]; z++)
+	{
+		i32 brickZ = (lattice.Samples[2][z] - node->BottomLeftCorner.z) >> shift;
+		for (i32 y = begin[1]; y < end[1]; y++)
+		{
+			i32 brickY = (lattice.Samples[1][y] - node->BottomLeftCorner.y) >> shift;
+			const i8* brickRow = brick + BASE_CELL_SIZE * brickY + BASE_CELL_SIZE * BASE_CELL_SIZE * brickZ;
+			i8* outRow = outVoxels + TOTAL_DECK_SIZE * z + TOTAL_CELL_SIZE * y;
+			if (bContiguousX)
+			{
+				memcpy(outRow + begin[0], brickRow + ((samplesX[begin[0]] - node->BottomLeftCorner.x) >> shift), runLength);
+			}
+			else
+			{
+				for (i32 x = begin[0]; x < end[0]; x++)
+				{
+					outRow[x] = brickRow[(samplesX[x] - node->BottomLeftCorner.x) >> shift];
+				}
+			}
+		}
+	}
 }
 
 void SparseTerrainVoxelOctree::GetVoxelsForNode(ITerrainOctreeNode* node, i8* outVoxels)
+{
+	GetVoxelsForNode_Internal(node, LIVE_VERSION, outVoxels);
+}
+
+void SparseTerrainVoxelOctree::GetVoxelsForNode_Internal(ITerrainOctreeNode* node, u32 version, i8* outVoxels)
 {
 	u32 sizeInVoxels = node->GetSizeInVoxels();
 	const glm::ivec3& bottomLeft = node->GetBottomLeftCorner();
 	i32 stepSize = sizeInVoxels / 16;
-	i32 initialX = bottomLeft.x - POLYGONIZER_NEGATIVE_GUTTER * stepSize;
-	i32 initialY = bottomLeft.y - POLYGONIZER_NEGATIVE_GUTTER * stepSize;
-	i32 initialZ = bottomLeft.z - POLYGONIZER_NEGATIVE_GUTTER * stepSize;
-	i32 endX = bottomLeft.x + sizeInVoxels + POLYGONIZER_POSITIVE_GUTTER * stepSize;
-	i32 endY = bottomLeft.y + sizeInVoxels + POLYGONIZER_POSITIVE_GUTTER * stepSize;
-	i32 endZ = bottomLeft.z + sizeInVoxels + POLYGONIZER_POSITIVE_GUTTER * stepSize;
 
-	for (i32 z = initialZ; z < endZ; z += stepSize)
+	VoxelGatherLattice lattice;
+	for (i32 axis = 0; axis < 3; axis++)
 	{
-		for (i32 y = initialY; y < endY; y += stepSize)
+		i32 initial = bottomLeft[axis] - POLYGONIZER_NEGATIVE_GUTTER * stepSize;
+		for (i32 i = 0; i < TOTAL_CELL_SIZE; i++)
 		{
-			for (i32 x = initialX; x < endX; x += stepSize)
-			{
-				i8 value = GetVoxelAt(glm::ivec3{ x,y,z });
-				*(outVoxels++) = value;
-			}
+			i32 sample = initial + i * stepSize;
+			lattice.Samples[axis][i] = sample < 0 ? 0 : sample;
 		}
 	}
+
+	// anything outside the octree reads as the default
+	memset(outVoxels, VoxelDefaultValue, TOTAL_CELL_VOLUME_SIZE);
+	GatherVoxelRegion(this, &ParentNode, lattice, bUsePrefilteredMips ? node->GetMipLevel() : 0, version, outVoxels);
 }
 
 i8 SparseTerrainVoxelOctree::GetVoxelAt(const glm::ivec3& location)
+{
+	return GetVoxelAt_Internal(location, LIVE_VERSION);
+}
+
+i8 SparseTerrainVoxelOctree::GetVoxelAt_Internal(const glm::ivec3& location, u32 version)
 {
 	glm::ivec3 locationToUse =
 	{
@@ -137,11 +457,14 @@ i8 SparseTerrainVoxelOctree::GetVoxelAt(const glm::ivec3& location)
 	{
 		return VoxelDefaultValue;
 	}
+	if (SparseTerrainOctreeNode* leaf = static_cast<SparseTerrainOctreeNode*>(LeafIndex.Find(GetLeafMortonCode(locationToUse))))
+	{
+		onNode = leaf;
+	}
+	// no leaf, the point is in a part of the tree that's been collapsed into an ancestor's uniform value
 	while (onNode->MipLevel != 0)
 	{
 		assert(OctreeFunctionLibrary::IsPointInCube(locationToUse, onNode->BottomLeftCorner, onNode->SizeInVoxels));
-		i32 childDims = onNode->SizeInVoxels / 2;
-		i32 childMipLevel = onNode->MipLevel - 1;
 
 		// find which child the point is in and set onNode to that child
 		if (auto child = FindChildContainingPoint(onNode, locationToUse, outIndex, false))
@@ -150,13 +473,73 @@ i8 SparseTerrainVoxelOctree::GetVoxelAt(const glm::ivec3& location)
 		}
 		else
 		{
-			return VoxelDefaultValue;
+			return onNode->UniformValue;
 		}
 	}
-	assert(onNode->VoxelData);
 	glm::ivec3 voxelDataLocation = GetLocationWithinMipZeroCellFromWorldLocation(onNode, locationToUse);
 	size_t voxelDataIndex = voxelDataLocation.x + BASE_CELL_SIZE * voxelDataLocation.y + BASE_CELL_SIZE * BASE_CELL_SIZE * voxelDataLocation.z;
-	return onNode->VoxelData[voxelDataIndex];
+	if (!MakeLeafResidentForRead(onNode))
+	{
+		i8 voxels[BRICK_SIZE_BYTES];
+		ReadUnresidentLeaf(onNode, voxels);
+		return voxels[voxelDataIndex];
+	}
+	LeafState leaf;
+	GetLeafState(onNode, version, leaf);
+	if (!leaf.VoxelData && !leaf.CompressedVoxelData)
+	{
+		return leaf.UniformValue;
+	}
+	if (!leaf.VoxelData)
+	{
+		return VoxelBrickCompression::GetVoxel(leaf.CompressedVoxelData, voxelDataIndex);
+	}
+	return leaf.VoxelData[voxelDataIndex];
+}
+
+void SparseTerrainVoxelOctree::GetVoxelRegionContainingPoint(const glm::ivec3& location, VoxelRegion& outRegion)
+{
+	GetVoxelRegionContainingPoint_Internal(location, LIVE_VERSION, outRegion);
+}
+
+void SparseTerrainVoxelOctree::GetVoxelRegionContainingPoint_Internal(const glm::ivec3& location, u32 version, VoxelRegion& outRegion)
+{
+	outRegion = VoxelRegion();
+	SparseTerrainOctreeNode* onNode = &ParentNode;
+	if (!OctreeFunctionLibrary::IsPointInCube(location, onNode->BottomLeftCorner, onNode->SizeInVoxels))
+	{
+		return;
+	}
+	if (SparseTerrainOctreeNode* leaf = static_cast<SparseTerrainOctreeNode*>(LeafIndex.Find(GetLeafMortonCode(location))))
+	{
+		onNode = leaf;
+	}
+	while (onNode->MipLevel != 0)
+	{
+		u8 childIndex;
+		SparseTerrainOctreeNode* child = FindChildContainingPoint(onNode, location, childIndex, false);
+		if (!child)
+		{
+			// all of the missing child's cube is the parent's uniform value
+			outRegion.SizeInVoxels = onNode->SizeInVoxels / 2;
+			outRegion.BottomLeft = onNode->BottomLeftCorner + glm::ivec3{ childIndex & 1, (childIndex >> 1) & 1, (childIndex >> 2) & 1 } * (i32)outRegion.SizeInVoxels;
+			outRegion.UniformValue = onNode->UniformValue;
+			return;
+		}
+		onNode = child;
+	}
+	if (!MakeLeafResidentForRead(onNode))
+	{
+		// nothing to point the region at, GetVoxelAt reads it from the stand in
+		return;
+	}
+	LeafState leaf;
+	GetLeafState(onNode, version, leaf);
+	outRegion.BottomLeft = onNode->BottomLeftCorner;
+	outRegion.SizeInVoxels = onNode->SizeInVoxels;
+	outRegion.Voxels = leaf.VoxelData;
+	outRegion.CompressedVoxels = leaf.VoxelData ? nullptr : leaf.CompressedVoxelData;
+	outRegion.UniformValue = leaf.UniformValue;
 }
 
 TerrainOctreeIndex SparseTerrainVoxelOctree::SetVoxelAt(const glm::ivec3& location, i8 value)
@@ -167,16 +550,21 @@ TerrainOctreeIndex SparseTerrainVoxelOctree::SetVoxelAt(const glm::ivec3& locati
 
 void SparseTerrainVoxelOctree::Clear()
 {
+	FinishMeshing();
+	assert(NumPinnedSnapshots.load() == 0);
 	DeleteAllChildren(&ParentNode);
+	TakeDirtyBricks();
 }
 
 void SparseTerrainVoxelOctree::ResizeAndClear(const size_t newSize)
 {
+	FinishMeshing();
+	assert(NumPinnedSnapshots.load() == 0);
 	DeleteAllChildren(&ParentNode);
+	TakeDirtyBricks();
 	ParentNode.SizeInVoxels = newSize;
 	ParentNode.MipLevel = OctreeFunctionLibrary::GetMipLevel(newSize);
-	Allocator->Free(ParentNodeStack);
-	IAllocator::NewArray<SparseTerrainOctreeNode*>(Allocator, ParentNode.MipLevel + 1);
+	assert(ParentNode.MipLevel <= MAX_OCTREE_DEPTH);
 }
 
 size_t SparseTerrainVoxelOctree::GetSize() const
@@ -188,36 +576,23 @@ size_t SparseTerrainVoxelOctree::GetSize() const
 ITerrainOctreeNode* SparseTerrainVoxelOctree::FindNodeFromIndex(TerrainOctreeIndex index, bool createIfDoesntExist/* = false*/)
 {
 	SparseTerrainOctreeNode* onNode = &ParentNode;
-	onNode->Mesh.bNeedsRegenerating = true;
 	for (u32 i = 0; i < ParentNode.MipLevel; i++)
 	{
-		onNode->Mesh.bNeedsRegenerating = true;
+		MarkEdited(onNode);
 		u32 thisIndex = (index >> (4 * i)) & 0x0f;
-		
+		SparseTerrainOctreeNode* child = onNode->Children[thisIndex].load(std::memory_order_acquire);
 		if (createIfDoesntExist)
 		{
-			i32 childDims = onNode->SizeInVoxels / 2;
-			i32 childMipLevel = onNode->MipLevel - 1;
-			i32 x = (thisIndex & 1);
-			i32 y = (thisIndex & 2) >> 1;
-			i32 z = (thisIndex & 4) >> 2;
-			glm::ivec3& childBL = glm::ivec3
-			{
-				onNode->BottomLeftCorner.x + x * childDims,
-				onNode->BottomLeftCorner.y + y * childDims,
-				onNode->BottomLeftCorner.z + z * childDims
-			};
-			if (!(onNode->Children[thisIndex]))
-			{
-				onNode->Children[thisIndex] = IAllocator::New<SparseTerrainOctreeNode>(Allocator);
-				new(onNode->Children[thisIndex])SparseTerrainOctreeNode(childMipLevel, childBL, childDims);
-			}
-			onNode = onNode->Children[thisIndex];
+			onNode = child ? child : CreateChild(onNode, thisIndex);
 		}
 		else
 		{
-			assert(onNode);
-			onNode = onNode->Children[thisIndex];
+			onNode = child;
+			if (!onNode)
+			{
+				// the branch doesn't exist, or has been collapsed into a uniform ancestor
+				return nullptr;
+			}
 		}
 	}
 	return onNode;
@@ -232,104 +607,248 @@ void SparseTerrainVoxelOctree::GetChunksToRender(const Camera& camera, float asp
 	glm::mat4 viewMatrix = camera.GetViewMatrix();
 	glm::mat4 viewProjectionMatrix = projection * viewMatrix;
 
-	std::vector<std::future<PolygonizeWorkerThreadData*>> polygonizedNodeFutures;
-	
-	TerrainLODSelectionAndCullingAlgorithm::GetChunksToRender(frustum, outNodesToRender, &ParentNode, viewProjectionMatrix,
-	[&polygonizedNodeFutures, this](ITerrainOctreeNode* node) {
+	UploadFinishedMeshes(false);
+
+	bool bStartedBatch = false;
+
+	if (!MeshingSnapshot)
+	{
+		// nothing's reading the last batch's snapshot any more. the mips are brought up to date before the next batch
+		// starts reading them, bricks edited since the last batch can be compressed again and the ones it faulted in
+		// can push others out
+		if (bUsePrefilteredMips)
+		{
+			UpdateMips();
+		}
+		CompressBricks();
+		EnforceBrickBudget();
+		// the polygonize jobs read this rather than the octree, so it can be written to while they run
+		MeshingSnapshot = new SparseTerrainVoxelOctreeSnapshot(this);
+		bStartedBatch = true;
+	}
+
+	auto polygonizeNode = [bStartedBatch, this](ITerrainOctreeNode* node) {
 		// every time the terrain chunk selection algorithm pushes a chunk to render that needs to be polygonized,
-		// queue an async operation to polygonize it 
-		polygonizedNodeFutures.push_back(Polygonizer->PolygonizeNodeAsync(node, this));
-	});
+		// queue an async operation to polygonize it, unless the last batch is still running - then it's left for the next.
+		// the generation is recorded before the polygonizer reads anything so an edit made while it's running isn't lost
+		if (!bStartedBatch)
+		{
+			return;
+		}
+		SparseTerrainOctreeNode* cast = static_cast<SparseTerrainOctreeNode*>(node);
+		cast->MeshedGeneration = cast->EditGeneration.load(std::memory_order_acquire);
+		MeshingFutures.push_back(Polygonizer->PolygonizeNodeAsync(node, MeshingSnapshot));
+	};
+	// the traversals are instantiated for these node types so nothing in them goes through a vtable or std::function
+	if (bUseFlatTraversal)
+	{
+		const FlatTerrainOctree& flat = GetFlatOctree();
+		TerrainLODSelectionAndCullingAlgorithm::GetChunksToRender(FlatTerrainOctreeLODTraits(flat), frustum, outNodesToRender, flat.GetRoot(), viewProjectionMatrix, polygonizeNode);
+	}
+	else
+	{
+		TerrainLODSelectionAndCullingAlgorithm::GetChunksToRender(TerrainLODNodeTraits<SparseTerrainOctreeNode>(), frustum, outNodesToRender, &ParentNode, viewProjectionMatrix, polygonizeNode);
+	}
+
+	if (bStartedBatch && MeshingFutures.empty())
+	{
+		// nothing needed regenerating
+		delete MeshingSnapshot;
+		MeshingSnapshot = nullptr;
+	}
+}
+
+void SparseTerrainVoxelOctree::FinishMeshing()
+{
+	UploadFinishedMeshes(true);
+}
 
-	for (auto& future : polygonizedNodeFutures)
+void SparseTerrainVoxelOctree::UploadFinishedMeshes(bool bWait)
+{
+	for (size_t i = 0; i < MeshingFutures.size();)
 	{
+		if (!bWait && MeshingFutures[i].wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			i++;
+			continue;
+		}
 		// upload the newly generated polygon data to a GPU buffer (fill in TerrainChunkMesh) and free the raw vertex data
-		PolygonizeWorkerThreadData* data = future.get();
+		PolygonizeWorkerThreadData* data = MeshingFutures[i].get();
 		GraphicsAPIAdaptor->UploadNewlyPolygonizedToGPU(data);
-		TerrainChunkMesh& mesh = data->Node->GetTerrainChunkMeshMutable();
-		mesh.bNeedsRegenerating = false;
 		data->MyAllocator->Free(data->GetPtrToDeallocate());
+		MeshingFutures[i] = std::move(MeshingFutures.back());
+		MeshingFutures.pop_back();
+	}
+	if (MeshingFutures.empty() && MeshingSnapshot)
+	{
+		delete MeshingSnapshot;
+		MeshingSnapshot = nullptr;
 	}
-
-
 }
 
 SparseTerrainVoxelOctree::SparseTerrainOctreeNode* SparseTerrainVoxelOctree::FindChildContainingPoint(SparseTerrainOctreeNode* onNode, const glm::ivec3& location, u8& outChildIndex, bool allocateNewIfNull)
 {
 	assert(OctreeFunctionLibrary::IsPointInCube(location, onNode->BottomLeftCorner, onNode->SizeInVoxels));
-	i32 childDims = onNode->SizeInVoxels / 2;
-	i32 childMipLevel = onNode->MipLevel - 1;
-	for (i32 z = 0; z < 2; z++)
+	u8 i = OctreeFunctionLibrary::GetChildIndexContainingPoint(location, onNode->BottomLeftCorner, onNode->SizeInVoxels);
+	outChildIndex = i;
+	SparseTerrainOctreeNode* child = onNode->Children[i].load(std::memory_order_acquire);
+	if (!child && allocateNewIfNull)
 	{
-		for (i32 y = 0; y < 2; y++)
-		{
-			for (i32 x = 0; x < 2; x++)
-			{
-				i32 i = x | (y << 1) | (z << 2);
-
-				glm::ivec3& childBL =
-					glm::ivec3{
-						onNode->BottomLeftCorner.x + x * childDims,
-						onNode->BottomLeftCorner.y + y * childDims,
-						onNode->BottomLeftCorner.z + z * childDims
-				};
-				if (OctreeFunctionLibrary::IsPointInCube(location, childBL, childDims))
-				{
-					if (!onNode->Children[i] && allocateNewIfNull)
-					{
-						onNode->Children[i] = IAllocator::New<SparseTerrainOctreeNode>(Allocator);
-						new(onNode->Children[i])SparseTerrainOctreeNode(childMipLevel, childBL, childDims);
-					}
-					outChildIndex = i;
-
-					return onNode->Children[i];
-				}
-			}
-		}
+		child = CreateChild(onNode, i);
 	}
-	assert(false); // should never get here
-	return nullptr;
+	return child;
 }
 
 void SparseTerrainVoxelOctree::DeleteAllChildren(SparseTerrainOctreeNode* node)
 {
-	for (i32 i = 0; i < 8; i++)
+	StructureGeneration++;
+	if (node == &ParentNode)
 	{
-		if (node->Children[i])
+		// everything below the root was allocated from the pools so it can all be dropped at once
+		for (i32 i = 0; i < 8; i++)
+		{
+			ParentNode.Children[i] = nullptr;
+		}
+		ParentNode.UniformValue = VoxelDefaultValue;
+		ParentNode.VoxelData = nullptr;
+		ParentNode.CompressedVoxelData = nullptr;
+		ParentNode.MipVoxelData = nullptr;
+		ParentNode.bHasUncompressedBricks = false;
+		ParentNode.bMipStale = true;
+		LeafIndex.Clear();
+		LeafVersionPool.ReleaseAll();
+		LeavesWithHistory = nullptr;
+		RetiredLeafVersions.clear();
+		NumLeafVersions = 0;
+		NodePool.ReleaseAll();
+		BrickPool.ReleaseAll();
+		ResidentBrickBytes = 0;
+		if (Pager.IsOpen())
+		{
+			Pager.FreeAllSlots();
+		}
+		for (PoolAllocator& pool : CompressedBrickPools)
 		{
-			DeleteAllChildren(node->Children[i]);
+			pool.ReleaseAll();
 		}
+		// no leaves left pointing into it
+		MappedWorld.Close();
+		return;
 	}
-	if (node != &ParentNode)
+	for (i32 i = 0; i < 8; i++)
 	{
-		if (node->VoxelData)
+		if (SparseTerrainOctreeNode* child = node->Children[i].load(std::memory_order_relaxed))
 		{
-			Allocator->Free(node->VoxelData);
+			DeleteAllChildren(child);
 		}
-		Allocator->Free(node);
 	}
+	FreeLeafBricks(node);
+	DiscardPagedCopy(node);
+	FreeMipBrick(node);
+	if (node->MipLevel == 0)
+	{
+		LeafIndex.Remove(GetLeafMortonCode(node->BottomLeftCorner));
+	}
+	node->~SparseTerrainOctreeNode();
+	NodePool.Free(node);
 }
 
-glm::ivec3 SparseTerrainVoxelOctree::GetLocationWithinMipZeroCellFromWorldLocation(SparseTerrainOctreeNode* mipZeroCell, const glm::ivec3& globalLocation)
+void SparseTerrainVoxelOctree::MarkNodesReadingRegion(const glm::ivec3& editMin, const glm::ivec3& editMax, SparseTerrainOctreeNode* leaf, SparseTerrainOctreeNode** ancestors)
 {
-	assert(mipZeroCell->MipLevel == 0);
-	glm::ivec3 voxelDataLocation = globalLocation - mipZeroCell->BottomLeftCorner;
-	assert(voxelDataLocation.x < BASE_CELL_SIZE);
-	assert(voxelDataLocation.y < BASE_CELL_SIZE);
-	assert(voxelDataLocation.z < BASE_CELL_SIZE);
-	return voxelDataLocation;
-}
-
-
-
-
+	for (u32 mipLevel = 0; mipLevel <= ParentNode.MipLevel; mipLevel++)
+	{
+		i32 step = 1 << mipLevel;
+		bool bBoxFiltered = bUsePrefilteredMips && mipLevel != 0;
+		if (mipLevel != 0 && !bBoxFiltered)
+		{
+			// the polygonizer reads the lattice points, and points along the edges between them when
+			// it shifts a vertex onto the surface - so only voxels with at least two coordinates on the lattice
+			u32 axesOnLattice = 0;
+			for (i32 axis = 0; axis < 3; axis++)
+			{
+				axesOnLattice += RangeContainsMultipleOf(editMin[axis], editMax[axis], step) ? 1 : 0;
+			}
+			if (axesOnLattice < 2)
+			{
+				continue;
+			}
+		}
 
+		SparseTerrainOctreeNode* node = mipLevel == 0 ? leaf : ancestors[ParentNode.MipLevel - mipLevel];
+		MarkEdited(node);
 
-SparseTerrainVoxelOctree::SparseTerrainOctreeNode::SparseTerrainOctreeNode(u32 mipLevel, const ivec3& bottomLeftCorner, u32 sizeInVoxels)
+		// the neighbours whose gutters reach into the edit. a box filtered sample covers step voxels from its lattice point
+		i32 size = node->SizeInVoxels;
+		i32 lowReach = POLYGONIZER_NEGATIVE_GUTTER * step;
+		i32 highReach = (BASE_CELL_SIZE + POLYGONIZER_POSITIVE_GUTTER - 1) * step + (bBoxFiltered ? step - 1 : 0);
+		glm::ivec3 first, last;
+		for (i32 axis = 0; axis < 3; axis++)
+		{
+			first[axis] = editMin[axis] - node->BottomLeftCorner[axis] <= highReach - size ? -1 : 0;
+			last[axis] = editMax[axis] >= node->BottomLeftCorner[axis] + size - lowReach ? 1 : 0;
+		}
+		for (i32 z = first.z; z <= last.z; z++)
+		{
+			for (i32 y = first.y; y <= last.y; y++)
+			{
+				for (i32 x = first.x; x <= last.x; x++)
+				{
+					if (!x && !y && !z)
+					{
+						continue;
+					}
+					glm::ivec3 neighbourBL = node->BottomLeftCorner + glm::ivec3{ x, y, z } * size;
+					if (!OctreeFunctionLibrary::IsPointInCube(neighbourBL, ParentNode.BottomLeftCorner, ParentNode.SizeInVoxels))
+					{
+						continue;
+					}
+					if (SparseTerrainOctreeNode* neighbour = FindExistingNode(neighbourBL, mipLevel))
+					{
+						MarkEdited(neighbour);
+					}
+				}
+			}
+		}
+	}
+}
+
+SparseTerrainVoxelOctree::SparseTerrainOctreeNode* SparseTerrainVoxelOctree::FindExistingNode(const glm::ivec3& bottomLeft, u32 mipLevel)
+{
+	if (mipLevel == 0)
+	{
+		return static_cast<SparseTerrainOctreeNode*>(LeafIndex.Find(GetLeafMortonCode(bottomLeft)));
+	}
+	SparseTerrainOctreeNode* onNode = &ParentNode;
+	while (onNode && onNode->MipLevel > mipLevel)
+	{
+		u8 childIndex = OctreeFunctionLibrary::GetChildIndexContainingPoint(bottomLeft, onNode->BottomLeftCorner, onNode->SizeInVoxels);
+		onNode = onNode->Children[childIndex].load(std::memory_order_acquire);
+	}
+	return onNode;
+}
+
+glm::ivec3 SparseTerrainVoxelOctree::GetLocationWithinMipZeroCellFromWorldLocation(SparseTerrainOctreeNode* mipZeroCell, const glm::ivec3& globalLocation)
+{
+	assert(mipZeroCell->MipLevel == 0);
+	glm::ivec3 voxelDataLocation = globalLocation - mipZeroCell->BottomLeftCorner;
+	assert(voxelDataLocation.x < BASE_CELL_SIZE);
+	assert(voxelDataLocation.y < BASE_CELL_SIZE);
+	assert(voxelDataLocation.z < BASE_CELL_SIZE);
+	return voxelDataLocation;
+}
+
+
+
+
+
+
+SparseTerrainVoxelOctree::SparseTerrainOctreeNode::SparseTerrainOctreeNode(u32 mipLevel, const ivec3& bottomLeftCorner, u32 sizeInVoxels)
 	:MipLevel(mipLevel),
 	BottomLeftCorner(bottomLeftCorner),
 	SizeInVoxels(sizeInVoxels)
 {
+	// a new node has never been meshed, EditGeneration starts out ahead of MeshedGeneration
+	Mesh = {};
 }
 
 SparseTerrainVoxelOctree::SparseTerrainOctreeNode::SparseTerrainOctreeNode(u32 mipLevel, const ivec3& bottomLeftCorner)
@@ -337,6 +856,7 @@ SparseTerrainVoxelOctree::SparseTerrainOctreeNode::SparseTerrainOctreeNode(u32 m
 	BottomLeftCorner(bottomLeftCorner),
 	SizeInVoxels(OctreeFunctionLibrary::GetSizeInVoxels(mipLevel))
 {
+	Mesh = {};
 }
 
 const TerrainChunkMesh& SparseTerrainVoxelOctree::SparseTerrainOctreeNode::GetTerrainChunkMesh() const
@@ -352,7 +872,8 @@ void SparseTerrainVoxelOctree::SparseTerrainOctreeNode::SetTerrainChunkMesh(cons
 void SparseTerrainVoxelOctree::AllocateNodeVoxelData(ITerrainOctreeNode* node)
 {
 	static const size_t voxelDataAllocationSize = BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE;
-	node->SetVoxelData(IAllocator::NewArray<i8>(Allocator, voxelDataAllocationSize));
+	assert(voxelDataAllocationSize == BRICK_SIZE_BYTES);
+	node->SetVoxelData(AllocateRawBrick());
 }
 
 void SparseTerrainVoxelOctree::CreateChildrenForFirstNMipLevels(ITerrainOctreeNode* node, int n, int onLevel)
@@ -366,33 +887,1338 @@ void SparseTerrainVoxelOctree::CreateChildrenForFirstNMipLevels(ITerrainOctreeNo
 	}
 	for (int i = 0; i < 8; i++)
 	{
-		CreateChildrenForFirstNMipLevels(cast->Children[i], n, onLevel);
+		CreateChildrenForFirstNMipLevels(cast->Children[i].load(std::memory_order_acquire), n, onLevel);
 	}
 }
 
 void SparseTerrainVoxelOctree::PopulateSingleMipLevel(SparseTerrainOctreeNode* node)
 {
-	int startMip = node->GetMipLevel();
-	int onMip = startMip;
-	for (i32 z = 0; z < 2; z++)
+	for (u8 i = 0; i < 8; i++)
+	{
+		CreateChild(node, i);
+	}
+}
+
+SparseTerrainVoxelOctree::SparseTerrainOctreeNode* SparseTerrainVoxelOctree::CreateChild(SparseTerrainOctreeNode* parent, u8 childIndex)
+{
+	i32 childDims = parent->SizeInVoxels / 2;
+	glm::ivec3 childBL = parent->BottomLeftCorner + glm::ivec3{ childIndex & 1, (childIndex >> 1) & 1, (childIndex >> 2) & 1 } * childDims;
+	SparseTerrainOctreeNode* child = IAllocator::New<SparseTerrainOctreeNode>(&NodePool);
+	new(child)SparseTerrainOctreeNode(parent->MipLevel - 1, childBL, childDims);
+	// a new child starts out as the part of its parent it covers
+	child->UniformValue = parent->UniformValue.load();
+	child->Parent = parent;
+	// if another thread got there first use its child and throw this one away
+	SparseTerrainOctreeNode* existing = nullptr;
+	if (!parent->Children[childIndex].compare_exchange_strong(existing, child, std::memory_order_acq_rel, std::memory_order_acquire))
+	{
+		child->~SparseTerrainOctreeNode();
+		NodePool.Free(child);
+		return existing;
+	}
+	StructureGeneration++;
+	if (child->MipLevel == 0)
+	{
+		LeafIndex.Insert(GetLeafMortonCode(childBL), child);
+	}
+	return child;
+}
+
+bool SparseTerrainVoxelOctree::IsBrickUniform(const i8* voxels)
+{
+	static const size_t voxelDataAllocationSize = BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE;
+	return memcmp(voxels, voxels + 1, voxelDataAllocationSize - 1) == 0;
+}
+
+void SparseTerrainVoxelOctree::CollapseUniformSubtrees()
+{
+	{
+		std::lock_guard<std::mutex> lock(SnapshotMutex);
+		if (!PinnedVersions.empty())
+		{
+			// a snapshot might be reading the nodes it would free
+			return;
+		}
+		// leaves being freed mustn't be left on the list
+		ReclaimLeafVersions();
+	}
+	CollapseUniformSubtree(&ParentNode);
+	CompressBricks();
+}
+
+bool SparseTerrainVoxelOctree::CollapseUniformSubtree(SparseTerrainOctreeNode* node)
+{
+	if (node->MipLevel == 0)
+	{
+		if (node->VoxelData && IsBrickUniform(node->VoxelData))
+		{
+			node->UniformValue = node->VoxelData.load()[0];
+			FreeLeafBricks(node);
+			DiscardPagedCopy(node);
+		}
+		// raw bricks in the mapped world are left for the OS to page, compressing them would only take up memory
+		node->bHasUncompressedBricks = node->VoxelData != nullptr && !IsMappedBrick(node->VoxelData);
+		// an evicted brick isn't looked at, it wasn't uniform when it was written
+		return !node->VoxelData && !node->CompressedVoxelData && !node->bPagedOut;
+	}
+
+	bool bAllChildrenUniform = true;
+	bool bAnyChildMissing = false;
+	node->bHasUncompressedBricks = false;
+	bool bFoundChild = false;
+	i8 value = node->UniformValue;
+	for (i32 i = 0; i < 8; i++)
+	{
+		SparseTerrainOctreeNode* child = node->Children[i];
+		if (!child)
+		{
+			bAnyChildMissing = true;
+			continue;
+		}
+		// every child is visited, even once we know this node can't collapse, so that its subtrees can
+		bool bChildUniform = CollapseUniformSubtree(child);
+		if (child->bHasUncompressedBricks)
+		{
+			node->bHasUncompressedBricks = true;
+		}
+		if (!bChildUniform)
+		{
+			bAllChildrenUniform = false;
+		}
+		else if (!bFoundChild)
+		{
+			value = child->UniformValue;
+			bFoundChild = true;
+		}
+		else if (child->UniformValue != value)
+		{
+			bAllChildrenUniform = false;
+		}
+	}
+
+	// missing children read as this node's uniform value so they have to agree with the rest
+	if (!bAllChildrenUniform || (bAnyChildMissing && value != node->UniformValue))
+	{
+		return false;
+	}
+
+	for (i32 i = 0; i < 8; i++)
+	{
+		if (SparseTerrainOctreeNode* child = node->Children[i].load(std::memory_order_relaxed))
+		{
+			if (child->MipLevel == 0)
+			{
+				LeafIndex.Remove(GetLeafMortonCode(child->BottomLeftCorner));
+			}
+			FreeMipBrick(child);
+			child->~SparseTerrainOctreeNode();
+			NodePool.Free(child);
+			node->Children[i] = nullptr;
+		}
+	}
+	StructureGeneration++;
+	node->UniformValue = value;
+	// with no children it reads as UniformValue everywhere, no need for a mip brick
+	FreeMipBrick(node);
+	// it has no children to draw in its place now so it's drawn itself
+	MarkEdited(node);
+	return true;
+}
+
+void SparseTerrainVoxelOctree::CompressBricks()
+{
+	if (!bCompressBricks || NumPinnedSnapshots.load() != 0)
+	{
+		return;
+	}
+	CompressBricksInSubtree(&ParentNode);
+}
+
+void SparseTerrainVoxelOctree::CompressBricksInSubtree(SparseTerrainOctreeNode* node)
+{
+	if (!node->bHasUncompressedBricks)
+	{
+		return;
+	}
+	node->bHasUncompressedBricks = false;
+	if (node->MipLevel != 0)
+	{
+		for (i32 i = 0; i < 8; i++)
+		{
+			if (SparseTerrainOctreeNode* child = node->Children[i].load(std::memory_order_relaxed))
+			{
+				CompressBricksInSubtree(child);
+			}
+		}
+		return;
+	}
+	if (!node->VoxelData)
+	{
+		return;
+	}
+
+	// if there are too many distinct values it stays raw
+	TryCompressLeafBrick(node, node->VoxelData);
+}
+
+bool SparseTerrainVoxelOctree::TryCompressLeafBrick(SparseTerrainOctreeNode* leaf, const i8* voxels)
+{
+	VoxelBrickCompression::CompressedBrickHeader header;
+	size_t compressedSize = VoxelBrickCompression::PlanCompression(voxels, header);
+	if (!compressedSize)
+	{
+		return false;
+	}
+	if (header.PaletteSize == 1)
+	{
+		leaf->UniformValue = voxels[0];
+		FreeLeafBricks(leaf);
+		return true;
+	}
+	u8* compressed = AllocateCompressedBrick(compressedSize);
+	VoxelBrickCompression::Compress(voxels, header, compressed);
+	FreeLeafBricks(leaf);
+	leaf->CompressedVoxelData = compressed;
+	return true;
+}
+
+void SparseTerrainVoxelOctree::UpdateMips()
+{
+	if (NumPinnedSnapshots.load() != 0)
 	{
-		for (i32 y = 0; y < 2; y++)
+		return;
+	}
+	UpdateMipsInSubtree(&ParentNode);
+}
+
+void SparseTerrainVoxelOctree::UpdateMipsInSubtree(SparseTerrainOctreeNode* node)
+{
+	if (!node->bMipStale)
+	{
+		return;
+	}
+	node->bMipStale = false;
+	if (node->MipLevel == 0)
+	{
+		return;
+	}
+
+	// children first, the mips of interior children are what this node is built from
+	bool bAnyChildren = false;
+	for (i32 i = 0; i < 8; i++)
+	{
+		if (SparseTerrainOctreeNode* child = node->Children[i].load(std::memory_order_relaxed))
+		{
+			UpdateMipsInSubtree(child);
+			bAnyChildren = true;
+		}
+	}
+	if (!bAnyChildren)
+	{
+		FreeMipBrick(node);
+		return;
+	}
+
+	bool bNewMip = !node->MipVoxelData;
+	if (bNewMip)
+	{
+		node->MipVoxelData = IAllocator::NewArray<i8>(&BrickPool, BRICK_SIZE_BYTES);
+	}
+	i8 decompressed[BRICK_SIZE_BYTES];
+	for (u8 i = 0; i < 8; i++)
+	{
+		SparseTerrainOctreeNode* child = node->Children[i].load(std::memory_order_relaxed);
+		const i8* childBrick = nullptr;
+		if (child && child->MipLevel == 0)
 		{
-			for (i32 x = 0; x < 2; x++)
+			if (!MakeLeafResidentForRead(child))
 			{
-				i32 i = x + (2 * y) + (4 * z);
-				i32 childDims = node->SizeInVoxels / 2;
-				i32 childMipLevel = node->MipLevel - 1;
+				// keep what the octant was built from before, if there was anything, and build it again next time
+				if (bNewMip)
+				{
+					VoxelBrickDownsample::FillOctant(VoxelDefaultValue, i, node->MipVoxelData);
+				}
+				for (SparseTerrainOctreeNode* stale = node; stale; stale = stale->Parent)
+				{
+					SetFlag(stale->bMipStale);
+				}
+				continue;
+			}
+			childBrick = child->VoxelData;
+			if (!childBrick && child->CompressedVoxelData)
+			{
+				VoxelBrickCompression::Decompress(child->CompressedVoxelData, decompressed);
+				childBrick = decompressed;
+			}
+		}
+		else if (child)
+		{
+			childBrick = child->MipVoxelData;
+		}
+
+		if (childBrick)
+		{
+			VoxelBrickDownsample::DownsampleIntoOctant(childBrick, i, node->MipVoxelData);
+		}
+		else
+		{
+			// a missing child reads as this node's uniform value, a child with no brick as its own
+			VoxelBrickDownsample::FillOctant(child ? child->UniformValue : node->UniformValue, i, node->MipVoxelData);
+		}
+	}
+}
+
+void SparseTerrainVoxelOctree::FreeMipBrick(SparseTerrainOctreeNode* node)
+{
+	if (node->MipVoxelData)
+	{
+		BrickPool.Free(node->MipVoxelData);
+		node->MipVoxelData = nullptr;
+	}
+}
+
+PoolAllocator& SparseTerrainVoxelOctree::GetCompressedBrickPool(const u8* compressed)
+{
+	return CompressedBrickPools[VoxelBrickCompression::GetSizeClass(VoxelBrickCompression::GetHeader(compressed)->SizeBytes)];
+}
+
+i8* SparseTerrainVoxelOctree::MakeLeafBrickRaw(SparseTerrainOctreeNode* leaf)
+{
+	assert(leaf->MipLevel == 0);
+	if (i8* voxels = leaf->VoxelData.load())
+	{
+		if (!IsMappedBrick(voxels))
+		{
+			return voxels;
+		}
+		// the mapping is read only, the leaf gets its own copy to write to
+		i8* copy = AllocateRawBrick();
+		memcpy(copy, voxels, BRICK_SIZE_BYTES);
+		leaf->VoxelData = copy;
+		leaf->bHasUncompressedBricks = true;
+		return copy;
+	}
+	// filled in before it's stored, a snapshot may be looking at the leaf
+	i8* voxels = AllocateRawBrick();
+	u8* compressed = leaf->CompressedVoxelData.load();
+	if (compressed)
+	{
+		VoxelBrickCompression::Decompress(compressed, voxels);
+	}
+	else
+	{
+		memset(voxels, leaf->UniformValue, BRICK_SIZE_BYTES);
+	}
+	leaf->VoxelData = voxels;
+	if (compressed)
+	{
+		leaf->CompressedVoxelData = nullptr;
+		FreeCompressedBrick(compressed);
+	}
+	leaf->bHasUncompressedBricks = true;
+	return voxels;
+}
+
+void SparseTerrainVoxelOctree::FreeLeafBricks(SparseTerrainOctreeNode* leaf)
+{
+	if (i8* voxels = leaf->VoxelData.exchange(nullptr))
+	{
+		FreeRawBrick(voxels);
+	}
+	if (u8* compressed = leaf->CompressedVoxelData.exchange(nullptr))
+	{
+		FreeCompressedBrick(compressed);
+	}
+}
+
+i8* SparseTerrainVoxelOctree::AllocateRawBrick()
+{
+	ResidentBrickBytes.fetch_add(BRICK_SIZE_BYTES, std::memory_order_relaxed);
+	return IAllocator::NewArray<i8>(&BrickPool, BRICK_SIZE_BYTES);
+}
+
+u8* SparseTerrainVoxelOctree::AllocateCompressedBrick(size_t sizeBytes)
+{
+	PoolAllocator& pool = CompressedBrickPools[VoxelBrickCompression::GetSizeClass(sizeBytes)];
+	ResidentBrickBytes.fetch_add(pool.GetBlockSize(), std::memory_order_relaxed);
+	return IAllocator::NewArray<u8>(&pool, sizeBytes);
+}
+
+void SparseTerrainVoxelOctree::FreeRawBrick(const i8* voxels)
+{
+	if (IsMappedBrick(voxels))
+	{
+		return;
+	}
+	ResidentBrickBytes.fetch_sub(BRICK_SIZE_BYTES, std::memory_order_relaxed);
+	BrickPool.Free(const_cast<i8*>(voxels));
+}
+
+void SparseTerrainVoxelOctree::FreeCompressedBrick(const u8* compressed)
+{
+	if (IsMappedBrick(compressed))
+	{
+		return;
+	}
+	PoolAllocator& pool = GetCompressedBrickPool(compressed);
+	ResidentBrickBytes.fetch_sub(pool.GetBlockSize(), std::memory_order_relaxed);
+	pool.Free(const_cast<u8*>(compressed));
+}
 
-				glm::ivec3& childBL = glm::ivec3
+bool SparseTerrainVoxelOctree::EnablePaging(const char* backingFilePath, size_t budgetBytes)
+{
+	if (Pager.IsOpen())
+	{
+		// the bricks in the old file would be lost
+		DisablePaging();
+	}
+	BrickBudgetBytes = budgetBytes;
+	return Pager.Open(backingFilePath);
+}
+
+void SparseTerrainVoxelOctree::DisablePaging()
+{
+	if (!Pager.IsOpen())
+	{
+		return;
+	}
+	for (u64 slot = 0; slot < LeafIndex.GetNumSlots(); slot++)
+	{
+		if (SparseTerrainOctreeNode* leaf = static_cast<SparseTerrainOctreeNode*>(LeafIndex.GetLeafInSlot(slot)))
+		{
+			if (leaf->bPagedOut && !FaultInLeaf(leaf))
+			{
+				// the page file's about to close so the brick's gone, the leaf keeps what it's been reading as instead
+				i8* voxels = AllocateRawBrick();
+				ReadUnresidentLeaf(leaf, voxels);
+				leaf->VoxelData = voxels;
+				leaf->bPagedOut = false;
+				for (SparseTerrainOctreeNode* node = leaf; node; node = node->Parent)
 				{
-					node->BottomLeftCorner.x + x * childDims,
-					node->BottomLeftCorner.y + y * childDims,
-					node->BottomLeftCorner.z + z * childDims
-				};
-				node->Children[i] = IAllocator::New<SparseTerrainOctreeNode>(Allocator);
-				new(node->Children[i])SparseTerrainOctreeNode(childMipLevel, childBL, childDims);
+					SetFlag(node->bHasUncompressedBricks);
+				}
 			}
+			leaf->PagedSlot = VoxelBrickPager::INVALID_SLOT;
+		}
+	}
+	Pager.Close();
+}
+
+void SparseTerrainVoxelOctree::EnforceBrickBudget()
+{
+	if (!Pager.IsOpen() || NumPinnedSnapshots.load() != 0)
+	{
+		// a snapshot might be reading the bricks that would be freed
+		return;
+	}
+	u64 numSlots = LeafIndex.GetNumSlots();
+	// twice round at most, the first time round might only clear the referenced flags
+	for (u64 visited = 0; visited < numSlots * 2 && ResidentBrickBytes.load(std::memory_order_relaxed) > BrickBudgetBytes; visited++)
+	{
+		ClockHand = (ClockHand + 1) & (numSlots - 1);
+		SparseTerrainOctreeNode* leaf = static_cast<SparseTerrainOctreeNode*>(LeafIndex.GetLeafInSlot(ClockHand));
+		if (!leaf)
+		{
+			continue;
+		}
+		const void* brick = leaf->VoxelData.load(std::memory_order_relaxed);
+		if (!brick)
+		{
+			brick = leaf->CompressedVoxelData.load(std::memory_order_relaxed);
+		}
+		if (!brick || IsMappedBrick(brick))
+		{
+			// uniform, already evicted, or in the mapped world where the OS pages it itself
+			continue;
+		}
+		if (leaf->bReferenced.load(std::memory_order_relaxed))
+		{
+			// used since the hand last came round, give it another go
+			leaf->bReferenced.store(false, std::memory_order_relaxed);
+			continue;
+		}
+		if (!EvictLeaf(leaf))
+		{
+			// the page file can't be written to, the rest would fail too
+			return;
 		}
 	}
-}
\ No newline at end of file
+}
+
+bool SparseTerrainVoxelOctree::EvictLeaf(SparseTerrainOctreeNode* leaf)
+{
+	// nothing else is using the octree so the leaf's lock isn't needed
+	if (leaf->PagedSlot.load(std::memory_order_relaxed) == VoxelBrickPager::INVALID_SLOT)
+	{
+		u32 slot = VoxelBrickPager::INVALID_SLOT;
+		if (const i8* voxels = leaf->VoxelData.load(std::memory_order_relaxed))
+		{
+			slot = Pager.WriteSlot(voxels, BRICK_SIZE_BYTES, false);
+		}
+		else
+		{
+			const u8* compressed = leaf->CompressedVoxelData.load(std::memory_order_relaxed);
+			slot = Pager.WriteSlot(compressed, VoxelBrickCompression::GetHeader(compressed)->SizeBytes, true);
+		}
+		if (slot == VoxelBrickPager::INVALID_SLOT)
+		{
+			return false;
+		}
+		leaf->PagedSlot.store(slot, std::memory_order_relaxed);
+	}
+	// otherwise it hasn't changed since it was last faulted in and the copy in the file will do
+	FreeLeafBricks(leaf);
+	leaf->bPagedOut.store(true, std::memory_order_relaxed);
+	NumBrickEvictions++;
+	return true;
+}
+
+bool SparseTerrainVoxelOctree::FaultInLeaf(SparseTerrainOctreeNode* leaf)
+{
+	// read before taking the lock, readers of the leaf's neighbours shouldn't have to wait for the file
+	u8 buffer[BRICK_SIZE_BYTES];
+	bool bCompressed = false;
+	u32 slot = leaf->PagedSlot.load(std::memory_order_acquire);
+	// the slot's gone if another thread has faulted the leaf in and written to it since
+	u32 sizeBytes = slot != VoxelBrickPager::INVALID_SLOT ? Pager.ReadSlot(slot, buffer, bCompressed) : 0;
+
+	std::lock_guard<SpinLock> lock(leaf->BrickLock);
+	if (!leaf->bPagedOut.load(std::memory_order_relaxed))
+	{
+		// another thread got there first
+		return true;
+	}
+	if (!sizeBytes)
+	{
+		// the slot's still the leaf's, it might read next time
+		std::cout << "Failed to fault in brick at " << leaf->BottomLeftCorner.x << " " << leaf->BottomLeftCorner.y << " " << leaf->BottomLeftCorner.z << "\n";
+		return false;
+	}
+	// stored before bPagedOut is cleared so a reader that sees it cleared sees the brick
+	if (bCompressed)
+	{
+		u8* compressed = AllocateCompressedBrick(sizeBytes);
+		memcpy(compressed, buffer, sizeBytes);
+		leaf->CompressedVoxelData.store(compressed, std::memory_order_release);
+	}
+	else
+	{
+		i8* voxels = AllocateRawBrick();
+		memcpy(voxels, buffer, BRICK_SIZE_BYTES);
+		leaf->VoxelData.store(voxels, std::memory_order_release);
+	}
+	leaf->bPagedOut.store(false, std::memory_order_release);
+	NumBrickFaults.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+bool SparseTerrainVoxelOctree::MakeLeafResidentForRead(SparseTerrainOctreeNode* leaf)
+{
+	for (u32 attempt = 0; attempt < BRICK_FAULT_READ_ATTEMPTS; attempt++)
+	{
+		if (MakeLeafResident(leaf))
+		{
+			return true;
+		}
+	}
+	NumFailedBrickReads.fetch_add(1, std::memory_order_relaxed);
+	// whatever's meshed from the stand in is thrown away once the leaf can be read
+	SparseTerrainOctreeNode* ancestors[MAX_OCTREE_DEPTH];
+	SparseTerrainOctreeNode** ancestor = ancestors + ParentNode.MipLevel;
+	for (SparseTerrainOctreeNode* parent = leaf->Parent; parent; parent = parent->Parent)
+	{
+		*(--ancestor) = parent;
+	}
+	MarkNodesReadingRegion(leaf->BottomLeftCorner, leaf->BottomLeftCorner + glm::ivec3(BASE_CELL_SIZE - 1), leaf, ancestors);
+	return false;
+}
+
+void SparseTerrainVoxelOctree::ReadUnresidentLeaf(const SparseTerrainOctreeNode* leaf, i8* outVoxels) const
+{
+	const SparseTerrainOctreeNode* parent = leaf->Parent;
+	const i8* mip = parent ? parent->MipVoxelData : nullptr;
+	if (!mip)
+	{
+		memset(outVoxels, VoxelDefaultValue, BRICK_SIZE_BYTES);
+		return;
+	}
+	// the parent's mip has a voxel for every 2x2x2 of the leaf's
+	glm::ivec3 offset = (leaf->BottomLeftCorner - parent->BottomLeftCorner) / 2;
+	for (i32 z = 0; z < BASE_CELL_SIZE; z++)
+	{
+		for (i32 y = 0; y < BASE_CELL_SIZE; y++)
+		{
+			for (i32 x = 0; x < BASE_CELL_SIZE; x++)
+			{
+				outVoxels[x + BASE_CELL_SIZE * y + BASE_CELL_SIZE * BASE_CELL_SIZE * z] =
+					mip[(offset.x + x / 2) + BASE_CELL_SIZE * (offset.y + y / 2) + BASE_CELL_SIZE * BASE_CELL_SIZE * (offset.z + z / 2)];
+			}
+		}
+	}
+}
+
+void SparseTerrainVoxelOctree::DiscardPagedCopy(SparseTerrainOctreeNode* leaf)
+{
+	if (leaf->PagedSlot.load(std::memory_order_relaxed) == VoxelBrickPager::INVALID_SLOT)
+	{
+		return;
+	}
+	u32 slot = leaf->PagedSlot.exchange(VoxelBrickPager::INVALID_SLOT, std::memory_order_acq_rel);
+	if (slot != VoxelBrickPager::INVALID_SLOT)
+	{
+		Pager.FreeSlot(slot);
+	}
+}
+
+std::future<void> SparseTerrainVoxelOctree::PrefetchRegionAsync(const glm::ivec3& min, const glm::ivec3& max, rdx::thread_pool* threadPool)
+{
+	auto prefetch = [this, min, max]()
+	{
+		glm::ivec3 first = glm::max(min, glm::ivec3(0)) / (i32)BASE_CELL_SIZE;
+		glm::ivec3 last = glm::min(max, glm::ivec3((i32)ParentNode.SizeInVoxels - 1)) / (i32)BASE_CELL_SIZE;
+		for (i32 z = first.z; z <= last.z; z++)
+		{
+			for (i32 y = first.y; y <= last.y; y++)
+			{
+				for (i32 x = first.x; x <= last.x; x++)
+				{
+					// a leaf that won't fault in is left for its readers to retry and report
+					if (SparseTerrainOctreeNode* leaf = static_cast<SparseTerrainOctreeNode*>(LeafIndex.Find(OctreeFunctionLibrary::GetMortonCode(x, y, z))))
+					{
+						MakeLeafResident(leaf);
+					}
+				}
+			}
+		}
+	};
+	if (!threadPool)
+	{
+		prefetch();
+		std::promise<void> done;
+		done.set_value();
+		return done.get_future();
+	}
+	return threadPool->enqueue(prefetch);
+}
+
+std::vector<glm::ivec3> SparseTerrainVoxelOctree::TakeDirtyBricks()
+{
+	std::vector<glm::ivec3> bricks;
+	std::lock_guard<std::mutex> lock(DirtyBricksMutex);
+	// leaves marked in the old generation look clean from here on
+	CheckpointGeneration.fetch_add(1, std::memory_order_acq_rel);
+	bricks.swap(DirtyBricks);
+	return bricks;
+}
+
+size_t SparseTerrainVoxelOctree::GetNumDirtyBricks()
+{
+	std::lock_guard<std::mutex> lock(DirtyBricksMutex);
+	return DirtyBricks.size();
+}
+
+void SparseTerrainVoxelOctree::MarkLeafDirty(SparseTerrainOctreeNode* leaf)
+{
+	u32 generation = CheckpointGeneration.load(std::memory_order_acquire);
+	// only the first write to a leaf after each checkpoint takes the lock
+	if (leaf->DirtyCheckpoint.load(std::memory_order_relaxed) == generation || leaf->DirtyCheckpoint.exchange(generation, std::memory_order_acq_rel) == generation)
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(DirtyBricksMutex);
+	DirtyBricks.push_back(leaf->BottomLeftCorner);
+}
+
+#define MAPPED_WORLD_MAGIC 0x444c5756 // "VWLD"
+#define MAPPED_WORLD_VERSION 1
+// raw bricks are each given a page so the leaves can point at them in place
+#define MAPPED_WORLD_PAGE_SIZE 4096
+#define MAPPED_WORLD_COMPRESSED_ALIGNMENT 8
+
+static_assert(BRICK_SIZE_BYTES % MAPPED_WORLD_PAGE_SIZE == 0, "raw bricks in a mapped world must start on a page");
+
+/// <summary>
+/// Start of a file written by SaveMappedWorld. After it comes a MappedWorldNode for every node depth first,
+/// then starting on a page the raw bricks, one to a page, then the compressed bricks packed together
+/// </summary>
+struct MappedWorldHeader
+{
+	u32 Magic;
+	u32 Version;
+	u64 SizeVoxels;
+	u64 NumNodes;
+	u64 NodesOffset;
+	u64 BricksOffset;
+	u64 FileSizeBytes;
+};
+
+enum class MappedBrickKind : u8
+{
+	None,
+	Raw,
+	Compressed
+};
+
+struct SparseTerrainVoxelOctree::MappedWorldNode
+{
+	u64 BrickOffset; // from the start of the file, leaves only
+	u32 BrickSizeBytes;
+	u8 ChildMask; // bit i set if Children[i] exists, its entry follows those of the children before it
+	MappedBrickKind BrickKind;
+	i8 UniformValue;
+	u8 Padding = 0;
+};
+
+static inline u64 RoundUp(u64 value, u64 alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+bool SparseTerrainVoxelOctree::SaveMappedWorld(const char* path)
+{
+	std::vector<MappedWorldNode> nodes;
+	std::vector<const void*> bricks;
+	if (!CollectMappedWorldNodes(&ParentNode, nodes, bricks))
+	{
+		std::cout << "Failed to read every brick to save world to " << path << "\n";
+		return false;
+	}
+
+	MappedWorldHeader header;
+	header.Magic = MAPPED_WORLD_MAGIC;
+	header.Version = MAPPED_WORLD_VERSION;
+	header.SizeVoxels = ParentNode.SizeInVoxels;
+	header.NumNodes = nodes.size();
+	header.NodesOffset = sizeof(MappedWorldHeader);
+	header.BricksOffset = RoundUp(header.NodesOffset + nodes.size() * sizeof(MappedWorldNode), MAPPED_WORLD_PAGE_SIZE);
+
+	// the raw bricks first so that they all stay on page boundaries
+	u64 offset = header.BricksOffset;
+	for (MappedWorldNode& node : nodes)
+	{
+		if (node.BrickKind == MappedBrickKind::Raw)
+		{
+			node.BrickOffset = offset;
+			offset += BRICK_SIZE_BYTES;
+		}
+	}
+	for (MappedWorldNode& node : nodes)
+	{
+		if (node.BrickKind == MappedBrickKind::Compressed)
+		{
+			node.BrickOffset = offset;
+			offset = RoundUp(offset + node.BrickSizeBytes, MAPPED_WORLD_COMPRESSED_ALIGNMENT);
+		}
+	}
+	header.FileSizeBytes = offset;
+
+	std::ofstream ofs(path, std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!ofs)
+	{
+		std::cout << "Cannot open file " << path << "\n";
+		return false;
+	}
+	static const char padding[MAPPED_WORLD_PAGE_SIZE] = {};
+	ofs.write((const char*)&header, sizeof(MappedWorldHeader));
+	ofs.write((const char*)nodes.data(), nodes.size() * sizeof(MappedWorldNode));
+	ofs.write(padding, header.BricksOffset - (header.NodesOffset + nodes.size() * sizeof(MappedWorldNode)));
+	for (MappedBrickKind kind : { MappedBrickKind::Raw, MappedBrickKind::Compressed })
+	{
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			if (nodes[i].BrickKind != kind)
+			{
+				continue;
+			}
+			ofs.write((const char*)bricks[i], nodes[i].BrickSizeBytes);
+			if (kind == MappedBrickKind::Compressed)
+			{
+				ofs.write(padding, RoundUp(nodes[i].BrickSizeBytes, MAPPED_WORLD_COMPRESSED_ALIGNMENT) - nodes[i].BrickSizeBytes);
+			}
+		}
+	}
+	if (!ofs)
+	{
+		std::cout << "Failed to write world to " << path << "\n";
+		return false;
+	}
+	return true;
+}
+
+bool SparseTerrainVoxelOctree::CollectMappedWorldNodes(SparseTerrainOctreeNode* node, std::vector<MappedWorldNode>& outNodes, std::vector<const void*>& outBricks)
+{
+	MappedWorldNode entry;
+	entry.BrickOffset = 0;
+	entry.BrickSizeBytes = 0;
+	entry.ChildMask = 0;
+	entry.BrickKind = MappedBrickKind::None;
+	const void* brick = nullptr;
+	if (node->MipLevel == 0)
+	{
+		if (!MakeLeafResidentForRead(node))
+		{
+			return false;
+		}
+		if (const i8* voxels = node->VoxelData.load())
+		{
+			entry.BrickKind = MappedBrickKind::Raw;
+			entry.BrickSizeBytes = BRICK_SIZE_BYTES;
+			brick = voxels;
+		}
+		else if (const u8* compressed = node->CompressedVoxelData.load())
+		{
+			entry.BrickKind = MappedBrickKind::Compressed;
+			entry.BrickSizeBytes = VoxelBrickCompression::GetHeader(compressed)->SizeBytes;
+			brick = compressed;
+		}
+	}
+	for (u8 i = 0; i < 8; i++)
+	{
+		if (node->Children[i].load(std::memory_order_relaxed))
+		{
+			entry.ChildMask |= 1 << i;
+		}
+	}
+	entry.UniformValue = node->UniformValue;
+	outNodes.push_back(entry);
+	outBricks.push_back(brick);
+	for (u8 i = 0; i < 8; i++)
+	{
+		if (SparseTerrainOctreeNode* child = node->Children[i].load(std::memory_order_relaxed))
+		{
+			if (!CollectMappedWorldNodes(child, outNodes, outBricks))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool SparseTerrainVoxelOctree::LoadMappedWorld(const char* path)
+{
+	static_assert(sizeof(MappedWorldNode) == 16, "mapped world nodes are read straight from the file");
+	FinishMeshing();
+	assert(NumPinnedSnapshots.load() == 0);
+	MemoryMappedFile file;
+	if (!file.Open(path))
+	{
+		return false;
+	}
+	MappedWorldHeader header;
+	bool bValid = file.GetSize() >= sizeof(MappedWorldHeader);
+	if (bValid)
+	{
+		memcpy(&header, file.GetData(), sizeof(MappedWorldHeader));
+		bValid = header.Magic == MAPPED_WORLD_MAGIC
+			&& header.Version == MAPPED_WORLD_VERSION
+			&& header.FileSizeBytes == file.GetSize()
+			&& header.SizeVoxels >= BASE_CELL_SIZE
+			&& (header.SizeVoxels & (header.SizeVoxels - 1)) == 0
+			&& header.SizeVoxels <= ((u64)BASE_CELL_SIZE << MAX_OCTREE_DEPTH)
+			&& header.NodesOffset % alignof(MappedWorldNode) == 0
+			&& header.NodesOffset <= file.GetSize()
+			&& header.NumNodes != 0
+			&& header.NumNodes <= (file.GetSize() - header.NodesOffset) / sizeof(MappedWorldNode);
+	}
+	if (!bValid)
+	{
+		std::cout << path << " is not a voxel world\n";
+		return false;
+	}
+
+	ResizeAndClear(header.SizeVoxels);
+	MappedWorld = std::move(file);
+	u64 cursor = 0;
+	const MappedWorldNode* nodes = reinterpret_cast<const MappedWorldNode*>(MappedWorld.GetData() + header.NodesOffset);
+	if (!BuildMappedSubtree(&ParentNode, nodes, header.NumNodes, cursor) || cursor != header.NumNodes)
+	{
+		std::cout << path << " is corrupt\n";
+		Clear();
+		return false;
+	}
+	return true;
+}
+
+bool SparseTerrainVoxelOctree::BuildMappedSubtree(SparseTerrainOctreeNode* node, const MappedWorldNode* nodes, u64 numNodes, u64& cursor)
+{
+	if (cursor == numNodes)
+	{
+		return false;
+	}
+	const MappedWorldNode& entry = nodes[cursor++];
+	node->UniformValue = entry.UniformValue;
+	if (node->MipLevel != 0)
+	{
+		if (entry.BrickKind != MappedBrickKind::None)
+		{
+			return false;
+		}
+		for (u8 i = 0; i < 8; i++)
+		{
+			if ((entry.ChildMask & (1 << i)) && !BuildMappedSubtree(CreateChild(node, i), nodes, numNodes, cursor))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	if (entry.ChildMask)
+	{
+		return false;
+	}
+	if (entry.BrickKind == MappedBrickKind::None)
+	{
+		return true;
+	}
+	// the brick itself isn't looked at, that would read in every page of the file
+	if (entry.BrickOffset > MappedWorld.GetSize() || entry.BrickSizeBytes > MappedWorld.GetSize() - entry.BrickOffset)
+	{
+		return false;
+	}
+	u8* brick = const_cast<u8*>(MappedWorld.GetData()) + entry.BrickOffset;
+	if (entry.BrickKind == MappedBrickKind::Raw && entry.BrickSizeBytes == BRICK_SIZE_BYTES && entry.BrickOffset % MAPPED_WORLD_PAGE_SIZE == 0)
+	{
+		node->VoxelData = reinterpret_cast<i8*>(brick);
+		return true;
+	}
+	if (entry.BrickKind == MappedBrickKind::Compressed && entry.BrickSizeBytes >= sizeof(VoxelBrickCompression::CompressedBrickHeader)
+		&& entry.BrickSizeBytes < BRICK_SIZE_BYTES && entry.BrickOffset % MAPPED_WORLD_COMPRESSED_ALIGNMENT == 0)
+	{
+		node->CompressedVoxelData = brick;
+		return true;
+	}
+	return false;
+}
+
+void SparseTerrainVoxelOctree::ReadLeafBrick(const LeafState& leaf, i8* outVoxels)
+{
+	if (leaf.VoxelData)
+	{
+		memcpy(outVoxels, leaf.VoxelData, BRICK_SIZE_BYTES);
+	}
+	else if (leaf.CompressedVoxelData)
+	{
+		VoxelBrickCompression::Decompress(leaf.CompressedVoxelData, outVoxels);
+	}
+	else
+	{
+		memset(outVoxels, leaf.UniformValue, BRICK_SIZE_BYTES);
+	}
+}
+
+bool SparseTerrainVoxelOctree::ReadBrick(const glm::ivec3& brickBottomLeft, i8* outVoxels)
+{
+	return ReadBrick_Internal(brickBottomLeft, LIVE_VERSION, outVoxels);
+}
+
+bool SparseTerrainVoxelOctree::ReadBrick_Internal(const glm::ivec3& brickBottomLeft, u32 version, i8* outVoxels)
+{
+	SparseTerrainOctreeNode* onNode = &ParentNode;
+	if (!OctreeFunctionLibrary::IsPointInCube(brickBottomLeft, onNode->BottomLeftCorner, onNode->SizeInVoxels))
+	{
+		memset(outVoxels, VoxelDefaultValue, BRICK_SIZE_BYTES);
+		return true;
+	}
+	if (SparseTerrainOctreeNode* leaf = static_cast<SparseTerrainOctreeNode*>(LeafIndex.Find(GetLeafMortonCode(brickBottomLeft))))
+	{
+		onNode = leaf;
+	}
+	while (onNode->MipLevel != 0)
+	{
+		u8 childIndex;
+		SparseTerrainOctreeNode* child = FindChildContainingPoint(onNode, brickBottomLeft, childIndex, false);
+		if (!child)
+		{
+			memset(outVoxels, onNode->UniformValue, BRICK_SIZE_BYTES);
+			return true;
+		}
+		onNode = child;
+	}
+	if (!MakeLeafResidentForRead(onNode))
+	{
+		ReadUnresidentLeaf(onNode, outVoxels);
+		return false;
+	}
+	LeafState leaf;
+	GetLeafState(onNode, version, leaf);
+	ReadLeafBrick(leaf, outVoxels);
+	return true;
+}
+
+const FlatTerrainOctree& SparseTerrainVoxelOctree::GetFlatOctree()
+{
+	u32 generation = StructureGeneration.load(std::memory_order_acquire);
+	if (generation != FlatOctreeGeneration)
+	{
+		FlatOctree.Build(&ParentNode);
+		FlatOctreeGeneration = generation;
+	}
+	return FlatOctree;
+}
+
+// this node's own contribution, not its children's
+static void AddNodeToStatistics(const SparseTerrainVoxelOctree::SparseTerrainOctreeNode* node, const VoxelBrickPager& pager, TerrainOctreeStatistics& stats)
+{
+	stats.NodesPerMipLevel[node->MipLevel]++;
+	stats.NodeBytes += sizeof(SparseTerrainVoxelOctree::SparseTerrainOctreeNode);
+	if (node->Mesh.VAO)
+	{
+		stats.NumMeshes++;
+		stats.NumMeshIndices += node->Mesh.IndiciesToDraw;
+	}
+	for (const TerrainChunkTransitionMesh& transition : node->Mesh.TransitionMeshes)
+	{
+		if (transition.VAO)
+		{
+			stats.NumTransitionMeshes++;
+			stats.NumMeshIndices += transition.IndiciesToDraw;
+		}
+	}
+	if (node->MipVoxelData)
+	{
+		stats.NumMipBricks++;
+		stats.MipBrickBytes += BRICK_SIZE_BYTES;
+	}
+
+	if (node->MipLevel != 0)
+	{
+		// missing children are the node's uniform value
+		u64 childVolume = (u64)(node->SizeInVoxels / 2) * (node->SizeInVoxels / 2) * (node->SizeInVoxels / 2);
+		u32 numMissing = 0;
+		for (u32 i = 0; i < 8; i++)
+		{
+			numMissing += node->Children[i].load(std::memory_order_acquire) ? 0 : 1;
+		}
+		stats.VoxelValueCounts[(i32)node->UniformValue + 128] += childVolume * numMissing;
+		stats.NumCollapsedNodes += numMissing == 8 ? 1 : 0;
+		return;
+	}
+
+	SparseTerrainVoxelOctree::LeafState leaf;
+	SparseTerrainVoxelOctree::GetLeafState(node, SparseTerrainVoxelOctree::LIVE_VERSION, leaf);
+	const i8* voxels = leaf.VoxelData;
+	i8 decompressed[BRICK_SIZE_BYTES];
+	if (node->bPagedOut)
+	{
+		// read from the file rather than faulted in, counting shouldn't change what's resident
+		u8 paged[BRICK_SIZE_BYTES];
+		bool bCompressed = false;
+		if (!pager.ReadSlot(node->PagedSlot, paged, bCompressed))
+		{
+			return;
+		}
+		stats.NumPagedOutBricks++;
+		if (bCompressed)
+		{
+			VoxelBrickCompression::Decompress(paged, decompressed);
+		}
+		else
+		{
+			memcpy(decompressed, paged, BRICK_SIZE_BYTES);
+		}
+		voxels = decompressed;
+	}
+	else if (!leaf.VoxelData && !leaf.CompressedVoxelData)
+	{
+		stats.NumUniformLeaves++;
+		stats.VoxelValueCounts[(i32)leaf.UniformValue + 128] += BRICK_SIZE_BYTES;
+		return;
+	}
+	else if (voxels)
+	{
+		stats.NumRawBricks++;
+		stats.RawBrickBytes += BRICK_SIZE_BYTES;
+	}
+	else
+	{
+		stats.NumCompressedBricks++;
+		stats.CompressedBrickBytes += VoxelBrickCompression::GetHeader(leaf.CompressedVoxelData)->SizeBytes;
+		VoxelBrickCompression::Decompress(leaf.CompressedVoxelData, decompressed);
+		voxels = decompressed;
+	}
+	u32 numNegative = 0;
+	for (u32 i = 0; i < BRICK_SIZE_BYTES; i++)
+	{
+		stats.VoxelValueCounts[(i32)voxels[i] + 128]++;
+		numNegative += voxels[i] < 0 ? 1 : 0;
+	}
+	stats.NumSurfaceBricks += (numNegative != 0 && numNegative != BRICK_SIZE_BYTES) ? 1 : 0;
+}
+
+static void AddSubtreeToStatistics(const SparseTerrainVoxelOctree::SparseTerrainOctreeNode* node, const VoxelBrickPager& pager, TerrainOctreeStatistics& stats)
+{
+	AddNodeToStatistics(node, pager, stats);
+	for (u32 i = 0; i < 8 && node->MipLevel != 0; i++)
+	{
+		if (const SparseTerrainVoxelOctree::SparseTerrainOctreeNode* child = node->Children[i].load(std::memory_order_acquire))
+		{
+			AddSubtreeToStatistics(child, pager, stats);
+		}
+	}
+}
+
+void SparseTerrainVoxelOctree::GetStatistics(TerrainOctreeStatistics& outStatistics, rdx::thread_pool* threadPool) const
+{
+	outStatistics = TerrainOctreeStatistics();
+	outStatistics.NumMipLevels = ParentNode.MipLevel + 1;
+
+	// count the top of the tree here until there are enough subtrees below it to keep every worker busy
+	size_t targetSubtrees = threadPool ? std::max<size_t>(threadPool->NumWorkers(), 1) * 4 : 1;
+	std::vector<const SparseTerrainOctreeNode*> subtrees = { &ParentNode };
+	while (subtrees.size() < targetSubtrees && subtrees[0]->MipLevel > 1)
+	{
+		std::vector<const SparseTerrainOctreeNode*> nextLevel;
+		for (const SparseTerrainOctreeNode* node : subtrees)
+		{
+			AddNodeToStatistics(node, Pager, outStatistics);
+			for (u32 i = 0; i < 8; i++)
+			{
+				if (const SparseTerrainOctreeNode* child = node->Children[i].load(std::memory_order_acquire))
+				{
+					nextLevel.push_back(child);
+				}
+			}
+		}
+		subtrees = std::move(nextLevel);
+		if (subtrees.empty())
+		{
+			break;
+		}
+	}
+
+	if (!threadPool)
+	{
+		for (const SparseTerrainOctreeNode* subtree : subtrees)
+		{
+			AddSubtreeToStatistics(subtree, Pager, outStatistics);
+		}
+	}
+	else
+	{
+		std::vector<std::future<TerrainOctreeStatistics>> futures;
+		for (const SparseTerrainOctreeNode* subtree : subtrees)
+		{
+			futures.push_back(threadPool->enqueue([this, subtree]()
+			{
+				TerrainOctreeStatistics stats;
+				AddSubtreeToStatistics(subtree, Pager, stats);
+				return stats;
+			}));
+		}
+		for (auto& future : futures)
+		{
+			outStatistics.Add(future.get());
+		}
+	}
+
+	outStatistics.NumLeafVersions = NumLeafVersions.load();
+	outStatistics.NodePoolBytes = NodePool.GetNumSlabs() * NodePool.GetSlabSizeBytes();
+	outStatistics.BrickPoolBytes = BrickPool.GetNumSlabs() * BrickPool.GetSlabSizeBytes();
+	for (const PoolAllocator& pool : CompressedBrickPools)
+	{
+		outStatistics.CompressedBrickPoolBytes += pool.GetNumSlabs() * pool.GetSlabSizeBytes();
+	}
+	outStatistics.LeafVersionPoolBytes = LeafVersionPool.GetNumSlabs() * LeafVersionPool.GetSlabSizeBytes();
+	outStatistics.PageFileBytes = Pager.IsOpen() ? Pager.GetFileSizeBytes() : 0;
+	outStatistics.MappedWorldBytes = MappedWorld.GetSize();
+}
+
+size_t SparseTerrainVoxelOctree::GetResidentVoxelDataBytes() const
+{
+	size_t bytes = BrickPool.GetNumSlabs() * BrickPool.GetSlabSizeBytes();
+	for (const PoolAllocator& pool : CompressedBrickPools)
+	{
+		bytes += pool.GetNumSlabs() * pool.GetSlabSizeBytes();
+	}
+	return bytes;
+}
+
+void SparseTerrainVoxelOctree::GetLeafState(const SparseTerrainOctreeNode* leaf, u32 version, LeafState& outState)
+{
+	while (true)
+	{
+		const LeafVersion* history = leaf->History.load(std::memory_order_acquire);
+		if (version != LIVE_VERSION && history && version < history->Until)
+		{
+			// written to since the snapshot was pinned, find the entry covering it
+			while (version < history->From && history->Previous)
+			{
+				history = history->Previous;
+			}
+			outState.VoxelData = history->VoxelData;
+			outState.CompressedVoxelData = history->CompressedVoxelData;
+			outState.UniformValue = history->UniformValue;
+			return;
+		}
+		outState.VoxelData = leaf->VoxelData.load(std::memory_order_acquire);
+		outState.CompressedVoxelData = leaf->CompressedVoxelData.load(std::memory_order_acquire);
+		outState.UniformValue = leaf->UniformValue.load(std::memory_order_acquire);
+		// a writer preserves the leaf before touching any of it, if History hasn't moved what was read is still the
+		// snapshot's - and the bricks read won't be written to or freed while it's pinned
+		if (version == LIVE_VERSION || leaf->History.load(std::memory_order_acquire) == history)
+		{
+			return;
+		}
+	}
+}
+
+u32 SparseTerrainVoxelOctree::PinSnapshot()
+{
+	std::lock_guard<std::mutex> lock(SnapshotMutex);
+	u32 version = WriteVersion.fetch_add(1);
+	PinnedVersions.push_back(version);
+	NumPinnedSnapshots++;
+	return version;
+}
+
+void SparseTerrainVoxelOctree::ReleaseSnapshot(u32 version)
+{
+	std::lock_guard<std::mutex> lock(SnapshotMutex);
+	auto it = std::find(PinnedVersions.begin(), PinnedVersions.end(), version);
+	assert(it != PinnedVersions.end());
+	PinnedVersions.erase(it);
+	NumPinnedSnapshots--;
+	ReclaimLeafVersions();
+}
+
+void SparseTerrainVoxelOctree::PreserveLeafForSnapshots(SparseTerrainOctreeNode* leaf, bool bKeepBricks/* = true*/)
+{
+	u32 writeVersion = WriteVersion.load(std::memory_order_relaxed);
+	if (NumPinnedSnapshots.load() == 0 || leaf->PreservedVersion == writeVersion)
+	{
+		// nothing to keep, or it's already been kept for every pinned snapshot
+		return;
+	}
+	leaf->PreservedVersion = writeVersion;
+
+	LeafVersion* previous = leaf->History.load(std::memory_order_relaxed);
+	LeafVersion* version = IAllocator::New<LeafVersion>(&LeafVersionPool);
+	version->From = previous ? previous->Until : 0;
+	version->Until = writeVersion;
+	version->VoxelData = leaf->VoxelData.load(std::memory_order_relaxed);
+	version->CompressedVoxelData = leaf->CompressedVoxelData.load(std::memory_order_relaxed);
+	version->UniformValue = leaf->UniformValue.load(std::memory_order_relaxed);
+	version->Previous = previous;
+	version->RetiredAfter = 0;
+	NumLeafVersions++;
+	leaf->History.store(version, std::memory_order_release);
+	if (!leaf->bInLeavesWithHistory.exchange(true))
+	{
+		PushLeafWithHistory(leaf);
+	}
+
+	// the bricks belong to the version now, the leaf gets its own to write to
+	i8* voxels = nullptr;
+	if (bKeepBricks && (version->VoxelData || version->CompressedVoxelData))
+	{
+		// the caller is about to write single voxels so it may as well be raw
+		voxels = AllocateRawBrick();
+		if (version->VoxelData)
+		{
+			memcpy(voxels, version->VoxelData, BRICK_SIZE_BYTES);
+		}
+		else
+		{
+			VoxelBrickCompression::Decompress(version->CompressedVoxelData, voxels);
+		}
+	}
+	leaf->VoxelData.store(voxels, std::memory_order_release);
+	leaf->CompressedVoxelData.store(nullptr, std::memory_order_release);
+}
+
+void SparseTerrainVoxelOctree::PushLeafWithHistory(SparseTerrainOctreeNode* leaf)
+{
+	SparseTerrainOctreeNode* head = LeavesWithHistory.load(std::memory_order_relaxed);
+	do
+	{
+		leaf->NextWithHistory = head;
+	} while (!LeavesWithHistory.compare_exchange_weak(head, leaf, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void SparseTerrainVoxelOctree::ReclaimLeafVersions()
+{
+	u32 oldestPinned = PinnedVersions.empty() ? LIVE_VERSION : *std::min_element(PinnedVersions.begin(), PinnedVersions.end());
+	// the newest snapshot anyone could have pinned, ones unlinked now might be seen by snapshots up to this
+	u32 newestPossible = WriteVersion.load() - 1;
+
+	// a retired version can go once every snapshot that might have seen it has been released
+	auto retiredEnd = std::remove_if(RetiredLeafVersions.begin(), RetiredLeafVersions.end(), [this, oldestPinned](LeafVersion* version)
+	{
+		if (oldestPinned == LIVE_VERSION || version->RetiredAfter < oldestPinned)
+		{
+			FreeLeafVersion(version);
+			return true;
+		}
+		return false;
+	});
+	RetiredLeafVersions.erase(retiredEnd, RetiredLeafVersions.end());
+
+	SparseTerrainOctreeNode* leaf = LeavesWithHistory.exchange(nullptr, std::memory_order_acquire);
+	while (leaf)
+	{
+		SparseTerrainOctreeNode* next = leaf->NextWithHistory;
+		LeafVersion* dead = nullptr;
+		{
+			std::lock_guard<SpinLock> lock(leaf->BrickLock);
+			// versions covering only snapshots older than the oldest pinned one are dead
+			LeafVersion* kept = nullptr;
+			LeafVersion* onVersion = leaf->History.load(std::memory_order_relaxed);
+			while (onVersion && onVersion->Until > oldestPinned)
+			{
+				kept = onVersion;
+				onVersion = onVersion->Previous;
+			}
+			dead = onVersion;
+			if (kept)
+			{
+				kept->Previous = nullptr;
+			}
+			else
+			{
+				leaf->History.store(nullptr, std::memory_order_release);
+			}
+
+			if (kept)
+			{
+				PushLeafWithHistory(leaf);
+			}
+			else
+			{
+				leaf->bInLeavesWithHistory = false;
+			}
+		}
+
+		while (dead)
+		{
+			LeafVersion* previous = dead->Previous;
+			if (oldestPinned == LIVE_VERSION)
+			{
+				FreeLeafVersion(dead);
+			}
+			else
+			{
+				// a snapshot may have just read it as the head of the leaf's History
+				dead->RetiredAfter = newestPossible;
+				RetiredLeafVersions.push_back(dead);
+			}
+			dead = previous;
+		}
+		leaf = next;
+	}
+}
+
+void SparseTerrainVoxelOctree::FreeLeafVersion(LeafVersion* version)
+{
+	if (version->VoxelData)
+	{
+		FreeRawBrick(version->VoxelData);
+	}
+	if (version->CompressedVoxelData)
+	{
+		FreeCompressedBrick(version->CompressedVoxelData);
+	}
+	LeafVersionPool.Free(version);
+	NumLeafVersions--;
+}
@@ -0,0 +1,101 @@
+#include "SparseTerrainVoxelOctreeSnapshot.h"
+#include "SparseTerrainVoxelOctree.h"
+#include "ITerrainOctreeNode.h"
+#include <cassert>
+
+SparseTerrainVoxelOctreeSnapshot::SparseTerrainVoxelOctreeSnapshot(SparseTerrainVoxelOctree* octree)
+	:Octree(octree),
+	Version(octree->PinSnapshot())
+{
+}
+
+SparseTerrainVoxelOctreeSnapshot::~SparseTerrainVoxelOctreeSnapshot()
+{
+	Octree->ReleaseSnapshot(Version);
+}
+
+i8 SparseTerrainVoxelOctreeSnapshot::GetVoxelAt(const glm::ivec3& location)
+{
+	return Octree->GetVoxelAt_Internal(location, Version);
+}
+
+void SparseTerrainVoxelOctreeSnapshot::GetVoxelsForNode(ITerrainOctreeNode* node, i8* outVoxels)
+{
+	Octree->GetVoxelsForNode_Internal(node, Version, outVoxels);
+}
+
+void SparseTerrainVoxelOctreeSnapshot::GetVoxelRegionContainingPoint(const glm::ivec3& location, VoxelRegion& outRegion)
+{
+	Octree->GetVoxelRegionContainingPoint_Internal(location, Version, outRegion);
+}
+
+bool SparseTerrainVoxelOctreeSnapshot::ReadBrick(const glm::ivec3& brickBottomLeft, i8* outVoxels)
+{
+	return Octree->ReadBrick_Internal(brickBottomLeft, Version, outVoxels);
+}
+
+size_t SparseTerrainVoxelOctreeSnapshot::GetSize() const
+{
+	return Octree->GetSize();
+}
+
+ITerrainOctreeNode* SparseTerrainVoxelOctreeSnapshot::FindNodeFromIndex(TerrainOctreeIndex index, bool createIfDoesntExist/* = false*/)
+{
+	assert(!createIfDoesntExist);
+	// walked here rather than through the octree's, which marks the path as edited
+	ITerrainOctreeNode* onNode = Octree->GetParentNode();
+	u32 mipLevels = onNode->GetMipLevel();
+	for (u32 i = 0; i < mipLevels && onNode; i++)
+	{
+		onNode = onNode->GetChild((index >> (4 * i)) & 0x0f);
+	}
+	return onNode;
+}
+
+ITerrainOctreeNode* SparseTerrainVoxelOctreeSnapshot::GetParentNode()
+{
+	return Octree->GetParentNode();
+}
+
+TerrainOctreeIndex SparseTerrainVoxelOctreeSnapshot::SetVoxelAt(const glm::ivec3& location, i8 value)
+{
+	assert(false);
+	return 0xffffffffffffffff;
+}
+
+TerrainOctreeIndex SparseTerrainVoxelOctreeSnapshot::FillBrick(const glm::ivec3& brickBottomLeft, const i8* voxels)
+{
+	assert(false);
+	return 0xffffffffffffffff;
+}
+
+TerrainOctreeIndex SparseTerrainVoxelOctreeSnapshot::FillBrick(const glm::ivec3& brickBottomLeft, const std::function<i8(const glm::ivec3&)>& generator)
+{
+	assert(false);
+	return 0xffffffffffffffff;
+}
+
+void SparseTerrainVoxelOctreeSnapshot::Clear()
+{
+	assert(false);
+}
+
+void SparseTerrainVoxelOctreeSnapshot::ResizeAndClear(const size_t newSize)
+{
+	assert(false);
+}
+
+void SparseTerrainVoxelOctreeSnapshot::AllocateNodeVoxelData(ITerrainOctreeNode* node)
+{
+	assert(false);
+}
+
+void SparseTerrainVoxelOctreeSnapshot::CreateChildrenForFirstNMipLevels(ITerrainOctreeNode* node, int n, int onLevel/* = 0*/)
+{
+	assert(false);
+}
+
+void SparseTerrainVoxelOctreeSnapshot::CollapseUniformSubtrees()
+{
+	assert(false);
+}
@@ -0,0 +1,89 @@
+#include "TerrainOctreeStatistics.h"
+#include <sstream>
+
+void TerrainOctreeStatistics::Add(const TerrainOctreeStatistics& other)
+{
+	for (u32 i = 0; i < TERRAIN_STATISTICS_MAX_MIP_LEVELS; i++)
+	{
+		NodesPerMipLevel[i] += other.NodesPerMipLevel[i];
+	}
+	NodeBytes += other.NodeBytes;
+	NumUniformLeaves += other.NumUniformLeaves;
+	NumRawBricks += other.NumRawBricks;
+	NumCompressedBricks += other.NumCompressedBricks;
+	NumPagedOutBricks += other.NumPagedOutBricks;
+	NumSurfaceBricks += other.NumSurfaceBricks;
+	RawBrickBytes += other.RawBrickBytes;
+	CompressedBrickBytes += other.CompressedBrickBytes;
+	NumCollapsedNodes += other.NumCollapsedNodes;
+	NumMipBricks += other.NumMipBricks;
+	MipBrickBytes += other.MipBrickBytes;
+	NumLeafVersions += other.NumLeafVersions;
+	NumMeshes += other.NumMeshes;
+	NumTransitionMeshes += other.NumTransitionMeshes;
+	NumMeshIndices += other.NumMeshIndices;
+	NodePoolBytes += other.NodePoolBytes;
+	BrickPoolBytes += other.BrickPoolBytes;
+	CompressedBrickPoolBytes += other.CompressedBrickPoolBytes;
+	LeafVersionPoolBytes += other.LeafVersionPoolBytes;
+	PageFileBytes += other.PageFileBytes;
+	MappedWorldBytes += other.MappedWorldBytes;
+	for (u32 i = 0; i < 256; i++)
+	{
+		VoxelValueCounts[i] += other.VoxelValueCounts[i];
+	}
+}
+
+std::string TerrainOctreeStatistics::ToJson() const
+{
+	std::ostringstream json;
+	json << "{\n";
+	json << "\t\"nodesPerMipLevel\": [";
+	for (u32 i = 0; i < NumMipLevels; i++)
+	{
+		json << (i ? ", " : "") << NodesPerMipLevel[i];
+	}
+	json << "],\n";
+	json << "\t\"nodeBytes\": " << NodeBytes << ",\n";
+	json << "\t\"leaves\": {\n";
+	json << "\t\t\"uniform\": " << NumUniformLeaves << ",\n";
+	json << "\t\t\"rawBricks\": " << NumRawBricks << ",\n";
+	json << "\t\t\"compressedBricks\": " << NumCompressedBricks << ",\n";
+	json << "\t\t\"pagedOutBricks\": " << NumPagedOutBricks << ",\n";
+	json << "\t\t\"surfaceBricks\": " << NumSurfaceBricks << ",\n";
+	json << "\t\t\"rawBrickBytes\": " << RawBrickBytes << ",\n";
+	json << "\t\t\"compressedBrickBytes\": " << CompressedBrickBytes << "\n";
+	json << "\t},\n";
+	json << "\t\"collapsedNodes\": " << NumCollapsedNodes << ",\n";
+	json << "\t\"mipBricks\": " << NumMipBricks << ",\n";
+	json << "\t\"mipBrickBytes\": " << MipBrickBytes << ",\n";
+	json << "\t\"leafVersions\": " << NumLeafVersions << ",\n";
+	json << "\t\"meshes\": {\n";
+	json << "\t\t\"chunks\": " << NumMeshes << ",\n";
+	json << "\t\t\"transitions\": " << NumTransitionMeshes << ",\n";
+	json << "\t\t\"indices\": " << NumMeshIndices << "\n";
+	json << "\t},\n";
+	json << "\t\"pools\": {\n";
+	json << "\t\t\"nodeBytes\": " << NodePoolBytes << ",\n";
+	json << "\t\t\"brickBytes\": " << BrickPoolBytes << ",\n";
+	json << "\t\t\"compressedBrickBytes\": " << CompressedBrickPoolBytes << ",\n";
+	json << "\t\t\"leafVersionBytes\": " << LeafVersionPoolBytes << ",\n";
+	json << "\t\t\"totalBytes\": " << GetTotalPoolBytes() << "\n";
+	json << "\t},\n";
+	json << "\t\"pageFileBytes\": " << PageFileBytes << ",\n";
+	json << "\t\"mappedWorldBytes\": " << MappedWorldBytes << ",\n";
+	// only the values that occur, keyed by value
+	json << "\t\"voxelValueCounts\": {";
+	bool bFirst = true;
+	for (u32 i = 0; i < 256; i++)
+	{
+		if (VoxelValueCounts[i])
+		{
+			json << (bFirst ? "\n" : ",\n") << "\t\t\"" << (i32)i - 128 << "\": " << VoxelValueCounts[i];
+			bFirst = false;
+		}
+	}
+	json << (bFirst ? "}\n" : "\n\t}\n");
+	json << "}\n";
+	return json.str();
+}
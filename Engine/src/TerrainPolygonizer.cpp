@@ -2,19 +2,22 @@
 #include "IAllocator.h"
 #include "TerrainDefs.h"
 #include "IVoxelDataSource.h"
+#include "VoxelAccessor.h"
 #include "TransVoxel.h"
 #include "ITerrainOctreeNode.h"
+#include "VoxelCellCases.h"
+#include "TerrainVertexCompression.h"
+#include "ScratchArena.h"
 #include <cmath>
+#include <cstddef>
 
+// only the old marching cubes path still uses fixed size arrays, PolygonizeCellSyncMMC counts what it needs first
 #define TERRAIN_CELL_VERTEX_ARRAY_SIZE 10000 // each worker can output this number of vertices maximum
 #define TERRAIN_CELL_INDEX_ARRAY_SIZE 10000 // each worker can output this number of vertices maximum
 
 #define TERRAIN_CELL_TRANSITION_MESH_VERTEX_ARRAY_SIZE 1000
 #define TERRAIN_CELL_TRANSITION_MESH_INDEX_ARRAY_SIZE 1000
 
-#define TERRAIN_FIXED_FRACTION_SIZE_BITS 8
-#define TERRAIN_FIXED_FRACTION_MAX 0xff
-
 #define K   (1 << (Q - 1))
 
 TerrainPolygonizer::TerrainPolygonizer(IAllocator* allocator, std::shared_ptr<rdx::thread_pool> threadPool)
@@ -336,7 +339,7 @@ char triTable[256][16] =
    Linearly interpolate the position where an isosurface cuts
    an edge between two vertices, each with their own scalar value
 */
-TerrainVertex TerrainPolygonizer::VertexInterp( glm::vec3 p1, glm::vec3 p2,float valp1,float valp2, glm::ivec3& coords1, glm::ivec3& coords2, i8* voxels, ITerrainOctreeNode* cellToPolygonize, IVoxelDataSource* source)
+TerrainVertex TerrainPolygonizer::VertexInterp( glm::vec3 p1, glm::vec3 p2,float valp1,float valp2, glm::ivec3& coords1, glm::ivec3& coords2, i8* voxels, ITerrainOctreeNode* cellToPolygonize, VoxelAccessor& accessor)
 {
 	auto GetVoxelValueAt = [](u8 x, u8 y, u8 z, i8* voxels) -> i8
 	{
@@ -381,7 +384,7 @@ TerrainVertex TerrainPolygonizer::VertexInterp( glm::vec3 p1, glm::vec3 p2,float
 		while (mipLevel > 0)
 		{
 			glm::ivec3 midPoint = glm::vec3(p1) + glm::vec3(p2 - p1) * 0.5f;
-			float midPointVal = source->GetVoxelAt(midPoint);
+			float midPointVal = accessor.GetVoxelAt(midPoint);
 			if (mu > 0.5f)
 			{
 				
@@ -421,7 +424,7 @@ TerrainVertex TerrainPolygonizer::VertexInterp( glm::vec3 p1, glm::vec3 p2,float
 }
 //#pragma optimize("", on)
 
-int TerrainPolygonizer::Polygonise(GridCell &Grid, int &NewVertexCount, TerrainVertex *Vertices, int& newIndicesCount, char* indices, i8* voxels, ITerrainOctreeNode* node, IVoxelDataSource* source)
+int TerrainPolygonizer::Polygonise(GridCell &Grid, int &NewVertexCount, TerrainVertex *Vertices, int& newIndicesCount, char* indices, i8* voxels, ITerrainOctreeNode* node, VoxelAccessor& accessor)
 {
 	int CubeIndex;
 
@@ -447,51 +450,51 @@ int TerrainPolygonizer::Polygonise(GridCell &Grid, int &NewVertexCount, TerrainV
 
 	//Find the vertices where the surface intersects the cube
 	if (edgeTable[CubeIndex] & 1) {
-		VertexList[0] = VertexInterp(Grid.p[0],Grid.p[1],Grid.val[0],Grid.val[1],Grid.coords[0],Grid.coords[1],voxels, node, source);
+		VertexList[0] = VertexInterp(Grid.p[0],Grid.p[1],Grid.val[0],Grid.val[1],Grid.coords[0],Grid.coords[1],voxels, node, accessor);
 	}
 		
 	if (edgeTable[CubeIndex] & 2) {
-		VertexList[1] = VertexInterp(Grid.p[1],Grid.p[2],Grid.val[1],Grid.val[2],Grid.coords[1],Grid.coords[2],voxels, node, source);
+		VertexList[1] = VertexInterp(Grid.p[1],Grid.p[2],Grid.val[1],Grid.val[2],Grid.coords[1],Grid.coords[2],voxels, node, accessor);
 	}
 		
 	if (edgeTable[CubeIndex] & 4) {
-		VertexList[2] = VertexInterp(Grid.p[2],Grid.p[3],Grid.val[2],Grid.val[3],Grid.coords[2],Grid.coords[3],voxels, node, source);
+		VertexList[2] = VertexInterp(Grid.p[2],Grid.p[3],Grid.val[2],Grid.val[3],Grid.coords[2],Grid.coords[3],voxels, node, accessor);
 	}
 		
 	if (edgeTable[CubeIndex] & 8) {
-		VertexList[3] = VertexInterp(Grid.p[3],Grid.p[0],Grid.val[3],Grid.val[0],Grid.coords[3],Grid.coords[0],voxels, node, source);
+		VertexList[3] = VertexInterp(Grid.p[3],Grid.p[0],Grid.val[3],Grid.val[0],Grid.coords[3],Grid.coords[0],voxels, node, accessor);
 	}
 
 	if (edgeTable[CubeIndex] & 16) {
-		VertexList[4] = VertexInterp(Grid.p[4],Grid.p[5],Grid.val[4],Grid.val[5],Grid.coords[4],Grid.coords[5],voxels, node, source);
+		VertexList[4] = VertexInterp(Grid.p[4],Grid.p[5],Grid.val[4],Grid.val[5],Grid.coords[4],Grid.coords[5],voxels, node, accessor);
 	}
 		
 	if (edgeTable[CubeIndex] & 32) {
-		VertexList[5] = VertexInterp(Grid.p[5],Grid.p[6],Grid.val[5],Grid.val[6],Grid.coords[5],Grid.coords[6],voxels, node, source);
+		VertexList[5] = VertexInterp(Grid.p[5],Grid.p[6],Grid.val[5],Grid.val[6],Grid.coords[5],Grid.coords[6],voxels, node, accessor);
 	}
 
 	if (edgeTable[CubeIndex] & 64) {
-		VertexList[6] = VertexInterp(Grid.p[6],Grid.p[7],Grid.val[6],Grid.val[7],Grid.coords[6],Grid.coords[7],voxels, node, source);
+		VertexList[6] = VertexInterp(Grid.p[6],Grid.p[7],Grid.val[6],Grid.val[7],Grid.coords[6],Grid.coords[7],voxels, node, accessor);
 	}
 		
 	if (edgeTable[CubeIndex] & 128) {
-		VertexList[7] = VertexInterp(Grid.p[7],Grid.p[4],Grid.val[7],Grid.val[4],Grid.coords[7],Grid.coords[4],voxels, node, source);
+		VertexList[7] = VertexInterp(Grid.p[7],Grid.p[4],Grid.val[7],Grid.val[4],Grid.coords[7],Grid.coords[4],voxels, node, accessor);
 	}
 		
 	if (edgeTable[CubeIndex] & 256) {
-		VertexList[8] = VertexInterp(Grid.p[0],Grid.p[4],Grid.val[0],Grid.val[4],Grid.coords[0],Grid.coords[4],voxels, node, source);
+		VertexList[8] = VertexInterp(Grid.p[0],Grid.p[4],Grid.val[0],Grid.val[4],Grid.coords[0],Grid.coords[4],voxels, node, accessor);
 	}
 
 	if (edgeTable[CubeIndex] & 512) {
-		VertexList[9] = VertexInterp(Grid.p[1],Grid.p[5],Grid.val[1],Grid.val[5],Grid.coords[1],Grid.coords[5],voxels, node, source);
+		VertexList[9] = VertexInterp(Grid.p[1],Grid.p[5],Grid.val[1],Grid.val[5],Grid.coords[1],Grid.coords[5],voxels, node, accessor);
 	}
 
 	if (edgeTable[CubeIndex] & 1024) {
-		VertexList[10] = VertexInterp(Grid.p[2],Grid.p[6],Grid.val[2],Grid.val[6],Grid.coords[2],Grid.coords[6],voxels, node, source);
+		VertexList[10] = VertexInterp(Grid.p[2],Grid.p[6],Grid.val[2],Grid.val[6],Grid.coords[2],Grid.coords[6],voxels, node, accessor);
 	}
 		
 	if (edgeTable[CubeIndex] & 2048) {
-		VertexList[11] = VertexInterp(Grid.p[3],Grid.p[7],Grid.val[3],Grid.val[7],Grid.coords[3],Grid.coords[7],voxels, node, source);
+		VertexList[11] = VertexInterp(Grid.p[3],Grid.p[7],Grid.val[3],Grid.val[7],Grid.coords[3],Grid.coords[7],voxels, node, accessor);
 	}
 		
 
@@ -559,6 +562,8 @@ PolygonizeWorkerThreadData* TerrainPolygonizer::PolygonizeCellSync(ITerrainOctre
 	rVal->Vertices = (TerrainVertex*)dataPtr;
 	dataPtr += TERRAIN_CELL_VERTEX_ARRAY_SIZE * sizeof(TerrainVertex);
 	rVal->Indices = (u32*)dataPtr;
+	rVal->IndexType = TerrainIndexType::U32;
+	rVal->VertexFormat = TerrainVertexFormat::Full;
 	dataPtr += TERRAIN_CELL_INDEX_ARRAY_SIZE * sizeof(u32);
 	rVal->VoxelData = (i8*)dataPtr;
 
@@ -579,6 +584,8 @@ PolygonizeWorkerThreadData* TerrainPolygonizer::PolygonizeCellSync(ITerrainOctre
 	u32 indicesTop = 0;
 
 	source->GetVoxelsForNode(cellToPolygonize, rVal->VoxelData);
+	// anything read outside the prefetched block goes through here, it's one per job so one per worker thread
+	VoxelAccessor accessor(source);
 
 	
 	glm::ivec3 blockBottomLeft = cellToPolygonize->GetBottomLeftCorner();
@@ -648,7 +655,7 @@ PolygonizeWorkerThreadData* TerrainPolygonizer::PolygonizeCellSync(ITerrainOctre
 				int numOutputtedVerts = 0;
 				int numOutputtedIndices = 0;
 
-				Polygonise(g, numOutputtedVerts, outputtedVerts, numOutputtedIndices, outputtedIndices,rVal->VoxelData, cellToPolygonize, source);
+				Polygonise(g, numOutputtedVerts, outputtedVerts, numOutputtedIndices, outputtedIndices,rVal->VoxelData, cellToPolygonize, accessor);
 
 				for (int i = 0; i < numOutputtedIndices; i++)
 				{
@@ -671,22 +678,23 @@ PolygonizeWorkerThreadData* TerrainPolygonizer::PolygonizeCellSync(ITerrainOctre
 typedef i8 Voxel;
 
 
-inline Voxel GetVoxel(IVoxelDataSource* source, i32 i, i32 j, i32 k)
+// i, j and k are lattice coordinates relative to the chunks bottom left corner - the gutter
+// fetched by GetVoxelsForNode means they can range from -POLYGONIZER_NEGATIVE_GUTTER to BASE_CELL_SIZE + POLYGONIZER_POSITIVE_GUTTER - 1
+inline Voxel GetVoxel(const Voxel* field, i32 i, i32 j, i32 k)
 {
-	return source->GetVoxelAt({i,j,k});//field[TOTAL_DECK_SIZE * (k+POLYGONIZER_NEGATIVE_GUTTER) + TOTAL_CELL_SIZE * (j+POLYGONIZER_NEGATIVE_GUTTER) + (i+POLYGONIZER_NEGATIVE_GUTTER)];
-	//return (field[(k * m + j) * n + i]);
+	return field[TOTAL_DECK_SIZE * (k + POLYGONIZER_NEGATIVE_GUTTER) + TOTAL_CELL_SIZE * (j + POLYGONIZER_NEGATIVE_GUTTER) + (i + POLYGONIZER_NEGATIVE_GUTTER)];
 }
 
-u32 LoadCell(IVoxelDataSource* source, int stepSize, i32 i, i32 j, i32 k, Voxel *distance)
+u32 LoadCell(const Voxel* field, i32 i, i32 j, i32 k, Voxel *distance)
 {
-	distance[0] = source->GetVoxelAt({i,j,k});//GetVoxel(field, n, m, i, j, k);
-	distance[1] = source->GetVoxelAt({i+stepSize,j,         k});//GetVoxel(field, n, m, i + 1, j, k);
-	distance[2] = source->GetVoxelAt({i,         j+stepSize,k});//GetVoxel(field, n, m, i, j + 1, k);
-	distance[3] = source->GetVoxelAt({i+stepSize,j+stepSize,k});//GetVoxel(field, n, m, i + 1, j + 1, k);
-	distance[4] = source->GetVoxelAt({i,         j,         k+stepSize});//GetVoxel(field, n, m, i, j, k + 1);
-	distance[5] = source->GetVoxelAt({i+stepSize,j,         k+stepSize});//GetVoxel(field, n, m, i + 1, j, k + 1);
-	distance[6] = source->GetVoxelAt({i,         j+stepSize,k+stepSize});//GetVoxel(field, n, m, i, j + 1, k + 1);
-	distance[7] = source->GetVoxelAt({i+stepSize,j+stepSize,k+stepSize});//GetVoxel(field, n, m, i + 1, j + 1, k + 1);
+	distance[0] = GetVoxel(field, i,     j,     k);
+	distance[1] = GetVoxel(field, i + 1, j,     k);
+	distance[2] = GetVoxel(field, i,     j + 1, k);
+	distance[3] = GetVoxel(field, i + 1, j + 1, k);
+	distance[4] = GetVoxel(field, i,     j,     k + 1);
+	distance[5] = GetVoxel(field, i + 1, j,     k + 1);
+	distance[6] = GetVoxel(field, i,     j + 1, k + 1);
+	distance[7] = GetVoxel(field, i + 1, j + 1, k + 1);
 
 	// Concatenate sign bits of the voxel values to form the case index for the cell.
 	return (((distance[0] >> 7) & 0x01) | ((distance[1] >> 6) & 0x02)
@@ -1119,14 +1127,25 @@ Integer3D NormalizeFixedPointVector(const Integer3D& inVec)
 
 //#pragma optimize("", on)
 
-void SurfaceShift(u8 currentLOD, Integer3D& minSample, Integer3D& maxSample, IVoxelDataSource* source, i32& d0, i32& d1)
+// central difference gradient at a lattice point of the prefetched block. Corners go up to BASE_CELL_SIZE
+// so this reads one lattice step either side, which is always inside the gutter.
+inline Integer3D LoadCornerNormal(const Voxel* field, const Integer3D& corner)
+{
+	return Integer3D{
+		int2fix(GetVoxel(field, corner.x - 1, corner.y, corner.z) - GetVoxel(field, corner.x + 1, corner.y, corner.z)),
+		int2fix(GetVoxel(field, corner.x, corner.y - 1, corner.z) - GetVoxel(field, corner.x, corner.y + 1, corner.z)),
+		int2fix(GetVoxel(field, corner.x, corner.y, corner.z - 1) - GetVoxel(field, corner.x, corner.y, corner.z + 1))
+	};
+}
+
+void SurfaceShift(u8 currentLOD, Integer3D& minSample, Integer3D& maxSample, VoxelAccessor& accessor, i32& d0, i32& d1)
 {
 	if (!currentLOD)
 	{
 		return;
 	}
 	Integer3D midSample = ((minSample + maxSample) / 2);
-	Voxel sample = source->GetVoxelAt(midSample);
+	Voxel sample = accessor.GetVoxelAt(midSample);
 	if (d0 < 0)
 	{
 		if (sample < 0)
@@ -1153,32 +1172,32 @@ void SurfaceShift(u8 currentLOD, Integer3D& minSample, Integer3D& maxSample, IVo
 			d0 = sample;
 		}
 	}
-	SurfaceShift(currentLOD -1, minSample, maxSample, source, d0, d1);
+	SurfaceShift(currentLOD -1, minSample, maxSample, accessor, d0, d1);
 }
 
 void ProcessCell(
 	const Voxel* field,
 	i32 n, i32 m, i32 i, i32 j, i32 k,
+	u32 caseIndex,
 	CellStorage* const (& deckStorage)[2],
 	u32 deltaMask,
 	i32& meshVertexCount,
 	i32& meshTriangleCount,
 	TerrainVertexFixedPoint* meshVertexArray,
 	Triangle* meshTriangleArray,
-	IVoxelDataSource* source,
+	VoxelAccessor& accessor,
 	u8 lod,
 	glm::ivec3& bottomLeft,
 	int stepSize)
 {
 	Voxel		distance[8];
 
-	// Get storage for current cell and set vertex indices at corners
-	// to invalid values so those not generated here won't get reused.
+	// Get storage for current cell. ExtractIsosurface has already set the vertex indices
+	// at its corners to invalid values so those not generated here won't get reused.
 	CellStorage *cellStorage = &deckStorage[0][j * n + i];
-	for (i32 a = 0; a < 7; a++) cellStorage->corner[a] = 0xFFFF;
 
-	// Call LoadCell() to populate the distance array and get case index.
-	u32 caseIndex = LoadCell(source, stepSize, bottomLeft.x + i*stepSize, bottomLeft.y + j*stepSize, bottomLeft.z+k*stepSize, distance);
+	// Call LoadCell() to populate the distance array, the case index comes from the pre-pass.
+	LoadCell(field, i, j, k, distance);
 
 	// Look up the equivalence class index and use it to look up
 	// geometric data for this cell. No geometry if case is 0 or 255.
@@ -1211,6 +1230,11 @@ void ProcessCell(
 			corner[0] = vcode & 0x07;
 			corner[1] = (vcode >> 3) & 0x07;
 
+			// Gradients come from the prefetched block at the edge's lattice endpoints,
+			// so they are taken before SurfaceShift moves the endpoints off the lattice.
+			normal[0] = NormalizeFixedPointVector(LoadCornerNormal(field, Integer3D{ i + (corner[0] & 1), j + ((corner[0] >> 1) & 1), k + ((corner[0] >> 2) & 1) }));
+			normal[1] = NormalizeFixedPointVector(LoadCornerNormal(field, Integer3D{ i + (corner[1] & 1), j + ((corner[1] >> 1) & 1), k + ((corner[1] >> 2) & 1) }));
+
 			// Construct integer coordinates of edge's endpoints.
 			position[0].x = bottomLeft.x +  ((i + (corner[0] & 1)) * stepSize);
 			position[0].y = bottomLeft.y + ((j + ((corner[0] >> 1) & 1)) * stepSize);
@@ -1234,18 +1258,10 @@ void ProcessCell(
 
 			if ((t & 0x00FF) != 0)
 			{
-				SurfaceShift(lod, position[0], position[1], source, d0, d1);
-
-				normal[0].x = int2fix(GetVoxel(source, position[0].x-1, position[0].y, position[0].z) - GetVoxel(source, position[0].x+1, position[0].y, position[0].z));
-				normal[0].y = int2fix(GetVoxel(source, position[0].x, position[0].y-1, position[0].z) - GetVoxel(source, position[0].x, position[0].y+1, position[0].z));
-				normal[0].z = int2fix(GetVoxel(source, position[0].x, position[0].y, position[0].z-1) - GetVoxel(source, position[0].x, position[0].y, position[0].z+1));
+				// the prefetched block only holds lattice samples, so refining the
+				// crossing below the lattice still has to go to the source
+				SurfaceShift(lod, position[0], position[1], accessor, d0, d1);
 
-				normal[1].x = int2fix(GetVoxel(source, position[1].x-1, position[1].y, position[1].z) - GetVoxel(source, position[1].x+1, position[1].y, position[1].z));
-				normal[1].y = int2fix(GetVoxel(source, position[1].x, position[1].y-1, position[1].z) - GetVoxel(source, position[1].x, position[1].y+1, position[1].z));
-				normal[1].z = int2fix(GetVoxel(source, position[1].x, position[1].y, position[1].z-1) - GetVoxel(source, position[1].x, position[1].y, position[1].z+1));
-
-				normal[0] = NormalizeFixedPointVector(normal[0]);
-				normal[1] = NormalizeFixedPointVector(normal[1]);
 				// Vertex falls in the interior of an edge.
 				// Extract edge index and delta code from vertex code.
 				u16 edgeIndex = (vcode >> 8) & 0x0F;
@@ -1275,16 +1291,6 @@ void ProcessCell(
 			}
 			else
 			{
-				normal[0].x = int2fix(GetVoxel(source, position[0].x-1, position[0].y, position[0].z) - GetVoxel(source, position[0].x+1, position[0].y, position[0].z));
-				normal[0].y = int2fix(GetVoxel(source, position[0].x, position[0].y-1, position[0].z) - GetVoxel(source, position[0].x, position[0].y+1, position[0].z));
-				normal[0].z = int2fix(GetVoxel(source, position[0].x, position[0].y, position[0].z-1) - GetVoxel(source, position[0].x, position[0].y, position[0].z+1));
-
-				normal[1].x = int2fix(GetVoxel(source, position[1].x-1, position[1].y, position[1].z) - GetVoxel(source, position[1].x+1, position[1].y, position[1].z));
-				normal[1].y = int2fix(GetVoxel(source, position[1].x, position[1].y-1, position[1].z) - GetVoxel(source, position[1].x, position[1].y+1, position[1].z));
-				normal[1].z = int2fix(GetVoxel(source, position[1].x, position[1].y, position[1].z-1) - GetVoxel(source, position[1].x, position[1].y, position[1].z+1));
-
-				normal[0] = NormalizeFixedPointVector(normal[0]);
-				normal[1] = NormalizeFixedPointVector(normal[1]);
 				// Vertex falls exactly at the first corner of the cell if
 				// t == 0, and at the second corner if t == 0x0100.
 				u8 c = (t == 0);
@@ -1336,20 +1342,45 @@ void ProcessCell(
 	}
 }
 
+// first pass of polygonizing a block - how many triangles the occupied cells make and the most vertices they can,
+// every cell's own vertices with none shared, so the second pass can write into arrays that are exactly big enough
+void CountIsosurfaceGeometry(const VoxelCellCases::CellCases& cases, u32& outMaxVertices, u32& outTriangles)
+{
+	u32 maxVertices = 0;
+	u32 triangles = 0;
+	for (u32 row = 0; row < BASE_CELL_SIZE * BASE_CELL_SIZE; row++)
+	{
+		u32 occupied = cases.OccupiedCells[row];
+		const u8* rowCases = cases.Cases + BASE_CELL_SIZE * row;
+		while (occupied)
+		{
+			u32 i = VoxelCellCases::LowestSetBit(occupied);
+			occupied &= occupied - 1;
+			u32 geometryCounts = classGeometryTable[equivClassTable[rowCases[i]]].geometryCounts;
+			maxVertices += geometryCounts >> 4;
+			triangles += geometryCounts & 0x0F;
+		}
+	}
+	outMaxVertices = maxVertices;
+	outTriangles = triangles;
+}
+
 // Listing 10.24
 
 void ExtractIsosurface(
 	const Voxel* field, 
+	const VoxelCellCases::CellCases& cases,
 	i32 n, i32 m, i32 h, 
 	i32* meshVertexCount,
 	i32* meshTriangleCount,
 	TerrainVertexFixedPoint* meshVertexArray,
 	Triangle* meshTriangleArray,
 	IAllocator* allocator,
-	IVoxelDataSource* source,
+	VoxelAccessor& accessor,
 	u8 lod,
 	glm::ivec3& bottomLeft,
-	float stepSize)
+	float stepSize,
+	bool bSkipEmptyCells)
 {
 	CellStorage* deckStorage[2];
 	// Allocate storage for two decks of history.
@@ -1358,26 +1389,48 @@ void ExtractIsosurface(
 
 	i32 vertexCount = 0;
 	i32 triangleCount = 0;
-	u16 deltaMask = 0;
+	assert(n == BASE_CELL_SIZE && m == BASE_CELL_SIZE && h == BASE_CELL_SIZE);
 
+	auto isDeckVisited = [&cases, bSkipEmptyCells](i32 k)
+	{
+		return !bSkipEmptyCells || VoxelCellCases::IsDeckOccupied(cases, k);
+	};
+
+	bool bNextDeckOccupied = isDeckVisited(0);
 	for (i32 k = 0; k < h; k++)
 	{
 		// Ping-pong between history decks.
 		deckStorage[0] = &precedingCellStorage[n * m * (k & 1)];
 
-		for (i32 j = 0; j < m; j++)
+		// cells with no surface in them are skipped, so rather than each cell invalidating its own corners
+		// the whole deck is, if anything in it or the next deck is going to look at it
+		bool bDeckOccupied = bNextDeckOccupied;
+		bNextDeckOccupied = k + 1 < h && isDeckVisited(k + 1);
+		if (bDeckOccupied || bNextDeckOccupied)
 		{
-			for (i32 i = 0; i < n; i++)
+			memset(deckStorage[0], 0xFF, sizeof(CellStorage) * n * m);
+		}
+
+		if (bDeckOccupied)
+		{
+			for (i32 j = 0; j < m; j++)
 			{
-				ProcessCell(field, n, m, i, j, k, deckStorage, deltaMask, vertexCount, triangleCount, meshVertexArray, meshTriangleArray, source, lod, bottomLeft, stepSize);
-				deltaMask |= 1;  					// Allow reuse in x direction.
-			}
+				// only visit the cells the surface goes through
+				u32 occupied = bSkipEmptyCells ? cases.OccupiedCells[j + n * k] : (1u << n) - 1;
+				while (occupied)
+				{
+					i32 i = (i32)VoxelCellCases::LowestSetBit(occupied);
+					occupied &= occupied - 1;
 
-			deltaMask = (deltaMask | 2) & 6;		// Allow reuse in y direction, but not x.
+					// Allow reuse in each direction that has a preceding cell.
+					u32 deltaMask = (i > 0) | ((j > 0) << 1) | ((k > 0) << 2);
+					u32 caseIndex = cases.Cases[i + n * j + n * m * k];
+					ProcessCell(field, n, m, i, j, k, caseIndex, deckStorage, deltaMask, vertexCount, triangleCount, meshVertexArray, meshTriangleArray, accessor, lod, bottomLeft, stepSize);
+				}
+			}
 		}
 
 		deckStorage[1] = deckStorage[0];			// Current deck becomes preceding deck.
-		deltaMask = 4;								// Allow reuse only in z direction.
 	}
 
 	allocator->Free(precedingCellStorage);
@@ -1386,19 +1439,19 @@ void ExtractIsosurface(
 	*meshTriangleCount = triangleCount;
 }
 
-u32 LoadTransitionCellX(const Voxel* field, IVoxelDataSource* source, i32 i, i32 j, i32 k, i8* outDistance, u32 stepSize, const glm::ivec3& bl)
+u32 LoadTransitionCellX(const Voxel* field, VoxelAccessor& accessor, i32 i, i32 j, i32 k, i8* outDistance, u32 stepSize, const glm::ivec3& bl)
 {
 	glm::ivec3 ijk = {i,j,k};
 
-	outDistance[0] = outDistance[0x9] = source->GetVoxelAt({i, j, k});
-	outDistance[1] = source->GetVoxelAt(ijk + glm::ivec3{0, (stepSize >> 1), 0} + bl);
-	outDistance[2] = outDistance[0xa] = source->GetVoxelAt({ i, j + stepSize, k});
-	outDistance[3] = source->GetVoxelAt(ijk + glm::ivec3{0, 0, (stepSize >> 1)} + bl);
-	outDistance[4] = source->GetVoxelAt(ijk + glm::ivec3{0, (stepSize >> 1), (stepSize >> 1)} + bl);
-	outDistance[5] = source->GetVoxelAt(ijk + glm::ivec3{0, stepSize, (stepSize >> 1)} + bl);
-	outDistance[6] = outDistance[0xb] = source->GetVoxelAt({ i, j, k + stepSize});
-	outDistance[7] = source->GetVoxelAt(ijk + glm::ivec3{0, (stepSize >> 1), stepSize} + bl);
-	outDistance[8] = outDistance[0xc] = source->GetVoxelAt({ i, j + stepSize, k + stepSize});
+	outDistance[0] = outDistance[0x9] = accessor.GetVoxelAt({i, j, k});
+	outDistance[1] = accessor.GetVoxelAt(ijk + glm::ivec3{0, (stepSize >> 1), 0} + bl);
+	outDistance[2] = outDistance[0xa] = accessor.GetVoxelAt({ i, j + stepSize, k});
+	outDistance[3] = accessor.GetVoxelAt(ijk + glm::ivec3{0, 0, (stepSize >> 1)} + bl);
+	outDistance[4] = accessor.GetVoxelAt(ijk + glm::ivec3{0, (stepSize >> 1), (stepSize >> 1)} + bl);
+	outDistance[5] = accessor.GetVoxelAt(ijk + glm::ivec3{0, stepSize, (stepSize >> 1)} + bl);
+	outDistance[6] = outDistance[0xb] = accessor.GetVoxelAt({ i, j, k + stepSize});
+	outDistance[7] = accessor.GetVoxelAt(ijk + glm::ivec3{0, (stepSize >> 1), stepSize} + bl);
+	outDistance[8] = outDistance[0xc] = accessor.GetVoxelAt({ i, j + stepSize, k + stepSize});
 	return 0
 		| ((std::signbit(static_cast<float>(outDistance[0])) << 0) & 0x01)
 		| ((std::signbit(static_cast<float>(outDistance[1])) << 1) & 0x02)
@@ -1411,18 +1464,18 @@ u32 LoadTransitionCellX(const Voxel* field, IVoxelDataSource* source, i32 i, i32
 		| ((std::signbit(static_cast<float>(outDistance[8])) << 4) & 0x10);
 }
 
-u32 LoadTransitionCellY(const Voxel* field, IVoxelDataSource* source, i32 i, i32 j, i32 k, i8* outDistance, u32 stepSize, const glm::ivec3& bl)
+u32 LoadTransitionCellY(const Voxel* field, VoxelAccessor& accessor, i32 i, i32 j, i32 k, i8* outDistance, u32 stepSize, const glm::ivec3& bl)
 {
 	glm::ivec3 ijk = {i,j,k};
-	outDistance[0] = outDistance[0x9] = source->GetVoxelAt({ i, j, k});
-	outDistance[1] = source->GetVoxelAt(ijk + glm::ivec3{ (stepSize >> 1), 0, 0} + bl);
-	outDistance[2] = outDistance[0xa] = source->GetVoxelAt({i + stepSize, j, k});
-	outDistance[3] = source->GetVoxelAt(ijk + glm::ivec3{0, 0, (stepSize >> 1)} + bl);
-	outDistance[4] = source->GetVoxelAt(ijk + glm::ivec3{(stepSize >> 1), 0, (stepSize >> 1)} + bl);
-	outDistance[5] = source->GetVoxelAt(ijk + glm::ivec3{stepSize, 0, (stepSize >> 1)} + bl);
-	outDistance[6] = outDistance[0xb] = source->GetVoxelAt({ i, j, k + stepSize});
-	outDistance[7] = source->GetVoxelAt(ijk + glm::ivec3{(stepSize >> 1), 0, stepSize} + bl);
-	outDistance[8] = outDistance[0xc] = source->GetVoxelAt({ i + stepSize, j, k + stepSize});
+	outDistance[0] = outDistance[0x9] = accessor.GetVoxelAt({ i, j, k});
+	outDistance[1] = accessor.GetVoxelAt(ijk + glm::ivec3{ (stepSize >> 1), 0, 0} + bl);
+	outDistance[2] = outDistance[0xa] = accessor.GetVoxelAt({i + stepSize, j, k});
+	outDistance[3] = accessor.GetVoxelAt(ijk + glm::ivec3{0, 0, (stepSize >> 1)} + bl);
+	outDistance[4] = accessor.GetVoxelAt(ijk + glm::ivec3{(stepSize >> 1), 0, (stepSize >> 1)} + bl);
+	outDistance[5] = accessor.GetVoxelAt(ijk + glm::ivec3{stepSize, 0, (stepSize >> 1)} + bl);
+	outDistance[6] = outDistance[0xb] = accessor.GetVoxelAt({ i, j, k + stepSize});
+	outDistance[7] = accessor.GetVoxelAt(ijk + glm::ivec3{(stepSize >> 1), 0, stepSize} + bl);
+	outDistance[8] = outDistance[0xc] = accessor.GetVoxelAt({ i + stepSize, j, k + stepSize});
 	return 0
 		| ((std::signbit(static_cast<float>(outDistance[0])) << 0) & 0x01)
 		| ((std::signbit(static_cast<float>(outDistance[1])) << 1) & 0x02)
@@ -1444,7 +1497,7 @@ void ProcessTransitionCell(
 	i32& meshTriangleCount,
 	TerrainVertexFixedPoint* meshVertexArray,
 	Triangle* meshTriangleArray,
-	IVoxelDataSource* source,
+	VoxelAccessor& accessor,
 	u8 lod,
 	glm::ivec3& bottomLeft,
 	int stepSize,
@@ -1456,7 +1509,7 @@ void ProcessTransitionCell(
 	{
 		cellStorage->reuseVertex[i] = 0xffff;
 	}
-	u32 caseIndex = axis == 0 ? LoadTransitionCellX(field, source, i, j, k, distance, stepSize, bottomLeft) : LoadTransitionCellY(field, source, i, j, k, distance, stepSize, bottomLeft);
+	u32 caseIndex = axis == 0 ? LoadTransitionCellX(field, accessor, i, j, k, distance, stepSize, bottomLeft) : LoadTransitionCellY(field, accessor, i, j, k, distance, stepSize, bottomLeft);
 }
 
 
@@ -1468,7 +1521,7 @@ void ExtractTransitionCellIsosurface(
 	TerrainVertexFixedPoint* meshVertexArray,
 	Triangle* meshTriangleArray,
 	IAllocator* allocator,
-	IVoxelDataSource* source,
+	VoxelAccessor& accessor,
 	u8 lod,
 	glm::ivec3& bottomLeft,
 	float stepSize
@@ -1491,7 +1544,7 @@ void ExtractTransitionCellIsosurface(
 				*meshTriangleCount,
 				meshVertexArray,
 				meshTriangleArray,
-				source,
+				accessor,
 				lod,
 				bottomLeft,
 				stepSize,1);
@@ -1506,67 +1559,127 @@ void ExtractTransitionCellIsosurface(
 
 }
 
-PolygonizeWorkerThreadData* TerrainPolygonizer::PolygonizeCellSyncMMC(ITerrainOctreeNode* cellToPolygonize, IVoxelDataSource* source)
+// each worker polygonizes into its own arena, reset at the start of each job, so the worst case sized arrays
+// the polygonizer writes into are only allocated once per thread
+static ScratchArena& GetWorkerScratchArena()
 {
-	size_t size = sizeof(Triangle);
-	u32 cellOutputTop = 0;
+	// grows to fit the densest chunk the worker has seen
+	thread_local ScratchArena tScratch;
+	return tScratch;
+}
 
-	u8* data = (u8*)Allocator->Malloc(
+// the result handed back to the caller, in one block with room for exactly this many vertices and indices.
+// indices are u16 if there are few enough vertices for them
+static PolygonizeWorkerThreadData* AllocateMeshResult(IAllocator* allocator, ITerrainOctreeNode* node, u32 numVertices, u32 numIndices, TerrainVertexFormat vertexFormat)
+{
+	size_t vertexSize = vertexFormat == TerrainVertexFormat::Compact ? sizeof(TerrainVertexCompact) : sizeof(TerrainVertex);
+	TerrainIndexType indexType = numVertices <= 0x10000 ? TerrainIndexType::U16 : TerrainIndexType::U32;
+	size_t indexSize = indexType == TerrainIndexType::U16 ? sizeof(u16) : sizeof(u32);
+	u8* data = (u8*)allocator->Malloc(
 		sizeof(PolygonizeWorkerThreadData) +
-		TERRAIN_CELL_VERTEX_ARRAY_SIZE * sizeof(TerrainVertex) +
-		TERRAIN_CELL_INDEX_ARRAY_SIZE * sizeof(u32) +
-		TOTAL_CELL_VOLUME_SIZE * sizeof(i8) +
-		6 * (TERRAIN_CELL_TRANSITION_MESH_VERTEX_ARRAY_SIZE * sizeof(TerrainVertex)) + 
-		6 * (TERRAIN_CELL_TRANSITION_MESH_INDEX_ARRAY_SIZE * sizeof(u32))
-	); // malloc everything in a single block
+		numVertices * vertexSize +
+		numIndices * indexSize
+	);
 
 	PolygonizeWorkerThreadData* rVal = (PolygonizeWorkerThreadData*)data;
 	u8* dataPtr = data + sizeof(PolygonizeWorkerThreadData);
+	rVal->VertexFormat = vertexFormat;
+	rVal->Vertices = numVertices && vertexFormat == TerrainVertexFormat::Full ? (TerrainVertex*)dataPtr : nullptr;
+	rVal->CompactVertices = numVertices && vertexFormat == TerrainVertexFormat::Compact ? (TerrainVertexCompact*)dataPtr : nullptr;
+	dataPtr += numVertices * vertexSize;
+	rVal->IndexType = indexType;
+	rVal->Indices = numIndices && indexType == TerrainIndexType::U32 ? (u32*)dataPtr : nullptr;
+	rVal->ShortIndices = numIndices && indexType == TerrainIndexType::U16 ? (u16*)dataPtr : nullptr;
+	rVal->Tris = (Triangle*)rVal->Indices;
+	// the block is only needed while polygonizing, it stays on the worker's stack
+	rVal->VoxelData = nullptr;
+
+	rVal->VerticesSize = numVertices;
+	rVal->IndicesSize = numIndices;
+	rVal->Node = node;
+	rVal->OutputtedVertices = numVertices;
+	rVal->OutputtedIndices = numIndices;
+	rVal->MyAllocator = allocator;
+	return rVal;
+}
 
-	TerrainVertexFixedPoint* fixedPointVerts = (TerrainVertexFixedPoint*)dataPtr;
-	rVal->Vertices = (TerrainVertex*)dataPtr;
-	dataPtr += TERRAIN_CELL_VERTEX_ARRAY_SIZE * sizeof(TerrainVertex);
-	rVal->Tris = (Triangle*)dataPtr;
-	dataPtr += TERRAIN_CELL_INDEX_ARRAY_SIZE * sizeof(u32);
-	rVal->VoxelData = (i8*)dataPtr;
-
-	rVal->VerticesSize = TERRAIN_CELL_VERTEX_ARRAY_SIZE;
-	rVal->IndicesSize = TERRAIN_CELL_INDEX_ARRAY_SIZE;
-	rVal->Node = cellToPolygonize;
-	rVal->OutputtedVertices = 0;
-	rVal->OutputtedIndices = 0;
-	rVal->MyAllocator = Allocator;
+PolygonizeWorkerThreadData* TerrainPolygonizer::PolygonizeCellSyncMMC(ITerrainOctreeNode* cellToPolygonize, IVoxelDataSource* source)
+{
+	TerrainVertexFormat vertexFormat = bCompactVertices ? TerrainVertexFormat::Compact : TerrainVertexFormat::Full;
 
+	// gather the block and find which cells the surface goes through before allocating anything for the mesh,
+	// most chunks of a terrain are all solid or all air and don't need more than this
+	Voxel voxels[TOTAL_CELL_VOLUME_SIZE];
+	source->GetVoxelsForNode(cellToPolygonize, voxels);
+	VoxelCellCases::CellCases cases;
+	u32 numOccupiedCells = VoxelCellCases::Build(voxels, cases);
 
-	CellStorage* deckStorage[2];
+	if (numOccupiedCells == 0)
+	{
+		// the caller still needs something to upload and free
+		return AllocateMeshResult(Allocator, cellToPolygonize, 0, 0, vertexFormat);
+	}
 
+	// count then emit - the triangle count is exact, the vertex count is what it would be if no vertices were shared
+	u32 maxVertices = 0;
+	u32 numTrianglesCounted = 0;
+	CountIsosurfaceGeometry(cases, maxVertices, numTrianglesCounted);
 
-	u32 verticesTop = 0;
-	u32 indicesTop = 0;
+	ScratchArena& scratch = GetWorkerScratchArena();
+	scratch.Reset();
+	TerrainVertexFixedPoint* fixedPointVerts = IAllocator::NewArray<TerrainVertexFixedPoint>(&scratch, maxVertices);
+	Triangle* triangles = IAllocator::NewArray<Triangle>(&scratch, numTrianglesCounted);
 
-	source->GetVoxelsForNode(cellToPolygonize, rVal->VoxelData);
+	// anything read outside the prefetched block goes through here, it's one per job so one per worker thread
+	VoxelAccessor accessor(source);
 
 	glm::ivec3 blockBottomLeft = cellToPolygonize->GetBottomLeftCorner();
 	float cellSize = cellToPolygonize->GetSizeInVoxels();
 	float stepSize = cellSize / BASE_CELL_SIZE;
 
-	ExtractIsosurface(rVal->VoxelData, 
+	i32 numVertices = 0;
+	i32 numTriangles = 0;
+	ExtractIsosurface(voxels, 
+		cases,
 		BASE_CELL_SIZE,
 		BASE_CELL_SIZE,
 		BASE_CELL_SIZE,
-		(i32*)&rVal->OutputtedVertices,
-		(i32*)&rVal->OutputtedIndices,
+		&numVertices,
+		&numTriangles,
 		fixedPointVerts,
-		rVal->Tris,
-		Allocator,
-		source,
+		triangles,
+		&scratch,
+		accessor,
 		cellToPolygonize->GetMipLevel(),
 		blockBottomLeft,
-		stepSize);
+		stepSize,
+		bSkipEmptyCells);
+	assert((u32)numVertices <= maxVertices && (u32)numTriangles == numTrianglesCounted);
 
-	rVal->OutputtedIndices *= 3;
+	PolygonizeWorkerThreadData* rVal = AllocateMeshResult(Allocator, cellToPolygonize, numVertices, numTriangles * 3, vertexFormat);
+	if (rVal->IndexType == TerrainIndexType::U16)
+	{
+		const u32* indices = (const u32*)triangles;
+		for (u32 i = 0; i < rVal->OutputtedIndices; i++)
+		{
+			rVal->ShortIndices[i] = (u16)indices[i];
+		}
+	}
+	else if (numTriangles > 0)
+	{
+		memcpy(rVal->Indices, triangles, numTriangles * sizeof(Triangle));
+	}
 
-	
+	if (vertexFormat == TerrainVertexFormat::Compact)
+	{
+		// straight from fixed point, the renderer does the rest
+		u32 stepSizeVoxels = cellToPolygonize->GetSizeInVoxels() / BASE_CELL_SIZE;
+		for (int i = 0; i < rVal->OutputtedVertices; i++)
+		{
+			rVal->CompactVertices[i] = TerrainVertexCompression::Encode(fixedPointVerts[i], blockBottomLeft, stepSizeVoxels);
+		}
+		return rVal;
+	}
 
 	// convert from fixed point to floating point, transforming to actual position and scale
 	for (int i = 0; i < rVal->OutputtedVertices; i++)
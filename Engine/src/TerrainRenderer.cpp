@@ -8,6 +8,7 @@
 #include "TerrainLight.h"
 #include "TerrainMaterial.h"
 #include "Gizmos.h"
+#include "TerrainDefs.h"
 
 static const char* gTerrainShaderCodeVert =
 "#version 330 core\n"
@@ -37,6 +38,50 @@ static const char* gTerrainShaderCodeVert =
     "LightPos = vec3(view * vec4(lightPos, 1.0)); // Transform world-space light position to view-space light position\n"
 "}\n";
 
+// the same as gTerrainShaderCodeVert, for TerrainVertexCompact - positions relative to the chunk in steps and octahedral normals
+static const char* gCompactTerrainShaderCodeVert =
+"#version 330 core\n"
+"layout(location = 0) in vec3 aPos;\n"
+"layout(location = 1) in vec2 aOctahedralNormal;\n"
+
+"out vec3 FragPos;\n"
+"out vec3 FragWorldPos;\n"
+"out vec3 Normal;\n"
+"out vec3 LightPos;\n"
+"out vec3 WorldSpaceNormal;\n"
+
+"uniform vec3 lightPos;\n"
+
+"uniform mat4 model;\n"
+"uniform mat4 view;\n"
+"uniform mat4 projection;\n"
+
+"uniform vec3 chunkOrigin;\n" // the chunk's bottom left corner
+"uniform float chunkStep;\n" // voxels per unit of aPos
+
+"vec3 DecodeOctahedralNormal(vec2 e)\n"
+"{\n"
+    "vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+    "if (n.z < 0.0)\n"
+    "{\n"
+        "n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);\n"
+    "}\n"
+    "return normalize(n);\n"
+"}\n"
+
+"void main()\n"
+"{""\n"
+    "vec3 pos = chunkOrigin + aPos * chunkStep;\n"
+    "vec3 normal = DecodeOctahedralNormal(aOctahedralNormal);\n"
+    "gl_Position = projection * view * model * vec4(pos, 1.0);\n"
+    "FragPos = vec3(view * model * vec4(pos, 1.0));\n"
+    "FragWorldPos = vec3(model * vec4(pos, 1.0));\n"
+    "Normal = mat3(transpose(inverse(view * model))) * normal;\n"
+    "WorldSpaceNormal = vec3(model * vec4(normal, 0.0));\n"
+
+    "LightPos = vec3(view * vec4(lightPos, 1.0));\n"
+"}\n";
+
 static const char* gTerrainShaderCodeFrag =
 "#version 330 core\n"
 "out vec4 FragColor;\n"
@@ -112,11 +157,16 @@ TerrainRenderer::TerrainRenderer(const TerrainRendererConfigData& config)
     FreeingData(config.FreeingData)
 {
     TerrainShader.LoadFromString(gTerrainShaderCodeVert, gTerrainShaderCodeFrag);
+    CompactTerrainShader.LoadFromString(gCompactTerrainShaderCodeVert, gTerrainShaderCodeFrag);
 }
 
 void TerrainRenderer::UploadNewlyPolygonizedToGPU(PolygonizeWorkerThreadData* data)
 {
-    size_t allocationSize = (data->OutputtedVertices * sizeof(TerrainVertex)) + (data->OutputtedIndices * sizeof(u32));
+    bool bCompact = data->VertexFormat == TerrainVertexFormat::Compact;
+    size_t vertexSize = bCompact ? sizeof(TerrainVertexCompact) : sizeof(TerrainVertex);
+    bool bShortIndices = data->IndexType == TerrainIndexType::U16;
+    size_t indexSize = bShortIndices ? sizeof(u16) : sizeof(u32);
+    size_t allocationSize = (data->OutputtedVertices * vertexSize) + (data->OutputtedIndices * indexSize);
     if (CurrentTerrainGPUAllocation + allocationSize > MemoryBudget)
     {
         FreeChunksToFit(allocationSize);
@@ -125,19 +175,32 @@ void TerrainRenderer::UploadNewlyPolygonizedToGPU(PolygonizeWorkerThreadData* da
     glGenBuffers(2, mesh.Buffers);
     glGenVertexArrays(1, &mesh.VAO);
     mesh.IndiciesToDraw = data->OutputtedIndices;
+    mesh.VertexFormat = data->VertexFormat;
+    mesh.IndexType = data->IndexType;
     u32 VBO = mesh.Buffers[(u32)TerrainChunkMeshBuffer::VBO];
     u32 EBO = mesh.Buffers[(u32)TerrainChunkMeshBuffer::EBO];
 
     glBindVertexArray(mesh.VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, data->OutputtedVertices * sizeof(TerrainVertex), data->Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void*)offsetof(TerrainVertex, Position));
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void*)offsetof(TerrainVertex, Normal));
-    glEnableVertexAttribArray(1);
+    if (bCompact)
+    {
+        glBufferData(GL_ARRAY_BUFFER, data->OutputtedVertices * sizeof(TerrainVertexCompact), data->CompactVertices, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(TerrainVertexCompact), (void*)offsetof(TerrainVertexCompact, Position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_BYTE, GL_TRUE, sizeof(TerrainVertexCompact), (void*)offsetof(TerrainVertexCompact, Normal));
+        glEnableVertexAttribArray(1);
+    }
+    else
+    {
+        glBufferData(GL_ARRAY_BUFFER, data->OutputtedVertices * sizeof(TerrainVertex), data->Vertices, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void*)offsetof(TerrainVertex, Position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void*)offsetof(TerrainVertex, Normal));
+        glEnableVertexAttribArray(1);
+    }
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, data->OutputtedIndices * sizeof(u32), data->Tris, GL_STATIC_DRAW); // WILL BREAK IF OLD MARCHING CUBES USED - data->Tris needs to be changed to whatever it used to be
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, data->OutputtedIndices * indexSize, bShortIndices ? (const void*)data->ShortIndices : (const void*)data->Indices, GL_STATIC_DRAW);
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
@@ -227,20 +290,26 @@ void TerrainRenderer::FreeChunksToFit_UntilFixedTimeAgoRendered(u32 attemptedAll
 
 void TerrainRenderer::SetTerrainMaterial(const TerrainMaterial& material)
 {
-    TerrainShader.use();
-    TerrainShader.setVec3("objectColor", material.Colour);
-    TerrainShader.setFloat("ambientStrength", material.AmbientStrength);
-    TerrainShader.setFloat("diffuseStrength", material.DiffuseStrength);
+    for (Shader* shader : { &TerrainShader, &CompactTerrainShader })
+    {
+        shader->use();
+        shader->setVec3("objectColor", material.Colour);
+        shader->setFloat("ambientStrength", material.AmbientStrength);
+        shader->setFloat("diffuseStrength", material.DiffuseStrength);
 
-    TerrainShader.setFloat("specularStrength", material.SpecularStrength);
-    TerrainShader.setFloat("shininess", material.Shinyness);
+        shader->setFloat("specularStrength", material.SpecularStrength);
+        shader->setFloat("shininess", material.Shinyness);
+    }
 }
 
 void TerrainRenderer::SetTerrainLight(const TerrainLight& light)
 {
-    TerrainShader.use();
-    TerrainShader.setVec3("lightPos", light.LightPosition);
-    TerrainShader.setVec3("lightColor", light.LightColor);
+    for (Shader* shader : { &TerrainShader, &CompactTerrainShader })
+    {
+        shader->use();
+        shader->setVec3("lightPos", light.LightPosition);
+        shader->setVec3("lightColor", light.LightColor);
+    }
 }
 
 void TerrainRenderer::RenderTerrainNodes(
@@ -254,13 +323,20 @@ void TerrainRenderer::RenderTerrainNodes(
         const TerrainChunkMesh& mesh = node->GetTerrainChunkMesh();
 
         u32 ebo = mesh.GetEBO();
-        TerrainShader.use();
-        TerrainShader.setMat4("model", model);
-        TerrainShader.setMat4("view", view);
-        TerrainShader.setMat4("projection", projection);
+        const Shader& shader = mesh.VertexFormat == TerrainVertexFormat::Compact ? CompactTerrainShader : TerrainShader;
+        shader.use();
+        shader.setMat4("model", model);
+        shader.setMat4("view", view);
+        shader.setMat4("projection", projection);
+        if (mesh.VertexFormat == TerrainVertexFormat::Compact)
+        {
+            // positions are in fractions of a step from the chunk's corner
+            shader.setVec3("chunkOrigin", glm::vec3(node->GetBottomLeftCorner()));
+            shader.setFloat("chunkStep", (float)(node->GetSizeInVoxels() / BASE_CELL_SIZE) / (float)(1 << TERRAIN_COMPACT_POSITION_FRACTION_BITS));
+        }
         glBindVertexArray(mesh.VAO);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.GetEBO());
-        glDrawElements(GL_TRIANGLES, mesh.IndiciesToDraw, GL_UNSIGNED_INT, 0);
+        glDrawElements(GL_TRIANGLES, mesh.IndiciesToDraw, mesh.IndexType == TerrainIndexType::U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, 0);
         const auto& bl = node->GetBottomLeftCorner();
         const auto size = node->GetSizeInVoxels();
         glm::vec3 parentCenter = {
@@ -0,0 +1,66 @@
+#include "TerrainVertexCompression.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace TerrainVertexCompression
+{
+	TerrainVertexCompact Encode(const TerrainVertexFixedPoint& fixed, const glm::ivec3& chunkBottomLeft, u32 stepSize)
+	{
+		TerrainVertexCompact compact;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			u32 relative = fixed.Position[axis] - ((u32)chunkBottomLeft[axis] << TERRAIN_FIXED_FRACTION_SIZE_BITS);
+			// rounded to nearest, the far side of the chunk is 16 steps in which still fits
+			u32 inSteps = ((relative << (TERRAIN_COMPACT_POSITION_FRACTION_BITS - TERRAIN_FIXED_FRACTION_SIZE_BITS)) + stepSize / 2) / stepSize;
+			assert(inSteps <= 0xffff);
+			compact.Position[axis] = (u16)std::min(inSteps, 0xffffu);
+		}
+		// the normal was summed in signed fixed point
+		EncodeNormal(glm::vec3((float)(i32)fixed.Normal.x, (float)(i32)fixed.Normal.y, (float)(i32)fixed.Normal.z), compact.Normal);
+		return compact;
+	}
+
+	glm::vec3 DecodePosition(const TerrainVertexCompact& compact, const glm::ivec3& chunkBottomLeft, u32 stepSize)
+	{
+		float step = (float)stepSize / (float)(1 << TERRAIN_COMPACT_POSITION_FRACTION_BITS);
+		return glm::vec3(chunkBottomLeft) + glm::vec3(compact.Position[0], compact.Position[1], compact.Position[2]) * step;
+	}
+
+	// see "A Survey of Efficient Representations for Independent Unit Vectors"
+	void EncodeNormal(const glm::vec3& normal, i8* outEncoded)
+	{
+		float sum = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+		if (sum == 0.0f)
+		{
+			outEncoded[0] = outEncoded[1] = 0;
+			return;
+		}
+		float x = normal.x / sum;
+		float y = normal.y / sum;
+		if (normal.z < 0.0f)
+		{
+			// fold the lower half of the octahedron over the upper
+			float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = foldedX;
+			y = foldedY;
+		}
+		outEncoded[0] = (i8)roundf(x * 127.0f);
+		outEncoded[1] = (i8)roundf(y * 127.0f);
+	}
+
+	glm::vec3 DecodeNormal(const i8* encoded)
+	{
+		glm::vec3 normal((float)encoded[0] / 127.0f, (float)encoded[1] / 127.0f, 0.0f);
+		normal.z = 1.0f - fabsf(normal.x) - fabsf(normal.y);
+		if (normal.z < 0.0f)
+		{
+			float unfoldedX = (1.0f - fabsf(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f);
+			float unfoldedY = (1.0f - fabsf(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f);
+			normal.x = unfoldedX;
+			normal.y = unfoldedY;
+		}
+		return glm::normalize(normal);
+	}
+}
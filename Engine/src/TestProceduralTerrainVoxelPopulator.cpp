@@ -11,6 +11,7 @@
 #include <sstream>
 #include "ITerrainOctreeNode.h"
 #include <chrono>
+#include "TerrainDefs.h"
 
 TestProceduralTerrainVoxelPopulator::TestProceduralTerrainVoxelPopulator(const std::shared_ptr<rdx::thread_pool>& threadPool)
 	:ThreadPool(threadPool)
@@ -27,12 +28,12 @@ void ThreadsafePrint(const char* format, ...)
 	vprintf_s(format, args);
 }
 
-static int numDecks = 8*8*512;
-static int decksCompleted = 0;
-void OnDeckCompleted()
+static int numBrickLayers = 8*8*32;
+static int brickLayersCompleted = 0;
+void OnBrickLayerCompleted()
 {
 	std::lock_guard<std::mutex>lg(sPrintMutex);
-	printf("%f percent complete\n", ((float)++decksCompleted / (float)numDecks) * 100.0f);
+	printf("%f percent complete\n", ((float)++brickLayersCompleted / (float)numBrickLayers) * 100.0f);
 }
 
 float GetHeight(const glm::vec3& location)
@@ -52,19 +53,24 @@ std::unordered_set<TerrainOctreeIndex> TestProceduralTerrainVoxelPopulator::Popu
 	int childDims = node->GetSizeInVoxels();
 	float planeHeight = 200.0f;
 
-	for (int tz = childBL.z; tz < childBL.z + childDims; tz++)
+	auto generator = [&noise, planeHeight](const glm::ivec3& location) -> i8
 	{
-		for (int ty = childBL.y; ty < childBL.y + childDims; ty++)
+		float noiseVal = noise.fractal(8, location.x * 0.001f, location.y * 0.0001f, location.z * 0.001f);
+		float val = (planeHeight + noiseVal * GetHeight(glm::vec3(location))) - location.y;
+		return (i8)std::clamp(-val * 10.0f, -127.0f, 127.0f);
+	};
+
+	// write whole leaves at a time rather than a voxel at a time - each brick is found once
+	for (int bz = childBL.z; bz < childBL.z + childDims; bz += BASE_CELL_SIZE)
+	{
+		for (int by = childBL.y; by < childBL.y + childDims; by += BASE_CELL_SIZE)
 		{
-			for (int tx = childBL.x; tx < childBL.x + childDims; tx++)
+			for (int bx = childBL.x; bx < childBL.x + childDims; bx += BASE_CELL_SIZE)
 			{
-				float noiseVal = noise.fractal(8, tx * 0.001f,  ty * 0.0001f, tz * 0.001f);
-				float val = (planeHeight + noiseVal * GetHeight({tx,ty,tz})) - ty;
-				TerrainOctreeIndex indexSet = dataSrcToWriteTo->SetVoxelAt({ tx,ty,tz }, std::clamp(-val*10.0f, -127.0f, 127.0f));
-				output.insert(indexSet);
+				output.insert(dataSrcToWriteTo->FillBrick({ bx,by,bz }, generator));
 			}
 		}
-		OnDeckCompleted();
+		OnBrickLayerCompleted();
 	}
 	return output;
 }
@@ -72,7 +78,7 @@ std::unordered_set<TerrainOctreeIndex> TestProceduralTerrainVoxelPopulator::Popu
 
 void TestProceduralTerrainVoxelPopulator::PopulateTerrain(IVoxelDataSource* dataSrcToWriteTo)
 {
-	//OctreeSerialisation::LoadFromFile(dataSrcToWriteTo,"level.vox");
+	//OctreeSerialisation::LoadFromFile(dataSrcToWriteTo,"level.vox", ThreadPool.get());
 	//return;
 
 	using std::chrono::high_resolution_clock;
@@ -89,12 +95,12 @@ void TestProceduralTerrainVoxelPopulator::PopulateTerrain(IVoxelDataSource* data
 	float planeHeight = 200.0f;
 	std::vector<std::future<std::unordered_set<TerrainOctreeIndex>>> futures;
 	int numThreads = 0;
-	decksCompleted = 0;
+	brickLayersCompleted = 0;
 	if (ThreadPool->NumWorkers() > 8)
 	{
 		// if we have more than 8 threads then queue a task for each of the first 2 mip levels,
 		// 64 nodes in total
-		numDecks = 8*8*512;
+		numBrickLayers = 8*8*(512 / BASE_CELL_SIZE);
 		numThreads = 64;
 		dataSrcToWriteTo->CreateChildrenForFirstNMipLevels(onNode, 2);
 		for (int i = 0; i < 8; i++)
@@ -112,7 +118,7 @@ void TestProceduralTerrainVoxelPopulator::PopulateTerrain(IVoxelDataSource* data
 	else
 	{
 		// if we have <= 8 workers then queue 8 nodes to be generated
-		numDecks = 8*1024;
+		numBrickLayers = 8*(1024 / BASE_CELL_SIZE);
 		numThreads = 8;
 		dataSrcToWriteTo->CreateChildrenForFirstNMipLevels(onNode, 1);
 		for (int i = 0; i < 8; i++)
@@ -145,5 +151,5 @@ void TestProceduralTerrainVoxelPopulator::PopulateTerrain(IVoxelDataSource* data
 	std::cout << "done in " << ms_int.count() << "ms\n";
 	printf("%i", allSet.find(0xfffffff) == allSet.end());
 
-	OctreeSerialisation::SaveNewlyGeneratedToFile(allSet, dataSrcToWriteTo, "level.vox");
+	OctreeSerialisation::SaveNewlyGeneratedToFile(allSet, dataSrcToWriteTo, "level.vox", ThreadPool.get());
 }
@@ -0,0 +1,32 @@
+#include "VoxelAccessor.h"
+#include "IVoxelDataSource.h"
+
+VoxelAccessor::VoxelAccessor(IVoxelDataSource* source)
+	:Source(source)
+{
+}
+
+void VoxelAccessor::Reset()
+{
+	for (VoxelRegion& region : Regions)
+	{
+		region = VoxelRegion();
+	}
+	NextRegionToReplace = 0;
+}
+
+i8 VoxelAccessor::GetVoxelAt_Miss(const glm::ivec3& location)
+{
+	NumMisses++;
+	VoxelRegion region;
+	Source->GetVoxelRegionContainingPoint(location, region);
+	if (!region.SizeInVoxels)
+	{
+		// outside the source, it decides what that reads as
+		return Source->GetVoxelAt(location);
+	}
+	// replace the oldest
+	Regions[NextRegionToReplace] = region;
+	NextRegionToReplace = (NextRegionToReplace + 1) % VOXEL_ACCESSOR_CACHED_REGIONS;
+	return ReadRegion(region, location);
+}
@@ -0,0 +1,203 @@
+#include "VoxelBrickCompression.h"
+#include <cassert>
+#include <cstring>
+
+#define BRICK_VOLUME (BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE)
+#define BRICK_ROWS (BASE_CELL_SIZE * BASE_CELL_SIZE)
+
+namespace VoxelBrickCompression
+{
+	static constexpr size_t GetPaletteCompressedSize(u32 bitsPerVoxel)
+	{
+		return sizeof(CompressedBrickHeader) + (BRICK_VOLUME * bitsPerVoxel) / 8;
+	}
+
+	// the last class is the biggest a compressed brick is allowed to be, past that it isn't worth decoding
+	static constexpr size_t gSizeClasses[VOXEL_BRICK_NUM_SIZE_CLASSES] =
+	{
+		GetPaletteCompressedSize(1),
+		GetPaletteCompressedSize(2),
+		1536,
+		GetPaletteCompressedSize(4),
+		2560,
+		3072
+	};
+
+	u32 BuildPalette(const i8* brick, CompressedBrickHeader& outHeader)
+	{
+		// palette index + 1 of each possible value, 0 if it hasn't been seen yet
+		u8 seen[256] = {};
+		outHeader.PaletteSize = 0;
+		for (u32 i = 0; i < BRICK_VOLUME; i++)
+		{
+			u8& entry = seen[(u8)brick[i]];
+			if (!entry)
+			{
+				if (outHeader.PaletteSize == VOXEL_BRICK_MAX_PALETTE_SIZE)
+				{
+					outHeader.BitsPerVoxel = 0;
+					return 0;
+				}
+				outHeader.Palette[outHeader.PaletteSize] = brick[i];
+				entry = ++outHeader.PaletteSize;
+			}
+		}
+		outHeader.BitsPerVoxel = outHeader.PaletteSize <= 2 ? 1 : outHeader.PaletteSize <= 4 ? 2 : 4;
+		return outHeader.BitsPerVoxel;
+	}
+
+	static u32 CountRuns(const i8* brick)
+	{
+		u32 runs = 0;
+		for (u32 row = 0; row < BRICK_ROWS; row++)
+		{
+			const i8* voxels = brick + row * BASE_CELL_SIZE;
+			runs++;
+			for (u32 x = 1; x < BASE_CELL_SIZE; x++)
+			{
+				runs += voxels[x] != voxels[x - 1];
+			}
+		}
+		return runs;
+	}
+
+	size_t PlanCompression(const i8* brick, CompressedBrickHeader& outHeader)
+	{
+		u32 bitsPerVoxel = BuildPalette(brick, outHeader);
+		if (bitsPerVoxel)
+		{
+			outHeader.SizeBytes = (u16)GetPaletteCompressedSize(bitsPerVoxel);
+			return outHeader.SizeBytes;
+		}
+		size_t runLengthSize = sizeof(CompressedBrickHeader) + BRICK_ROWS * sizeof(u16) + 2 * CountRuns(brick);
+		if (runLengthSize > gSizeClasses[VOXEL_BRICK_NUM_SIZE_CLASSES - 1])
+		{
+			return 0;
+		}
+		outHeader.BitsPerVoxel = 0;
+		outHeader.PaletteSize = 0;
+		outHeader.SizeBytes = (u16)runLengthSize;
+		return outHeader.SizeBytes;
+	}
+
+	static void CompressPalette(const i8* brick, const CompressedBrickHeader& header, u8* packed)
+	{
+		assert(header.BitsPerVoxel == 1 || header.BitsPerVoxel == 2 || header.BitsPerVoxel == 4);
+		u8 paletteIndices[256] = {};
+		for (u8 i = 0; i < header.PaletteSize; i++)
+		{
+			paletteIndices[(u8)header.Palette[i]] = i;
+		}
+
+		u32 voxelsPerByte = 8 / header.BitsPerVoxel;
+		for (u32 byte = 0; byte < BRICK_VOLUME / voxelsPerByte; byte++)
+		{
+			u8 packedByte = 0;
+			const i8* voxels = brick + byte * voxelsPerByte;
+			for (u32 i = 0; i < voxelsPerByte; i++)
+			{
+				packedByte |= paletteIndices[(u8)voxels[i]] << (i * header.BitsPerVoxel);
+			}
+			packed[byte] = packedByte;
+		}
+	}
+
+	static void CompressRuns(const i8* brick, u8* out)
+	{
+		u16* rowStarts = reinterpret_cast<u16*>(out);
+		u8* runs = reinterpret_cast<u8*>(rowStarts + BRICK_ROWS);
+		u16 numRuns = 0;
+		for (u32 row = 0; row < BRICK_ROWS; row++)
+		{
+			rowStarts[row] = numRuns;
+			const i8* voxels = brick + row * BASE_CELL_SIZE;
+			u32 x = 0;
+			while (x < BASE_CELL_SIZE)
+			{
+				u32 runStart = x;
+				while (x < BASE_CELL_SIZE && voxels[x] == voxels[runStart])
+				{
+					x++;
+				}
+				runs[2 * numRuns] = (u8)voxels[runStart];
+				runs[2 * numRuns + 1] = (u8)(x - runStart);
+				numRuns++;
+			}
+		}
+	}
+
+	void Compress(const i8* brick, const CompressedBrickHeader& header, u8* out)
+	{
+		memcpy(out, &header, sizeof(CompressedBrickHeader));
+		if (header.BitsPerVoxel)
+		{
+			CompressPalette(brick, header, out + sizeof(CompressedBrickHeader));
+		}
+		else
+		{
+			CompressRuns(brick, out + sizeof(CompressedBrickHeader));
+		}
+	}
+
+	template<u32 BitsPerVoxel>
+	static void Unpack(const u8* packed, const i8* palette, i8* outBrick)
+	{
+		static const u32 voxelsPerByte = 8 / BitsPerVoxel;
+		static const u32 mask = (1u << BitsPerVoxel) - 1;
+		for (u32 byte = 0; byte < BRICK_VOLUME / voxelsPerByte; byte++)
+		{
+			u8 packedByte = packed[byte];
+			for (u32 i = 0; i < voxelsPerByte; i++)
+			{
+				*(outBrick++) = palette[(packedByte >> (i * BitsPerVoxel)) & mask];
+			}
+		}
+	}
+
+	static void ExpandRuns(const u8* data, i8* outBrick)
+	{
+		// rows are stored one after another so the runs can be expanded without looking at the row starts
+		const u8* run = data + BRICK_ROWS * sizeof(u16);
+		const i8* end = outBrick + BRICK_VOLUME;
+		while (outBrick < end)
+		{
+			memset(outBrick, run[0], run[1]);
+			outBrick += run[1];
+			run += 2;
+		}
+	}
+
+	void Decompress(const u8* compressed, i8* outBrick)
+	{
+		const CompressedBrickHeader* header = GetHeader(compressed);
+		const u8* data = compressed + sizeof(CompressedBrickHeader);
+		// the bit width is fixed per instantiation so the inner loop unrolls
+		switch (header->BitsPerVoxel)
+		{
+		case 0: ExpandRuns(data, outBrick); break;
+		case 1: Unpack<1>(data, header->Palette, outBrick); break;
+		case 2: Unpack<2>(data, header->Palette, outBrick); break;
+		case 4: Unpack<4>(data, header->Palette, outBrick); break;
+		default: assert(false); break;
+		}
+	}
+
+	size_t GetSizeClassBytes(u32 sizeClass)
+	{
+		assert(sizeClass < VOXEL_BRICK_NUM_SIZE_CLASSES);
+		return gSizeClasses[sizeClass];
+	}
+
+	u32 GetSizeClass(size_t sizeBytes)
+	{
+		for (u32 i = 0; i < VOXEL_BRICK_NUM_SIZE_CLASSES; i++)
+		{
+			if (sizeBytes <= gSizeClasses[i])
+			{
+				return i;
+			}
+		}
+		assert(false);
+		return VOXEL_BRICK_NUM_SIZE_CLASSES - 1;
+	}
+}
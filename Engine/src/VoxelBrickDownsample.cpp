@@ -0,0 +1,113 @@
+#include "VoxelBrickDownsample.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VOXEL_DOWNSAMPLE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define HALF_CELL_SIZE (BASE_CELL_SIZE / 2)
+
+namespace VoxelBrickDownsample
+{
+	static inline i8* GetOctantStart(u8 octant, i8* outBrick)
+	{
+		return outBrick
+			+ (octant & 1) * HALF_CELL_SIZE
+			+ ((octant >> 1) & 1) * HALF_CELL_SIZE * BASE_CELL_SIZE
+			+ ((octant >> 2) & 1) * HALF_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE;
+	}
+
+	static inline i8 Average(i32 sum)
+	{
+		// round half up, the same as the SSE2 version's add then arithmetic shift
+		return (i8)((sum + 4) >> 3);
+	}
+
+	static void DownsampleRows_Scalar(const i8* row00, const i8* row01, const i8* row10, const i8* row11, i8* outRow)
+	{
+		for (u32 x = 0; x < HALF_CELL_SIZE; x++)
+		{
+			u32 x2 = x * 2;
+			i32 sum = row00[x2] + row00[x2 + 1] + row01[x2] + row01[x2 + 1]
+				+ row10[x2] + row10[x2 + 1] + row11[x2] + row11[x2 + 1];
+			outRow[x] = Average(sum);
+		}
+	}
+
+#ifdef VOXEL_DOWNSAMPLE_SSE2
+	static_assert(BASE_CELL_SIZE == 16, "the SSE2 downsample loads a whole row into one register");
+
+	// sign extend the low and high eight bytes of a row to 16 bits
+	static inline void WidenRow(const i8* row, __m128i& outLow, __m128i& outHigh)
+	{
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row));
+		outLow = _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8);
+		outHigh = _mm_srai_epi16(_mm_unpackhi_epi8(bytes, bytes), 8);
+	}
+
+	static void DownsampleRows_SSE2(const i8* row00, const i8* row01, const i8* row10, const i8* row11, i8* outRow)
+	{
+		__m128i low, high, sumLow, sumHigh;
+		WidenRow(row00, sumLow, sumHigh);
+		WidenRow(row01, low, high);
+		sumLow = _mm_add_epi16(sumLow, low);
+		sumHigh = _mm_add_epi16(sumHigh, high);
+		WidenRow(row10, low, high);
+		sumLow = _mm_add_epi16(sumLow, low);
+		sumHigh = _mm_add_epi16(sumHigh, high);
+		WidenRow(row11, low, high);
+		sumLow = _mm_add_epi16(sumLow, low);
+		sumHigh = _mm_add_epi16(sumHigh, high);
+
+		// add neighbouring pairs along x, then back down to 16 bits - the sums are at most 8 * 128
+		const __m128i ones = _mm_set1_epi16(1);
+		__m128i sums = _mm_packs_epi32(_mm_madd_epi16(sumLow, ones), _mm_madd_epi16(sumHigh, ones));
+		__m128i averages = _mm_srai_epi16(_mm_add_epi16(sums, _mm_set1_epi16(4)), 3);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(outRow), _mm_packs_epi16(averages, averages));
+	}
+#endif
+
+	template<void(*DownsampleRows)(const i8*, const i8*, const i8*, const i8*, i8*)>
+	static void DownsampleIntoOctant_Impl(const i8* childBrick, u8 octant, i8* outBrick)
+	{
+		i8* out = GetOctantStart(octant, outBrick);
+		for (u32 z = 0; z < HALF_CELL_SIZE; z++)
+		{
+			for (u32 y = 0; y < HALF_CELL_SIZE; y++)
+			{
+				const i8* row00 = childBrick + BASE_CELL_SIZE * (y * 2) + BASE_CELL_SIZE * BASE_CELL_SIZE * (z * 2);
+				const i8* row01 = row00 + BASE_CELL_SIZE;
+				const i8* row10 = row00 + BASE_CELL_SIZE * BASE_CELL_SIZE;
+				const i8* row11 = row10 + BASE_CELL_SIZE;
+				DownsampleRows(row00, row01, row10, row11, out + BASE_CELL_SIZE * y + BASE_CELL_SIZE * BASE_CELL_SIZE * z);
+			}
+		}
+	}
+
+	void DownsampleIntoOctant(const i8* childBrick, u8 octant, i8* outBrick)
+	{
+#ifdef VOXEL_DOWNSAMPLE_SSE2
+		DownsampleIntoOctant_Impl<DownsampleRows_SSE2>(childBrick, octant, outBrick);
+#else
+		DownsampleIntoOctant_Impl<DownsampleRows_Scalar>(childBrick, octant, outBrick);
+#endif
+	}
+
+	void DownsampleIntoOctant_Scalar(const i8* childBrick, u8 octant, i8* outBrick)
+	{
+		DownsampleIntoOctant_Impl<DownsampleRows_Scalar>(childBrick, octant, outBrick);
+	}
+
+	void FillOctant(i8 value, u8 octant, i8* outBrick)
+	{
+		i8* out = GetOctantStart(octant, outBrick);
+		for (u32 z = 0; z < HALF_CELL_SIZE; z++)
+		{
+			for (u32 y = 0; y < HALF_CELL_SIZE; y++)
+			{
+				memset(out + BASE_CELL_SIZE * y + BASE_CELL_SIZE * BASE_CELL_SIZE * z, value, HALF_CELL_SIZE);
+			}
+		}
+	}
+}
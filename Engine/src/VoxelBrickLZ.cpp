@@ -0,0 +1,186 @@
+#include "VoxelBrickLZ.h"
+#include <algorithm>
+#include <cstring>
+
+#define BRICK_VOLUME (BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE)
+#define MIN_MATCH_LENGTH 4
+#define MATCH_HASH_BITS 12
+#define NO_POSITION 0xffff
+
+static_assert(BRICK_VOLUME < NO_POSITION, "brick positions and offsets are stored in a u16");
+
+namespace VoxelBrickLZ
+{
+	static inline u32 HashFourBytes(const u8* bytes)
+	{
+		u32 value;
+		memcpy(&value, bytes, sizeof(u32));
+		return (value * 2654435761u) >> (32 - MATCH_HASH_BITS);
+	}
+
+	// the part of a length that didn't fit in its nibble
+	static bool WriteExtraLength(size_t length, u8*& out, const u8* outEnd)
+	{
+		for (; length >= 255; length -= 255)
+		{
+			if (out == outEnd)
+			{
+				return false;
+			}
+			*out++ = 255;
+		}
+		if (out == outEnd)
+		{
+			return false;
+		}
+		*out++ = (u8)length;
+		return true;
+	}
+
+	static bool ReadExtraLength(const u8*& in, const u8* end, size_t& inOutLength)
+	{
+		u8 byte = 255;
+		while (byte == 255)
+		{
+			if (in == end)
+			{
+				return false;
+			}
+			byte = *in++;
+			inOutLength += byte;
+		}
+		return true;
+	}
+
+	// matchLength is 0 for the last sequence, which is only literals
+	static bool WriteSequence(const u8* literals, size_t numLiterals, size_t offset, size_t matchLength, u8*& out, const u8* outEnd)
+	{
+		if (out == outEnd)
+		{
+			return false;
+		}
+		size_t extraMatchLength = matchLength ? matchLength - MIN_MATCH_LENGTH : 0;
+		*out++ = (u8)((std::min<size_t>(numLiterals, 15) << 4) | std::min<size_t>(extraMatchLength, 15));
+		if (numLiterals >= 15 && !WriteExtraLength(numLiterals - 15, out, outEnd))
+		{
+			return false;
+		}
+		if ((size_t)(outEnd - out) < numLiterals)
+		{
+			return false;
+		}
+		memcpy(out, literals, numLiterals);
+		out += numLiterals;
+		if (!matchLength)
+		{
+			return true;
+		}
+		if (outEnd - out < 2)
+		{
+			return false;
+		}
+		out[0] = (u8)(offset & 0xff);
+		out[1] = (u8)(offset >> 8);
+		out += 2;
+		return extraMatchLength < 15 || WriteExtraLength(extraMatchLength - 15, out, outEnd);
+	}
+
+	size_t Compress(const i8* brick, u8* out, size_t maxSizeBytes)
+	{
+		const u8* in = reinterpret_cast<const u8*>(brick);
+		const u8* outEnd = out + maxSizeBytes;
+		u8* outPtr = out;
+		// the last position each hash of four bytes was seen at
+		u16 lastSeen[1 << MATCH_HASH_BITS];
+		memset(lastSeen, 0xff, sizeof(lastSeen));
+
+		size_t literalsStart = 0;
+		size_t pos = 0;
+		while (pos + MIN_MATCH_LENGTH <= BRICK_VOLUME)
+		{
+			u32 hash = HashFourBytes(in + pos);
+			size_t candidate = lastSeen[hash];
+			lastSeen[hash] = (u16)pos;
+			if (candidate == NO_POSITION || memcmp(in + candidate, in + pos, MIN_MATCH_LENGTH) != 0)
+			{
+				pos++;
+				continue;
+			}
+			// the match can run on into the bytes it's matching, a run of one value is a match at offset 1
+			size_t length = MIN_MATCH_LENGTH;
+			while (pos + length < BRICK_VOLUME && in[candidate + length] == in[pos + length])
+			{
+				length++;
+			}
+			if (!WriteSequence(in + literalsStart, pos - literalsStart, pos - candidate, length, outPtr, outEnd))
+			{
+				return 0;
+			}
+			// so that later matches can start part way through this one
+			for (size_t i = pos + 1; i < pos + length && i + MIN_MATCH_LENGTH <= BRICK_VOLUME; i++)
+			{
+				lastSeen[HashFourBytes(in + i)] = (u16)i;
+			}
+			pos += length;
+			literalsStart = pos;
+		}
+		// a brick that ends in a match needs nothing more
+		if (literalsStart != BRICK_VOLUME && !WriteSequence(in + literalsStart, BRICK_VOLUME - literalsStart, 0, 0, outPtr, outEnd))
+		{
+			return 0;
+		}
+		return outPtr - out;
+	}
+
+	bool Decompress(const u8* compressed, size_t sizeBytes, i8* outBrick)
+	{
+		const u8* in = compressed;
+		const u8* end = compressed + sizeBytes;
+		u8* out = reinterpret_cast<u8*>(outBrick);
+		size_t outPos = 0;
+		while (in < end)
+		{
+			u8 token = *in++;
+			size_t numLiterals = token >> 4;
+			if (numLiterals == 15 && !ReadExtraLength(in, end, numLiterals))
+			{
+				return false;
+			}
+			if ((size_t)(end - in) < numLiterals || BRICK_VOLUME - outPos < numLiterals)
+			{
+				return false;
+			}
+			memcpy(out + outPos, in, numLiterals);
+			in += numLiterals;
+			outPos += numLiterals;
+			if (in == end)
+			{
+				break;
+			}
+
+			if (end - in < 2)
+			{
+				return false;
+			}
+			size_t offset = in[0] | ((size_t)in[1] << 8);
+			in += 2;
+			size_t matchLength = token & 0x0f;
+			if (matchLength == 15 && !ReadExtraLength(in, end, matchLength))
+			{
+				return false;
+			}
+			matchLength += MIN_MATCH_LENGTH;
+			if (offset == 0 || offset > outPos || BRICK_VOLUME - outPos < matchLength)
+			{
+				return false;
+			}
+			// a byte at a time, the match may overlap what it's writing
+			for (size_t i = 0; i < matchLength; i++)
+			{
+				out[outPos + i] = out[outPos + i - offset];
+			}
+			outPos += matchLength;
+		}
+		return outPos == BRICK_VOLUME;
+	}
+}
@@ -0,0 +1,128 @@
+#include "VoxelBrickPager.h"
+#include "TerrainDefs.h"
+#include <cassert>
+#include <iostream>
+
+// a raw brick, compressed ones are always smaller
+#define SLOT_SIZE_BYTES (BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE)
+
+VoxelBrickPager::VoxelBrickPager()
+{
+}
+
+VoxelBrickPager::~VoxelBrickPager()
+{
+	Close();
+}
+
+bool VoxelBrickPager::Open(const char* path)
+{
+	std::lock_guard<std::mutex> lock(Mtx);
+	if (File.is_open())
+	{
+		File.close();
+	}
+	Slots.clear();
+	FreeSlots.clear();
+	File.open(path, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!File)
+	{
+		std::cout << "Cannot open brick page file " << path << "\n";
+		return false;
+	}
+	return true;
+}
+
+void VoxelBrickPager::Close()
+{
+	std::lock_guard<std::mutex> lock(Mtx);
+	if (File.is_open())
+	{
+		File.close();
+	}
+	Slots.clear();
+	FreeSlots.clear();
+}
+
+u32 VoxelBrickPager::WriteSlot(const void* data, u32 sizeBytes, bool bCompressed)
+{
+	assert(sizeBytes != 0 && sizeBytes <= SLOT_SIZE_BYTES);
+	std::lock_guard<std::mutex> lock(Mtx);
+	u32 slot = INVALID_SLOT;
+	if (!FreeSlots.empty())
+	{
+		slot = FreeSlots.back();
+		FreeSlots.pop_back();
+	}
+	else
+	{
+		slot = (u32)Slots.size();
+		Slots.push_back({ 0, false });
+	}
+
+	File.seekp((std::streamoff)slot * SLOT_SIZE_BYTES);
+	File.write((const char*)data, sizeBytes);
+	if (!File)
+	{
+		std::cout << "Failed to write brick to page file\n";
+		File.clear();
+		FreeSlots.push_back(slot);
+		return INVALID_SLOT;
+	}
+	Slots[slot] = { sizeBytes, bCompressed };
+	return slot;
+}
+
+u32 VoxelBrickPager::ReadSlot(u32 slot, void* outData, bool& outCompressed) const
+{
+	std::lock_guard<std::mutex> lock(Mtx);
+	assert(slot < Slots.size());
+	const Slot& info = Slots[slot];
+	if (info.SizeBytes == 0)
+	{
+		// freed by a writer that faulted the brick in first, whoever's asking will find it resident
+		return 0;
+	}
+	File.seekg((std::streamoff)slot * SLOT_SIZE_BYTES);
+	File.read((char*)outData, info.SizeBytes);
+	if (!File)
+	{
+		std::cout << "Failed to read brick from page file\n";
+		File.clear();
+		return 0;
+	}
+	outCompressed = info.bCompressed;
+	return info.SizeBytes;
+}
+
+void VoxelBrickPager::FreeSlot(u32 slot)
+{
+	std::lock_guard<std::mutex> lock(Mtx);
+	assert(slot < Slots.size() && Slots[slot].SizeBytes != 0);
+	Slots[slot].SizeBytes = 0;
+	FreeSlots.push_back(slot);
+}
+
+void VoxelBrickPager::FreeAllSlots()
+{
+	std::lock_guard<std::mutex> lock(Mtx);
+	FreeSlots.clear();
+	for (u32 i = (u32)Slots.size(); i > 0; i--)
+	{
+		Slots[i - 1].SizeBytes = 0;
+		// lowest slots last so they're the first to be reused
+		FreeSlots.push_back(i - 1);
+	}
+}
+
+u32 VoxelBrickPager::GetNumSlotsInUse() const
+{
+	std::lock_guard<std::mutex> lock(Mtx);
+	return (u32)(Slots.size() - FreeSlots.size());
+}
+
+u64 VoxelBrickPager::GetFileSizeBytes() const
+{
+	std::lock_guard<std::mutex> lock(Mtx);
+	return (u64)Slots.size() * SLOT_SIZE_BYTES;
+}
@@ -0,0 +1,100 @@
+#include "VoxelCellCases.h"
+#include <bitset>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VOXEL_CELL_CASES_SSE2
+#include <emmintrin.h>
+#endif
+
+// a cell row's BASE_CELL_SIZE cells have BASE_CELL_SIZE + 1 lattice points along each edge
+#define LATTICE_ROW_SIZE (BASE_CELL_SIZE + 1)
+
+namespace VoxelCellCases
+{
+	static inline const i8* GetLatticeRow(const i8* field, u32 j, u32 k)
+	{
+		return field
+			+ TOTAL_DECK_SIZE * (k + POLYGONIZER_NEGATIVE_GUTTER)
+			+ TOTAL_CELL_SIZE * (j + POLYGONIZER_NEGATIVE_GUTTER)
+			+ POLYGONIZER_NEGATIVE_GUTTER;
+	}
+
+	// bit x set if lattice point x of the row is negative
+	static u32 GetRowSigns_Scalar(const i8* row)
+	{
+		u32 signs = 0;
+		for (u32 x = 0; x < LATTICE_ROW_SIZE; x++)
+		{
+			signs |= (u32)(row[x] < 0) << x;
+		}
+		return signs;
+	}
+
+#ifdef VOXEL_CELL_CASES_SSE2
+	static_assert(BASE_CELL_SIZE == 16, "the SSE2 version takes the sign bits of a row's first 16 lattice points in one go");
+	static_assert(POLYGONIZER_POSITIVE_GUTTER >= 1, "the last lattice point of a row has to be in the gathered block");
+
+	static u32 GetRowSigns_SSE2(const i8* row)
+	{
+		// movemask is the top bit of each byte, which is the sign of an i8
+		u32 signs = (u32)_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row)));
+		return signs | ((u32)(row[BASE_CELL_SIZE] < 0) << BASE_CELL_SIZE);
+	}
+#endif
+
+	template<u32(*GetRowSigns)(const i8*)>
+	static u32 Build_Impl(const i8* field, CellCases& outCases)
+	{
+		u32 signs[LATTICE_ROW_SIZE][LATTICE_ROW_SIZE];
+		for (u32 k = 0; k < LATTICE_ROW_SIZE; k++)
+		{
+			for (u32 j = 0; j < LATTICE_ROW_SIZE; j++)
+			{
+				signs[k][j] = GetRowSigns(GetLatticeRow(field, j, k));
+			}
+		}
+
+		u32 numOccupied = 0;
+		for (u32 k = 0; k < BASE_CELL_SIZE; k++)
+		{
+			for (u32 j = 0; j < BASE_CELL_SIZE; j++)
+			{
+				// the four lattice rows along the edges of this row of cells
+				u32 s0 = signs[k][j];
+				u32 s1 = signs[k][j + 1];
+				u32 s2 = signs[k + 1][j];
+				u32 s3 = signs[k + 1][j + 1];
+
+				// a cell is between two neighbouring columns of four points
+				u32 anyNegative = s0 | s1 | s2 | s3;
+				u32 allNegative = s0 & s1 & s2 & s3;
+				anyNegative |= anyNegative >> 1;
+				allNegative &= allNegative >> 1;
+				u16 occupied = (u16)(anyNegative & ~allNegative);
+				outCases.OccupiedCells[j + BASE_CELL_SIZE * k] = occupied;
+				numOccupied += (u32)std::bitset<BASE_CELL_SIZE>(occupied).count();
+
+				u8* cases = outCases.Cases + BASE_CELL_SIZE * j + BASE_DECK_SIZE * k;
+				for (u32 i = 0; i < BASE_CELL_SIZE; i++)
+				{
+					cases[i] = (u8)(((s0 >> i) & 3) | (((s1 >> i) & 3) << 2) | (((s2 >> i) & 3) << 4) | (((s3 >> i) & 3) << 6));
+				}
+			}
+		}
+		return numOccupied;
+	}
+
+	u32 Build(const i8* field, CellCases& outCases)
+	{
+#ifdef VOXEL_CELL_CASES_SSE2
+		return Build_Impl<GetRowSigns_SSE2>(field, outCases);
+#else
+		return Build_Impl<GetRowSigns_Scalar>(field, outCases);
+#endif
+	}
+
+	u32 Build_Scalar(const i8* field, CellCases& outCases)
+	{
+		return Build_Impl<GetRowSigns_Scalar>(field, outCases);
+	}
+}
@@ -0,0 +1,504 @@
+#include "VoxelEditJournal.h"
+#include "IVoxelDataSource.h"
+#include "TerrainDefs.h"
+#include "OctreeFunctionLibrary.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+#define JOURNAL_MAGIC 0x4a584f56 // "VOXJ"
+#define JOURNAL_VERSION 1
+#define CHECKPOINT_MAGIC 0x4b434843 // "CHCK"
+// the same as in a region file, compressed bricks are read a u16 at a time
+#define JOURNAL_BRICK_ALIGNMENT 4
+#define BRICK_SIZE_BYTES (BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE)
+
+struct JournalHeader
+{
+	u32 Magic;
+	u32 Version;
+	u32 SizeVoxels;
+	u32 Padding;
+};
+
+struct CheckpointHeader
+{
+	u32 Magic;
+	u32 NumBricks;
+	u64 SizeBytes; // of the directory and bricks after it
+	u32 Checksum; // of the directory and bricks, to find a checkpoint that wasn't finished
+	u32 Padding;
+};
+
+static_assert(sizeof(JournalHeader) % JOURNAL_BRICK_ALIGNMENT == 0 && sizeof(CheckpointHeader) % JOURNAL_BRICK_ALIGNMENT == 0
+	&& sizeof(VoxelRegionFile::DirectoryEntry) % JOURNAL_BRICK_ALIGNMENT == 0, "every brick in the journal starts aligned");
+
+typedef VoxelRegionFile::DirectoryEntry DirectoryEntry;
+
+// FNV-1a
+static u32 GetChecksum(const u8* data, size_t sizeBytes)
+{
+	u32 hash = 2166136261u;
+	for (size_t i = 0; i < sizeBytes; i++)
+	{
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+	return hash;
+}
+
+static bool WriteJournalHeader(std::ofstream& ofs, u32 sizeVoxels)
+{
+	JournalHeader header;
+	header.Magic = JOURNAL_MAGIC;
+	header.Version = JOURNAL_VERSION;
+	header.SizeVoxels = sizeVoxels;
+	header.Padding = 0;
+	return (bool)ofs.write((const char*)&header, sizeof(JournalHeader));
+}
+
+// a checkpoint's directory isn't aligned for reading in place
+static inline DirectoryEntry GetCheckpointEntry(const u8* checkpointData, u32 index)
+{
+	DirectoryEntry entry;
+	memcpy(&entry, checkpointData + index * sizeof(DirectoryEntry), sizeof(DirectoryEntry));
+	return entry;
+}
+
+static inline const u8* GetCheckpointBricks(const u8* checkpointData, u32 numBricks)
+{
+	return checkpointData + numBricks * sizeof(DirectoryEntry);
+}
+
+// is data, SizeBytes of directory and bricks, a checkpoint that was finished
+static bool IsCheckpointValid(const CheckpointHeader& header, const u8* data)
+{
+	if (header.Magic != CHECKPOINT_MAGIC || header.SizeBytes < (u64)header.NumBricks * sizeof(DirectoryEntry)
+		|| GetChecksum(data, header.SizeBytes) != header.Checksum)
+	{
+		return false;
+	}
+	u64 bricksSize = header.SizeBytes - header.NumBricks * sizeof(DirectoryEntry);
+	for (u32 i = 0; i < header.NumBricks; i++)
+	{
+		DirectoryEntry entry = GetCheckpointEntry(data, i);
+		if (entry.SizeBytes > BRICK_SIZE_BYTES || entry.Offset % JOURNAL_BRICK_ALIGNMENT != 0 || entry.Offset + entry.SizeBytes > bricksSize)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool VoxelEditJournal::Open(const char* path, u32 sizeVoxels)
+{
+	Close();
+	std::lock_guard<std::mutex> lock(Mutex);
+	std::error_code error;
+	u64 fileSize = std::filesystem::exists(path, error) ? (u64)std::filesystem::file_size(path, error) : 0;
+	if (error)
+	{
+		std::cout << "Cannot open file " << path << "\n";
+		return false;
+	}
+
+	u64 validSize = sizeof(JournalHeader);
+	if (fileSize == 0)
+	{
+		std::ofstream ofs(path, std::ios::out | std::ios::trunc | std::ios::binary);
+		if (!ofs || !WriteJournalHeader(ofs, sizeVoxels))
+		{
+			std::cout << "Cannot open file " << path << "\n";
+			return false;
+		}
+	}
+	else
+	{
+		std::ifstream ifs(path, std::ios::in | std::ios::binary);
+		JournalHeader header;
+		if (fileSize < sizeof(JournalHeader) || !ifs.read((char*)&header, sizeof(JournalHeader)) || header.Magic != JOURNAL_MAGIC || header.Version != JOURNAL_VERSION)
+		{
+			std::cout << path << " is not an edit journal\n";
+			return false;
+		}
+		if (header.SizeVoxels != sizeVoxels)
+		{
+			std::cout << "Trying to open an edit journal saved from a different sized volume\n";
+			return false;
+		}
+		std::vector<u8> data;
+		CheckpointHeader checkpoint;
+		while (fileSize - validSize >= sizeof(CheckpointHeader) && ifs.read((char*)&checkpoint, sizeof(CheckpointHeader)))
+		{
+			if (checkpoint.SizeBytes > fileSize - validSize - sizeof(CheckpointHeader))
+			{
+				break;
+			}
+			data.resize(checkpoint.SizeBytes);
+			if (!ifs.read((char*)data.data(), data.size()) || !IsCheckpointValid(checkpoint, data.data()))
+			{
+				break;
+			}
+			Checkpoints.push_back({ validSize, checkpoint.SizeBytes, checkpoint.NumBricks });
+			validSize += sizeof(CheckpointHeader) + checkpoint.SizeBytes;
+		}
+		ifs.close();
+		if (validSize != fileSize)
+		{
+			// the game stopped part way through writing a checkpoint, appending after it would lose everything after it too
+			std::cout << "Dropping an unfinished checkpoint from " << path << "\n";
+			std::filesystem::resize_file(path, validSize, error);
+			if (error)
+			{
+				std::cout << "Cannot open file " << path << "\n";
+				Checkpoints.clear();
+				return false;
+			}
+		}
+	}
+
+	File.open(path, std::ios::out | std::ios::app | std::ios::binary);
+	if (!File)
+	{
+		std::cout << "Cannot open file " << path << "\n";
+		File.clear();
+		Checkpoints.clear();
+		return false;
+	}
+	Path = path;
+	SizeBytes = validSize;
+	SizeVoxels = sizeVoxels;
+	return true;
+}
+
+void VoxelEditJournal::Close()
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	if (File.is_open())
+	{
+		File.close();
+	}
+	File.clear();
+	Path.clear();
+	Checkpoints.clear();
+	SizeBytes = 0;
+	SizeVoxels = 0;
+}
+
+bool VoxelEditJournal::IsOpen() const
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	return File.is_open();
+}
+
+u32 VoxelEditJournal::GetNumCheckpoints() const
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	return (u32)Checkpoints.size();
+}
+
+u64 VoxelEditJournal::GetSizeBytes() const
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	return SizeBytes;
+}
+
+bool VoxelEditJournal::AppendCheckpoint(IVoxelDataSource* source, const std::vector<glm::ivec3>& brickBottomLefts)
+{
+	// a brick can be dirtied twice around a checkpoint, see SparseTerrainVoxelOctree::TakeDirtyBricks
+	std::vector<DirectoryEntry> directory(brickBottomLefts.size());
+	for (size_t i = 0; i < brickBottomLefts.size(); i++)
+	{
+		directory[i].MortonCode = OctreeFunctionLibrary::GetMortonCode(
+			(u32)brickBottomLefts[i].x / BASE_CELL_SIZE, (u32)brickBottomLefts[i].y / BASE_CELL_SIZE, (u32)brickBottomLefts[i].z / BASE_CELL_SIZE);
+	}
+	std::sort(directory.begin(), directory.end(), [](const DirectoryEntry& a, const DirectoryEntry& b) { return a.MortonCode < b.MortonCode; });
+	directory.erase(std::unique(directory.begin(), directory.end(), [](const DirectoryEntry& a, const DirectoryEntry& b) { return a.MortonCode == b.MortonCode; }), directory.end());
+	if (directory.empty())
+	{
+		return true;
+	}
+
+	// the directory then the bricks, built up in memory so the checkpoint goes to the file in one write
+	size_t directorySize = directory.size() * sizeof(DirectoryEntry);
+	std::vector<u8> data(directorySize);
+	i8 voxels[BRICK_SIZE_BYTES];
+	u8 encoded[BRICK_SIZE_BYTES];
+	for (DirectoryEntry& entry : directory)
+	{
+		if (!source->ReadBrick(VoxelRegionFile::GetBrickBottomLeft(entry), voxels))
+		{
+			// a checkpoint with a stand in for the brick would replay over what's really there
+			std::cout << "Failed to read brick for checkpoint of " << Path << "\n";
+			return false;
+		}
+		u32 sizeBytes = VoxelRegionFile::EncodeBrick(voxels, entry, encoded);
+		entry.Offset = data.size() - directorySize;
+		data.insert(data.end(), encoded, encoded + sizeBytes);
+		// padding
+		data.resize((data.size() + JOURNAL_BRICK_ALIGNMENT - 1) / JOURNAL_BRICK_ALIGNMENT * JOURNAL_BRICK_ALIGNMENT, 0);
+	}
+	memcpy(data.data(), directory.data(), directorySize);
+	CheckpointHeader header;
+	header.Magic = CHECKPOINT_MAGIC;
+	header.NumBricks = (u32)directory.size();
+	header.SizeBytes = data.size();
+	header.Checksum = GetChecksum(data.data(), data.size());
+	header.Padding = 0;
+
+	std::lock_guard<std::mutex> lock(Mutex);
+	if (!File.is_open())
+	{
+		return false;
+	}
+	File.write((const char*)&header, sizeof(CheckpointHeader));
+	File.write((const char*)data.data(), data.size());
+	File.flush();
+	if (!File)
+	{
+		// cut off whatever did get written so the next checkpoint isn't appended after it
+		std::cout << "Failed to write checkpoint to " << Path << "\n";
+		File.close();
+		File.clear();
+		std::error_code error;
+		std::filesystem::resize_file(Path, SizeBytes, error);
+		File.open(Path, std::ios::out | std::ios::app | std::ios::binary);
+		return false;
+	}
+	Checkpoints.push_back({ SizeBytes, data.size(), header.NumBricks });
+	SizeBytes += sizeof(CheckpointHeader) + data.size();
+	return true;
+}
+
+u32 VoxelEditJournal::Replay(IVoxelDataSource* destination)
+{
+	std::vector<CheckpointInfo> checkpoints;
+	std::string path;
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		checkpoints = Checkpoints;
+		path = Path;
+	}
+	std::vector<u8> data;
+	if (checkpoints.empty() || !ReadCheckpoints(path, checkpoints, data))
+	{
+		return 0;
+	}
+	u32 numLoaded = 0;
+	i8 voxels[BRICK_SIZE_BYTES];
+	for (const CheckpointInfo& checkpoint : checkpoints)
+	{
+		const u8* checkpointData = data.data() + (checkpoint.Offset - checkpoints.front().Offset) + sizeof(CheckpointHeader);
+		const u8* bricks = GetCheckpointBricks(checkpointData, checkpoint.NumBricks);
+		for (u32 i = 0; i < checkpoint.NumBricks; i++)
+		{
+			DirectoryEntry entry = GetCheckpointEntry(checkpointData, i);
+			if (VoxelRegionFile::DecodeBrick(entry, bricks + entry.Offset, voxels))
+			{
+				destination->FillBrick(VoxelRegionFile::GetBrickBottomLeft(entry), voxels);
+				numLoaded++;
+			}
+		}
+	}
+	return numLoaded;
+}
+
+bool VoxelEditJournal::CompactInto(const char* regionFilePath)
+{
+	std::lock_guard<std::mutex> compactionLock(CompactionMutex);
+	std::vector<CheckpointInfo> checkpoints;
+	std::string path;
+	u32 sizeVoxels;
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		if (!File.is_open())
+		{
+			return false;
+		}
+		checkpoints = Checkpoints;
+		path = Path;
+		sizeVoxels = SizeVoxels;
+	}
+	if (checkpoints.empty())
+	{
+		return true;
+	}
+	// appends only add to the end, the checkpoints copied above won't change while they're read
+	std::vector<u8> data;
+	if (!ReadCheckpoints(path, checkpoints, data))
+	{
+		return false;
+	}
+
+	// the newest copy of each brick in the journal, in morton order
+	struct JournalBrick
+	{
+		DirectoryEntry Entry;
+		const u8* Data;
+	};
+	std::vector<JournalBrick> journalBricks;
+	for (const CheckpointInfo& checkpoint : checkpoints)
+	{
+		const u8* checkpointData = data.data() + (checkpoint.Offset - checkpoints.front().Offset) + sizeof(CheckpointHeader);
+		const u8* bricks = GetCheckpointBricks(checkpointData, checkpoint.NumBricks);
+		for (u32 i = 0; i < checkpoint.NumBricks; i++)
+		{
+			DirectoryEntry entry = GetCheckpointEntry(checkpointData, i);
+			journalBricks.push_back({ entry, bricks + entry.Offset });
+		}
+	}
+	// stable so that the last of each run of the same brick is the newest
+	std::stable_sort(journalBricks.begin(), journalBricks.end(), [](const JournalBrick& a, const JournalBrick& b) { return a.Entry.MortonCode < b.Entry.MortonCode; });
+	size_t numNewest = 0;
+	for (size_t i = 0; i < journalBricks.size(); i++)
+	{
+		if (i + 1 == journalBricks.size() || journalBricks[i + 1].Entry.MortonCode != journalBricks[i].Entry.MortonCode)
+		{
+			journalBricks[numNewest++] = journalBricks[i];
+		}
+	}
+	journalBricks.resize(numNewest);
+
+	VoxelRegionFile regionFile;
+	std::error_code error;
+	if (std::filesystem::exists(regionFilePath, error))
+	{
+		if (!regionFile.Open(regionFilePath))
+		{
+			return false;
+		}
+		if (regionFile.GetSizeVoxels() != sizeVoxels)
+		{
+			std::cout << "Trying to compact an edit journal into a region file saved from a different sized volume\n";
+			return false;
+		}
+	}
+
+	// merge the region file's directory with the journal's, the journal's bricks replacing the region file's.
+	// a brick with no data from the journal is read from the region file
+	const std::vector<DirectoryEntry>& regionDirectory = regionFile.GetDirectory();
+	std::vector<DirectoryEntry> directory;
+	std::vector<JournalBrick> sources;
+	directory.reserve(regionDirectory.size() + journalBricks.size());
+	sources.reserve(regionDirectory.size() + journalBricks.size());
+	size_t regionIndex = 0;
+	size_t journalIndex = 0;
+	while (regionIndex < regionDirectory.size() || journalIndex < journalBricks.size())
+	{
+		bool bFromJournal = journalIndex < journalBricks.size()
+			&& (regionIndex == regionDirectory.size() || journalBricks[journalIndex].Entry.MortonCode <= regionDirectory[regionIndex].MortonCode);
+		if (bFromJournal)
+		{
+			if (regionIndex < regionDirectory.size() && regionDirectory[regionIndex].MortonCode == journalBricks[journalIndex].Entry.MortonCode)
+			{
+				regionIndex++;
+			}
+			sources.push_back(journalBricks[journalIndex++]);
+		}
+		else
+		{
+			sources.push_back({ regionDirectory[regionIndex++], nullptr });
+		}
+		directory.push_back(sources.back().Entry);
+	}
+
+	std::string tempPath = std::string(regionFilePath) + ".compacting";
+	bool bWritten = VoxelRegionFile::WriteEncoded(tempPath.c_str(), sizeVoxels, directory, [&](size_t i, u8* out)
+	{
+		if (sources[i].Data)
+		{
+			memcpy(out, sources[i].Data, sources[i].Entry.SizeBytes);
+			return true;
+		}
+		return regionFile.ReadEncodedBrick(sources[i].Entry, out);
+	});
+	regionFile.Close();
+	if (!bWritten)
+	{
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(Mutex);
+	if (Path != path)
+	{
+		// closed or opened on another file while this was running
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	std::filesystem::rename(tempPath, regionFilePath, error);
+	if (error)
+	{
+		std::cout << "Cannot replace region file " << regionFilePath << "\n";
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	// if the game stops before the journal is cut short, replaying it just writes bricks the region file already has
+	return DropCheckpoints(checkpoints.size());
+}
+
+std::future<bool> VoxelEditJournal::CompactIntoAsync(const char* regionFilePath)
+{
+	return std::async(std::launch::async, [this, regionFilePath = std::string(regionFilePath)]()
+	{
+		return CompactInto(regionFilePath.c_str());
+	});
+}
+
+bool VoxelEditJournal::ReadCheckpoints(const std::string& path, const std::vector<CheckpointInfo>& checkpoints, std::vector<u8>& outData)
+{
+	u64 start = checkpoints.front().Offset;
+	outData.resize(checkpoints.back().Offset + sizeof(CheckpointHeader) + checkpoints.back().SizeBytes - start);
+	std::ifstream ifs(path, std::ios::in | std::ios::binary);
+	ifs.seekg(start);
+	if (!ifs.read((char*)outData.data(), outData.size()))
+	{
+		std::cout << "Failed to read edit journal " << path << "\n";
+		return false;
+	}
+	return true;
+}
+
+bool VoxelEditJournal::DropCheckpoints(size_t numDropped)
+{
+	u64 keptFrom = numDropped < Checkpoints.size() ? Checkpoints[numDropped].Offset : SizeBytes;
+	std::vector<u8> kept(SizeBytes - keptFrom);
+	File.close();
+	File.clear();
+	bool bWritten = true;
+	if (!kept.empty())
+	{
+		std::ifstream ifs(Path, std::ios::in | std::ios::binary);
+		ifs.seekg(keptFrom);
+		bWritten = (bool)ifs.read((char*)kept.data(), kept.size());
+	}
+	// written next to it and moved over it, the same as the region file
+	std::string tempPath = Path + ".compacting";
+	if (bWritten)
+	{
+		std::ofstream ofs(tempPath, std::ios::out | std::ios::trunc | std::ios::binary);
+		bWritten = ofs && WriteJournalHeader(ofs, SizeVoxels) && ofs.write((const char*)kept.data(), kept.size());
+	}
+	std::error_code error;
+	if (bWritten)
+	{
+		std::filesystem::rename(tempPath, Path, error);
+	}
+	if (!bWritten || error)
+	{
+		std::cout << "Failed to write edit journal " << Path << "\n";
+		std::remove(tempPath.c_str());
+		File.open(Path, std::ios::out | std::ios::app | std::ios::binary);
+		return false;
+	}
+
+	Checkpoints.erase(Checkpoints.begin(), Checkpoints.begin() + numDropped);
+	for (CheckpointInfo& checkpoint : Checkpoints)
+	{
+		checkpoint.Offset -= keptFrom - sizeof(JournalHeader);
+	}
+	SizeBytes = sizeof(JournalHeader) + kept.size();
+	File.open(Path, std::ios::out | std::ios::app | std::ios::binary);
+	return (bool)File;
+}
@@ -0,0 +1,498 @@
+#include "VoxelRegionFile.h"
+#include "IVoxelDataSource.h"
+#include "TerrainDefs.h"
+#include "OctreeFunctionLibrary.h"
+#include "VoxelBrickCompression.h"
+#include "VoxelBrickLZ.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <iostream>
+
+#define REGION_FILE_MAGIC 0x52584f56 // "VOXR"
+#define REGION_FILE_VERSION 1
+// compressed bricks are read a u16 at a time
+#define REGION_FILE_BRICK_ALIGNMENT 4
+#define BRICK_SIZE_BYTES (BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE)
+// subtrees per worker, more than one so that a worker given an empty part of the world isn't left idle
+#define REGION_FILE_PARTITIONS_PER_WORKER 8
+// encoded subtrees the writer lets pile up per worker before waiting for the oldest, so the whole file isn't held in memory
+#define REGION_FILE_WRITES_IN_FLIGHT_PER_WORKER 2
+
+struct RegionFileHeader
+{
+	u32 Magic;
+	u32 Version;
+	u32 SizeVoxels;
+	u32 NumBricks;
+	u64 DirectoryOffset;
+};
+
+static_assert(sizeof(RegionFileHeader) % REGION_FILE_BRICK_ALIGNMENT == 0, "the first brick starts straight after the header");
+static_assert(sizeof(VoxelRegionFile::DirectoryEntry) == 24, "directory entries are read straight from the file");
+
+static inline u64 GetBrickMortonCode(const glm::ivec3& brickBottomLeft)
+{
+	return OctreeFunctionLibrary::GetMortonCode((u32)brickBottomLeft.x / BASE_CELL_SIZE, (u32)brickBottomLeft.y / BASE_CELL_SIZE, (u32)brickBottomLeft.z / BASE_CELL_SIZE);
+}
+
+static inline u64 AlignBrickOffset(u64 offset)
+{
+	return (offset + REGION_FILE_BRICK_ALIGNMENT - 1) / REGION_FILE_BRICK_ALIGNMENT * REGION_FILE_BRICK_ALIGNMENT;
+}
+
+bool VoxelRegionFile::Write(const char* path, IVoxelDataSource* source, const std::vector<glm::ivec3>& brickBottomLefts, rdx::thread_pool* threadPool)
+{
+	std::vector<DirectoryEntry> directory(brickBottomLefts.size());
+	for (size_t i = 0; i < brickBottomLefts.size(); i++)
+	{
+		directory[i].MortonCode = GetBrickMortonCode(brickBottomLefts[i]);
+	}
+	std::sort(directory.begin(), directory.end(), [](const DirectoryEntry& a, const DirectoryEntry& b) { return a.MortonCode < b.MortonCode; });
+	directory.erase(std::unique(directory.begin(), directory.end(), [](const DirectoryEntry& a, const DirectoryEntry& b) { return a.MortonCode == b.MortonCode; }), directory.end());
+
+	u32 sizeVoxels = (u32)source->GetSize();
+	std::ofstream ofs;
+	if (!BeginWriting(ofs, path, sizeVoxels, (u32)directory.size()))
+	{
+		return false;
+	}
+
+	// each subtree is encoded into memory on its own, then this thread writes them out in order and moves their offsets along
+	u64 offset = sizeof(RegionFileHeader);
+	std::atomic<bool> bReadAll = { true };
+	auto writePartition = [&](const std::pair<size_t, size_t>& partition, const std::vector<u8>& data)
+	{
+		for (size_t i = partition.first; i < partition.second; i++)
+		{
+			directory[i].Offset += offset;
+		}
+		ofs.write((const char*)data.data(), data.size());
+		offset += data.size();
+	};
+	if (!threadPool)
+	{
+		std::vector<u8> data;
+		for (const std::pair<size_t, size_t>& partition : PartitionBySubtree(directory, sizeVoxels, GetPartitionDepth(sizeVoxels, 1)))
+		{
+			if (!EncodePartition(source, directory.data() + partition.first, partition.second - partition.first, data))
+			{
+				bReadAll = false;
+			}
+			writePartition(partition, data);
+		}
+	}
+	else
+	{
+		size_t numWorkers = std::max<size_t>(threadPool->NumWorkers(), 1);
+		std::vector<std::pair<size_t, size_t>> partitions = PartitionBySubtree(directory, sizeVoxels, GetPartitionDepth(sizeVoxels, numWorkers * REGION_FILE_PARTITIONS_PER_WORKER));
+		std::deque<std::future<std::vector<u8>>> inFlight;
+		size_t numQueued = 0;
+		for (size_t numWritten = 0; numWritten < partitions.size(); numWritten++)
+		{
+			for (; numQueued < partitions.size() && inFlight.size() < numWorkers * REGION_FILE_WRITES_IN_FLIGHT_PER_WORKER; numQueued++)
+			{
+				// each task only touches its own entries
+				DirectoryEntry* entries = directory.data() + partitions[numQueued].first;
+				size_t numEntries = partitions[numQueued].second - partitions[numQueued].first;
+				inFlight.push_back(threadPool->enqueue([source, entries, numEntries, &bReadAll]() {
+					std::vector<u8> data;
+					if (!EncodePartition(source, entries, numEntries, data))
+					{
+						bReadAll = false;
+					}
+					return data;
+				}));
+			}
+			writePartition(partitions[numWritten], inFlight.front().get());
+			inFlight.pop_front();
+		}
+	}
+	if (!bReadAll)
+	{
+		// the header's left without a directory so the file can't be opened
+		std::cout << "Failed to read every brick to write to " << path << "\n";
+		return false;
+	}
+	return FinishWriting(ofs, path, sizeVoxels, directory, offset);
+}
+
+bool VoxelRegionFile::WriteEncoded(const char* path, u32 sizeVoxels, std::vector<DirectoryEntry>& directory, const std::function<bool(size_t, u8*)>& readBrick)
+{
+	std::ofstream ofs;
+	if (!BeginWriting(ofs, path, sizeVoxels, (u32)directory.size()))
+	{
+		return false;
+	}
+	static const char padding[REGION_FILE_BRICK_ALIGNMENT] = {};
+	u64 offset = sizeof(RegionFileHeader);
+	u8 encoded[BRICK_SIZE_BYTES];
+	for (size_t i = 0; i < directory.size(); i++)
+	{
+		DirectoryEntry& entry = directory[i];
+		if (entry.SizeBytes > BRICK_SIZE_BYTES || (entry.SizeBytes && !readBrick(i, encoded)))
+		{
+			std::cout << "Failed to read a brick to write to region file " << path << "\n";
+			return false;
+		}
+		entry.Offset = offset;
+		u64 alignedSize = AlignBrickOffset(entry.SizeBytes);
+		ofs.write((const char*)encoded, entry.SizeBytes);
+		ofs.write(padding, alignedSize - entry.SizeBytes);
+		offset += alignedSize;
+	}
+	return FinishWriting(ofs, path, sizeVoxels, directory, offset);
+}
+
+bool VoxelRegionFile::BeginWriting(std::ofstream& ofs, const char* path, u32 sizeVoxels, u32 numBricks)
+{
+	ofs.open(path, std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!ofs)
+	{
+		std::cout << "Cannot open file " << path << "\n";
+		return false;
+	}
+	RegionFileHeader header;
+	header.Magic = REGION_FILE_MAGIC;
+	header.Version = REGION_FILE_VERSION;
+	header.SizeVoxels = sizeVoxels;
+	header.NumBricks = numBricks;
+	header.DirectoryOffset = 0;
+	// filled in once the bricks have been written
+	ofs.write((const char*)&header, sizeof(RegionFileHeader));
+	return true;
+}
+
+bool VoxelRegionFile::FinishWriting(std::ofstream& ofs, const char* path, u32 sizeVoxels, const std::vector<DirectoryEntry>& directory, u64 directoryOffset)
+{
+	RegionFileHeader header;
+	header.Magic = REGION_FILE_MAGIC;
+	header.Version = REGION_FILE_VERSION;
+	header.SizeVoxels = sizeVoxels;
+	header.NumBricks = (u32)directory.size();
+	header.DirectoryOffset = directoryOffset;
+	ofs.write((const char*)directory.data(), directory.size() * sizeof(DirectoryEntry));
+	ofs.seekp(0);
+	ofs.write((const char*)&header, sizeof(RegionFileHeader));
+	if (!ofs)
+	{
+		std::cout << "Failed to write region file " << path << "\n";
+		return false;
+	}
+	return true;
+}
+
+bool VoxelRegionFile::Open(const char* path)
+{
+	Close();
+	Path = path;
+	File.open(path, std::ios::in | std::ios::binary);
+	if (!File)
+	{
+		std::cout << "Cannot open file " << path << "\n";
+		return false;
+	}
+	File.seekg(0, std::ios::end);
+	u64 fileSize = (u64)File.tellg();
+	File.seekg(0);
+	RegionFileHeader header;
+	bool bValid = fileSize >= sizeof(RegionFileHeader) && File.read((char*)&header, sizeof(RegionFileHeader))
+		&& header.Magic == REGION_FILE_MAGIC
+		&& header.Version == REGION_FILE_VERSION
+		&& header.DirectoryOffset >= sizeof(RegionFileHeader)
+		&& header.DirectoryOffset <= fileSize
+		&& (fileSize - header.DirectoryOffset) == (u64)header.NumBricks * sizeof(DirectoryEntry);
+	if (bValid)
+	{
+		Directory.resize(header.NumBricks);
+		File.seekg(header.DirectoryOffset);
+		bValid = (bool)File.read((char*)Directory.data(), Directory.size() * sizeof(DirectoryEntry));
+	}
+	for (size_t i = 0; bValid && i < Directory.size(); i++)
+	{
+		const DirectoryEntry& entry = Directory[i];
+		// bricks are stored in directory order, LoadPartition reads a run of them as one span
+		bValid = (i == 0 || (Directory[i - 1].MortonCode < entry.MortonCode && entry.Offset >= Directory[i - 1].Offset + Directory[i - 1].SizeBytes))
+			&& entry.Offset >= sizeof(RegionFileHeader)
+			&& entry.Offset % REGION_FILE_BRICK_ALIGNMENT == 0
+			&& entry.SizeBytes <= BRICK_SIZE_BYTES
+			&& entry.Offset + entry.SizeBytes <= header.DirectoryOffset;
+	}
+	if (!bValid)
+	{
+		std::cout << path << " is not a region file\n";
+		Close();
+		return false;
+	}
+	SizeVoxels = header.SizeVoxels;
+	DirectoryOffset = header.DirectoryOffset;
+	return true;
+}
+
+void VoxelRegionFile::Close()
+{
+	if (File.is_open())
+	{
+		File.close();
+	}
+	File.clear();
+	Path.clear();
+	Directory.clear();
+	DirectoryOffset = 0;
+	SizeVoxels = 0;
+}
+
+const VoxelRegionFile::DirectoryEntry* VoxelRegionFile::FindBrick(const glm::ivec3& brickBottomLeft) const
+{
+	u64 code = GetBrickMortonCode(brickBottomLeft);
+	auto it = std::lower_bound(Directory.begin(), Directory.end(), code, [](const DirectoryEntry& entry, u64 code) { return entry.MortonCode < code; });
+	return it != Directory.end() && it->MortonCode == code ? &*it : nullptr;
+}
+
+bool VoxelRegionFile::ReadBrick(const glm::ivec3& brickBottomLeft, i8* outVoxels)
+{
+	const DirectoryEntry* entry = FindBrick(brickBottomLeft);
+	return entry && ReadEntry(*entry, outVoxels);
+}
+
+u32 VoxelRegionFile::LoadRegion(IVoxelDataSource* destination, const glm::ivec3& min, const glm::ivec3& max)
+{
+	glm::ivec3 firstBrick = glm::max(min, glm::ivec3(0)) / (i32)BASE_CELL_SIZE;
+	glm::ivec3 lastBrick = max / (i32)BASE_CELL_SIZE;
+	if (max.x < 0 || max.y < 0 || max.z < 0 || lastBrick.x < firstBrick.x || lastBrick.y < firstBrick.y || lastBrick.z < firstBrick.z)
+	{
+		return 0;
+	}
+	// every brick in the box has a code between those of its corners, but not every code between them is in the box
+	u64 firstCode = OctreeFunctionLibrary::GetMortonCode(firstBrick.x, firstBrick.y, firstBrick.z);
+	u64 lastCode = OctreeFunctionLibrary::GetMortonCode(lastBrick.x, lastBrick.y, lastBrick.z);
+	auto it = std::lower_bound(Directory.begin(), Directory.end(), firstCode, [](const DirectoryEntry& entry, u64 code) { return entry.MortonCode < code; });
+	u32 numLoaded = 0;
+	i8 voxels[BRICK_SIZE_BYTES];
+	for (; it != Directory.end() && it->MortonCode <= lastCode; ++it)
+	{
+		glm::ivec3 brick = glm::ivec3(OctreeFunctionLibrary::GetCellFromMortonCode(it->MortonCode));
+		if (brick.x < firstBrick.x || brick.y < firstBrick.y || brick.z < firstBrick.z
+			|| brick.x > lastBrick.x || brick.y > lastBrick.y || brick.z > lastBrick.z)
+		{
+			continue;
+		}
+		if (ReadEntry(*it, voxels))
+		{
+			destination->FillBrick(brick * (i32)BASE_CELL_SIZE, voxels);
+			numLoaded++;
+		}
+	}
+	return numLoaded;
+}
+
+u32 VoxelRegionFile::LoadAll(IVoxelDataSource* destination, rdx::thread_pool* threadPool)
+{
+	if (Directory.empty())
+	{
+		return 0;
+	}
+	if (!threadPool)
+	{
+		return LoadPartition(File, destination, 0, Directory.size());
+	}
+
+	size_t numWorkers = std::max<size_t>(threadPool->NumWorkers(), 1);
+	u32 depth = GetPartitionDepth(SizeVoxels, numWorkers * REGION_FILE_PARTITIONS_PER_WORKER);
+	// the same as the populator, make the nodes the subtrees hang off up front so the workers never create nodes
+	// in the same place, after that each one only creates nodes in its own subtree
+	if (depth && destination->GetSize() == SizeVoxels)
+	{
+		destination->CreateChildrenForFirstNMipLevels(destination->GetParentNode(), depth);
+	}
+	std::vector<std::future<u32>> futures;
+	for (const std::pair<size_t, size_t>& partition : PartitionBySubtree(Directory, SizeVoxels, depth))
+	{
+		futures.push_back(threadPool->enqueue([this, destination, partition]() {
+			std::ifstream file(Path, std::ios::in | std::ios::binary);
+			if (!file)
+			{
+				std::cout << "Cannot open file " << Path << "\n";
+				return 0u;
+			}
+			return LoadPartition(file, destination, partition.first, partition.second);
+		}));
+	}
+	u32 numLoaded = 0;
+	for (std::future<u32>& future : futures)
+	{
+		numLoaded += future.get();
+	}
+	return numLoaded;
+}
+
+glm::ivec3 VoxelRegionFile::GetBrickBottomLeft(const DirectoryEntry& entry)
+{
+	return glm::ivec3(OctreeFunctionLibrary::GetCellFromMortonCode(entry.MortonCode)) * (i32)BASE_CELL_SIZE;
+}
+
+u32 VoxelRegionFile::EncodeBrick(const i8* voxels, DirectoryEntry& outEntry, u8* out)
+{
+	outEntry.UniformValue = voxels[0];
+	outEntry.Padding = 0;
+	if (memcmp(voxels, voxels + 1, BRICK_SIZE_BYTES - 1) == 0)
+	{
+		outEntry.Codec = BrickCodec::Uniform;
+		outEntry.SizeBytes = 0;
+		return 0;
+	}
+	VoxelBrickCompression::CompressedBrickHeader header;
+	size_t compressedSize = VoxelBrickCompression::PlanCompression(voxels, header);
+	// only if it beats the others
+	size_t lzSize = VoxelBrickLZ::Compress(voxels, out, (compressedSize ? compressedSize : BRICK_SIZE_BYTES) - 1);
+	if (lzSize)
+	{
+		outEntry.Codec = BrickCodec::LZ;
+		outEntry.SizeBytes = (u32)lzSize;
+	}
+	else if (compressedSize)
+	{
+		VoxelBrickCompression::Compress(voxels, header, out);
+		outEntry.Codec = BrickCodec::Compressed;
+		outEntry.SizeBytes = (u32)compressedSize;
+	}
+	else
+	{
+		memcpy(out, voxels, BRICK_SIZE_BYTES);
+		outEntry.Codec = BrickCodec::Raw;
+		outEntry.SizeBytes = BRICK_SIZE_BYTES;
+	}
+	return outEntry.SizeBytes;
+}
+
+bool VoxelRegionFile::DecodeBrick(const DirectoryEntry& entry, const u8* data, i8* outVoxels)
+{
+	switch (entry.Codec)
+	{
+	case BrickCodec::Uniform:
+		memset(outVoxels, entry.UniformValue, BRICK_SIZE_BYTES);
+		return true;
+	case BrickCodec::Raw:
+		if (entry.SizeBytes != BRICK_SIZE_BYTES)
+		{
+			return false;
+		}
+		memcpy(outVoxels, data, BRICK_SIZE_BYTES);
+		return true;
+	case BrickCodec::Compressed:
+		if (entry.SizeBytes < sizeof(VoxelBrickCompression::CompressedBrickHeader) || VoxelBrickCompression::GetHeader(data)->SizeBytes != entry.SizeBytes)
+		{
+			return false;
+		}
+		VoxelBrickCompression::Decompress(data, outVoxels);
+		return true;
+	case BrickCodec::LZ:
+		return VoxelBrickLZ::Decompress(data, entry.SizeBytes, outVoxels);
+	}
+	return false;
+}
+
+u32 VoxelRegionFile::GetPartitionDepth(u32 sizeVoxels, size_t minSubtrees)
+{
+	// stop a level above the leaves, splitting into single bricks would be a task per brick
+	u32 maxDepth = OctreeFunctionLibrary::GetMipLevel(sizeVoxels);
+	maxDepth = maxDepth ? maxDepth - 1 : 0;
+	u32 depth = std::min<u32>(1, maxDepth);
+	for (size_t numSubtrees = 8; numSubtrees < minSubtrees && depth < maxDepth; numSubtrees *= 8)
+	{
+		depth++;
+	}
+	return depth;
+}
+
+std::vector<std::pair<size_t, size_t>> VoxelRegionFile::PartitionBySubtree(const std::vector<DirectoryEntry>& directory, u32 sizeVoxels, u32 depth)
+{
+	// a brick's code has three bits per level below the root, the bricks of a subtree all share the top ones
+	u32 shift = 3 * (OctreeFunctionLibrary::GetMipLevel(sizeVoxels) - depth);
+	std::vector<std::pair<size_t, size_t>> partitions;
+	for (size_t i = 0; i < directory.size(); i++)
+	{
+		if (i == 0 || (directory[i].MortonCode >> shift) != (directory[i - 1].MortonCode >> shift))
+		{
+			partitions.push_back({ i, i });
+		}
+		partitions.back().second = i + 1;
+	}
+	return partitions;
+}
+
+bool VoxelRegionFile::EncodePartition(IVoxelDataSource* source, DirectoryEntry* entries, size_t numEntries, std::vector<u8>& outData)
+{
+	bool bReadAll = true;
+	outData.clear();
+	i8 voxels[BRICK_SIZE_BYTES];
+	u8 encoded[BRICK_SIZE_BYTES];
+	for (size_t i = 0; i < numEntries; i++)
+	{
+		DirectoryEntry& entry = entries[i];
+		if (!source->ReadBrick(GetBrickBottomLeft(entry), voxels))
+		{
+			bReadAll = false;
+		}
+		u32 sizeBytes = EncodeBrick(voxels, entry, encoded);
+		entry.Offset = outData.size();
+		outData.insert(outData.end(), encoded, encoded + sizeBytes);
+		// padding
+		outData.resize(AlignBrickOffset(outData.size()), 0);
+	}
+	return bReadAll;
+}
+
+u32 VoxelRegionFile::LoadPartition(std::istream& file, IVoxelDataSource* destination, size_t first, size_t last) const
+{
+	// one read for all of it rather than a seek and read per brick
+	u64 start = Directory[first].Offset;
+	std::vector<u8> bricks(Directory[last - 1].Offset + Directory[last - 1].SizeBytes - start);
+	file.clear();
+	file.seekg(start);
+	if (!file.read((char*)bricks.data(), bricks.size()))
+	{
+		std::cout << "Failed to read region file\n";
+		file.clear();
+		return 0;
+	}
+	u32 numLoaded = 0;
+	i8 voxels[BRICK_SIZE_BYTES];
+	for (size_t i = first; i < last; i++)
+	{
+		const DirectoryEntry& entry = Directory[i];
+		if (DecodeBrick(entry, bricks.data() + (entry.Offset - start), voxels))
+		{
+			destination->FillBrick(GetBrickBottomLeft(entry), voxels);
+			numLoaded++;
+		}
+	}
+	return numLoaded;
+}
+
+bool VoxelRegionFile::ReadEncodedBrick(const DirectoryEntry& entry, u8* out)
+{
+	if (!entry.SizeBytes)
+	{
+		return true;
+	}
+	File.clear();
+	File.seekg(entry.Offset);
+	if (!File.read((char*)out, entry.SizeBytes))
+	{
+		std::cout << "Failed to read brick from region file\n";
+		File.clear();
+		return false;
+	}
+	return true;
+}
+
+bool VoxelRegionFile::ReadEntry(const DirectoryEntry& entry, i8* outVoxels)
+{
+	// u16 aligned for compressed bricks
+	alignas(REGION_FILE_BRICK_ALIGNMENT) u8 data[BRICK_SIZE_BYTES];
+	return ReadEncodedBrick(entry, data) && DecodeBrick(entry, data, outVoxels);
+}
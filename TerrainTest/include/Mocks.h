@@ -9,7 +9,7 @@ class MockTerrainGraphicsAPIAdaptor : public ITerrainGraphicsAPIAdaptor
 {
 public:
 	MOCK_METHOD(void, UploadNewlyPolygonizedToGPU, (PolygonizeWorkerThreadData* data), (override));
-	MOCK_METHOD(void, RenderTerrainNodes, (const std::vector<ITerrainOctreeNode*>& nodes, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection), (override));
+	MOCK_METHOD(void, RenderTerrainNodes, (const std::vector<ITerrainOctreeNode*>& nodes, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, bool renderDebugBoxes), (override));
 	MOCK_METHOD(void, SetTerrainMaterial, (const TerrainMaterial& material), (override));
 	MOCK_METHOD(void, SetTerrainLight, (const TerrainLight& light), (override));
 };
@@ -25,19 +25,28 @@ public:
 	MOCK_METHOD(TerrainChunkMesh&, GetTerrainChunkMeshMutable, (), (override));
 	MOCK_METHOD(void, SetTerrainChunkMesh, (const TerrainChunkMesh& mesh), (override));
 	MOCK_METHOD(bool, NeedsRegenerating, (), (const, override));
-
+	MOCK_METHOD(i8*, GetVoxelData, (), (override));
+	MOCK_METHOD(void, SetVoxelData, (i8* data), (override));
 };
 
 class MockVoxelDataSource : public IVoxelDataSource
 {
 public:
 	MOCK_METHOD(i8, GetVoxelAt, (const glm::ivec3& valueAt), (override));
+	MOCK_METHOD(void, GetVoxelRegionContainingPoint, (const glm::ivec3& location, VoxelRegion& outRegion), (override));
 	MOCK_METHOD(void, GetVoxelsForNode, (ITerrainOctreeNode* node, i8* outVoxels), (override));
 	MOCK_METHOD(TerrainOctreeIndex, SetVoxelAt, (const glm::ivec3& location, i8 value), (override));
+	MOCK_METHOD(TerrainOctreeIndex, FillBrick, (const glm::ivec3& brickBottomLeft, const i8* voxels), (override));
+	MOCK_METHOD(TerrainOctreeIndex, FillBrick, (const glm::ivec3& brickBottomLeft, const std::function<i8(const glm::ivec3&)>& generator), (override));
+	MOCK_METHOD(bool, ReadBrick, (const glm::ivec3& brickBottomLeft, i8* outVoxels), (override));
 	MOCK_METHOD(void, Clear, (), (override));
 	MOCK_METHOD(void, ResizeAndClear, (const size_t newSize), (override));
 	MOCK_METHOD(size_t, GetSize, (), (const, override));
-
+	MOCK_METHOD(ITerrainOctreeNode*, FindNodeFromIndex, (TerrainOctreeIndex index, bool createIfDoesntExist), (override));
+	MOCK_METHOD(void, AllocateNodeVoxelData, (ITerrainOctreeNode* node), (override));
+	MOCK_METHOD(ITerrainOctreeNode*, GetParentNode, (), (override));
+	MOCK_METHOD(void, CreateChildrenForFirstNMipLevels, (ITerrainOctreeNode* node, int n, int onLevel), (override));
+	MOCK_METHOD(void, CollapseUniformSubtrees, (), (override));
 };
 
 class MockPolygonizer : public ITerrainPolygonizer
@@ -1,6 +1,9 @@
 #pragma once
 #include <functional>
 #include <memory>
+#include <unordered_set>
+#include <vector>
+#include <glm.hpp>
 #include "CommonTypedefs.h"
 #include "SparseTerrainVoxelOctree.h"
 
@@ -24,4 +27,27 @@ namespace SparseOctreeTesttHelpers
 	typedef std::function<void(OctreeAndMockDependencies&)> PreConstructionMockConfigurator;
 
 	void GetTestObjects(OctreeAndMockDependencies& testObjectsOut, PreConstructionMockConfigurator configurator = PreConstructionMockConfigurator(), u32 sizeVoxels = 64, i8 clampValueHigh = 50, i8 clampValueLow = -50);
+
+	// a rolling surface through the middle of the volume, sin along x and cos along z, with a band of values
+	// between the clamps either side of it. the defaults are roughly what the test populator makes
+	struct TerrainLikeParams
+	{
+		float FrequencyX = 0.05f;
+		float AmplitudeX = 20.0f;
+		float FrequencyZ = 0.03f;
+		float AmplitudeZ = 20.0f;
+		float DensityGradient = 10.0f;
+		i8 ClampMin = -127;
+		i8 ClampMax = 127;
+	};
+
+	i8 TerrainLikeDensity(const glm::ivec3& location, u32 sizeVoxels, const TerrainLikeParams& params);
+
+	// FillBrick every brick of the volume with TerrainLikeDensity, z then y then x.
+	// outBricks gets their bottom left corners and outLeaves the leaves written to, if given
+	void FillTerrainLikeOctree(SparseTerrainVoxelOctree& octree, u32 sizeVoxels, const TerrainLikeParams& params,
+		std::vector<glm::ivec3>* outBricks = nullptr, std::unordered_set<TerrainOctreeIndex>* outLeaves = nullptr);
+
+	// write a voxel into each brick of the volume with chance fraction, so there's a mix of full and partly empty nodes
+	void MakeSparseLeaves(SparseTerrainVoxelOctree& octree, u32 sizeVoxels, float fraction, u32 seed);
 }
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "pch.h"
+#include "SparseVoxelOctreeTestHelpers.h"
+#include "Mocks.h"
+#include "SparseTerrainVoxelOctree.h"
+#include "FlatTerrainOctree.h"
+#include "TerrainLODSelectionAndCullingAlgorithm.h"
+#include "Frustum.h"
+#include "TerrainDefs.h"
+#include <random>
+#include <vector>
+
+TEST(FlatTerrainOctree, MatchesTheTree)
+{
+	// arrange
+	const u32 size = 256;
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), size);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	MakeSparseLeaves(octree, size, 0.3f, 1);
+
+	// act
+	const FlatTerrainOctree& flat = octree.GetFlatOctree();
+
+	// assert - every node has the same position, size and children as the tree node it came from
+	ASSERT_EQ(flat.GetTreeNode(flat.GetRoot()), octree.GetParentNode());
+	for (u32 node = 0; node < flat.GetNumNodes(); node++)
+	{
+		ITerrainOctreeNode* treeNode = flat.GetTreeNode(node);
+		ASSERT_EQ(flat.GetBottomLeftCorner(node), treeNode->GetBottomLeftCorner());
+		ASSERT_EQ(flat.GetSizeInVoxels(node), treeNode->GetSizeInVoxels());
+		ASSERT_EQ(flat.GetMipLevel(node), treeNode->GetMipLevel());
+		for (u8 i = 0; i < 8; i++)
+		{
+			ITerrainOctreeNode* treeChild = treeNode->GetMipLevel() ? treeNode->GetChild(i) : nullptr;
+			u32 child = flat.GetChild(node, i);
+			ASSERT_EQ(child == FlatTerrainOctree::INVALID_NODE, treeChild == nullptr);
+			if (treeChild)
+			{
+				ASSERT_EQ(flat.GetTreeNode(child), treeChild);
+			}
+		}
+	}
+
+	// point lookups end at the same node as walking the tree
+	std::mt19937 gen(2);
+	std::uniform_int_distribution<int> posDistr(-8, size + 8);
+	for (int i = 0; i < 10000; i++)
+	{
+		glm::ivec3 point = { posDistr(gen), posDistr(gen), posDistr(gen) };
+		u32 found = flat.FindNodeContainingPoint(point);
+		glm::ivec3 relative = point;
+		if (relative.x < 0 || relative.y < 0 || relative.z < 0 || relative.x >= size || relative.y >= size || relative.z >= size)
+		{
+			ASSERT_EQ(found, FlatTerrainOctree::INVALID_NODE);
+			continue;
+		}
+		ITerrainOctreeNode* treeNode = octree.GetParentNode();
+		while (treeNode->GetMipLevel() != 0)
+		{
+			u32 half = treeNode->GetSizeInVoxels() / 2;
+			glm::ivec3 local = point - treeNode->GetBottomLeftCorner();
+			u8 childIndex = (local.x >= half ? 1 : 0) | (local.y >= half ? 2 : 0) | (local.z >= half ? 4 : 0);
+			ITerrainOctreeNode* child = treeNode->GetChild(childIndex);
+			if (!child)
+			{
+				break;
+			}
+			treeNode = child;
+		}
+		ASSERT_EQ(flat.GetTreeNode(found), treeNode);
+	}
+}
+
+TEST(FlatTerrainOctree, RebuiltWhenTheStructureChanges)
+{
+	// arrange
+	const u32 size = 128;
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), size);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	octree.SetVoxelAt({ 0,0,0 }, 1);
+	u32 nodesBefore = octree.GetFlatOctree().GetNumNodes();
+	u32 generation = octree.GetStructureGeneration();
+
+	// act / assert - writing to an existing leaf doesn't change anything
+	octree.SetVoxelAt({ 1,0,0 }, 2);
+	ASSERT_EQ(octree.GetStructureGeneration(), generation);
+
+	// a new leaf does
+	glm::ivec3 corner = { size - 1, size - 1, size - 1 };
+	i8 original = octree.GetVoxelAt(corner);
+	octree.SetVoxelAt(corner, original == 0 ? 1 : 0);
+	ASSERT_NE(octree.GetStructureGeneration(), generation);
+	ASSERT_GT(octree.GetFlatOctree().GetNumNodes(), nodesBefore);
+
+	// and so does collapsing it away again
+	generation = octree.GetStructureGeneration();
+	u32 nodesWithLeaf = octree.GetFlatOctree().GetNumNodes();
+	octree.SetVoxelAt(corner, original);
+	octree.CollapseUniformSubtrees();
+	ASSERT_NE(octree.GetStructureGeneration(), generation);
+	ASSERT_LT(octree.GetFlatOctree().GetNumNodes(), nodesWithLeaf);
+
+	octree.Clear();
+	ASSERT_EQ(octree.GetFlatOctree().GetNumNodes(), 1u);
+}
+
+TEST(FlatTerrainOctree, LODTraversalMatchesTheTree)
+{
+	// arrange
+	const u32 size = 256;
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), size);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	MakeSparseLeaves(octree, size, 0.5f, 3);
+	const FlatTerrainOctree& flat = octree.GetFlatOctree();
+
+	// with no projection a node's viewport area is its size squared, so the threshold picks the level to stop at
+	Frustum frustum{};
+	glm::mat4 viewProjection(1.0f);
+	float oldThreshold = TerrainLODSelectionAndCullingAlgorithm::MinimumViewportAreaThreshold;
+	for (float threshold : { 1.0f, 32.0f * 32.0f + 1.0f, 128.0f * 128.0f + 1.0f })
+	{
+		TerrainLODSelectionAndCullingAlgorithm::MinimumViewportAreaThreshold = threshold;
+		std::vector<ITerrainOctreeNode*> treeNodes, flatNodes;
+
+		// act
+		TerrainLODSelectionAndCullingAlgorithm::GetChunksToRender(frustum, treeNodes, octree.GetParentNode(), viewProjection);
+		TerrainLODSelectionAndCullingAlgorithm::GetChunksToRender(frustum, flatNodes, flat, flat.GetRoot(), viewProjection);
+
+		// assert
+		ASSERT_FALSE(treeNodes.empty());
+		ASSERT_EQ(treeNodes, flatNodes);
+	}
+	TerrainLODSelectionAndCullingAlgorithm::MinimumViewportAreaThreshold = oldThreshold;
+}
@@ -0,0 +1,130 @@
+#include "pch.h"
+#include "LeafHashIndex.h"
+#include "OctreeFunctionLibrary.h"
+#include "DefaultAllocator.h"
+#include "TerrainDefs.h"
+#include "Mocks.h"
+#include <random>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+TEST(OctreeFunctionLibrary, MortonCodeInterleavesBits)
+{
+	ASSERT_EQ(OctreeFunctionLibrary::GetMortonCode(0, 0, 0), 0u);
+	ASSERT_EQ(OctreeFunctionLibrary::GetMortonCode(1, 0, 0), 1u);
+	ASSERT_EQ(OctreeFunctionLibrary::GetMortonCode(0, 1, 0), 2u);
+	ASSERT_EQ(OctreeFunctionLibrary::GetMortonCode(0, 0, 1), 4u);
+	ASSERT_EQ(OctreeFunctionLibrary::GetMortonCode(3, 0, 0), 9u);
+	ASSERT_EQ(OctreeFunctionLibrary::GetMortonCode(0x1fffff, 0x1fffff, 0x1fffff), 0x7fffffffffffffffull);
+}
+
+TEST(OctreeFunctionLibrary, IndexOfLeafContainingPointMatchesBottomLeftCorner)
+{
+	// arrange
+	const u32 rootSize = 2048;
+	std::mt19937 gen(1);
+	std::uniform_int_distribution<int> posDistr(0, rootSize - 1);
+
+	for (int i = 0; i < 10000; i++)
+	{
+		glm::ivec3 point = { posDistr(gen), posDistr(gen), posDistr(gen) };
+
+		// act
+		TerrainOctreeIndex index = OctreeFunctionLibrary::GetIndexOfLeafContainingPoint(point, rootSize);
+
+		// assert
+		glm::ivec3 bottomLeft = OctreeFunctionLibrary::GetBottomLeftCornerFromIndex(index, rootSize);
+		ASSERT_TRUE(OctreeFunctionLibrary::IsPointInCube(point, bottomLeft, BASE_CELL_SIZE));
+	}
+}
+
+TEST(OctreeFunctionLibrary, ChildIndexContainingPoint)
+{
+	glm::ivec3 bottomLeft = { 64, 128, 0 };
+	for (u8 child = 0; child < 8; child++)
+	{
+		glm::ivec3 childBL = bottomLeft + glm::ivec3{ child & 1, (child >> 1) & 1, (child >> 2) & 1 } * 32;
+		ASSERT_EQ(OctreeFunctionLibrary::GetChildIndexContainingPoint(childBL, bottomLeft, 64), child);
+		ASSERT_EQ(OctreeFunctionLibrary::GetChildIndexContainingPoint(childBL + glm::ivec3(31, 31, 31), bottomLeft, 64), child);
+	}
+}
+
+// the index only stores the pointers so anything will do for leaves
+static ITerrainOctreeNode* FakeLeaf(u64 i)
+{
+	return reinterpret_cast<ITerrainOctreeNode*>((i + 1) * 16);
+}
+
+TEST(LeafHashIndex, InsertFindRemove)
+{
+	// arrange
+	DefaultAllocator allocator;
+	LeafHashIndex index(&allocator, 4);
+	const u64 numLeaves = 5000;
+	auto key = [](u64 i) { return OctreeFunctionLibrary::GetMortonCode((u32)(i % 17), (u32)(i / 17 % 17), (u32)(i / 289)); };
+
+	// act - enough to make it grow several times
+	for (u64 i = 0; i < numLeaves; i++)
+	{
+		index.Insert(key(i), FakeLeaf(i));
+	}
+
+	// assert
+	ASSERT_EQ(index.GetNumLeaves(), numLeaves);
+	for (u64 i = 0; i < numLeaves; i++)
+	{
+		ASSERT_EQ(index.Find(key(i)), FakeLeaf(i)) << "i was " << i;
+	}
+	ASSERT_EQ(index.Find(key(numLeaves)), nullptr);
+
+	// remove every third, the rest have to still be found after the gaps are closed up
+	for (u64 i = 0; i < numLeaves; i += 3)
+	{
+		index.Remove(key(i));
+	}
+	for (u64 i = 0; i < numLeaves; i++)
+	{
+		ASSERT_EQ(index.Find(key(i)), i % 3 == 0 ? nullptr : FakeLeaf(i)) << "i was " << i;
+	}
+
+	index.Clear();
+	ASSERT_EQ(index.GetNumLeaves(), 0u);
+	ASSERT_EQ(index.Find(key(1)), nullptr);
+}
+
+TEST(LeafHashIndex, FindWhileInserting)
+{
+	// arrange
+	DefaultAllocator allocator;
+	LeafHashIndex index(&allocator, 4);
+	const u64 numLeaves = 20000;
+	std::atomic<u64> inserted = 0;
+
+	// act - a reader checks everything inserted so far is found while the table grows underneath it
+	std::thread reader([&]()
+	{
+		while (inserted < numLeaves)
+		{
+			u64 upTo = inserted;
+			for (u64 i = 0; i < upTo; i += 7)
+			{
+				ITerrainOctreeNode* found = index.Find(i);
+				// a reader still on a retired table can miss a leaf inserted after it grew, but never sees a wrong one
+				ASSERT_TRUE(found == FakeLeaf(i) || found == nullptr);
+			}
+		}
+	});
+	for (u64 i = 0; i < numLeaves; i++)
+	{
+		index.Insert(i, FakeLeaf(i));
+		inserted++;
+	}
+	reader.join();
+
+	// assert
+	for (u64 i = 0; i < numLeaves; i++)
+	{
+		ASSERT_EQ(index.Find(i), FakeLeaf(i));
+	}
+}
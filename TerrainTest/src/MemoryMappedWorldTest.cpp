@@ -0,0 +1,242 @@
+#include "pch.h"
+#include "SparseVoxelOctreeTestHelpers.h"
+#include "Mocks.h"
+#include "SparseTerrainVoxelOctree.h"
+#include "SparseTerrainVoxelOctreeSnapshot.h"
+#include "MemoryMappedFile.h"
+#include "TerrainOctreeStatistics.h"
+#include "TerrainDefs.h"
+#include <random>
+#include <fstream>
+#include <vector>
+#include <cstdio>
+#include <filesystem>
+
+static const char* gMappedWorldTestFile = "MemoryMappedWorldTest.world";
+static const char* gMappedWorldTestPageFile = "MemoryMappedWorldTest.page";
+static const u32 gMappedWorldTestSizeVoxels = 128;
+
+// some bricks uniform and collapsed, some compressed and some raw
+static void FillMappedWorldTestOctree(SparseTerrainVoxelOctree& octree)
+{
+	SparseOctreeTesttHelpers::TerrainLikeParams params;
+	params.FrequencyX = 0.12f;
+	params.AmplitudeX = 18.0f;
+	params.FrequencyZ = 0.2f;
+	params.AmplitudeZ = 8.0f;
+	params.DensityGradient = 20.0f;
+	octree.bCompressBricks = true;
+	SparseOctreeTesttHelpers::FillTerrainLikeOctree(octree, gMappedWorldTestSizeVoxels, params);
+	std::mt19937 gen(7);
+	std::uniform_int_distribution<int> posDistr(0, gMappedWorldTestSizeVoxels - 1);
+	std::uniform_int_distribution<int> valueDistr(-127, 127);
+	for (int i = 0; i < 20; i++)
+	{
+		octree.SetVoxelAt({ posDistr(gen), posDistr(gen), posDistr(gen) }, (i8)valueDistr(gen));
+	}
+	octree.CollapseUniformSubtrees();
+}
+
+static void ReadMappedWorldTestVolume(IVoxelDataSource* source, std::vector<i8>& outVoxels)
+{
+	outVoxels.resize(gMappedWorldTestSizeVoxels * gMappedWorldTestSizeVoxels * gMappedWorldTestSizeVoxels);
+	for (int z = 0; z < gMappedWorldTestSizeVoxels; z++)
+	{
+		for (int y = 0; y < gMappedWorldTestSizeVoxels; y++)
+		{
+			for (int x = 0; x < gMappedWorldTestSizeVoxels; x++)
+			{
+				outVoxels[x + gMappedWorldTestSizeVoxels * y + gMappedWorldTestSizeVoxels * gMappedWorldTestSizeVoxels * z] = source->GetVoxelAt({ x,y,z });
+			}
+		}
+	}
+}
+
+TEST(MemoryMappedWorld, MapFile)
+{
+	// arrange
+	std::vector<u8> contents(10000);
+	for (size_t i = 0; i < contents.size(); i++)
+	{
+		contents[i] = (u8)(i * 31);
+	}
+	{
+		std::ofstream ofs(gMappedWorldTestFile, std::ios::out | std::ios::trunc | std::ios::binary);
+		ofs.write((const char*)contents.data(), contents.size());
+	}
+
+	// act
+	MemoryMappedFile file;
+	bool bOpened = file.Open(gMappedWorldTestFile);
+
+	// assert
+	ASSERT_TRUE(bOpened);
+	ASSERT_EQ(file.GetSize(), contents.size());
+	ASSERT_EQ(memcmp(file.GetData(), contents.data(), contents.size()), 0);
+	ASSERT_TRUE(file.Contains(file.GetData()));
+	ASSERT_TRUE(file.Contains(file.GetData() + contents.size() - 1));
+	ASSERT_FALSE(file.Contains(file.GetData() + contents.size()));
+	ASSERT_FALSE(file.Contains(contents.data()));
+	MemoryMappedFile moved = std::move(file);
+	ASSERT_FALSE(file.IsOpen());
+	ASSERT_TRUE(moved.IsOpen());
+	moved.Close();
+	ASSERT_FALSE(moved.Contains(nullptr));
+	ASSERT_FALSE(file.Open("MemoryMappedWorldTest.doesnotexist"));
+	std::remove(gMappedWorldTestFile);
+}
+
+TEST(MemoryMappedWorld, SaveAndLoad)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gMappedWorldTestSizeVoxels, 127, -127);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	FillMappedWorldTestOctree(octree);
+	std::vector<i8> expected;
+	ReadMappedWorldTestVolume(&octree, expected);
+	TerrainOctreeStatistics statsSaved;
+	octree.GetStatistics(statsSaved);
+	ASSERT_GT(statsSaved.NumRawBricks, 0u);
+	ASSERT_GT(statsSaved.NumCompressedBricks, 0u);
+	ASSERT_GT(statsSaved.NumCollapsedNodes, 0u);
+
+	// act
+	ASSERT_TRUE(octree.SaveMappedWorld(gMappedWorldTestFile));
+	OctreeAndMockDependencies loadedObjects;
+	GetTestObjects(loadedObjects, PreConstructionMockConfigurator(), BASE_CELL_SIZE * 2, 127, -127);
+	SparseTerrainVoxelOctree& loaded = *loadedObjects.Octree.get();
+	bool bLoaded = loaded.LoadMappedWorld(gMappedWorldTestFile);
+
+	// assert - the same tree, with no bricks of its own
+	ASSERT_TRUE(bLoaded);
+	ASSERT_EQ(loaded.GetSize(), gMappedWorldTestSizeVoxels);
+	ASSERT_EQ(loaded.GetResidentBrickBytes(), 0u);
+	TerrainOctreeStatistics statsLoaded;
+	loaded.GetStatistics(statsLoaded);
+	ASSERT_EQ(memcmp(statsLoaded.NodesPerMipLevel, statsSaved.NodesPerMipLevel, sizeof(statsSaved.NodesPerMipLevel)), 0);
+	ASSERT_EQ(statsLoaded.NumRawBricks, statsSaved.NumRawBricks);
+	ASSERT_EQ(statsLoaded.NumCompressedBricks, statsSaved.NumCompressedBricks);
+	ASSERT_EQ(statsLoaded.NumCollapsedNodes, statsSaved.NumCollapsedNodes);
+	ASSERT_GT(statsLoaded.MappedWorldBytes, 0u);
+	std::vector<i8> after;
+	ReadMappedWorldTestVolume(&loaded, after);
+	ASSERT_EQ(after, expected);
+
+	// a file that isn't a world leaves the octree empty
+	{
+		std::ofstream ofs(gMappedWorldTestFile, std::ios::out | std::ios::trunc | std::ios::binary);
+		ofs << "not a world";
+	}
+	ASSERT_FALSE(loaded.LoadMappedWorld(gMappedWorldTestFile));
+	std::remove(gMappedWorldTestFile);
+}
+
+TEST(MemoryMappedWorld, WritesCopyBricksOutOfTheFile)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gMappedWorldTestSizeVoxels, 127, -127);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	FillMappedWorldTestOctree(octree);
+	std::vector<i8> original;
+	ReadMappedWorldTestVolume(&octree, original);
+	ASSERT_TRUE(octree.SaveMappedWorld(gMappedWorldTestFile));
+	ASSERT_TRUE(octree.LoadMappedWorld(gMappedWorldTestFile));
+	ASSERT_TRUE(octree.EnablePaging(gMappedWorldTestPageFile, 0));
+
+	// act - single voxels, some while a snapshot is pinned, and whole bricks, then a lot of compressing and evicting
+	std::vector<i8> expected = original;
+	std::mt19937 gen(11);
+	std::uniform_int_distribution<int> posDistr(0, gMappedWorldTestSizeVoxels - 1);
+	std::uniform_int_distribution<int> valueDistr(-127, 127);
+	for (int round = 0; round < 3; round++)
+	{
+		SparseTerrainVoxelOctreeSnapshot* snapshot = round == 1 ? new SparseTerrainVoxelOctreeSnapshot(&octree) : nullptr;
+		for (int i = 0; i < 300; i++)
+		{
+			glm::ivec3 location = { posDistr(gen), posDistr(gen), posDistr(gen) };
+			i8 value = (i8)valueDistr(gen);
+			octree.SetVoxelAt(location, value);
+			expected[location.x + gMappedWorldTestSizeVoxels * location.y + gMappedWorldTestSizeVoxels * gMappedWorldTestSizeVoxels * location.z] = value;
+		}
+		if (snapshot)
+		{
+			std::vector<i8> snapshotVoxels;
+			ReadMappedWorldTestVolume(snapshot, snapshotVoxels);
+			ASSERT_EQ(snapshotVoxels, original);
+			delete snapshot;
+		}
+		glm::ivec3 brickBL = { BASE_CELL_SIZE * round, gMappedWorldTestSizeVoxels / 2, 0 };
+		octree.FillBrick(brickBL, [](const glm::ivec3& location) { return (i8)(location.x - location.y); });
+		for (int z = 0; z < BASE_CELL_SIZE; z++)
+		{
+			for (int y = 0; y < BASE_CELL_SIZE; y++)
+			{
+				for (int x = 0; x < BASE_CELL_SIZE; x++)
+				{
+					glm::ivec3 location = brickBL + glm::ivec3(x, y, z);
+					expected[location.x + gMappedWorldTestSizeVoxels * location.y + gMappedWorldTestSizeVoxels * gMappedWorldTestSizeVoxels * location.z] = std::clamp((i8)(location.x - location.y), (i8)-127, (i8)127);
+				}
+			}
+		}
+		octree.CompressBricks();
+		octree.CollapseUniformSubtrees();
+		octree.EnforceBrickBudget();
+		octree.EnforceBrickBudget();
+		original = expected;
+	}
+
+	// assert - the edits are read back, and the file still holds the world as it was saved
+	std::vector<i8> after;
+	ReadMappedWorldTestVolume(&octree, after);
+	ASSERT_EQ(after, expected);
+	octree.DisablePaging();
+	ReadMappedWorldTestVolume(&octree, after);
+	ASSERT_EQ(after, expected);
+	OctreeAndMockDependencies reloadedObjects;
+	GetTestObjects(reloadedObjects, PreConstructionMockConfigurator(), gMappedWorldTestSizeVoxels, 127, -127);
+	ASSERT_TRUE(reloadedObjects.Octree->LoadMappedWorld(gMappedWorldTestFile));
+	std::vector<i8> reloaded;
+	ReadMappedWorldTestVolume(reloadedObjects.Octree.get(), reloaded);
+	octree.Clear();
+	ASSERT_EQ(octree.GetResidentBrickBytes(), 0u);
+	OctreeAndMockDependencies savedObjects;
+	GetTestObjects(savedObjects, PreConstructionMockConfigurator(), gMappedWorldTestSizeVoxels, 127, -127);
+	FillMappedWorldTestOctree(*savedObjects.Octree.get());
+	std::vector<i8> saved;
+	ReadMappedWorldTestVolume(savedObjects.Octree.get(), saved);
+	ASSERT_EQ(reloaded, saved);
+	reloadedObjects.Octree->Clear();
+	std::remove(gMappedWorldTestFile);
+	std::remove(gMappedWorldTestPageFile);
+}
+
+TEST(MemoryMappedWorld, SaveFailsIfABrickCantBeRead)
+{
+	// arrange - every brick evicted, then the page file lost
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gMappedWorldTestSizeVoxels, 127, -127);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	FillMappedWorldTestOctree(octree);
+	ASSERT_TRUE(octree.EnablePaging(gMappedWorldTestPageFile, 0));
+	octree.EnforceBrickBudget();
+	octree.EnforceBrickBudget();
+	ASSERT_EQ(octree.GetResidentBrickBytes(), 0u);
+	std::error_code error;
+	std::filesystem::resize_file(gMappedWorldTestPageFile, 0, error);
+	ASSERT_FALSE(error);
+
+	// act
+	bool bSaved = octree.SaveMappedWorld(gMappedWorldTestFile);
+
+	// assert
+	ASSERT_FALSE(bSaved);
+	ASSERT_GT(octree.GetNumFailedBrickReads(), 0u);
+	octree.DisablePaging();
+	std::remove(gMappedWorldTestFile);
+	std::remove(gMappedWorldTestPageFile);
+}
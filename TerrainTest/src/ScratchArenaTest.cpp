@@ -0,0 +1,95 @@
+#include "pch.h"
+#include "ScratchArena.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+TEST(ScratchArena, AllocationsAreAlignedAndDontOverlap)
+{
+	// arrange
+	ScratchArena arena(1024);
+	std::vector<std::pair<u8*, size_t>> allocations;
+
+	// act - more than fits, so some come from overflow blocks
+	for (size_t i = 1; i < 40; i++)
+	{
+		size_t size = i * 7;
+		u8* ptr = (u8*)arena.Malloc(size);
+		ASSERT_NE(ptr, nullptr);
+		memset(ptr, (int)i, size);
+		allocations.push_back({ ptr, size });
+	}
+
+	// assert
+	for (size_t i = 0; i < allocations.size(); i++)
+	{
+		ASSERT_EQ((uintptr_t)allocations[i].first % alignof(std::max_align_t), 0u);
+		for (size_t b = 0; b < allocations[i].second; b++)
+		{
+			ASSERT_EQ(allocations[i].first[b], (u8)(i + 1));
+		}
+	}
+}
+
+TEST(ScratchArena, GrowsToFitTheBiggestJobAfterReset)
+{
+	// arrange
+	ScratchArena arena(256);
+
+	// act - a job bigger than the arena
+	u8* first = (u8*)arena.Malloc(200);
+	u8* second = (u8*)arena.Malloc(1000);
+	ASSERT_NE(first, nullptr);
+	ASSERT_NE(second, nullptr);
+	arena.Reset();
+
+	// assert - the same job fits in one block next time
+	ASSERT_GE(arena.GetSizeBytes(), 1200u);
+	ASSERT_GE(arena.GetHighWaterMarkBytes(), 1200u);
+	size_t sizeBefore = arena.GetSizeBytes();
+	u8* again = (u8*)arena.Malloc(200);
+	u8* againSecond = (u8*)arena.Malloc(1000);
+	ASSERT_LE(againSecond + 1000, again + arena.GetSizeBytes());
+	arena.Reset();
+	ASSERT_EQ(arena.GetSizeBytes(), sizeBefore);
+}
+
+TEST(ScratchArena, ReallocGrowsTheLastAllocationInPlaceAndMovesTheRest)
+{
+	// arrange
+	ScratchArena arena(1024);
+	u8* first = (u8*)arena.Malloc(64);
+	u8* second = (u8*)arena.Malloc(64);
+	for (u8 i = 0; i < 64; i++)
+	{
+		first[i] = i;
+		second[i] = 64 + i;
+	}
+
+	// act / assert - the last allocation grows where it is
+	ASSERT_EQ(arena.Realloc(second, 128), second);
+	u8* third = (u8*)arena.Malloc(16);
+	ASSERT_GE(third, second + 128);
+
+	// anything else is copied somewhere new, whether that's in the block or not
+	u8* movedFirst = (u8*)arena.Realloc(first, 128);
+	ASSERT_NE(movedFirst, nullptr);
+	ASSERT_NE(movedFirst, first);
+	u8* movedSecond = (u8*)arena.Realloc(second, 4096);
+	ASSERT_NE(movedSecond, nullptr);
+	ASSERT_NE(movedSecond, second);
+	for (u8 i = 0; i < 64; i++)
+	{
+		ASSERT_EQ(movedFirst[i], i);
+		ASSERT_EQ(movedSecond[i], 64 + i);
+	}
+
+	// including allocations that didn't fit in the block
+	arena.Malloc(16);
+	u8* movedAgain = (u8*)arena.Realloc(movedSecond, 8192);
+	ASSERT_NE(movedAgain, nullptr);
+	for (u8 i = 0; i < 64; i++)
+	{
+		ASSERT_EQ(movedAgain[i], 64 + i);
+	}
+}
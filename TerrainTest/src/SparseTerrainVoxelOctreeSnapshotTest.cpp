@@ -0,0 +1,364 @@
+#include "pch.h"
+#include "SparseVoxelOctreeTestHelpers.h"
+#include "Mocks.h"
+#include "SparseTerrainVoxelOctree.h"
+#include "SparseTerrainVoxelOctreeSnapshot.h"
+#include "VoxelAccessor.h"
+#include "TerrainLODSelectionAndCullingAlgorithm.h"
+#include "IAllocator.h"
+#include "Camera.h"
+#include "TerrainDefs.h"
+#include <random>
+#include <iostream>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <atomic>
+#include <vector>
+
+static const u32 gSnapshotTestSizeVoxels = 64;
+static const i8 gSnapshotTestClampMin = -127;
+static const i8 gSnapshotTestClampMax = 127;
+static const u32 gSnapshotTestVolume = gSnapshotTestSizeVoxels * gSnapshotTestSizeVoxels * gSnapshotTestSizeVoxels;
+
+// uniform, compressed and raw leaves
+static void FillSnapshotTestOctree(SparseTerrainVoxelOctree& octree)
+{
+	SparseOctreeTesttHelpers::TerrainLikeParams params;
+	params.FrequencyX = 0.2f;
+	params.AmplitudeX = 8.0f;
+	params.AmplitudeZ = 0.0f;
+	octree.bCompressBricks = true;
+	SparseOctreeTesttHelpers::FillTerrainLikeOctree(octree, gSnapshotTestSizeVoxels, params);
+	octree.SetVoxelAt({ 1, gSnapshotTestSizeVoxels / 2, 1 }, 3);
+}
+
+static void ReadWholeVolume(IVoxelDataSource* source, std::vector<i8>& outVoxels)
+{
+	outVoxels.resize(gSnapshotTestVolume);
+	u32 i = 0;
+	for (int z = 0; z < gSnapshotTestSizeVoxels; z++)
+	{
+		for (int y = 0; y < gSnapshotTestSizeVoxels; y++)
+		{
+			for (int x = 0; x < gSnapshotTestSizeVoxels; x++)
+			{
+				outVoxels[i++] = source->GetVoxelAt({ x,y,z });
+			}
+		}
+	}
+}
+
+static void AssertSourceMatches(IVoxelDataSource* source, const std::vector<i8>& expected)
+{
+	VoxelAccessor accessor(source);
+	u32 i = 0;
+	for (int z = 0; z < gSnapshotTestSizeVoxels; z++)
+	{
+		for (int y = 0; y < gSnapshotTestSizeVoxels; y++)
+		{
+			for (int x = 0; x < gSnapshotTestSizeVoxels; x++)
+			{
+				ASSERT_EQ(source->GetVoxelAt({ x,y,z }), expected[i]) << "at " << x << " " << y << " " << z;
+				ASSERT_EQ(accessor.GetVoxelAt({ x,y,z }), expected[i]) << "at " << x << " " << y << " " << z;
+				i++;
+			}
+		}
+	}
+
+	// whole bricks
+	i8 brick[BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE];
+	for (int z = 0; z < gSnapshotTestSizeVoxels; z += BASE_CELL_SIZE)
+	{
+		for (int y = 0; y < gSnapshotTestSizeVoxels; y += BASE_CELL_SIZE)
+		{
+			for (int x = 0; x < gSnapshotTestSizeVoxels; x += BASE_CELL_SIZE)
+			{
+				source->ReadBrick({ x,y,z }, brick);
+				for (int bz = 0; bz < BASE_CELL_SIZE; bz++)
+				{
+					for (int by = 0; by < BASE_CELL_SIZE; by++)
+					{
+						for (int bx = 0; bx < BASE_CELL_SIZE; bx++)
+						{
+							u32 volumeIndex = (x + bx) + gSnapshotTestSizeVoxels * (y + by) + gSnapshotTestSizeVoxels * gSnapshotTestSizeVoxels * (z + bz);
+							ASSERT_EQ(brick[bx + BASE_CELL_SIZE * by + BASE_CELL_SIZE * BASE_CELL_SIZE * bz], expected[volumeIndex]);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+// some single voxel writes and some whole bricks, uniform and not
+static void EditSnapshotTestOctree(SparseTerrainVoxelOctree& octree, std::mt19937& gen)
+{
+	std::uniform_int_distribution<int> posDistr(0, gSnapshotTestSizeVoxels - 1);
+	std::uniform_int_distribution<int> valueDistr(gSnapshotTestClampMin, gSnapshotTestClampMax);
+	std::uniform_int_distribution<int> brickDistr(0, gSnapshotTestSizeVoxels / BASE_CELL_SIZE - 1);
+	for (int i = 0; i < 200; i++)
+	{
+		octree.SetVoxelAt({ posDistr(gen), posDistr(gen), posDistr(gen) }, (i8)valueDistr(gen));
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		glm::ivec3 brickBL = glm::ivec3{ brickDistr(gen), brickDistr(gen), brickDistr(gen) } * (i32)BASE_CELL_SIZE;
+		i8 uniform = (i8)valueDistr(gen);
+		if (i & 1)
+		{
+			octree.FillBrick(brickBL, [uniform](const glm::ivec3&) { return uniform; });
+		}
+		else
+		{
+			octree.FillBrick(brickBL, [&](const glm::ivec3&) { return (i8)valueDistr(gen); });
+		}
+	}
+}
+
+TEST(SparseTerrainVoxelOctreeSnapshot, SeesTheOctreeAsItWasWhenMade)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gSnapshotTestSizeVoxels, gSnapshotTestClampMax, gSnapshotTestClampMin);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	FillSnapshotTestOctree(octree);
+	std::vector<i8> before;
+	ReadWholeVolume(&octree, before);
+
+	{
+		SparseTerrainVoxelOctreeSnapshot snapshot(&octree);
+
+		// act
+		std::mt19937 gen(1);
+		EditSnapshotTestOctree(octree, gen);
+
+		// assert
+		AssertSourceMatches(&snapshot, before);
+		std::vector<i8> after;
+		ReadWholeVolume(&octree, after);
+		ASSERT_NE(after, before);
+		ASSERT_GT(octree.GetNumLeafVersions(), 0u);
+
+		// voxels for the root node, through the gather path
+		std::vector<i8> snapshotVoxels(TOTAL_CELL_VOLUME_SIZE), liveVoxels(TOTAL_CELL_VOLUME_SIZE);
+		snapshot.GetVoxelsForNode(octree.GetParentNode(), snapshotVoxels.data());
+		octree.GetVoxelsForNode(octree.GetParentNode(), liveVoxels.data());
+		ASSERT_NE(snapshotVoxels, liveVoxels);
+	}
+
+	// releasing the only snapshot frees everything kept for it
+	ASSERT_EQ(octree.GetNumLeafVersions(), 0u);
+}
+
+TEST(SparseTerrainVoxelOctreeSnapshot, OverlappingSnapshotsReleasedInEitherOrder)
+{
+	for (int releaseOldestFirst = 0; releaseOldestFirst < 2; releaseOldestFirst++)
+	{
+		// arrange
+		using namespace SparseOctreeTesttHelpers;
+		OctreeAndMockDependencies objects;
+		GetTestObjects(objects, PreConstructionMockConfigurator(), gSnapshotTestSizeVoxels, gSnapshotTestClampMax, gSnapshotTestClampMin);
+		SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+		FillSnapshotTestOctree(octree);
+		std::mt19937 gen(2);
+
+		// act
+		std::vector<i8> firstState, secondState, liveState;
+		ReadWholeVolume(&octree, firstState);
+		auto first = std::make_unique<SparseTerrainVoxelOctreeSnapshot>(&octree);
+		EditSnapshotTestOctree(octree, gen);
+		ReadWholeVolume(&octree, secondState);
+		auto second = std::make_unique<SparseTerrainVoxelOctreeSnapshot>(&octree);
+		EditSnapshotTestOctree(octree, gen);
+		ReadWholeVolume(&octree, liveState);
+
+		// assert
+		AssertSourceMatches(first.get(), firstState);
+		AssertSourceMatches(second.get(), secondState);
+		if (releaseOldestFirst)
+		{
+			first.reset();
+			AssertSourceMatches(second.get(), secondState);
+			EditSnapshotTestOctree(octree, gen);
+			AssertSourceMatches(second.get(), secondState);
+			second.reset();
+		}
+		else
+		{
+			second.reset();
+			AssertSourceMatches(first.get(), firstState);
+			EditSnapshotTestOctree(octree, gen);
+			AssertSourceMatches(first.get(), firstState);
+			first.reset();
+		}
+		ASSERT_EQ(octree.GetNumLeafVersions(), 0u);
+
+		// the octree itself was never affected
+		std::vector<i8> finalState;
+		ReadWholeVolume(&octree, finalState);
+		octree.CollapseUniformSubtrees();
+		std::vector<i8> collapsedState;
+		ReadWholeVolume(&octree, collapsedState);
+		ASSERT_EQ(finalState, collapsedState);
+	}
+}
+
+TEST(SparseTerrainVoxelOctreeSnapshot, ReadersSeeTheSnapshotWhileAWriterEdits)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gSnapshotTestSizeVoxels, gSnapshotTestClampMax, gSnapshotTestClampMin);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	FillSnapshotTestOctree(octree);
+	std::vector<i8> before;
+	ReadWholeVolume(&octree, before);
+
+	for (int round = 0; round < 4; round++)
+	{
+		SparseTerrainVoxelOctreeSnapshot snapshot(&octree);
+		std::atomic<bool> bWriting = { true };
+		std::atomic<u32> mismatches = { 0 };
+
+		// act
+		std::thread writer([&octree, &bWriting, round]()
+		{
+			std::mt19937 gen(round + 10);
+			for (int i = 0; i < 4; i++)
+			{
+				EditSnapshotTestOctree(octree, gen);
+			}
+			bWriting = false;
+		});
+		std::vector<std::thread> readers;
+		for (int r = 0; r < 3; r++)
+		{
+			readers.emplace_back([&snapshot, &before, &bWriting, &mismatches, r]()
+			{
+				std::mt19937 gen(r);
+				std::uniform_int_distribution<int> posDistr(0, gSnapshotTestSizeVoxels - 1);
+				VoxelAccessor accessor(&snapshot);
+				// keep going for a while after the writer's done too
+				for (int i = 0; bWriting || i < 20000; i++)
+				{
+					glm::ivec3 location = { posDistr(gen), posDistr(gen), posDistr(gen) };
+					i8 expected = before[location.x + gSnapshotTestSizeVoxels * location.y + gSnapshotTestSizeVoxels * gSnapshotTestSizeVoxels * location.z];
+					if (snapshot.GetVoxelAt(location) != expected || accessor.GetVoxelAt(location) != expected)
+					{
+						mismatches++;
+					}
+				}
+			});
+		}
+		writer.join();
+		for (std::thread& reader : readers)
+		{
+			reader.join();
+		}
+
+		// assert
+		ASSERT_EQ(mismatches.load(), 0u);
+		AssertSourceMatches(&snapshot, before);
+		// the next round's snapshot starts from here
+		ReadWholeVolume(&octree, before);
+	}
+	ASSERT_EQ(octree.GetNumLeafVersions(), 0u);
+}
+
+TEST(SparseTerrainVoxelOctreeSnapshot, EditsWhileAPinnedBatchIsMeshing)
+{
+	// arrange - polygonize jobs that read their node through the source they're given once the gate opens
+	using namespace SparseOctreeTesttHelpers;
+	using ::testing::_;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gSnapshotTestSizeVoxels, gSnapshotTestClampMax, gSnapshotTestClampMin);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	FillSnapshotTestOctree(octree);
+	octree.bUsePrefilteredMips = true;
+	std::vector<i8> before;
+	ReadWholeVolume(&octree, before);
+	std::promise<void> gate;
+	std::shared_future<void> gateOpen = gate.get_future().share();
+	const std::vector<i8>* expected = &before;
+	std::atomic<u32> numJobs = { 0 };
+	std::atomic<u32> numJobsDone = { 0 };
+	std::atomic<u32> mismatches = { 0 };
+	std::atomic<u32> numUploads = { 0 };
+	IAllocator* allocator = objects.Allocator.get();
+	EXPECT_CALL(*objects.Polygonizer, PolygonizeNodeAsync(_, _)).WillRepeatedly([&](ITerrainOctreeNode* node, IVoxelDataSource* source)
+	{
+		numJobs++;
+		const std::vector<i8>* batchExpected = expected;
+		return std::async(std::launch::async, [&, node, source, batchExpected]()
+		{
+			gateOpen.wait();
+			glm::ivec3 bottomLeft = node->GetBottomLeftCorner();
+			i32 size = (i32)node->GetSizeInVoxels();
+			for (int z = bottomLeft.z; z < bottomLeft.z + size; z++)
+			{
+				for (int y = bottomLeft.y; y < bottomLeft.y + size; y++)
+				{
+					for (int x = bottomLeft.x; x < bottomLeft.x + size; x++)
+					{
+						if (source->GetVoxelAt({ x,y,z }) != (*batchExpected)[x + gSnapshotTestSizeVoxels * y + gSnapshotTestSizeVoxels * gSnapshotTestSizeVoxels * z])
+						{
+							mismatches++;
+						}
+					}
+				}
+			}
+			PolygonizeWorkerThreadData* data = IAllocator::New<PolygonizeWorkerThreadData>(allocator);
+			data->Node = node;
+			data->MyAllocator = allocator;
+			data->VoxelData = IAllocator::NewArray<i8>(allocator, TOTAL_CELL_VOLUME_SIZE);
+			source->GetVoxelsForNode(node, data->VoxelData);
+			allocator->Free(data->VoxelData);
+			numJobsDone++;
+			return data;
+		});
+	});
+	EXPECT_CALL(*objects.GraphicsAPIAdaptor, UploadNewlyPolygonizedToGPU(_)).WillRepeatedly([&](PolygonizeWorkerThreadData*) { numUploads++; });
+	float oldThreshold = TerrainLODSelectionAndCullingAlgorithm::MinimumViewportAreaThreshold;
+	TerrainLODSelectionAndCullingAlgorithm::MinimumViewportAreaThreshold = 1e30f;
+	Camera camera(glm::vec3(gSnapshotTestSizeVoxels / 2, gSnapshotTestSizeVoxels / 2, gSnapshotTestSizeVoxels * 3));
+	float fovY = glm::radians(90.0f);
+	float zFar = gSnapshotTestSizeVoxels * 10.0f;
+	std::vector<ITerrainOctreeNode*> nodes;
+	octree.GetChunksToRender(camera, 1.0f, fovY, 1.0f, zFar, nodes);
+	u32 firstBatch = numJobs.load();
+	ASSERT_GT(firstBatch, 0u);
+	ASSERT_EQ(octree.GetNumMeshingJobs(), firstBatch);
+
+	// act - edit the octree while the batch is held, then draw another frame before letting it finish
+	std::mt19937 gen(3);
+	EditSnapshotTestOctree(octree, gen);
+	std::vector<i8> after;
+	ReadWholeVolume(&octree, after);
+	ASSERT_NE(after, before);
+	nodes.clear();
+	octree.GetChunksToRender(camera, 1.0f, fovY, 1.0f, zFar, nodes);
+	ASSERT_EQ(numJobs.load(), firstBatch);
+	ASSERT_EQ(numUploads.load(), 0u);
+	expected = &after;
+	gate.set_value();
+	while (numJobsDone.load() != firstBatch)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	nodes.clear();
+	octree.GetChunksToRender(camera, 1.0f, fovY, 1.0f, zFar, nodes);
+
+	// assert - the held batch read the octree as it was before the edits, and the nodes edited since are meshed again
+	// from a fresh snapshot once it's finished
+	ASSERT_EQ(numUploads.load(), firstBatch);
+	ASSERT_GT(numJobs.load(), firstBatch);
+	octree.FinishMeshing();
+	ASSERT_EQ(octree.GetNumMeshingJobs(), 0u);
+	ASSERT_EQ(numUploads.load(), numJobs.load());
+	ASSERT_EQ(mismatches.load(), 0u);
+	ASSERT_EQ(octree.GetNumLeafVersions(), 0u);
+	AssertSourceMatches(&octree, after);
+	TerrainLODSelectionAndCullingAlgorithm::MinimumViewportAreaThreshold = oldThreshold;
+}
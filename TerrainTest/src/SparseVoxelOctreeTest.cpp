@@ -3,10 +3,16 @@
 #include "Mocks.h"
 #include "SparseTerrainVoxelOctree.h"
 #include "DefaultAllocator.h"
+#include "OctreeFunctionLibrary.h"
 #include "TerrainDefs.h"
 #include <random>
 #include <iostream>
 #include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <atomic>
 
 const u32 gSizeVoxels = 512;
 const i8 gClampMin = -127;
@@ -207,4 +213,658 @@ TEST(SparseTerrainVoxelOctree, GetVoxelsForRandomNode)
 	{
 		ASSERT_EQ(outVoxels[i], inVoxels[i]) << "i was "<< i;
 	}
-}
\ No newline at end of file
+}
+
+TEST(SparseTerrainVoxelOctree, FillBrickAndRetrieve)
+{
+	// arrange
+	std::random_device rd; std::mt19937 gen(rd());
+	std::mt19937 voxelGen(rd());
+	std::uniform_int_distribution<unsigned int> brickDistr(0, gSizeVoxels / BASE_CELL_SIZE - 1);
+	std::uniform_int_distribution<int> voxlDistr(gClampMin, gClampMax);
+
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gSizeVoxels, gClampMax, gClampMin);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+
+	glm::ivec3 bufferBrickBL = glm::ivec3{ brickDistr(gen), brickDistr(gen), brickDistr(gen) } * BASE_CELL_SIZE;
+	glm::ivec3 generatorBrickBL = bufferBrickBL;
+	while (generatorBrickBL == bufferBrickBL)
+	{
+		generatorBrickBL = glm::ivec3{ brickDistr(gen), brickDistr(gen), brickDistr(gen) } * BASE_CELL_SIZE;
+	}
+
+	i8 inVoxels[BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE];
+	for (i8& voxel : inVoxels)
+	{
+		voxel = voxlDistr(voxelGen);
+	}
+	auto generator = [](const glm::ivec3& location) -> i8 { return (i8)((location.x + location.y * 3 + location.z * 7) % 100); };
+
+	// act
+	octree.FillBrick(bufferBrickBL, inVoxels);
+	octree.FillBrick(generatorBrickBL, generator);
+
+	// assert
+	i32 i = 0;
+	for (int z = 0; z < BASE_CELL_SIZE; z++)
+	{
+		for (int y = 0; y < BASE_CELL_SIZE; y++)
+		{
+			for (int x = 0; x < BASE_CELL_SIZE; x++)
+			{
+				glm::ivec3 offset = { x,y,z };
+				ASSERT_EQ(octree.GetVoxelAt(bufferBrickBL + offset), inVoxels[i++]);
+				ASSERT_EQ(octree.GetVoxelAt(generatorBrickBL + offset), generator(generatorBrickBL + offset));
+			}
+		}
+	}
+}
+
+static void GetVoxelsForNodeMatchesGetVoxelAtTest(ITerrainOctreeNode* node, SparseTerrainVoxelOctree& octree)
+{
+	i8 outVoxels[TOTAL_CELL_VOLUME_SIZE];
+	octree.GetVoxelsForNode(node, outVoxels);
+
+	i32 stepSize = node->GetSizeInVoxels() / BASE_CELL_SIZE;
+	glm::ivec3 initial = node->GetBottomLeftCorner() - glm::ivec3(POLYGONIZER_NEGATIVE_GUTTER * stepSize);
+	i32 i = 0;
+	for (int z = 0; z < TOTAL_CELL_SIZE; z++)
+	{
+		for (int y = 0; y < TOTAL_CELL_SIZE; y++)
+		{
+			for (int x = 0; x < TOTAL_CELL_SIZE; x++)
+			{
+				glm::ivec3 location = initial + glm::ivec3{ x,y,z } * stepSize;
+				ASSERT_EQ(outVoxels[i], octree.GetVoxelAt(location)) << "i was " << i << " step size was " << stepSize;
+				i++;
+			}
+		}
+	}
+}
+
+TEST(SparseTerrainVoxelOctree, GetVoxelsForNodeAtEveryMipLevel)
+{
+	// arrange
+	std::random_device rd; std::mt19937 gen(rd());
+	std::mt19937 voxelGen(rd());
+	std::uniform_int_distribution<unsigned int> posDistr(0, gSizeVoxels - 1);
+	std::uniform_int_distribution<int> voxlDistr(gClampMin, gClampMax);
+
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gSizeVoxels, gClampMax, gClampMin);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+
+	// sparse random writes so that some branches are missing, plus the corners so the gutters
+	// of nodes on the edges of the octree are exercised
+	for (int i = 0; i < 10000; i++)
+	{
+		octree.SetVoxelAt({ posDistr(gen), posDistr(gen), posDistr(gen) }, voxlDistr(voxelGen));
+	}
+	octree.SetVoxelAt({ 0,0,0 }, gClampMin);
+	octree.SetVoxelAt({ gSizeVoxels - 1, gSizeVoxels - 1, gSizeVoxels - 1 }, gClampMin);
+
+	// act and assert - walk down through the first and last child at each level
+	for (u8 childIndex : { (u8)0, (u8)7 })
+	{
+		ITerrainOctreeNode* node = octree.GetParentNode();
+		while (node)
+		{
+			GetVoxelsForNodeMatchesGetVoxelAtTest(node, octree);
+			node = node->GetChild(childIndex);
+		}
+	}
+}
+
+TEST(SparseTerrainVoxelOctree, ClearThenStoreAndRetrieve)
+{
+	// arrange
+	std::random_device rd; std::mt19937 gen(rd());
+	std::mt19937 voxelGen(rd());
+	std::uniform_int_distribution<unsigned int> posDistr(0, gSizeVoxels - 1);
+	std::uniform_int_distribution<int> voxlDistr(gClampMin, gClampMax - 1);
+
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gSizeVoxels, gClampMax, gClampMin);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+
+	std::vector<glm::ivec3> positions(1000);
+	for (glm::ivec3& position : positions)
+	{
+		position = { posDistr(gen), posDistr(gen), posDistr(gen) };
+		octree.SetVoxelAt(position, voxlDistr(voxelGen));
+	}
+
+	// act
+	octree.Clear();
+
+	// assert - everything written before the clear is gone and the octree can be written to again
+	for (const glm::ivec3& position : positions)
+	{
+		ASSERT_EQ(octree.GetVoxelAt(position), gClampMax);
+	}
+	for (const glm::ivec3& position : positions)
+	{
+		i8 value = voxlDistr(voxelGen);
+		octree.SetVoxelAt(position, value);
+		ASSERT_EQ(octree.GetVoxelAt(position), value);
+	}
+}
+
+
+TEST(SparseTerrainVoxelOctree, UniformBrickHasNoVoxelData)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gSizeVoxels, gClampMax, gClampMin);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	glm::ivec3 brickBL = { BASE_CELL_SIZE * 3, BASE_CELL_SIZE * 5, BASE_CELL_SIZE * 2 };
+	i8 solid = gClampMin;
+
+	// act
+	TerrainOctreeIndex index = octree.FillBrick(brickBL, [solid](const glm::ivec3&) { return solid; });
+
+	// assert
+	ITerrainOctreeNode* leaf = octree.FindNodeFromIndex(index, false);
+	ASSERT_NE(leaf, nullptr);
+	ASSERT_EQ(leaf->GetVoxelData(), nullptr);
+	ASSERT_EQ(octree.GetVoxelAt(brickBL), solid);
+	ASSERT_EQ(octree.GetVoxelAt(brickBL + glm::ivec3(BASE_CELL_SIZE - 1)), solid);
+
+	// a differing write gives the leaf a brick again, filled with the old value
+	octree.SetVoxelAt(brickBL + glm::ivec3(1, 2, 3), 0);
+	ASSERT_NE(leaf->GetVoxelData(), nullptr);
+	ASSERT_EQ(octree.GetVoxelAt(brickBL + glm::ivec3(1, 2, 3)), 0);
+	ASSERT_EQ(octree.GetVoxelAt(brickBL), solid);
+}
+
+TEST(SparseTerrainVoxelOctree, CollapseUniformSubtrees)
+{
+	// arrange - the bottom half of the octree is solid and the top half is air except for a few random writes
+	std::random_device rd; std::mt19937 gen(rd());
+	std::uniform_int_distribution<unsigned int> posDistr(gSizeVoxels / 2, gSizeVoxels - 1);
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gSizeVoxels, gClampMax, gClampMin);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	for (int z = 0; z < gSizeVoxels; z += BASE_CELL_SIZE)
+	{
+		for (int y = 0; y < gSizeVoxels; y += BASE_CELL_SIZE)
+		{
+			for (int x = 0; x < gSizeVoxels; x += BASE_CELL_SIZE)
+			{
+				octree.FillBrick({ x,y,z }, [](const glm::ivec3& location) { return location.y < gSizeVoxels / 2 ? gClampMin : gClampMax; });
+			}
+		}
+	}
+	std::vector<glm::ivec3> positions(100);
+	for (glm::ivec3& position : positions)
+	{
+		position = { posDistr(gen), posDistr(gen), posDistr(gen) };
+		octree.SetVoxelAt(position, 0);
+	}
+
+	// act
+	octree.CollapseUniformSubtrees();
+
+	// assert - the bottom children of the root are now single values
+	ITerrainOctreeNode* root = octree.GetParentNode();
+	for (u8 i : { 0, 1, 4, 5 })
+	{
+		ITerrainOctreeNode* child = root->GetChild(i);
+		ASSERT_NE(child, nullptr);
+		for (u8 j = 0; j < 8; j++)
+		{
+			ASSERT_EQ(child->GetChild(j), nullptr);
+		}
+	}
+	for (const glm::ivec3& position : positions)
+	{
+		ASSERT_EQ(octree.GetVoxelAt(position), 0);
+	}
+	ASSERT_EQ(octree.GetVoxelAt({ 10, 20, 30 }), gClampMin);
+	ASSERT_EQ(octree.GetVoxelAt({ 10, gSizeVoxels / 2, 30 }), gClampMax);
+	for (u8 childIndex : { (u8)0, (u8)2, (u8)7 })
+	{
+		ITerrainOctreeNode* node = octree.GetParentNode();
+		while (node)
+		{
+			GetVoxelsForNodeMatchesGetVoxelAtTest(node, octree);
+			node = node->GetChild(childIndex);
+		}
+	}
+
+	// writing into a collapsed subtree expands it again
+	octree.SetVoxelAt({ 10, 20, 30 }, 5);
+	ASSERT_EQ(octree.GetVoxelAt({ 10, 20, 30 }), 5);
+	ASSERT_EQ(octree.GetVoxelAt({ 11, 20, 30 }), gClampMin);
+	ASSERT_NE(root->GetChild(0)->GetChild(0), nullptr);
+}
+
+
+static void GatherEveryLeaf(SparseTerrainVoxelOctree& octree, std::vector<i8>& outVoxels)
+{
+	std::vector<ITerrainOctreeNode*> stack = { octree.GetParentNode() };
+	i8 voxels[TOTAL_CELL_VOLUME_SIZE];
+	while (!stack.empty())
+	{
+		ITerrainOctreeNode* node = stack.back();
+		stack.pop_back();
+		octree.GetVoxelsForNode(node, voxels);
+		outVoxels.insert(outVoxels.end(), voxels, voxels + TOTAL_CELL_VOLUME_SIZE);
+		for (u8 i = 0; i < 8; i++)
+		{
+			if (ITerrainOctreeNode* child = node->GetChild(i))
+			{
+				stack.push_back(child);
+			}
+		}
+	}
+}
+
+static void CompressedBricksMatchRawTest(float densityGradient)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies rawObjects;
+	GetTestObjects(rawObjects, PreConstructionMockConfigurator(), gSizeVoxels, gClampMax, gClampMin);
+	SparseTerrainVoxelOctree& rawOctree = *rawObjects.Octree.get();
+	OctreeAndMockDependencies compressedObjects;
+	GetTestObjects(compressedObjects, PreConstructionMockConfigurator(), gSizeVoxels, gClampMax, gClampMin);
+	SparseTerrainVoxelOctree& compressedOctree = *compressedObjects.Octree.get();
+	compressedOctree.bCompressBricks = true;
+
+	TerrainLikeParams params;
+	params.DensityGradient = densityGradient;
+	FillTerrainLikeOctree(rawOctree, gSizeVoxels, params);
+	FillTerrainLikeOctree(compressedOctree, gSizeVoxels, params);
+
+	// act
+	std::vector<i8> rawVoxels, compressedVoxels;
+	GatherEveryLeaf(rawOctree, rawVoxels);
+	GatherEveryLeaf(compressedOctree, compressedVoxels);
+
+	// assert
+	ASSERT_LE(compressedOctree.GetResidentVoxelDataBytes(), rawOctree.GetResidentVoxelDataBytes());
+	ASSERT_EQ(rawVoxels.size(), compressedVoxels.size());
+	for (size_t i = 0; i < rawVoxels.size(); i++)
+	{
+		ASSERT_EQ(rawVoxels[i], compressedVoxels[i]) << "i was " << i;
+	}
+
+	// writing to a compressed brick decompresses it, and the next pass compresses it again
+	glm::ivec3 surface = { 100, gSizeVoxels / 2, 100 };
+	i8 before = compressedOctree.GetVoxelAt(surface + glm::ivec3(1, 0, 0));
+	compressedOctree.SetVoxelAt(surface, 3);
+	ASSERT_EQ(compressedOctree.GetVoxelAt(surface), 3);
+	ASSERT_EQ(compressedOctree.GetVoxelAt(surface + glm::ivec3(1, 0, 0)), before);
+	compressedOctree.CompressBricks();
+	ASSERT_EQ(compressedOctree.GetVoxelAt(surface), 3);
+	ASSERT_EQ(compressedOctree.GetVoxelAt(surface + glm::ivec3(1, 0, 0)), before);
+}
+
+TEST(SparseTerrainVoxelOctree, CompressedBricksMatchRaw)
+{
+	CompressedBricksMatchRawTest(10.0f);
+}
+
+TEST(SparseTerrainVoxelOctree, CompressedBricksMatchRawThinSurface)
+{
+	CompressedBricksMatchRawTest(100.0f);
+}
+
+static i8 StressTestValue(const glm::ivec3& location)
+{
+	return (i8)((location.x * 7 + location.y * 13 + location.z * 31) % 255 - 127);
+}
+
+// what a node at mipLevel holds for location, built up level by level the same way as UpdateMips
+static i8 BoxFilteredVoxelAt(SparseTerrainVoxelOctree& octree, const glm::ivec3& location, u32 mipLevel)
+{
+	if (mipLevel == 0)
+	{
+		return octree.GetVoxelAt(location);
+	}
+	i32 childStep = 1 << (mipLevel - 1);
+	i32 sum = 0;
+	for (i32 i = 0; i < 8; i++)
+	{
+		sum += BoxFilteredVoxelAt(octree, location + glm::ivec3{ i & 1, (i >> 1) & 1, (i >> 2) & 1 } * childStep, mipLevel - 1);
+	}
+	return (i8)((sum + 4) >> 3);
+}
+
+static void GetVoxelsForNodeMatchesBoxFilterTest(ITerrainOctreeNode* node, SparseTerrainVoxelOctree& octree)
+{
+	i8 outVoxels[TOTAL_CELL_VOLUME_SIZE];
+	octree.GetVoxelsForNode(node, outVoxels);
+
+	i32 stepSize = node->GetSizeInVoxels() / BASE_CELL_SIZE;
+	glm::ivec3 initial = node->GetBottomLeftCorner() - glm::ivec3(POLYGONIZER_NEGATIVE_GUTTER * stepSize);
+	i32 i = 0;
+	for (int z = 0; z < TOTAL_CELL_SIZE; z++)
+	{
+		for (int y = 0; y < TOTAL_CELL_SIZE; y++)
+		{
+			for (int x = 0; x < TOTAL_CELL_SIZE; x++)
+			{
+				glm::ivec3 location = glm::max(initial + glm::ivec3{ x,y,z } * stepSize, glm::ivec3(0));
+				bool bOutside = location.x >= (i32)gSizeVoxels || location.y >= (i32)gSizeVoxels || location.z >= (i32)gSizeVoxels;
+				i8 expected = bOutside ? octree.GetVoxelAt(location) : BoxFilteredVoxelAt(octree, location, node->GetMipLevel());
+				ASSERT_EQ(outVoxels[i], expected) << "i was " << i << " step size was " << stepSize;
+				i++;
+			}
+		}
+	}
+}
+
+// nodes from just above the leaves up to mip level 3 containing point
+static std::vector<ITerrainOctreeNode*> GetLowMipNodesContainingPoint(SparseTerrainVoxelOctree& octree, const glm::ivec3& point)
+{
+	std::vector<ITerrainOctreeNode*> nodes;
+	ITerrainOctreeNode* node = octree.GetParentNode();
+	while (node && node->GetMipLevel() > 0)
+	{
+		if (node->GetMipLevel() <= 3)
+		{
+			nodes.push_back(node);
+		}
+		node = node->GetChild(OctreeFunctionLibrary::GetChildIndexContainingPoint(point, node->GetBottomLeftCorner(), node->GetSizeInVoxels()));
+	}
+	return nodes;
+}
+
+TEST(SparseTerrainVoxelOctree, PrefilteredMipsMatchBoxFilter)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gSizeVoxels, gClampMax, gClampMin);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	octree.bCompressBricks = true;
+	FillTerrainLikeOctree(octree, gSizeVoxels, TerrainLikeParams());
+	octree.CollapseUniformSubtrees();
+	octree.bUsePrefilteredMips = true;
+
+	// act
+	octree.UpdateMips();
+
+	// assert - on the surface, and in the corner at the origin where the gutter is clamped
+	glm::ivec3 surface = { 100, gSizeVoxels / 2, 100 };
+	for (const glm::ivec3& point : { surface, glm::ivec3(0, gSizeVoxels / 2, 0) })
+	{
+		for (ITerrainOctreeNode* node : GetLowMipNodesContainingPoint(octree, point))
+		{
+			GetVoxelsForNodeMatchesBoxFilterTest(node, octree);
+		}
+	}
+
+	// edits only rebuild the mips above them, and show up once they're rebuilt
+	for (int i = 0; i < 16; i++)
+	{
+		octree.SetVoxelAt(surface + glm::ivec3(i, 0, i / 2), gClampMin);
+	}
+	octree.UpdateMips();
+	for (ITerrainOctreeNode* node : GetLowMipNodesContainingPoint(octree, surface))
+	{
+		GetVoxelsForNodeMatchesBoxFilterTest(node, octree);
+	}
+
+}
+
+// everything the polygonizer can read for a node - its lattice, gutters included, and the points
+// along the edges between neighbouring lattice points that surface shifting samples
+static std::vector<i8> ReadEverythingPolygonizerReads(ITerrainOctreeNode* node, SparseTerrainVoxelOctree& octree)
+{
+	std::vector<i8> read;
+	i32 stepSize = node->GetSizeInVoxels() / BASE_CELL_SIZE;
+	glm::ivec3 initial = node->GetBottomLeftCorner() - glm::ivec3(POLYGONIZER_NEGATIVE_GUTTER * stepSize);
+	for (int z = 0; z < TOTAL_CELL_SIZE; z++)
+	{
+		for (int y = 0; y < TOTAL_CELL_SIZE; y++)
+		{
+			for (int x = 0; x < TOTAL_CELL_SIZE; x++)
+			{
+				glm::ivec3 latticePoint = initial + glm::ivec3{ x,y,z } * stepSize;
+				read.push_back(octree.GetVoxelAt(latticePoint));
+				glm::ivec3 latticeIndex = { x, y, z };
+				for (int axis = 0; axis < 3; axis++)
+				{
+					if (latticeIndex[axis] == TOTAL_CELL_SIZE - 1)
+					{
+						continue;
+					}
+					for (int i = 1; i < stepSize; i++)
+					{
+						glm::ivec3 edgePoint = latticePoint;
+						edgePoint[axis] += i;
+						read.push_back(octree.GetVoxelAt(edgePoint));
+					}
+				}
+			}
+		}
+	}
+	return read;
+}
+
+static void GatherEveryNode(ITerrainOctreeNode* node, std::vector<ITerrainOctreeNode*>& outNodes)
+{
+	outNodes.push_back(node);
+	for (u8 i = 0; i < 8; i++)
+	{
+		if (ITerrainOctreeNode* child = node->GetChild(i))
+		{
+			GatherEveryNode(child, outNodes);
+		}
+	}
+}
+
+TEST(SparseTerrainVoxelOctree, EditsOnlyDirtyNodesThatReadThem)
+{
+	// arrange - a small octree with every leaf holding noise, all of it meshed
+	const u32 size = 64;
+	std::mt19937 gen(3);
+	std::uniform_int_distribution<int> voxlDistr(gClampMin, gClampMax);
+	std::uniform_int_distribution<int> posDistr(0, size - 1);
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), size, gClampMax, gClampMin);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	for (int z = 0; z < size; z += BASE_CELL_SIZE)
+	{
+		for (int y = 0; y < size; y += BASE_CELL_SIZE)
+		{
+			for (int x = 0; x < size; x += BASE_CELL_SIZE)
+			{
+				octree.FillBrick({ x,y,z }, [&](const glm::ivec3&) { return (i8)voxlDistr(gen); });
+			}
+		}
+	}
+	std::vector<ITerrainOctreeNode*> nodes;
+	GatherEveryNode(octree.GetParentNode(), nodes);
+	std::vector<std::vector<i8>> reads;
+	for (ITerrainOctreeNode* node : nodes)
+	{
+		reads.push_back(ReadEverythingPolygonizerReads(node, octree));
+	}
+
+	// the corners, points on the lattices of every level and on borders between nodes, and some random ones
+	std::vector<glm::ivec3> edits = { {0,0,0}, {size - 1, size - 1, size - 1}, {16,16,5}, {31,32,47}, {32,32,32}, {15,17,33}, {48,1,16} };
+	for (int i = 0; i < 20; i++)
+	{
+		edits.push_back({ posDistr(gen), posDistr(gen), posDistr(gen) });
+	}
+	u32 totalDirtied = 0;
+	for (const glm::ivec3& edit : edits)
+	{
+		for (ITerrainOctreeNode* node : nodes)
+		{
+			SparseTerrainVoxelOctree::SparseTerrainOctreeNode* cast = static_cast<SparseTerrainVoxelOctree::SparseTerrainOctreeNode*>(node);
+			cast->MeshedGeneration = cast->EditGeneration;
+		}
+
+		// act
+		i8 current = octree.GetVoxelAt(edit);
+		octree.SetVoxelAt(edit, current == 0 ? 1 : 0);
+
+		// assert - exactly the nodes whose input changed need remeshing
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			std::vector<i8> read = ReadEverythingPolygonizerReads(nodes[i], octree);
+			bool bInputChanged = read != reads[i];
+			ASSERT_EQ(nodes[i]->NeedsRegenerating(), bInputChanged) << "editing " << edit.x << " " << edit.y << " " << edit.z
+				<< ", node at " << nodes[i]->GetBottomLeftCorner().x << " " << nodes[i]->GetBottomLeftCorner().y << " " << nodes[i]->GetBottomLeftCorner().z
+				<< " mip " << nodes[i]->GetMipLevel();
+			totalDirtied += bInputChanged ? 1 : 0;
+			reads[i] = std::move(read);
+		}
+	}
+	std::cerr << totalDirtied << " nodes remeshed for " << edits.size() << " edits, out of " << nodes.size() << " nodes\n";
+
+	// writing what's already there dirties nothing
+	for (ITerrainOctreeNode* node : nodes)
+	{
+		SparseTerrainVoxelOctree::SparseTerrainOctreeNode* cast = static_cast<SparseTerrainVoxelOctree::SparseTerrainOctreeNode*>(node);
+		cast->MeshedGeneration = cast->EditGeneration;
+	}
+	octree.SetVoxelAt(edits[0], octree.GetVoxelAt(edits[0]));
+	for (ITerrainOctreeNode* node : nodes)
+	{
+		ASSERT_FALSE(node->NeedsRegenerating());
+	}
+}
+
+TEST(SparseTerrainVoxelOctree, ConcurrentSetVoxelAt)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gSizeVoxels, gClampMax, gClampMin);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	u32 numThreads = std::max(4u, std::thread::hardware_concurrency());
+	const i32 regionSize = 64;
+	const glm::ivec3 regionBL = { 200, 100, 300 };
+
+	// act - the threads interleave voxel by voxel so they're all creating the same nodes and writing the same bricks
+	std::vector<std::thread> threads;
+	for (u32 t = 0; t < numThreads; t++)
+	{
+		threads.emplace_back([&octree, t, numThreads, regionSize, regionBL]()
+		{
+			for (i32 z = 0; z < regionSize; z++)
+			{
+				for (i32 y = 0; y < regionSize; y++)
+				{
+					for (i32 x = 0; x < regionSize; x++)
+					{
+						if ((u32)(x + y + z) % numThreads == t)
+						{
+							glm::ivec3 location = regionBL + glm::ivec3(x, y, z);
+							octree.SetVoxelAt(location, StressTestValue(location));
+						}
+					}
+				}
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	// assert
+	for (i32 z = 0; z < regionSize; z++)
+	{
+		for (i32 y = 0; y < regionSize; y++)
+		{
+			for (i32 x = 0; x < regionSize; x++)
+			{
+				glm::ivec3 location = regionBL + glm::ivec3(x, y, z);
+				ASSERT_EQ(octree.GetVoxelAt(location), StressTestValue(location)) << "at " << location.x << " " << location.y << " " << location.z;
+			}
+		}
+	}
+	ASSERT_TRUE(octree.GetParentNode()->NeedsRegenerating());
+}
+
+static void WriteWithThreads(SparseTerrainVoxelOctree& octree, u32 numThreads, const std::function<void(u32)>& work, u32 numWorkItems)
+{
+	std::atomic<u32> nextWorkItem = 0;
+	std::vector<std::thread> threads;
+	for (u32 t = 0; t < numThreads; t++)
+	{
+		threads.emplace_back([&]()
+		{
+			for (u32 i = nextWorkItem++; i < numWorkItems; i = nextWorkItem++)
+			{
+				work(i);
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+TEST(SparseTerrainVoxelOctree, ConcurrentFillBrickAndSetVoxelAt)
+{
+	// arrange - a region through the surface, small enough that every write can be checked
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gSizeVoxels, gClampMax, gClampMin);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	const u32 numThreads = 4;
+	const u32 regionSizeVoxels = 128;
+	const glm::ivec3 regionBL = { 0, gSizeVoxels / 2 - regionSizeVoxels / 2, 0 };
+	const u32 bricksPerAxis = regionSizeVoxels / BASE_CELL_SIZE;
+	const u32 numBricks = bricksPerAxis * bricksPerAxis * bricksPerAxis;
+	const u32 numEdits = 1 << 14;
+	auto brickBottomLeft = [bricksPerAxis, regionBL](u32 brick) -> glm::ivec3
+	{
+		return regionBL + glm::ivec3(brick % bricksPerAxis, (brick / bricksPerAxis) % bricksPerAxis, brick / (bricksPerAxis * bricksPerAxis)) * BASE_CELL_SIZE;
+	};
+	// distinct voxels spread through the region with a cheap hash, so no two edits race for the same voxel
+	auto editLocation = [regionSizeVoxels, regionBL](u32 edit) -> glm::ivec3
+	{
+		u32 voxel = (edit * 2654435761u) & (regionSizeVoxels * regionSizeVoxels * regionSizeVoxels - 1);
+		return regionBL + glm::ivec3(voxel % regionSizeVoxels, (voxel / regionSizeVoxels) % regionSizeVoxels, voxel / (regionSizeVoxels * regionSizeVoxels));
+	};
+	std::unordered_set<u32> edited;
+	for (u32 edit = 0; edit < numEdits; edit++)
+	{
+		glm::ivec3 location = editLocation(edit) - regionBL;
+		edited.insert(location.x + regionSizeVoxels * (location.y + regionSizeVoxels * location.z));
+	}
+	ASSERT_EQ(edited.size(), numEdits);
+
+	// act - bricks then single voxels, both spread over the threads
+	WriteWithThreads(octree, numThreads, [&](u32 brick)
+	{
+		octree.FillBrick(brickBottomLeft(brick), [](const glm::ivec3& location) { return TerrainLikeDensity(location, gSizeVoxels, TerrainLikeParams()); });
+	}, numBricks);
+	WriteWithThreads(octree, numThreads, [&](u32 edit)
+	{
+		glm::ivec3 location = editLocation(edit);
+		octree.SetVoxelAt(location, StressTestValue(location));
+	}, numEdits);
+
+	// assert - every voxel of the region is either its brick's fill or its edit
+	for (u32 z = 0; z < regionSizeVoxels; z++)
+	{
+		for (u32 y = 0; y < regionSizeVoxels; y++)
+		{
+			for (u32 x = 0; x < regionSizeVoxels; x++)
+			{
+				glm::ivec3 location = regionBL + glm::ivec3(x, y, z);
+				bool bEdited = edited.count(x + regionSizeVoxels * (y + regionSizeVoxels * z)) != 0;
+				i8 expected = bEdited ? StressTestValue(location) : TerrainLikeDensity(location, gSizeVoxels, TerrainLikeParams());
+				ASSERT_EQ(octree.GetVoxelAt(location), expected) << "at " << x << " " << y << " " << z;
+			}
+		}
+	}
+}
@@ -2,7 +2,11 @@
 #include "SparseTerrainVoxelOctree.h"
 #include "DefaultAllocator.h"
 #include "Mocks.h"
+#include "TerrainDefs.h"
 #include <tuple>
+#include <random>
+#include <algorithm>
+#include <cmath>
 
 namespace SparseOctreeTesttHelpers
 {
@@ -28,4 +32,56 @@ namespace SparseOctreeTesttHelpers
 			clampValueHigh,
 			clampValueLow);
 	}
+
+	i8 TerrainLikeDensity(const glm::ivec3& location, u32 sizeVoxels, const TerrainLikeParams& params)
+	{
+		float height = sizeVoxels / 2 + sinf(location.x * params.FrequencyX) * params.AmplitudeX + cosf(location.z * params.FrequencyZ) * params.AmplitudeZ;
+		return (i8)std::clamp((location.y - height) * params.DensityGradient, (float)params.ClampMin, (float)params.ClampMax);
+	}
+
+	void FillTerrainLikeOctree(SparseTerrainVoxelOctree& octree, u32 sizeVoxels, const TerrainLikeParams& params,
+		std::vector<glm::ivec3>* outBricks, std::unordered_set<TerrainOctreeIndex>* outLeaves)
+	{
+		auto generator = [sizeVoxels, &params](const glm::ivec3& location) -> i8
+		{
+			return TerrainLikeDensity(location, sizeVoxels, params);
+		};
+		for (int z = 0; z < (int)sizeVoxels; z += BASE_CELL_SIZE)
+		{
+			for (int y = 0; y < (int)sizeVoxels; y += BASE_CELL_SIZE)
+			{
+				for (int x = 0; x < (int)sizeVoxels; x += BASE_CELL_SIZE)
+				{
+					TerrainOctreeIndex leaf = octree.FillBrick({ x,y,z }, generator);
+					if (outBricks)
+					{
+						outBricks->push_back({ x,y,z });
+					}
+					if (outLeaves)
+					{
+						outLeaves->insert(leaf);
+					}
+				}
+			}
+		}
+	}
+
+	void MakeSparseLeaves(SparseTerrainVoxelOctree& octree, u32 sizeVoxels, float fraction, u32 seed)
+	{
+		std::mt19937 gen(seed);
+		std::uniform_real_distribution<float> chanceDistr(0.0f, 1.0f);
+		for (int z = 0; z < (int)sizeVoxels; z += BASE_CELL_SIZE)
+		{
+			for (int y = 0; y < (int)sizeVoxels; y += BASE_CELL_SIZE)
+			{
+				for (int x = 0; x < (int)sizeVoxels; x += BASE_CELL_SIZE)
+				{
+					if (chanceDistr(gen) < fraction)
+					{
+						octree.SetVoxelAt({ x,y,z }, 1);
+					}
+				}
+			}
+		}
+	}
 }
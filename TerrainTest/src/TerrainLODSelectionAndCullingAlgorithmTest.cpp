@@ -0,0 +1,70 @@
+#include "pch.h"
+#include "SparseVoxelOctreeTestHelpers.h"
+#include "Mocks.h"
+#include "SparseTerrainVoxelOctree.h"
+#include "FlatTerrainOctree.h"
+#include "TerrainLODSelectionAndCullingAlgorithm.h"
+#include "Frustum.h"
+#include "TerrainDefs.h"
+#include <vector>
+
+typedef SparseTerrainVoxelOctree::SparseTerrainOctreeNode LODTestNode;
+
+// every other node is meshed, so half of them need regenerating
+static void MarkHalfMeshed(LODTestNode* node, u32& counter)
+{
+	node->MeshedGeneration = (counter++ & 1) ? node->EditGeneration.load() : 0;
+	for (u8 i = 0; i < 8; i++)
+	{
+		if (LODTestNode* child = node->Children[i].load())
+		{
+			MarkHalfMeshed(child, counter);
+		}
+	}
+}
+
+TEST(TerrainLODSelectionAndCullingAlgorithm, TemplatedTraversalsMatchInterfaceTraversal)
+{
+	// arrange
+	const u32 size = 256;
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), size);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	MakeSparseLeaves(octree, size, 0.3f, 4);
+	LODTestNode* root = static_cast<LODTestNode*>(octree.GetParentNode());
+	u32 counter = 0;
+	MarkHalfMeshed(root, counter);
+	const FlatTerrainOctree& flat = octree.GetFlatOctree();
+	Frustum frustum{};
+	glm::mat4 viewProjection(1.0f);
+	float oldThreshold = TerrainLODSelectionAndCullingAlgorithm::MinimumViewportAreaThreshold;
+
+	for (float threshold : { 1.0f, 64.0f * 64.0f + 1.0f })
+	{
+		TerrainLODSelectionAndCullingAlgorithm::MinimumViewportAreaThreshold = threshold;
+
+		// act
+		std::vector<ITerrainOctreeNode*> interfaceNodes, interfaceRegenerate;
+		TerrainLODSelectionAndCullingAlgorithm::GetChunksToRender(frustum, interfaceNodes, root, viewProjection,
+			[&interfaceRegenerate](ITerrainOctreeNode* node) { interfaceRegenerate.push_back(node); });
+
+		std::vector<ITerrainOctreeNode*> concreteNodes, concreteRegenerate;
+		auto concreteCallback = [&concreteRegenerate](ITerrainOctreeNode* node) { concreteRegenerate.push_back(node); };
+		TerrainLODSelectionAndCullingAlgorithm::GetChunksToRender(TerrainLODNodeTraits<LODTestNode>(), frustum, concreteNodes, root, viewProjection, concreteCallback);
+
+		std::vector<ITerrainOctreeNode*> flatNodes, flatRegenerate;
+		auto flatCallback = [&flatRegenerate](ITerrainOctreeNode* node) { flatRegenerate.push_back(node); };
+		TerrainLODSelectionAndCullingAlgorithm::GetChunksToRender(FlatTerrainOctreeLODTraits(flat), frustum, flatNodes, flat.GetRoot(), viewProjection, flatCallback);
+
+		// assert
+		ASSERT_FALSE(interfaceNodes.empty());
+		ASSERT_FALSE(interfaceRegenerate.empty());
+		ASSERT_LT(interfaceRegenerate.size(), interfaceNodes.size());
+		ASSERT_EQ(concreteNodes, interfaceNodes);
+		ASSERT_EQ(concreteRegenerate, interfaceRegenerate);
+		ASSERT_EQ(flatNodes, interfaceNodes);
+		ASSERT_EQ(flatRegenerate, interfaceRegenerate);
+	}
+	TerrainLODSelectionAndCullingAlgorithm::MinimumViewportAreaThreshold = oldThreshold;
+}
@@ -0,0 +1,154 @@
+#include "pch.h"
+#include "SparseVoxelOctreeTestHelpers.h"
+#include "Mocks.h"
+#include "SparseTerrainVoxelOctree.h"
+#include "TerrainOctreeStatistics.h"
+#include "ThreadPool.h"
+#include "TerrainDefs.h"
+#include <random>
+#include <iostream>
+#include <vector>
+
+static const u32 gStatisticsTestSizeVoxels = 128;
+
+// raw, compressed and uniform leaves and some collapsed subtrees
+static void FillStatisticsTestOctree(SparseTerrainVoxelOctree& octree)
+{
+	SparseOctreeTesttHelpers::TerrainLikeParams params;
+	params.FrequencyX = 0.1f;
+	params.AmplitudeX = 10.0f;
+	params.AmplitudeZ = 0.0f;
+	params.DensityGradient = 4.0f;
+	params.ClampMin = -50;
+	params.ClampMax = 50;
+	octree.bCompressBricks = true;
+	SparseOctreeTesttHelpers::FillTerrainLikeOctree(octree, gStatisticsTestSizeVoxels, params);
+	octree.CollapseUniformSubtrees();
+	std::mt19937 gen(1);
+	std::uniform_int_distribution<int> posDistr(0, gStatisticsTestSizeVoxels - 1);
+	for (int i = 0; i < 30; i++)
+	{
+		octree.SetVoxelAt({ posDistr(gen), gStatisticsTestSizeVoxels / 2, posDistr(gen) }, (i8)(i - 15));
+	}
+}
+
+static void CountNodes(ITerrainOctreeNode* node, std::vector<u64>& outPerMipLevel)
+{
+	outPerMipLevel[node->GetMipLevel()]++;
+	for (u8 i = 0; i < 8 && node->GetMipLevel() != 0; i++)
+	{
+		if (ITerrainOctreeNode* child = node->GetChild(i))
+		{
+			CountNodes(child, outPerMipLevel);
+		}
+	}
+}
+
+TEST(TerrainOctreeStatistics, MatchesCountingByHand)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gStatisticsTestSizeVoxels);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	FillStatisticsTestOctree(octree);
+
+	// act
+	TerrainOctreeStatistics stats;
+	octree.GetStatistics(stats);
+
+	// assert - nodes
+	std::vector<u64> perMipLevel(stats.NumMipLevels, 0);
+	CountNodes(octree.GetParentNode(), perMipLevel);
+	for (u32 i = 0; i < stats.NumMipLevels; i++)
+	{
+		ASSERT_EQ(stats.NodesPerMipLevel[i], perMipLevel[i]) << "mip " << i;
+	}
+	ASSERT_EQ(stats.NumUniformLeaves + stats.NumRawBricks + stats.NumCompressedBricks, perMipLevel[0]);
+	ASSERT_GT(stats.NumUniformLeaves, 0u);
+	ASSERT_GT(stats.NumRawBricks, 0u);
+	ASSERT_GT(stats.NumCompressedBricks, 0u);
+	ASSERT_GT(stats.NumCollapsedNodes, 0u);
+	ASSERT_EQ(stats.RawBrickBytes, stats.NumRawBricks * BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE);
+	ASSERT_GE(stats.BrickPoolBytes, stats.RawBrickBytes);
+	ASSERT_GE(stats.CompressedBrickPoolBytes, stats.CompressedBrickBytes);
+	ASSERT_EQ(stats.NumMeshes, 0u);
+
+	// the histogram covers every voxel in the volume
+	std::vector<u64> valueCounts(256, 0);
+	for (int z = 0; z < gStatisticsTestSizeVoxels; z++)
+	{
+		for (int y = 0; y < gStatisticsTestSizeVoxels; y++)
+		{
+			for (int x = 0; x < gStatisticsTestSizeVoxels; x++)
+			{
+				valueCounts[(i32)octree.GetVoxelAt({ x,y,z }) + 128]++;
+			}
+		}
+	}
+	for (u32 i = 0; i < 256; i++)
+	{
+		ASSERT_EQ(stats.VoxelValueCounts[i], valueCounts[i]) << "value " << (i32)i - 128;
+	}
+
+	// every brick the surface goes through
+	u64 surfaceBricks = 0;
+	i8 brick[BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE];
+	for (int z = 0; z < gStatisticsTestSizeVoxels; z += BASE_CELL_SIZE)
+	{
+		for (int y = 0; y < gStatisticsTestSizeVoxels; y += BASE_CELL_SIZE)
+		{
+			for (int x = 0; x < gStatisticsTestSizeVoxels; x += BASE_CELL_SIZE)
+			{
+				octree.ReadBrick({ x,y,z }, brick);
+				bool bAnyNegative = std::any_of(std::begin(brick), std::end(brick), [](i8 v) { return v < 0; });
+				bool bAnyPositive = std::any_of(std::begin(brick), std::end(brick), [](i8 v) { return v >= 0; });
+				surfaceBricks += bAnyNegative && bAnyPositive ? 1 : 0;
+			}
+		}
+	}
+	ASSERT_EQ(stats.NumSurfaceBricks, surfaceBricks);
+}
+
+TEST(TerrainOctreeStatistics, SameOnAThreadPool)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gStatisticsTestSizeVoxels);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	FillStatisticsTestOctree(octree);
+	rdx::thread_pool threadPool(4);
+	TerrainOctreeStatistics serial;
+	octree.GetStatistics(serial);
+
+	// act
+	TerrainOctreeStatistics pooled;
+	octree.GetStatistics(pooled, &threadPool);
+
+	// assert
+	ASSERT_EQ(pooled.ToJson(), serial.ToJson());
+}
+
+TEST(TerrainOctreeStatistics, ToJson)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gStatisticsTestSizeVoxels);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	FillStatisticsTestOctree(octree);
+	TerrainOctreeStatistics stats;
+	octree.GetStatistics(stats);
+
+	// act
+	std::string json = stats.ToJson();
+
+	// assert
+	ASSERT_EQ(std::count(json.begin(), json.end(), '{'), std::count(json.begin(), json.end(), '}'));
+	ASSERT_EQ(std::count(json.begin(), json.end(), '['), std::count(json.begin(), json.end(), ']'));
+	ASSERT_NE(json.find("\"nodesPerMipLevel\": [" + std::to_string(stats.NodesPerMipLevel[0]) + ", "), std::string::npos);
+	ASSERT_NE(json.find("\"totalBytes\": " + std::to_string(stats.GetTotalPoolBytes())), std::string::npos);
+	ASSERT_NE(json.find("\"-50\": " + std::to_string(stats.VoxelValueCounts[-50 + 128])), std::string::npos);
+	ASSERT_EQ(json.find(",\n\t}"), std::string::npos);
+}
@@ -0,0 +1,213 @@
+#include "pch.h"
+#include "SparseVoxelOctreeTestHelpers.h"
+#include "Mocks.h"
+#include "SparseTerrainVoxelOctree.h"
+#include "TerrainPolygonizer.h"
+#include "TerrainVertexCompression.h"
+#include "DefaultAllocator.h"
+#include "TerrainDefs.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+static const u32 gPolygonizerTestSizeVoxels = 128;
+
+// every node of the octree, parents before children
+static void GetEveryNode(ITerrainOctreeNode* root, std::vector<ITerrainOctreeNode*>& outNodes)
+{
+	outNodes.push_back(root);
+	for (size_t i = 0; i < outNodes.size(); i++)
+	{
+		for (u8 child = 0; child < 8 && outNodes[i]->GetMipLevel() != 0; child++)
+		{
+			if (ITerrainOctreeNode* node = outNodes[i]->GetChild(child))
+			{
+				outNodes.push_back(node);
+			}
+		}
+	}
+}
+
+// integers only, so the reference meshes below don't depend on the platform's maths library
+static i8 ReferenceTerrainDensity(const glm::ivec3& location)
+{
+	i32 height = 120 + (location.x * 7 + location.z * 3) % 23 - (location.x * location.z) % 13;
+	return (i8)std::clamp((location.y - height) * 5, -127, 127);
+}
+
+static ITerrainOctreeNode* FindNodeAtMip(ITerrainOctreeNode* node, const glm::ivec3& point, u32 mipLevel)
+{
+	while (node && node->GetMipLevel() > mipLevel)
+	{
+		u32 half = node->GetSizeInVoxels() / 2;
+		glm::ivec3 local = point - node->GetBottomLeftCorner();
+		node = node->GetChild((local.x >= half ? 1 : 0) | (local.y >= half ? 2 : 0) | (local.z >= half ? 4 : 0));
+	}
+	return node;
+}
+
+static u32 GetMeshIndex(const PolygonizeWorkerThreadData* mesh, u32 i)
+{
+	return mesh->IndexType == TerrainIndexType::U16 ? mesh->ShortIndices[i] : mesh->Indices[i];
+}
+
+// FNV-1a over the positions and the indices widened to 32 bits, so it's the same whatever index type the mesh uses.
+// positions come straight from fixed point so are exact, normals go through normalize so are left out
+static u64 HashMesh(const PolygonizeWorkerThreadData* mesh)
+{
+	u64 hash = 0xcbf29ce484222325ull;
+	auto add = [&hash](const void* data, size_t numBytes)
+	{
+		for (size_t i = 0; i < numBytes; i++)
+		{
+			hash ^= ((const u8*)data)[i];
+			hash *= 0x100000001b3ull;
+		}
+	};
+	for (u32 i = 0; i < mesh->OutputtedVertices; i++)
+	{
+		add(&mesh->Vertices[i].Position, sizeof(glm::vec3));
+	}
+	for (u32 i = 0; i < mesh->OutputtedIndices; i++)
+	{
+		u32 index = GetMeshIndex(mesh, i);
+		add(&index, sizeof(u32));
+	}
+	return hash;
+}
+
+static void AssertMeshesMatch(const PolygonizeWorkerThreadData* expected, const PolygonizeWorkerThreadData* actual)
+{
+	ASSERT_EQ(actual->OutputtedVertices, expected->OutputtedVertices);
+	ASSERT_EQ(actual->OutputtedIndices, expected->OutputtedIndices);
+	ASSERT_EQ(actual->VertexFormat, expected->VertexFormat);
+	ASSERT_EQ(actual->IndexType, expected->IndexType);
+	for (u32 i = 0; i < expected->OutputtedVertices; i++)
+	{
+		if (expected->VertexFormat == TerrainVertexFormat::Compact)
+		{
+			ASSERT_EQ(memcmp(&actual->CompactVertices[i], &expected->CompactVertices[i], sizeof(TerrainVertexCompact)), 0) << "vertex " << i;
+			continue;
+		}
+		ASSERT_EQ(actual->Vertices[i].Position, expected->Vertices[i].Position) << "vertex " << i;
+		ASSERT_EQ(actual->Vertices[i].Normal, expected->Vertices[i].Normal) << "vertex " << i;
+	}
+	for (u32 i = 0; i < expected->OutputtedIndices; i++)
+	{
+		ASSERT_EQ(GetMeshIndex(actual, i), GetMeshIndex(expected, i)) << "index " << i;
+	}
+}
+
+TEST(TerrainPolygonizer, SkippingEmptyCellsMakesTheSameMesh)
+{
+	// arrange - a surface through the middle with some single voxels poking out of it
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gPolygonizerTestSizeVoxels, 127, -127);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	TerrainLikeParams params;
+	params.FrequencyX = 0.1f;
+	params.FrequencyZ = 0.07f;
+	params.AmplitudeZ = 12.0f;
+	params.DensityGradient = 4.0f;
+	FillTerrainLikeOctree(octree, gPolygonizerTestSizeVoxels, params);
+	for (int i = 0; i < gPolygonizerTestSizeVoxels; i += 7)
+	{
+		octree.SetVoxelAt({ i, (i * 13) % gPolygonizerTestSizeVoxels, (i * 5) % gPolygonizerTestSizeVoxels }, (i & 1) ? 60 : -60);
+	}
+	std::vector<ITerrainOctreeNode*> nodes;
+	GetEveryNode(octree.GetParentNode(), nodes);
+	DefaultAllocator allocator;
+	TerrainPolygonizer polygonizer(&allocator, nullptr);
+
+	u32 numNodesWithSurface = 0;
+	for (ITerrainOctreeNode* node : nodes)
+	{
+		// act
+		polygonizer.bSkipEmptyCells = false;
+		PolygonizeWorkerThreadData* everyCell = polygonizer.PolygonizeCellSyncMMC(node, &octree);
+		polygonizer.bSkipEmptyCells = true;
+		PolygonizeWorkerThreadData* occupiedCells = polygonizer.PolygonizeCellSyncMMC(node, &octree);
+
+		// assert
+		numNodesWithSurface += everyCell->OutputtedIndices != 0;
+		AssertMeshesMatch(everyCell, occupiedCells);
+		allocator.Free(everyCell->GetPtrToDeallocate());
+		allocator.Free(occupiedCells->GetPtrToDeallocate());
+	}
+	ASSERT_GT(numNodesWithSurface, 0u);
+}
+
+TEST(TerrainPolygonizer, MatchesReferenceMeshes)
+{
+	// arrange - reference counts and hashes are from the polygonizer before it used a scratch arena and exact-size output,
+	// given a triangle array big enough for the mip 0 chunk - it used to overrun into the voxels it was reading
+	struct ReferenceMesh
+	{
+		u32 MipLevel;
+		u32 NumVertices;
+		u32 NumIndices;
+		u64 Hash;
+	};
+	const ReferenceMesh references[] = {
+		{ 0, 2995, 18462, 0x1efd9944b550fd71ull },
+		{ 2, 1082, 6492, 0xa69fe5852ed3ca21ull },
+		{ 4, 662, 3933, 0xead444a51c8f350cull },
+	};
+	const u32 size = 256;
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), size, 127, -127);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	for (int z = 0; z < (int)size; z += BASE_CELL_SIZE)
+	{
+		for (int y = 0; y < (int)size; y += BASE_CELL_SIZE)
+		{
+			for (int x = 0; x < (int)size; x += BASE_CELL_SIZE)
+			{
+				octree.FillBrick({ x,y,z }, ReferenceTerrainDensity);
+			}
+		}
+	}
+	DefaultAllocator allocator;
+	TerrainPolygonizer polygonizer(&allocator, nullptr);
+
+	for (const ReferenceMesh& reference : references)
+	{
+		ITerrainOctreeNode* node = FindNodeAtMip(octree.GetParentNode(), { 100, 125, 100 }, reference.MipLevel);
+		ASSERT_NE(node, nullptr);
+		ASSERT_EQ(node->GetMipLevel(), reference.MipLevel);
+
+		// act
+		polygonizer.bCompactVertices = false;
+		PolygonizeWorkerThreadData* full = polygonizer.PolygonizeCellSyncMMC(node, &octree);
+		polygonizer.bCompactVertices = true;
+		PolygonizeWorkerThreadData* compact = polygonizer.PolygonizeCellSyncMMC(node, &octree);
+
+		// assert
+		ASSERT_EQ(full->VertexFormat, TerrainVertexFormat::Full);
+		ASSERT_EQ(full->IndexType, TerrainIndexType::U16);
+		ASSERT_EQ(full->OutputtedVertices, reference.NumVertices);
+		ASSERT_EQ(full->OutputtedIndices, reference.NumIndices);
+		ASSERT_EQ(HashMesh(full), reference.Hash) << "mip " << reference.MipLevel;
+
+		// the compact mesh has the same triangles and its positions decode to the full mesh's
+		ASSERT_EQ(compact->VertexFormat, TerrainVertexFormat::Compact);
+		ASSERT_EQ(compact->IndexType, TerrainIndexType::U16);
+		ASSERT_EQ(compact->OutputtedVertices, full->OutputtedVertices);
+		ASSERT_EQ(compact->OutputtedIndices, full->OutputtedIndices);
+		ASSERT_EQ(memcmp(compact->ShortIndices, full->ShortIndices, full->OutputtedIndices * sizeof(u16)), 0);
+		u32 stepSize = node->GetSizeInVoxels() / BASE_CELL_SIZE;
+		float halfQuantum = (float)stepSize / (float)(1 << TERRAIN_COMPACT_POSITION_FRACTION_BITS) / 2.0f;
+		for (u32 i = 0; i < full->OutputtedVertices; i++)
+		{
+			glm::vec3 decoded = TerrainVertexCompression::DecodePosition(compact->CompactVertices[i], node->GetBottomLeftCorner(), stepSize);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				ASSERT_LE(fabsf(decoded[axis] - full->Vertices[i].Position[axis]), halfQuantum * 1.001f) << "vertex " << i;
+			}
+		}
+		allocator.Free(full->GetPtrToDeallocate());
+		allocator.Free(compact->GetPtrToDeallocate());
+	}
+}
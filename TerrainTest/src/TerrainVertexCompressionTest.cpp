@@ -0,0 +1,91 @@
+#include "pch.h"
+#include "TerrainVertexCompression.h"
+#include "TerrainDefs.h"
+#include <random>
+#include <cmath>
+
+TEST(TerrainVertexCompression, PositionsRoundTripToWithinHalfAQuantum)
+{
+	// arrange
+	std::mt19937 gen(1);
+	for (u32 mipLevel = 0; mipLevel <= 5; mipLevel++)
+	{
+		u32 stepSize = 1u << mipLevel;
+		u32 chunkSize = stepSize * BASE_CELL_SIZE;
+		glm::ivec3 chunkBottomLeft = glm::ivec3(3, 1, 2) * (i32)chunkSize;
+		float halfQuantum = (float)stepSize / (float)(1 << TERRAIN_COMPACT_POSITION_FRACTION_BITS) / 2.0f;
+		std::uniform_int_distribution<u32> relativeDistr(0, chunkSize << TERRAIN_FIXED_FRACTION_SIZE_BITS);
+		for (int i = 0; i < 10000; i++)
+		{
+			TerrainVertexFixedPoint fixed;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				fixed.Position[axis] = ((u32)chunkBottomLeft[axis] << TERRAIN_FIXED_FRACTION_SIZE_BITS) + relativeDistr(gen);
+			}
+			fixed.Normal = TerrainNormalFixed(0, 1, 0);
+
+			// act
+			TerrainVertexCompact compact = TerrainVertexCompression::Encode(fixed, chunkBottomLeft, stepSize);
+			glm::vec3 decoded = TerrainVertexCompression::DecodePosition(compact, chunkBottomLeft, stepSize);
+
+			// assert
+			for (int axis = 0; axis < 3; axis++)
+			{
+				float expected = (float)fixed.Position[axis] / (float)(1 << TERRAIN_FIXED_FRACTION_SIZE_BITS);
+				ASSERT_LE(fabsf(decoded[axis] - expected), halfQuantum * 1.001f) << "mip " << mipLevel << " position " << expected;
+			}
+		}
+	}
+}
+
+TEST(TerrainVertexCompression, PositionsAreRoundedNotTruncated)
+{
+	// arrange - with a step size of 3 a 256th of a voxel is 2 and 2/3 quanta, truncating would give 2
+	TerrainVertexFixedPoint fixed;
+	fixed.Position = TerrainPositionFixed(1, 0, 0);
+	fixed.Normal = TerrainNormalFixed(0, 1, 0);
+
+	// act
+	TerrainVertexCompact compact = TerrainVertexCompression::Encode(fixed, glm::ivec3(0), 3);
+
+	// assert
+	ASSERT_EQ(compact.Position[0], 3);
+	ASSERT_EQ(compact.Position[1], 0);
+	ASSERT_EQ(compact.Position[2], 0);
+}
+
+TEST(TerrainVertexCompression, NormalsRoundTrip)
+{
+	// arrange - the polygonizer's normals are unnormalized signed fixed point
+	std::mt19937 gen(2);
+	std::uniform_int_distribution<i32> componentDistr(-2000, 2000);
+	float minDot = 1.0f;
+	for (int i = 0; i < 100000; i++)
+	{
+		glm::ivec3 normal(componentDistr(gen), componentDistr(gen), componentDistr(gen));
+		if (normal == glm::ivec3(0))
+		{
+			continue;
+		}
+		TerrainVertexFixedPoint fixed;
+		fixed.Position = TerrainPositionFixed(0);
+		fixed.Normal = TerrainNormalFixed((u32)normal.x, (u32)normal.y, (u32)normal.z);
+
+		// act
+		TerrainVertexCompact compact = TerrainVertexCompression::Encode(fixed, glm::ivec3(0), 1);
+		glm::vec3 decoded = TerrainVertexCompression::DecodeNormal(compact.Normal);
+
+		// assert - within a degree or so, what two bytes of octahedral encoding can do
+		ASSERT_NEAR(glm::length(decoded), 1.0f, 0.0001f);
+		minDot = std::min(minDot, glm::dot(decoded, glm::normalize(glm::vec3(normal))));
+	}
+	ASSERT_GT(minDot, cosf(glm::radians(1.5f)));
+
+	// the axes come back exactly
+	for (glm::ivec3 axis : { glm::ivec3(1, 0, 0), glm::ivec3(0, -1, 0), glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1) })
+	{
+		i8 encoded[2];
+		TerrainVertexCompression::EncodeNormal(glm::vec3(axis), encoded);
+		ASSERT_EQ(TerrainVertexCompression::DecodeNormal(encoded), glm::vec3(axis));
+	}
+}
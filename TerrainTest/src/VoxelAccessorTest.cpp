@@ -0,0 +1,68 @@
+#include "pch.h"
+#include "SparseVoxelOctreeTestHelpers.h"
+#include "Mocks.h"
+#include "SparseTerrainVoxelOctree.h"
+#include "VoxelAccessor.h"
+#include "TerrainDefs.h"
+#include <random>
+
+static const u32 gAccessorTestSizeVoxels = 256;
+static const i8 gAccessorTestClampMin = -127;
+static const i8 gAccessorTestClampMax = 127;
+
+// a mix of raw, compressed and uniform leaves, with the solid and empty parts collapsed into single values
+static void FillAccessorTestOctree(SparseTerrainVoxelOctree& octree)
+{
+	octree.bCompressBricks = true;
+	SparseOctreeTesttHelpers::FillTerrainLikeOctree(octree, gAccessorTestSizeVoxels, SparseOctreeTesttHelpers::TerrainLikeParams());
+	octree.CollapseUniformSubtrees();
+
+	// a few uncompressed bricks on the surface
+	std::mt19937 gen(1);
+	std::uniform_int_distribution<int> posDistr(0, gAccessorTestSizeVoxels - 1);
+	for (int i = 0; i < 20; i++)
+	{
+		glm::ivec3 location = { posDistr(gen), gAccessorTestSizeVoxels / 2, posDistr(gen) };
+		octree.SetVoxelAt(location, (i8)i);
+	}
+}
+
+TEST(VoxelAccessor, MatchesGetVoxelAt)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gAccessorTestSizeVoxels, gAccessorTestClampMax, gAccessorTestClampMin);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	FillAccessorTestOctree(octree);
+	VoxelAccessor accessor(&octree);
+
+	// act / assert - sweep the whole volume plus a border outside it
+	const int border = 4;
+	for (int z = -border; z < (int)gAccessorTestSizeVoxels + border; z++)
+	{
+		for (int y = -border; y < (int)gAccessorTestSizeVoxels + border; y++)
+		{
+			for (int x = -border; x < (int)gAccessorTestSizeVoxels + border; x++)
+			{
+				glm::ivec3 location = { x, y, z };
+				ASSERT_EQ(accessor.GetVoxelAt(location), octree.GetVoxelAt(location)) << "at " << x << " " << y << " " << z;
+			}
+		}
+	}
+
+	// random jumps miss the cache every time but still give the right answer
+	std::mt19937 gen(2);
+	std::uniform_int_distribution<int> posDistr(-border, gAccessorTestSizeVoxels + border - 1);
+	for (int i = 0; i < 10000; i++)
+	{
+		glm::ivec3 location = { posDistr(gen), posDistr(gen), posDistr(gen) };
+		ASSERT_EQ(accessor.GetVoxelAt(location), octree.GetVoxelAt(location));
+	}
+
+	// after a write the accessor has to be reset to see it
+	glm::ivec3 written = { 3, gAccessorTestSizeVoxels / 2, 3 };
+	octree.SetVoxelAt(written, 42);
+	accessor.Reset();
+	ASSERT_EQ(accessor.GetVoxelAt(written), 42);
+}
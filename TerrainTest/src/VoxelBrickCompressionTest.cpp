@@ -0,0 +1,134 @@
+#include "pch.h"
+#include "VoxelBrickCompression.h"
+#include "TerrainDefs.h"
+#include <random>
+#include <algorithm>
+#include <iostream>
+
+const u32 gBrickVolume = BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE;
+
+static void AssertRoundTrips(const std::vector<i8>& brick, const VoxelBrickCompression::CompressedBrickHeader& header)
+{
+	std::vector<u8> compressed(header.SizeBytes);
+	VoxelBrickCompression::Compress(brick.data(), header, compressed.data());
+	std::vector<i8> decompressed(gBrickVolume);
+	VoxelBrickCompression::Decompress(compressed.data(), decompressed.data());
+	for (u32 i = 0; i < gBrickVolume; i++)
+	{
+		ASSERT_EQ(decompressed[i], brick[i]) << "i was " << i;
+		ASSERT_EQ(VoxelBrickCompression::GetVoxel(compressed.data(), i), brick[i]) << "i was " << i;
+	}
+}
+
+static void RoundTripBrickWithNDistinctValues(u32 numDistinctValues, u32 expectedBitsPerVoxel)
+{
+	// arrange
+	std::random_device rd;
+	unsigned int seed = rd();
+	std::mt19937 gen(seed);
+	std::uniform_int_distribution<int> valueDistr(-127, 127);
+	std::uniform_int_distribution<unsigned int> paletteDistr(0, numDistinctValues - 1);
+	std::cerr << "Seed: " << seed << "\n";
+
+	std::vector<i8> values;
+	while (values.size() < numDistinctValues)
+	{
+		i8 value = valueDistr(gen);
+		if (std::find(values.begin(), values.end(), value) == values.end())
+		{
+			values.push_back(value);
+		}
+	}
+	std::vector<i8> brick(gBrickVolume);
+	for (u32 i = 0; i < gBrickVolume; i++)
+	{
+		// make sure every value turns up at least once
+		brick[i] = i < numDistinctValues ? values[i] : values[paletteDistr(gen)];
+	}
+
+	// act
+	VoxelBrickCompression::CompressedBrickHeader header;
+	u32 bitsPerVoxel = VoxelBrickCompression::BuildPalette(brick.data(), header);
+
+	// assert
+	ASSERT_EQ(bitsPerVoxel, expectedBitsPerVoxel);
+	if (!bitsPerVoxel)
+	{
+		return;
+	}
+	ASSERT_EQ(header.PaletteSize, numDistinctValues);
+	ASSERT_EQ(VoxelBrickCompression::PlanCompression(brick.data(), header), gBrickVolume * bitsPerVoxel / 8 + sizeof(VoxelBrickCompression::CompressedBrickHeader));
+	AssertRoundTrips(brick, header);
+}
+
+TEST(VoxelBrickCompression, RoundTripTwoValues)
+{
+	RoundTripBrickWithNDistinctValues(2, 1);
+}
+
+TEST(VoxelBrickCompression, RoundTripThreeValues)
+{
+	RoundTripBrickWithNDistinctValues(3, 2);
+}
+
+TEST(VoxelBrickCompression, RoundTripFiveValues)
+{
+	RoundTripBrickWithNDistinctValues(5, 4);
+}
+
+TEST(VoxelBrickCompression, RoundTripSixteenValues)
+{
+	RoundTripBrickWithNDistinctValues(16, 4);
+}
+
+TEST(VoxelBrickCompression, SeventeenValuesIsNotCompressed)
+{
+	RoundTripBrickWithNDistinctValues(17, 0);
+}
+
+TEST(VoxelBrickCompression, ThinSurfaceIsRunLengthCompressed)
+{
+	// arrange - a sloped surface only a couple of voxels thick with a different value in every voxel it crosses
+	std::vector<i8> brick(gBrickVolume);
+	for (u32 z = 0; z < BASE_CELL_SIZE; z++)
+	{
+		for (u32 y = 0; y < BASE_CELL_SIZE; y++)
+		{
+			for (u32 x = 0; x < BASE_CELL_SIZE; x++)
+			{
+				float height = 4.0f + x * 0.3f + z * 0.2f;
+				brick[x + y * BASE_CELL_SIZE + z * BASE_CELL_SIZE * BASE_CELL_SIZE] = (i8)std::clamp((y - height) * 100.0f, -127.0f, 127.0f);
+			}
+		}
+	}
+
+	// act
+	VoxelBrickCompression::CompressedBrickHeader header;
+	size_t size = VoxelBrickCompression::PlanCompression(brick.data(), header);
+
+	// assert
+	ASSERT_EQ(header.BitsPerVoxel, 0);
+	ASSERT_GT(size, 0u);
+	ASSERT_LT(size, gBrickVolume);
+	ASSERT_LE(size, VoxelBrickCompression::GetSizeClassBytes(VoxelBrickCompression::GetSizeClass(size)));
+	AssertRoundTrips(brick, header);
+}
+
+TEST(VoxelBrickCompression, NoisyBrickIsNotCompressed)
+{
+	// arrange
+	std::mt19937 gen(1);
+	std::uniform_int_distribution<int> valueDistr(-127, 127);
+	std::vector<i8> brick(gBrickVolume);
+	for (i8& voxel : brick)
+	{
+		voxel = valueDistr(gen);
+	}
+
+	// act
+	VoxelBrickCompression::CompressedBrickHeader header;
+	size_t size = VoxelBrickCompression::PlanCompression(brick.data(), header);
+
+	// assert
+	ASSERT_EQ(size, 0u);
+}
@@ -0,0 +1,93 @@
+#include "pch.h"
+#include "VoxelBrickDownsample.h"
+#include "TerrainDefs.h"
+#include <random>
+#include <iostream>
+#include <vector>
+
+const u32 gDownsampleBrickVolume = BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE;
+
+static u32 BrickIndex(u32 x, u32 y, u32 z)
+{
+	return x + BASE_CELL_SIZE * y + BASE_CELL_SIZE * BASE_CELL_SIZE * z;
+}
+
+TEST(VoxelBrickDownsample, MatchesScalarOnRandomBricks)
+{
+	// arrange - the whole range of i8 so the sums hit their extremes
+	std::random_device rd;
+	unsigned int seed = rd();
+	std::mt19937 gen(seed);
+	std::uniform_int_distribution<int> valueDistr(-128, 127);
+	std::cerr << "Seed: " << seed << "\n";
+	std::vector<i8> brick(gDownsampleBrickVolume);
+
+	for (int repeat = 0; repeat < 20; repeat++)
+	{
+		for (i8& voxel : brick)
+		{
+			voxel = (i8)valueDistr(gen);
+		}
+		if (repeat == 0)
+		{
+			std::fill(brick.begin(), brick.end(), (i8)-128);
+		}
+		else if (repeat == 1)
+		{
+			std::fill(brick.begin(), brick.end(), (i8)127);
+		}
+
+		// act
+		std::vector<i8> simd(gDownsampleBrickVolume, 0), scalar(gDownsampleBrickVolume, 0);
+		for (u8 octant = 0; octant < 8; octant++)
+		{
+			VoxelBrickDownsample::DownsampleIntoOctant(brick.data(), octant, simd.data());
+			VoxelBrickDownsample::DownsampleIntoOctant_Scalar(brick.data(), octant, scalar.data());
+		}
+
+		// assert
+		for (u32 i = 0; i < gDownsampleBrickVolume; i++)
+		{
+			ASSERT_EQ(simd[i], scalar[i]) << "i was " << i;
+		}
+	}
+}
+
+TEST(VoxelBrickDownsample, AveragesEachBlockIntoItsOctant)
+{
+	// arrange - each 2x2x2 block holds a known set of values
+	std::vector<i8> brick(gDownsampleBrickVolume);
+	for (u32 z = 0; z < BASE_CELL_SIZE; z++)
+	{
+		for (u32 y = 0; y < BASE_CELL_SIZE; y++)
+		{
+			for (u32 x = 0; x < BASE_CELL_SIZE; x++)
+			{
+				// blocks sum to 8 * (x / 2) + 4 so they should round up to x / 2 + 1
+				brick[BrickIndex(x, y, z)] = (i8)((x / 2) + ((x & 1) && (y & 1) && (z & 1) ? 4 : 0));
+			}
+		}
+	}
+
+	for (u8 octant = 0; octant < 8; octant++)
+	{
+		// act
+		std::vector<i8> out(gDownsampleBrickVolume, -1);
+		VoxelBrickDownsample::DownsampleIntoOctant(brick.data(), octant, out.data());
+
+		// assert - only the octant is touched
+		u32 ox = (octant & 1) * BASE_CELL_SIZE / 2, oy = ((octant >> 1) & 1) * BASE_CELL_SIZE / 2, oz = ((octant >> 2) & 1) * BASE_CELL_SIZE / 2;
+		for (u32 z = 0; z < BASE_CELL_SIZE; z++)
+		{
+			for (u32 y = 0; y < BASE_CELL_SIZE; y++)
+			{
+				for (u32 x = 0; x < BASE_CELL_SIZE; x++)
+				{
+					bool bInOctant = x - ox < BASE_CELL_SIZE / 2 && y - oy < BASE_CELL_SIZE / 2 && z - oz < BASE_CELL_SIZE / 2;
+					i8 expected = bInOctant ? (i8)(x - ox + 1) : (i8)-1;
+					ASSERT_EQ(out[BrickIndex(x, y, z)], expected) << "at " << x << " " << y << " " << z;
+				}
+			}
+		}
+	}
+}
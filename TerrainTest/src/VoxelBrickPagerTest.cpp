@@ -0,0 +1,351 @@
+#include "pch.h"
+#include "SparseVoxelOctreeTestHelpers.h"
+#include "Mocks.h"
+#include "SparseTerrainVoxelOctree.h"
+#include "SparseTerrainVoxelOctreeSnapshot.h"
+#include "VoxelBrickPager.h"
+#include "VoxelBrickCompression.h"
+#include "TerrainOctreeStatistics.h"
+#include "ThreadPool.h"
+#include "VoxelRegionFile.h"
+#include "TerrainDefs.h"
+#include <random>
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <cstdio>
+
+static const char* gPagerTestFile = "VoxelBrickPagerTest.page";
+static const char* gPagerTestRegionFile = "VoxelBrickPagerTest.region";
+static const u32 gPagerTestSizeVoxels = 128;
+static const u32 gPagerTestBrickBytes = BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE;
+
+// every brick filled, some end up uniform, some compressed and some raw
+static void FillPagerTestOctree(SparseTerrainVoxelOctree& octree)
+{
+	SparseOctreeTesttHelpers::TerrainLikeParams params;
+	params.FrequencyX = 0.15f;
+	params.FrequencyZ = 0.1f;
+	params.AmplitudeZ = 10.0f;
+	params.DensityGradient = 6.0f;
+	octree.bCompressBricks = true;
+	SparseOctreeTesttHelpers::FillTerrainLikeOctree(octree, gPagerTestSizeVoxels, params);
+	std::mt19937 gen(3);
+	std::uniform_int_distribution<int> posDistr(0, gPagerTestSizeVoxels - 1);
+	std::uniform_int_distribution<int> valueDistr(-127, 127);
+	for (int i = 0; i < 100; i++)
+	{
+		octree.SetVoxelAt({ posDistr(gen), posDistr(gen), posDistr(gen) }, (i8)valueDistr(gen));
+	}
+}
+
+static void ReadPagerTestVolume(IVoxelDataSource* source, std::vector<i8>& outVoxels)
+{
+	outVoxels.resize(gPagerTestSizeVoxels * gPagerTestSizeVoxels * gPagerTestSizeVoxels);
+	i8 brick[gPagerTestBrickBytes];
+	for (int z = 0; z < gPagerTestSizeVoxels; z += BASE_CELL_SIZE)
+	{
+		for (int y = 0; y < gPagerTestSizeVoxels; y += BASE_CELL_SIZE)
+		{
+			for (int x = 0; x < gPagerTestSizeVoxels; x += BASE_CELL_SIZE)
+			{
+				source->ReadBrick({ x,y,z }, brick);
+				for (int bz = 0; bz < BASE_CELL_SIZE; bz++)
+				{
+					for (int by = 0; by < BASE_CELL_SIZE; by++)
+					{
+						memcpy(&outVoxels[x + gPagerTestSizeVoxels * (y + by) + gPagerTestSizeVoxels * gPagerTestSizeVoxels * (z + bz)],
+							brick + BASE_CELL_SIZE * by + BASE_CELL_SIZE * BASE_CELL_SIZE * bz, BASE_CELL_SIZE);
+					}
+				}
+			}
+		}
+	}
+}
+
+TEST(VoxelBrickPager, WriteReadAndReuseSlots)
+{
+	// arrange
+	VoxelBrickPager pager;
+	ASSERT_TRUE(pager.Open(gPagerTestFile));
+	std::mt19937 gen(1);
+	std::uniform_int_distribution<int> valueDistr(-128, 127);
+	std::vector<i8> raw(gPagerTestBrickBytes);
+	for (i8& voxel : raw)
+	{
+		voxel = (i8)valueDistr(gen);
+	}
+	std::vector<u8> compressed(100);
+	for (u8& byte : compressed)
+	{
+		byte = (u8)valueDistr(gen);
+	}
+
+	// act
+	u32 rawSlot = pager.WriteSlot(raw.data(), gPagerTestBrickBytes, false);
+	u32 compressedSlot = pager.WriteSlot(compressed.data(), (u32)compressed.size(), true);
+
+	// assert
+	ASSERT_NE(rawSlot, compressedSlot);
+	ASSERT_EQ(pager.GetNumSlotsInUse(), 2u);
+	std::vector<u8> read(gPagerTestBrickBytes);
+	bool bCompressed = true;
+	ASSERT_EQ(pager.ReadSlot(rawSlot, read.data(), bCompressed), gPagerTestBrickBytes);
+	ASSERT_FALSE(bCompressed);
+	ASSERT_EQ(memcmp(read.data(), raw.data(), gPagerTestBrickBytes), 0);
+	ASSERT_EQ(pager.ReadSlot(compressedSlot, read.data(), bCompressed), compressed.size());
+	ASSERT_TRUE(bCompressed);
+	ASSERT_EQ(memcmp(read.data(), compressed.data(), compressed.size()), 0);
+
+	// a freed slot is the next one written to, and the file doesn't grow
+	u64 fileSize = pager.GetFileSizeBytes();
+	pager.FreeSlot(rawSlot);
+	ASSERT_EQ(pager.ReadSlot(rawSlot, read.data(), bCompressed), 0u);
+	ASSERT_EQ(pager.WriteSlot(compressed.data(), (u32)compressed.size(), true), rawSlot);
+	ASSERT_EQ(pager.GetFileSizeBytes(), fileSize);
+
+	pager.Close();
+	std::remove(gPagerTestFile);
+}
+
+TEST(VoxelBrickPager, OctreeReadsTheSameWithBricksEvicted)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gPagerTestSizeVoxels, 127, -127);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	FillPagerTestOctree(octree);
+	octree.CompressBricks();
+	std::vector<i8> before;
+	ReadPagerTestVolume(&octree, before);
+	TerrainOctreeStatistics statsBefore;
+	octree.GetStatistics(statsBefore);
+	size_t residentBefore = octree.GetResidentBrickBytes();
+	ASSERT_GT(statsBefore.NumRawBricks, 0u);
+	ASSERT_GT(statsBefore.NumCompressedBricks, 0u);
+
+	// act
+	const size_t budget = 16 * gPagerTestBrickBytes;
+	ASSERT_TRUE(octree.EnablePaging(gPagerTestFile, budget));
+	octree.EnforceBrickBudget();
+
+	// assert - every brick has just been read so the clock had to go round once clearing their referenced flags first
+	ASSERT_LE(octree.GetResidentBrickBytes(), budget);
+	ASSERT_LT(octree.GetResidentBrickBytes(), residentBefore);
+	ASSERT_GT(octree.GetNumBrickEvictions(), 0u);
+	TerrainOctreeStatistics statsEvicted;
+	octree.GetStatistics(statsEvicted);
+	ASSERT_GT(statsEvicted.NumPagedOutBricks, 0u);
+	ASSERT_EQ(memcmp(statsEvicted.VoxelValueCounts, statsBefore.VoxelValueCounts, sizeof(statsBefore.VoxelValueCounts)), 0);
+	ASSERT_EQ(octree.GetNumBrickFaults(), 0u);
+
+	// reading faults them back in, through each of the read paths
+	std::vector<i8> after;
+	ReadPagerTestVolume(&octree, after);
+	ASSERT_EQ(after, before);
+	ASSERT_GT(octree.GetNumBrickFaults(), 0u);
+	octree.EnforceBrickBudget();
+	octree.EnforceBrickBudget();
+	for (int i = 0; i < 2000; i++)
+	{
+		glm::ivec3 location = { (i * 7) % gPagerTestSizeVoxels, (i * 13) % gPagerTestSizeVoxels, (i * 29) % gPagerTestSizeVoxels };
+		ASSERT_EQ(octree.GetVoxelAt(location), before[location.x + gPagerTestSizeVoxels * location.y + gPagerTestSizeVoxels * gPagerTestSizeVoxels * location.z]);
+	}
+	octree.EnforceBrickBudget();
+	octree.EnforceBrickBudget();
+	std::vector<i8> nodeVoxels(TOTAL_CELL_VOLUME_SIZE);
+	octree.GetVoxelsForNode(octree.GetParentNode(), nodeVoxels.data());
+	octree.DisablePaging();
+	std::vector<i8> residentNodeVoxels(TOTAL_CELL_VOLUME_SIZE);
+	octree.GetVoxelsForNode(octree.GetParentNode(), residentNodeVoxels.data());
+	ASSERT_EQ(nodeVoxels, residentNodeVoxels);
+	ASSERT_EQ(octree.GetResidentBrickBytes(), residentBefore);
+	std::remove(gPagerTestFile);
+}
+
+TEST(VoxelBrickPager, WritesToEvictedBricks)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gPagerTestSizeVoxels, 127, -127);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	FillPagerTestOctree(octree);
+	ASSERT_TRUE(octree.EnablePaging(gPagerTestFile, 0));
+	octree.EnforceBrickBudget();
+	octree.EnforceBrickBudget();
+	ASSERT_EQ(octree.GetResidentBrickBytes(), 0u);
+	std::vector<i8> expected;
+	ReadPagerTestVolume(&octree, expected);
+	octree.EnforceBrickBudget();
+	octree.EnforceBrickBudget();
+	ASSERT_EQ(octree.GetResidentBrickBytes(), 0u);
+
+	// act - single voxels, whole bricks, and enough to make a brick uniform so it can be collapsed
+	std::mt19937 gen(5);
+	std::uniform_int_distribution<int> posDistr(0, gPagerTestSizeVoxels - 1);
+	std::uniform_int_distribution<int> valueDistr(-127, 127);
+	for (int round = 0; round < 3; round++)
+	{
+		for (int i = 0; i < 300; i++)
+		{
+			glm::ivec3 location = { posDistr(gen), posDistr(gen), posDistr(gen) };
+			i8 value = (i8)valueDistr(gen);
+			octree.SetVoxelAt(location, value);
+			expected[location.x + gPagerTestSizeVoxels * location.y + gPagerTestSizeVoxels * gPagerTestSizeVoxels * location.z] = value;
+		}
+		glm::ivec3 brickBL = { BASE_CELL_SIZE * round, gPagerTestSizeVoxels / 2, 0 };
+		octree.FillBrick(brickBL, [](const glm::ivec3&) { return (i8)-127; });
+		for (int z = 0; z < BASE_CELL_SIZE; z++)
+		{
+			for (int y = 0; y < BASE_CELL_SIZE; y++)
+			{
+				memset(&expected[brickBL.x + gPagerTestSizeVoxels * (brickBL.y + y) + gPagerTestSizeVoxels * gPagerTestSizeVoxels * (brickBL.z + z)], -127, BASE_CELL_SIZE);
+			}
+		}
+		octree.CollapseUniformSubtrees();
+		octree.EnforceBrickBudget();
+		octree.EnforceBrickBudget();
+	}
+
+	// assert
+	std::vector<i8> after;
+	ReadPagerTestVolume(&octree, after);
+	ASSERT_EQ(after, expected);
+	octree.Clear();
+	ASSERT_EQ(octree.GetResidentBrickBytes(), 0u);
+	octree.DisablePaging();
+	std::remove(gPagerTestFile);
+}
+
+TEST(VoxelBrickPager, ConcurrentFaults)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gPagerTestSizeVoxels, 127, -127);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	FillPagerTestOctree(octree);
+	std::vector<i8> expected;
+	ReadPagerTestVolume(&octree, expected);
+	ASSERT_TRUE(octree.EnablePaging(gPagerTestFile, 0));
+	rdx::thread_pool threadPool(2);
+
+	for (int round = 0; round < 3; round++)
+	{
+		octree.EnforceBrickBudget();
+		octree.EnforceBrickBudget();
+		ASSERT_EQ(octree.GetResidentBrickBytes(), 0u);
+		u64 faultsBefore = octree.GetNumBrickFaults();
+
+		// act - readers of the octree and of a snapshot all faulting the same bricks in, while half of it is prefetched
+		std::atomic<u32> mismatches = { 0 };
+		{
+			SparseTerrainVoxelOctreeSnapshot snapshot(&octree);
+			std::future<void> prefetch = octree.PrefetchRegionAsync({ 0, 0, 0 }, { gPagerTestSizeVoxels / 2, gPagerTestSizeVoxels, gPagerTestSizeVoxels }, &threadPool);
+			std::vector<std::thread> readers;
+			for (int r = 0; r < 4; r++)
+			{
+				readers.emplace_back([&octree, &snapshot, &expected, &mismatches, r, round]()
+				{
+					std::mt19937 gen(r + round * 10);
+					std::uniform_int_distribution<int> posDistr(0, gPagerTestSizeVoxels - 1);
+					IVoxelDataSource* source = (r & 1) ? (IVoxelDataSource*)&snapshot : (IVoxelDataSource*)&octree;
+					for (int i = 0; i < 20000; i++)
+					{
+						glm::ivec3 location = { posDistr(gen), posDistr(gen), posDistr(gen) };
+						if (source->GetVoxelAt(location) != expected[location.x + gPagerTestSizeVoxels * location.y + gPagerTestSizeVoxels * gPagerTestSizeVoxels * location.z])
+						{
+							mismatches++;
+						}
+					}
+				});
+			}
+			prefetch.get();
+			for (std::thread& reader : readers)
+			{
+				reader.join();
+			}
+		}
+
+		// assert
+		ASSERT_EQ(mismatches.load(), 0u);
+		ASSERT_GT(octree.GetNumBrickFaults(), faultsBefore);
+		std::vector<i8> after;
+		ReadPagerTestVolume(&octree, after);
+		ASSERT_EQ(after, expected);
+	}
+	octree.DisablePaging();
+	std::remove(gPagerTestFile);
+}
+
+TEST(VoxelBrickPager, UnreadableBricksAreReported)
+{
+	// arrange - every brick evicted, then the page file lost
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gPagerTestSizeVoxels, 127, -127);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	FillPagerTestOctree(octree);
+	octree.UpdateMips();
+	glm::ivec3 brickBL = { 0, 0, 0 };
+	i8 brick[gPagerTestBrickBytes];
+	for (brickBL.y = 0; brickBL.y < gPagerTestSizeVoxels; brickBL.y += BASE_CELL_SIZE)
+	{
+		ASSERT_TRUE(octree.ReadBrick(brickBL, brick));
+		if (std::count(brick, brick + gPagerTestBrickBytes, brick[0]) != gPagerTestBrickBytes)
+		{
+			break;
+		}
+	}
+	ASSERT_LT(brickBL.y, (i32)gPagerTestSizeVoxels);
+	ITerrainOctreeNode* leaf = octree.GetParentNode();
+	while (leaf->GetMipLevel() != 0)
+	{
+		glm::ivec3 local = brickBL - leaf->GetBottomLeftCorner();
+		u32 half = leaf->GetSizeInVoxels() / 2;
+		leaf = leaf->GetChild((local.x >= half ? 1 : 0) | (local.y >= half ? 2 : 0) | (local.z >= half ? 4 : 0));
+		ASSERT_NE(leaf, nullptr);
+	}
+	SparseTerrainVoxelOctree::SparseTerrainOctreeNode* cast = static_cast<SparseTerrainVoxelOctree::SparseTerrainOctreeNode*>(leaf);
+	cast->MeshedGeneration = cast->EditGeneration;
+	ASSERT_TRUE(octree.EnablePaging(gPagerTestFile, 0));
+	octree.EnforceBrickBudget();
+	octree.EnforceBrickBudget();
+	ASSERT_EQ(octree.GetResidentBrickBytes(), 0u);
+	std::error_code error;
+	std::filesystem::resize_file(gPagerTestFile, 0, error);
+	ASSERT_FALSE(error);
+
+	// act
+	bool bRead = octree.ReadBrick(brickBL, brick);
+
+	// assert - it reads as its parent's mip rather than as uniform, and whatever was meshed from it will be again
+	ASSERT_FALSE(bRead);
+	ASSERT_GT(octree.GetNumFailedBrickReads(), 0u);
+	ASSERT_TRUE(leaf->NeedsRegenerating());
+	const i8* mip = cast->Parent->MipVoxelData;
+	ASSERT_NE(mip, nullptr);
+	glm::ivec3 offset = (brickBL - cast->Parent->BottomLeftCorner) / 2;
+	for (int z = 0; z < BASE_CELL_SIZE; z++)
+	{
+		for (int y = 0; y < BASE_CELL_SIZE; y++)
+		{
+			for (int x = 0; x < BASE_CELL_SIZE; x++)
+			{
+				i8 expected = mip[(offset.x + x / 2) + BASE_CELL_SIZE * (offset.y + y / 2) + BASE_CELL_SIZE * BASE_CELL_SIZE * (offset.z + z / 2)];
+				ASSERT_EQ(brick[x + BASE_CELL_SIZE * y + BASE_CELL_SIZE * BASE_CELL_SIZE * z], expected);
+				ASSERT_EQ(octree.GetVoxelAt(brickBL + glm::ivec3(x, y, z)), expected);
+			}
+		}
+	}
+	ASSERT_FALSE(VoxelRegionFile::Write(gPagerTestRegionFile, &octree, { brickBL }));
+	octree.DisablePaging();
+	ASSERT_TRUE(octree.ReadBrick(brickBL, brick));
+	std::remove(gPagerTestFile);
+	std::remove(gPagerTestRegionFile);
+}
@@ -0,0 +1,101 @@
+#include "pch.h"
+#include "VoxelCellCases.h"
+#include "TerrainDefs.h"
+#include <random>
+#include <iostream>
+#include <vector>
+
+static i8 GetBlockVoxel(const std::vector<i8>& block, i32 i, i32 j, i32 k)
+{
+	return block[TOTAL_DECK_SIZE * (k + POLYGONIZER_NEGATIVE_GUTTER) + TOTAL_CELL_SIZE * (j + POLYGONIZER_NEGATIVE_GUTTER) + (i + POLYGONIZER_NEGATIVE_GUTTER)];
+}
+
+// the case the way the polygonizer's LoadCell works it out, one cell at a time
+static u8 GetExpectedCase(const std::vector<i8>& block, i32 i, i32 j, i32 k)
+{
+	u8 caseIndex = 0;
+	for (u32 corner = 0; corner < 8; corner++)
+	{
+		i8 value = GetBlockVoxel(block, i + (corner & 1), j + ((corner >> 1) & 1), k + ((corner >> 2) & 1));
+		caseIndex |= (u8)((value < 0) << corner);
+	}
+	return caseIndex;
+}
+
+TEST(VoxelCellCases, MatchesEachCellsCornersAndScalar)
+{
+	// arrange - mostly one sign with the odd voxel of the other so some cells are occupied and some aren't
+	std::random_device rd;
+	unsigned int seed = rd();
+	std::mt19937 gen(seed);
+	std::uniform_int_distribution<int> valueDistr(-128, 127);
+	std::uniform_int_distribution<int> flipDistr(0, 99);
+	std::cerr << "Seed: " << seed << "\n";
+	std::vector<i8> block(TOTAL_CELL_VOLUME_SIZE);
+
+	for (int repeat = 0; repeat < 20; repeat++)
+	{
+		for (i8& voxel : block)
+		{
+			int value = valueDistr(gen);
+			voxel = (i8)(flipDistr(gen) < repeat * 5 ? value : std::abs(value) / 2);
+		}
+
+		// act
+		VoxelCellCases::CellCases simd, scalar;
+		u32 numOccupied = VoxelCellCases::Build(block.data(), simd);
+		u32 numOccupiedScalar = VoxelCellCases::Build_Scalar(block.data(), scalar);
+
+		// assert
+		u32 expectedOccupied = 0;
+		for (i32 k = 0; k < BASE_CELL_SIZE; k++)
+		{
+			for (i32 j = 0; j < BASE_CELL_SIZE; j++)
+			{
+				for (i32 i = 0; i < BASE_CELL_SIZE; i++)
+				{
+					u32 cell = i + BASE_CELL_SIZE * j + BASE_DECK_SIZE * k;
+					u8 expectedCase = GetExpectedCase(block, i, j, k);
+					bool bExpectedOccupied = expectedCase != 0 && expectedCase != 255;
+					expectedOccupied += bExpectedOccupied;
+					ASSERT_EQ(simd.Cases[cell], expectedCase) << "cell " << i << " " << j << " " << k;
+					ASSERT_EQ(scalar.Cases[cell], expectedCase) << "cell " << i << " " << j << " " << k;
+					ASSERT_EQ(((simd.OccupiedCells[j + BASE_CELL_SIZE * k] >> i) & 1) != 0, bExpectedOccupied) << "cell " << i << " " << j << " " << k;
+				}
+				ASSERT_EQ(simd.OccupiedCells[j + BASE_CELL_SIZE * k], scalar.OccupiedCells[j + BASE_CELL_SIZE * k]);
+			}
+		}
+		ASSERT_EQ(numOccupied, expectedOccupied);
+		ASSERT_EQ(numOccupiedScalar, expectedOccupied);
+	}
+}
+
+TEST(VoxelCellCases, UniformBlocksHaveNoOccupiedCells)
+{
+	for (i8 value : { (i8)-128, (i8)-1, (i8)0, (i8)127 })
+	{
+		// arrange - the gutters having a different sign shouldn't matter
+		std::vector<i8> block(TOTAL_CELL_VOLUME_SIZE, value < 0 ? 100 : -100);
+		for (i32 k = 0; k <= BASE_CELL_SIZE; k++)
+		{
+			for (i32 j = 0; j <= BASE_CELL_SIZE; j++)
+			{
+				for (i32 i = 0; i <= BASE_CELL_SIZE; i++)
+				{
+					block[TOTAL_DECK_SIZE * (k + POLYGONIZER_NEGATIVE_GUTTER) + TOTAL_CELL_SIZE * (j + POLYGONIZER_NEGATIVE_GUTTER) + (i + POLYGONIZER_NEGATIVE_GUTTER)] = value;
+				}
+			}
+		}
+
+		// act
+		VoxelCellCases::CellCases cases;
+		u32 numOccupied = VoxelCellCases::Build(block.data(), cases);
+
+		// assert
+		ASSERT_EQ(numOccupied, 0u);
+		for (u32 k = 0; k < BASE_CELL_SIZE; k++)
+		{
+			ASSERT_FALSE(VoxelCellCases::IsDeckOccupied(cases, k));
+		}
+	}
+}
@@ -0,0 +1,148 @@
+#include "pch.h"
+#include "SparseVoxelOctreeTestHelpers.h"
+#include "Mocks.h"
+#include "SparseTerrainVoxelOctree.h"
+#include "VoxelEditJournal.h"
+#include "VoxelRegionFile.h"
+#include "OctreeSerialisationLibrary.h"
+#include "OctreeFunctionLibrary.h"
+#include "TerrainDefs.h"
+#include <random>
+#include <fstream>
+#include <vector>
+#include <cstdio>
+
+static const char* gJournalTestRegionFile = "VoxelEditJournalTest.vox";
+static const char* gJournalTestFile = "VoxelEditJournalTest.voxj";
+static const u32 gJournalTestSizeVoxels = 128;
+
+static SparseOctreeTesttHelpers::TerrainLikeParams GetJournalTestParams()
+{
+	SparseOctreeTesttHelpers::TerrainLikeParams params;
+	params.FrequencyX = 0.1f;
+	params.FrequencyZ = 0.07f;
+	params.AmplitudeZ = 12.0f;
+	params.DensityGradient = 4.0f;
+	return params;
+}
+
+static void FillJournalTestOctree(SparseTerrainVoxelOctree& octree, std::unordered_set<TerrainOctreeIndex>& outLeaves)
+{
+	SparseOctreeTesttHelpers::FillTerrainLikeOctree(octree, gJournalTestSizeVoxels, GetJournalTestParams(), nullptr, &outLeaves);
+}
+
+static void EditJournalTestOctree(SparseTerrainVoxelOctree& octree, std::mt19937& gen, int numEdits)
+{
+	std::uniform_int_distribution<int> posDistr(0, gJournalTestSizeVoxels - 1);
+	std::uniform_int_distribution<int> valueDistr(-127, 127);
+	for (int i = 0; i < numEdits; i++)
+	{
+		octree.SetVoxelAt({ posDistr(gen), posDistr(gen), posDistr(gen) }, (i8)valueDistr(gen));
+	}
+}
+
+static void AssertJournalTestOctreesMatch(SparseTerrainVoxelOctree& expected, SparseTerrainVoxelOctree& actual)
+{
+	for (int z = 0; z < gJournalTestSizeVoxels; z++)
+	{
+		for (int y = 0; y < gJournalTestSizeVoxels; y++)
+		{
+			for (int x = 0; x < gJournalTestSizeVoxels; x++)
+			{
+				ASSERT_EQ(actual.GetVoxelAt({ x,y,z }), expected.GetVoxelAt({ x,y,z }));
+			}
+		}
+	}
+}
+
+TEST(VoxelEditJournal, TracksDirtyBricks)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gJournalTestSizeVoxels, 127, -127);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	std::unordered_set<TerrainOctreeIndex> leaves;
+	FillJournalTestOctree(octree, leaves);
+	// every brick that isn't what a new leaf reads as
+	ASSERT_GT(octree.TakeDirtyBricks().size(), 0u);
+
+	// act - two edits in one brick, one in another, and writes that don't change anything
+	octree.SetVoxelAt({ 1, 2, 3 }, 100);
+	octree.SetVoxelAt({ 15, 15, 15 }, 101);
+	octree.SetVoxelAt({ 40, 70, 100 }, 102);
+	octree.SetVoxelAt({ 90, 5, 5 }, octree.GetVoxelAt({ 90, 5, 5 }));
+	octree.FillBrick({ 112, 112, 112 }, [](const glm::ivec3& location) { return SparseOctreeTesttHelpers::TerrainLikeDensity(location, gJournalTestSizeVoxels, GetJournalTestParams()); });
+	std::vector<glm::ivec3> dirty = octree.TakeDirtyBricks();
+
+	// assert
+	ASSERT_EQ(dirty.size(), 2u);
+	ASSERT_EQ(dirty[0], glm::ivec3(0, 0, 0));
+	ASSERT_EQ(dirty[1], glm::ivec3(32, 64, 96));
+	ASSERT_EQ(octree.GetNumDirtyBricks(), 0u);
+	octree.SetVoxelAt({ 1, 2, 3 }, 50);
+	ASSERT_EQ(octree.GetNumDirtyBricks(), 1u);
+}
+
+TEST(VoxelEditJournal, CheckpointReplayAndCompact)
+{
+	// arrange - a saved level and a journal of edits since
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gJournalTestSizeVoxels, 127, -127);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	std::unordered_set<TerrainOctreeIndex> leaves;
+	FillJournalTestOctree(octree, leaves);
+	OctreeSerialisation::SaveNewlyGeneratedToFile(leaves, &octree, gJournalTestRegionFile);
+	octree.TakeDirtyBricks();
+	std::remove(gJournalTestFile);
+	VoxelEditJournal journal;
+	ASSERT_TRUE(journal.Open(gJournalTestFile, gJournalTestSizeVoxels));
+	std::mt19937 gen(4);
+
+	// act - checkpoints, the second overwriting some of the first
+	EditJournalTestOctree(octree, gen, 20);
+	ASSERT_TRUE(journal.AppendCheckpoint(&octree, octree.TakeDirtyBricks()));
+	octree.SetVoxelAt({ 1, 2, 3 }, 100);
+	EditJournalTestOctree(octree, gen, 20);
+	octree.SetVoxelAt({ 1, 2, 3 }, -100);
+	ASSERT_TRUE(journal.AppendCheckpoint(&octree, octree.TakeDirtyBricks()));
+	journal.Close();
+	// a checkpoint that was being written when the game stopped
+	{
+		std::ofstream ofs(gJournalTestFile, std::ios::out | std::ios::app | std::ios::binary);
+		u32 partial[3] = { 0x4b434843, 5, 1000 };
+		ofs.write((const char*)partial, sizeof(partial));
+	}
+	ASSERT_TRUE(journal.Open(gJournalTestFile, gJournalTestSizeVoxels));
+
+	// assert - only what changed is in the journal, and the level and journal load back the octree
+	ASSERT_EQ(journal.GetNumCheckpoints(), 2u);
+	std::ifstream regionSize(gJournalTestRegionFile, std::ios::binary | std::ios::ate);
+	ASSERT_LT(journal.GetSizeBytes() * 4, (u64)regionSize.tellg());
+	regionSize.close();
+	OctreeAndMockDependencies loadedObjects;
+	GetTestObjects(loadedObjects, PreConstructionMockConfigurator(), gJournalTestSizeVoxels, 127, -127);
+	OctreeSerialisation::LoadFromFile(loadedObjects.Octree.get(), gJournalTestRegionFile);
+	ASSERT_GT(journal.Replay(loadedObjects.Octree.get()), 0u);
+	AssertJournalTestOctreesMatch(octree, *loadedObjects.Octree.get());
+
+	// act - fold the journal into the level, with a checkpoint written while it runs
+	std::future<bool> compaction = journal.CompactIntoAsync(gJournalTestRegionFile);
+	EditJournalTestOctree(octree, gen, 5);
+	ASSERT_TRUE(journal.AppendCheckpoint(&octree, octree.TakeDirtyBricks()));
+	ASSERT_TRUE(compaction.get());
+
+	// assert - the new checkpoint is either folded in or still in the journal, depending on when it was written
+	ASSERT_LE(journal.GetNumCheckpoints(), 1u);
+	OctreeAndMockDependencies compactedObjects;
+	GetTestObjects(compactedObjects, PreConstructionMockConfigurator(), gJournalTestSizeVoxels, 127, -127);
+	OctreeSerialisation::LoadFromFile(compactedObjects.Octree.get(), gJournalTestRegionFile);
+	journal.Replay(compactedObjects.Octree.get());
+	AssertJournalTestOctreesMatch(octree, *compactedObjects.Octree.get());
+	ASSERT_TRUE(journal.CompactInto(gJournalTestRegionFile));
+	ASSERT_EQ(journal.GetNumCheckpoints(), 0u);
+	journal.Close();
+	std::remove(gJournalTestFile);
+	std::remove(gJournalTestRegionFile);
+}
@@ -0,0 +1,313 @@
+#include "pch.h"
+#include "SparseVoxelOctreeTestHelpers.h"
+#include "Mocks.h"
+#include "SparseTerrainVoxelOctree.h"
+#include "VoxelRegionFile.h"
+#include "VoxelBrickLZ.h"
+#include "OctreeSerialisationLibrary.h"
+#include "OctreeFunctionLibrary.h"
+#include "TerrainDefs.h"
+#include "ThreadPool.h"
+#include <random>
+#include <fstream>
+#include <vector>
+#include <cstdio>
+
+static const char* gRegionTestFile = "VoxelRegionFileTest.vox";
+static const u32 gRegionTestSizeVoxels = 128;
+static const u32 gRegionTestBrickBytes = BASE_CELL_SIZE * BASE_CELL_SIZE * BASE_CELL_SIZE;
+
+static SparseOctreeTesttHelpers::TerrainLikeParams GetRegionTestParams()
+{
+	SparseOctreeTesttHelpers::TerrainLikeParams params;
+	params.FrequencyX = 0.1f;
+	params.FrequencyZ = 0.07f;
+	params.AmplitudeZ = 12.0f;
+	params.DensityGradient = 4.0f;
+	return params;
+}
+
+// every brick in the volume, the way the populator fills it
+static void FillRegionTestOctree(SparseTerrainVoxelOctree& octree, std::vector<glm::ivec3>& outBricks)
+{
+	SparseOctreeTesttHelpers::FillTerrainLikeOctree(octree, gRegionTestSizeVoxels, GetRegionTestParams(), &outBricks);
+	std::mt19937 gen(2);
+	std::uniform_int_distribution<int> posDistr(0, gRegionTestSizeVoxels - 1);
+	std::uniform_int_distribution<int> valueDistr(-127, 127);
+	for (int i = 0; i < 50; i++)
+	{
+		octree.SetVoxelAt({ posDistr(gen), posDistr(gen), posDistr(gen) }, (i8)valueDistr(gen));
+	}
+}
+
+static void AssertBrickLZRoundTrips(const std::vector<i8>& brick)
+{
+	std::vector<u8> compressed(gRegionTestBrickBytes * 2);
+	size_t size = VoxelBrickLZ::Compress(brick.data(), compressed.data(), compressed.size());
+	ASSERT_NE(size, 0u);
+	std::vector<i8> decompressed(gRegionTestBrickBytes);
+	ASSERT_TRUE(VoxelBrickLZ::Decompress(compressed.data(), size, decompressed.data()));
+	ASSERT_EQ(decompressed, brick);
+	// cut short, or given too little room to compress into
+	ASSERT_FALSE(VoxelBrickLZ::Decompress(compressed.data(), size - 1, decompressed.data()));
+	ASSERT_EQ(VoxelBrickLZ::Compress(brick.data(), compressed.data(), size - 1), 0u);
+}
+
+TEST(VoxelRegionFile, BrickLZRoundTrips)
+{
+	std::vector<i8> brick(gRegionTestBrickBytes);
+
+	// all one value
+	std::fill(brick.begin(), brick.end(), (i8)-127);
+	AssertBrickLZRoundTrips(brick);
+
+	// a surface, the same few rows over and over
+	for (u32 i = 0; i < gRegionTestBrickBytes; i++)
+	{
+		glm::ivec3 location = { i % BASE_CELL_SIZE, (i / BASE_CELL_SIZE) % BASE_CELL_SIZE + gRegionTestSizeVoxels / 2 - 8, i / (BASE_CELL_SIZE * BASE_CELL_SIZE) };
+		brick[i] = SparseOctreeTesttHelpers::TerrainLikeDensity(location, gRegionTestSizeVoxels, GetRegionTestParams());
+	}
+	AssertBrickLZRoundTrips(brick);
+
+	// noise, which it can't do anything with but still has to get back
+	std::mt19937 gen(9);
+	std::uniform_int_distribution<int> valueDistr(-128, 127);
+	for (i8& voxel : brick)
+	{
+		voxel = (i8)valueDistr(gen);
+	}
+	AssertBrickLZRoundTrips(brick);
+
+	// long runs of literals and matches
+	for (u32 i = 0; i < gRegionTestBrickBytes; i++)
+	{
+		brick[i] = i < 1000 ? (i8)valueDistr(gen) : i < 3000 ? (i8)5 : (i8)(i % 7);
+	}
+	AssertBrickLZRoundTrips(brick);
+}
+
+TEST(VoxelRegionFile, SaveAndLoad)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gRegionTestSizeVoxels, 127, -127);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	std::vector<glm::ivec3> bricks;
+	FillRegionTestOctree(octree, bricks);
+
+	// act
+	std::unordered_set<TerrainOctreeIndex> indices;
+	for (const glm::ivec3& brick : bricks)
+	{
+		indices.insert(OctreeFunctionLibrary::GetIndexOfLeafContainingPoint(brick, gRegionTestSizeVoxels));
+	}
+	OctreeSerialisation::SaveNewlyGeneratedToFile(indices, &octree, gRegionTestFile);
+	OctreeAndMockDependencies loadedObjects;
+	GetTestObjects(loadedObjects, PreConstructionMockConfigurator(), gRegionTestSizeVoxels, 127, -127);
+	OctreeSerialisation::LoadFromFile(loadedObjects.Octree.get(), gRegionTestFile);
+
+	// assert - the same voxels, in far less than the raw bricks would take
+	VoxelRegionFile file;
+	ASSERT_TRUE(file.Open(gRegionTestFile));
+	ASSERT_EQ(file.GetDirectory().size(), bricks.size());
+	ASSERT_EQ(file.GetSizeVoxels(), gRegionTestSizeVoxels);
+	u32 codecsUsed[4] = {};
+	for (const VoxelRegionFile::DirectoryEntry& entry : file.GetDirectory())
+	{
+		codecsUsed[(u32)entry.Codec]++;
+	}
+	ASSERT_GT(codecsUsed[(u32)VoxelRegionFile::BrickCodec::Uniform], 0u);
+	ASSERT_GT(codecsUsed[(u32)VoxelRegionFile::BrickCodec::LZ], 0u);
+	file.Close();
+	std::ifstream sizeCheck(gRegionTestFile, std::ios::binary | std::ios::ate);
+	ASSERT_LT((size_t)sizeCheck.tellg(), bricks.size() * gRegionTestBrickBytes / 2);
+	sizeCheck.close();
+	for (int z = 0; z < gRegionTestSizeVoxels; z++)
+	{
+		for (int y = 0; y < gRegionTestSizeVoxels; y++)
+		{
+			for (int x = 0; x < gRegionTestSizeVoxels; x++)
+			{
+				ASSERT_EQ(loadedObjects.Octree->GetVoxelAt({ x,y,z }), octree.GetVoxelAt({ x,y,z }));
+			}
+		}
+	}
+	std::remove(gRegionTestFile);
+}
+
+TEST(VoxelRegionFile, RandomAccess)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gRegionTestSizeVoxels, 127, -127);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	std::vector<glm::ivec3> bricks;
+	FillRegionTestOctree(octree, bricks);
+	ASSERT_TRUE(VoxelRegionFile::Write(gRegionTestFile, &octree, bricks));
+	VoxelRegionFile file;
+	ASSERT_TRUE(file.Open(gRegionTestFile));
+
+	// act - single bricks
+	std::vector<i8> expected(gRegionTestBrickBytes);
+	std::vector<i8> read(gRegionTestBrickBytes);
+	for (size_t i = 0; i < bricks.size(); i += 7)
+	{
+		octree.ReadBrick(bricks[i], expected.data());
+		ASSERT_TRUE(file.ReadBrick(bricks[i], read.data()));
+		ASSERT_EQ(read, expected);
+	}
+	ASSERT_FALSE(file.ReadBrick({ gRegionTestSizeVoxels, 0, 0 }, read.data()));
+
+	// act - a region that isn't aligned to bricks or to the morton order
+	OctreeAndMockDependencies regionObjects;
+	GetTestObjects(regionObjects, PreConstructionMockConfigurator(), gRegionTestSizeVoxels, 127, -127);
+	SparseTerrainVoxelOctree& region = *regionObjects.Octree.get();
+	glm::ivec3 min = { 20, 40, 5 };
+	glm::ivec3 max = { 70, 90, 40 };
+	u32 numLoaded = file.LoadRegion(&region, min, max);
+
+	// assert - the bricks overlapping it are loaded, and nothing else
+	ASSERT_EQ(numLoaded, 4u * 4u * 3u);
+	for (int z = 0; z < gRegionTestSizeVoxels; z += 3)
+	{
+		for (int y = 0; y < gRegionTestSizeVoxels; y += 3)
+		{
+			for (int x = 0; x < gRegionTestSizeVoxels; x += 3)
+			{
+				glm::ivec3 brick = glm::ivec3(x, y, z) / (i32)BASE_CELL_SIZE;
+				bool bInRegion = brick.x >= min.x / (i32)BASE_CELL_SIZE && brick.x <= max.x / (i32)BASE_CELL_SIZE
+					&& brick.y >= min.y / (i32)BASE_CELL_SIZE && brick.y <= max.y / (i32)BASE_CELL_SIZE
+					&& brick.z >= min.z / (i32)BASE_CELL_SIZE && brick.z <= max.z / (i32)BASE_CELL_SIZE;
+				if (bInRegion)
+				{
+					ASSERT_EQ(region.GetVoxelAt({ x,y,z }), octree.GetVoxelAt({ x,y,z }));
+				}
+				else
+				{
+					ASSERT_EQ(region.FindNodeFromIndex(OctreeFunctionLibrary::GetIndexOfLeafContainingPoint({ x,y,z }, gRegionTestSizeVoxels), false), nullptr);
+				}
+			}
+		}
+	}
+	file.Close();
+	std::remove(gRegionTestFile);
+}
+
+TEST(VoxelRegionFile, RejectsOverlappingBricks)
+{
+	// arrange - a good file, then a brick moved back over the one before it
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gRegionTestSizeVoxels, 127, -127);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	std::vector<glm::ivec3> bricks;
+	FillRegionTestOctree(octree, bricks);
+	ASSERT_TRUE(VoxelRegionFile::Write(gRegionTestFile, &octree, bricks));
+	VoxelRegionFile file;
+	ASSERT_TRUE(file.Open(gRegionTestFile));
+	std::vector<VoxelRegionFile::DirectoryEntry> directory = file.GetDirectory();
+	file.Close();
+	size_t moved = 1;
+	while (moved < directory.size() && !(directory[moved - 1].SizeBytes && directory[moved].SizeBytes))
+	{
+		moved++;
+	}
+	ASSERT_LT(moved, directory.size());
+	directory[moved].Offset = directory[moved - 1].Offset;
+	{
+		std::fstream patch(gRegionTestFile, std::ios::in | std::ios::out | std::ios::binary | std::ios::ate);
+		u64 directoryOffset = (u64)patch.tellp() - directory.size() * sizeof(VoxelRegionFile::DirectoryEntry);
+		patch.seekp(directoryOffset + moved * sizeof(VoxelRegionFile::DirectoryEntry));
+		patch.write((const char*)&directory[moved], sizeof(VoxelRegionFile::DirectoryEntry));
+	}
+
+	// act / assert
+	ASSERT_FALSE(file.Open(gRegionTestFile));
+	ASSERT_FALSE(file.IsOpen());
+	std::remove(gRegionTestFile);
+}
+
+TEST(VoxelRegionFile, ParallelSaveAndLoadMatchSerial)
+{
+	// arrange
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gRegionTestSizeVoxels, 127, -127);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	std::vector<glm::ivec3> bricks;
+	FillRegionTestOctree(octree, bricks);
+	rdx::thread_pool threadPool(4);
+	const char* serialFile = "VoxelRegionFileTestSerial.vox";
+
+	// act
+	ASSERT_TRUE(VoxelRegionFile::Write(serialFile, &octree, bricks));
+	ASSERT_TRUE(VoxelRegionFile::Write(gRegionTestFile, &octree, bricks, &threadPool));
+	OctreeAndMockDependencies loadedObjects;
+	GetTestObjects(loadedObjects, PreConstructionMockConfigurator(), gRegionTestSizeVoxels, 127, -127);
+	VoxelRegionFile file;
+	ASSERT_TRUE(file.Open(gRegionTestFile));
+	u32 numLoaded = file.LoadAll(loadedObjects.Octree.get(), &threadPool);
+	file.Close();
+
+	// assert - the file is the same whichever way it's written, and loads the same voxels
+	std::ifstream serial(serialFile, std::ios::binary);
+	std::ifstream parallel(gRegionTestFile, std::ios::binary);
+	std::vector<char> serialBytes((std::istreambuf_iterator<char>(serial)), std::istreambuf_iterator<char>());
+	std::vector<char> parallelBytes((std::istreambuf_iterator<char>(parallel)), std::istreambuf_iterator<char>());
+	serial.close();
+	parallel.close();
+	ASSERT_FALSE(serialBytes.empty());
+	ASSERT_EQ(parallelBytes, serialBytes);
+	ASSERT_EQ(numLoaded, bricks.size());
+	for (int z = 0; z < gRegionTestSizeVoxels; z++)
+	{
+		for (int y = 0; y < gRegionTestSizeVoxels; y++)
+		{
+			for (int x = 0; x < gRegionTestSizeVoxels; x++)
+			{
+				ASSERT_EQ(loadedObjects.Octree->GetVoxelAt({ x,y,z }), octree.GetVoxelAt({ x,y,z }));
+			}
+		}
+	}
+	std::remove(serialFile);
+	std::remove(gRegionTestFile);
+}
+
+TEST(VoxelRegionFile, LoadsFilesSavedBeforeRegionFiles)
+{
+	// arrange - the old format, a header of version 0 and the number of leaves, then an index and a raw brick each
+	using namespace SparseOctreeTesttHelpers;
+	OctreeAndMockDependencies objects;
+	GetTestObjects(objects, PreConstructionMockConfigurator(), gRegionTestSizeVoxels, 127, -127);
+	SparseTerrainVoxelOctree& octree = *objects.Octree.get();
+	std::vector<glm::ivec3> bricks;
+	FillRegionTestOctree(octree, bricks);
+	{
+		std::ofstream ofs(gRegionTestFile, std::ios::out | std::ios::trunc | std::ios::binary);
+		u32 header[2] = { 0, (u32)bricks.size() };
+		ofs.write((const char*)header, sizeof(header));
+		std::vector<i8> voxels(gRegionTestBrickBytes);
+		for (const glm::ivec3& brick : bricks)
+		{
+			TerrainOctreeIndex index = OctreeFunctionLibrary::GetIndexOfLeafContainingPoint(brick, gRegionTestSizeVoxels);
+			octree.ReadBrick(brick, voxels.data());
+			ofs.write((const char*)&index, sizeof(TerrainOctreeIndex));
+			ofs.write((const char*)voxels.data(), gRegionTestBrickBytes);
+		}
+	}
+
+	// act
+	OctreeAndMockDependencies loadedObjects;
+	GetTestObjects(loadedObjects, PreConstructionMockConfigurator(), gRegionTestSizeVoxels, 127, -127);
+	OctreeSerialisation::LoadFromFile(loadedObjects.Octree.get(), gRegionTestFile);
+
+	// assert
+	for (int i = 0; i < 5000; i++)
+	{
+		glm::ivec3 location = { (i * 7) % gRegionTestSizeVoxels, (i * 13) % gRegionTestSizeVoxels, (i * 29) % gRegionTestSizeVoxels };
+		ASSERT_EQ(loadedObjects.Octree->GetVoxelAt(location), octree.GetVoxelAt(location));
+	}
+	std::remove(gRegionTestFile);
+}